@@ -0,0 +1,179 @@
+--
+-- sqlite3 -cmd ".param set @FILE_COUNT N" bench.db < sql/bench-path-lookups.sql
+--
+-- Compares file path lookups in the schema before v9.0, which kept
+-- the full path in each file record with a unique index on it, with
+-- lookups by directory identifier and file name, and with a WITHOUT
+-- ROWID table clustered on a 64-bit path fingerprint. N synthetic
+-- files are created in directories of 100 files (one million if
+-- FILE_COUNT is omitted) and 10% of them are looked up in random
+-- order, first by themselves and then joined to their versions and
+-- scansets, same as when the last file version is selected.
+--
+-- bench.db must not exist and may be removed after the script runs.
+-- Fingerprints are not computed by SQLite and are derived from file
+-- identifiers, so only their lookup cost is measured.
+--
+.bail on
+.timer off
+
+BEGIN TRANSACTION;
+
+CREATE TABLE bench_params AS
+SELECT
+    coalesce(@FILE_COUNT, 1000000) AS file_count,
+    100 AS dir_files;
+
+--
+-- Shared version and scanset records, one per file.
+--
+CREATE TABLE versions (
+    id INTEGER NOT NULL PRIMARY KEY,
+    file_id INTEGER NOT NULL,
+    version INTEGER NOT NULL,
+    hash TEXT
+);
+
+CREATE TABLE scansets (
+    id INTEGER NOT NULL PRIMARY KEY,
+    scan_id INTEGER NOT NULL,
+    version_id INTEGER NOT NULL
+);
+
+WITH RECURSIVE seq(i) AS (
+    SELECT 1 UNION ALL SELECT i+1 FROM seq WHERE i < (SELECT file_count FROM bench_params)
+)
+INSERT INTO versions (id, file_id, version, hash) SELECT i, i, 1, hex(randomblob(32)) FROM seq;
+
+INSERT INTO scansets (id, scan_id, version_id) SELECT id, 1, id FROM versions;
+
+CREATE UNIQUE INDEX ix_versions_file ON versions (file_id, version);
+CREATE UNIQUE INDEX ix_scansets_version_scan ON scansets (version_id, scan_id);
+
+--
+-- Pre-v9.0 file records with full paths, such as:
+--
+--   /home/user/Pictures/2019/album-00042/set-07/IMG_0000123.jpg
+--
+CREATE TABLE files_path (
+    id INTEGER NOT NULL PRIMARY KEY,
+    name TEXT NOT NULL,
+    ext TEXT,
+    path TEXT NOT NULL
+);
+
+INSERT INTO files_path (id, name, ext, path)
+SELECT
+    id,
+    printf('IMG_%07d.jpg', id),
+    '.jpg',
+    printf('/home/user/Pictures/%d/album-%05d/set-%02d/IMG_%07d.jpg',
+            2000 + (id / 100000), id / 1000, (id / 100) % 10, id)
+FROM versions;
+
+CREATE UNIQUE INDEX ix_files_path ON files_path (path);
+
+--
+-- v9.0 directory and file records.
+--
+CREATE TABLE dirs (
+    id INTEGER NOT NULL PRIMARY KEY,
+    parent_id INTEGER NOT NULL,
+    name TEXT NOT NULL
+);
+
+INSERT INTO dirs (id, parent_id, name)
+SELECT DISTINCT
+    id / (SELECT dir_files FROM bench_params) + 1, 0,
+    printf('/home/user/Pictures/%d/album-%05d/set-%02d',
+            2000 + (id / 100000), id / 1000, (id / 100) % 10)
+FROM versions;
+
+CREATE TABLE files (
+    id INTEGER NOT NULL PRIMARY KEY,
+    dir_id INTEGER NOT NULL,
+    name TEXT NOT NULL
+);
+
+INSERT INTO files (id, dir_id, name)
+SELECT id, id / (SELECT dir_files FROM bench_params) + 1, printf('IMG_%07d.jpg', id) FROM versions;
+
+CREATE UNIQUE INDEX ix_files_dir_name ON files (dir_id, name);
+
+--
+-- Clustered path fingerprints, which would be confirmed against full
+-- paths. Scrambled file identifiers stand in for path hashes.
+--
+CREATE TABLE files_fp (
+    fp INTEGER NOT NULL,
+    path TEXT NOT NULL,
+    file_id INTEGER NOT NULL,
+    PRIMARY KEY (fp, path)
+) WITHOUT ROWID;
+
+INSERT INTO files_fp (fp, path, file_id)
+SELECT ((id * 2654435761) % 1073741824) * 4294967296 + id, path, id FROM files_path;
+
+--
+-- Lookup keys for 10% of files in random order, in the form each
+-- schema is queried, with directory identifiers coming from the
+-- directory cache in v9.0.
+--
+CREATE TABLE probes AS
+SELECT
+    files.id AS file_id,
+    files_path.path AS path,
+    files.dir_id AS dir_id,
+    files.name AS name,
+    ((files.id * 2654435761) % 1073741824) * 4294967296 + files.id AS fp
+FROM
+    files
+    JOIN files_path ON files_path.id = files.id
+WHERE abs(random()) % 10 = 0
+ORDER BY random();
+
+COMMIT TRANSACTION;
+
+ANALYZE;
+
+SELECT
+    (SELECT count(*) FROM files) AS files,
+    (SELECT count(*) FROM probes) AS probes,
+    (SELECT avg(length(path)) FROM files_path) AS avg_path;
+
+SELECT name, sum(pgsize) AS bytes FROM dbstat
+WHERE name IN ('files_path', 'ix_files_path', 'files', 'ix_files_dir_name', 'dirs', 'files_fp')
+GROUP BY name ORDER BY name;
+
+.timer on
+
+.print
+.print path
+SELECT count(*) FROM probes CROSS JOIN files_path ON files_path.path = probes.path;
+
+.print dir_id, name
+SELECT count(*) FROM probes CROSS JOIN files ON files.dir_id = probes.dir_id AND files.name = probes.name;
+
+.print fingerprint
+SELECT count(*) FROM probes CROSS JOIN files_fp ON files_fp.fp = probes.fp AND files_fp.path = probes.path;
+
+.print path, last version
+SELECT count(*)
+FROM probes
+    CROSS JOIN files_path ON files_path.path = probes.path
+    CROSS JOIN versions ON versions.file_id = files_path.id
+    CROSS JOIN scansets ON version_id = versions.id;
+
+.print dir_id, name, last version
+SELECT count(*)
+FROM probes
+    CROSS JOIN files ON files.dir_id = probes.dir_id AND files.name = probes.name
+    CROSS JOIN versions ON versions.file_id = files.id
+    CROSS JOIN scansets ON version_id = versions.id;
+
+.print fingerprint, last version
+SELECT count(*)
+FROM probes
+    CROSS JOIN files_fp ON files_fp.fp = probes.fp AND files_fp.path = probes.path
+    CROSS JOIN versions ON versions.file_id = files_fp.file_id
+    CROSS JOIN scansets ON version_id = versions.id;
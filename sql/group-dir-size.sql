@@ -8,21 +8,46 @@
 --
 -- If @SCAN_ID is not specified, the last one will be used.
 --
+-- Totals of the file tree under the directory are read from the
+-- scan_dirs record of the directory, which is found by following
+-- directory names in @DIR_NAME from the top directory. Incomplete
+-- scans and scans recorded before directory totals were introduced
+-- have no tree totals and their files are selected from scansets by
+-- their path instead.
+--
+SELECT
+    @DIR_NAME AS dir_name,
+    file_count,
+    round(total_size / 1000. / 1000. / file_count, 3) AS avg_entry_size_mb,
+    datetime(max_mod_time, 'unixepoch') AS max_mod_time,
+    round(total_size/1000./1000./1000., 3) AS dir_size_gb
+FROM
+    scan_dirs
+WHERE
+    scan_id = coalesce(@SCAN_ID, (select MAX(rowid) FROM scans), 0)
+    AND total_size IS NOT NULL
+    AND dir_id = (
+        WITH RECURSIVE dir_tree (id, path) AS (
+            SELECT id, name FROM dirs WHERE parent_id = 0 AND name = substring(@DIR_NAME, 1, length(name))
+            UNION ALL
+            SELECT dirs.id, dir_tree.path || dirs.name FROM dirs JOIN dir_tree ON dirs.parent_id = dir_tree.id
+                WHERE dirs.name = substring(@DIR_NAME, length(dir_tree.path) + 1, length(dirs.name))
+        )
+        SELECT id FROM dir_tree WHERE path = @DIR_NAME)
+UNION ALL
 SELECT
     @DIR_NAME AS dir_name,
     COUNT(file_id) AS file_count,
-    MIN(entry_size) AS min_entry_size,
     round(AVG(entry_size) / 1000. / 1000., 3) AS avg_entry_size_mb,
-    round(MAX(entry_size) / 1000. / 1000., 3) AS max_entry_size_mb,
-    MIN(datetime(mod_time, 'unixepoch')) AS min_mod_time,
     MAX(datetime(mod_time, 'unixepoch')) AS max_mod_time,
     round(SUM(entry_size)/1000./1000./1000., 3) AS dir_size_gb
 FROM
     scansets
     JOIN versions ON version_id = versions.rowid
-    JOIN files ON file_id = files.rowid
+    JOIN file_paths AS files ON file_id = files.id
 WHERE
     scan_id = coalesce(@SCAN_ID, (select MAX(rowid) FROM scans), 0)
+    AND NOT EXISTS (SELECT 1 FROM scan_dirs WHERE scan_id = coalesce(@SCAN_ID, (select MAX(rowid) FROM scans), 0) AND total_size IS NOT NULL)
     AND path LIKE concat(@DIR_NAME, '%')
 GROUP BY
     substring(path, 1, length(@DIR_NAME));
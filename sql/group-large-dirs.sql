@@ -1,24 +1,50 @@
 --
--- sqlite3 -line -cmd ".param set @SCAN_ID N" -cmd ".param set @TOP M" sqlite.db < sql/list-large-dirs.sql
+-- sqlite3 -line -cmd ".param set @SCAN_ID N" -cmd ".param set @TOP M" sqlite.db < sql/group-large-dirs.sql
 --
 -- Lists large directories in the specified scan. If SCAN_ID is omitted,
 -- the last one is used. If TOP is omitted, top 10 directories will be
 -- listed.
 --
+-- Sizes and counts of files directly in each directory are read from
+-- directory totals maintained during scans. Scans recorded before
+-- directory totals were introduced have no scan_dirs records and
+-- their files are grouped by directory from scansets instead. Files
+-- without a directory are reported in the `.` directory.
+--
 SELECT
-    MAX(scan_id),
-    substring(path, 1, length(path)-length(name)-1) AS dir,
-    round(SUM(entry_size)/1000./1000., 3) AS dir_size_mb,
-    COUNT(file_id) AS file_count
-FROM 
-    scansets
-    JOIN versions ON version_id = versions.rowid 
-    JOIN files ON file_id = files.rowid 
-WHERE
-    scan_id = coalesce(@SCAN_ID, (select MAX(rowid) FROM scans), 0)
-GROUP BY
-    substring(path, 1, length(path)-length(name)-1)
+    scan_id,
+    coalesce(dir_paths.path, '.') AS dir,
+    round(dir_size/1000./1000., 3) AS dir_size_mb,
+    dir_file_count AS file_count
+FROM
+    (SELECT
+        scan_id,
+        dir_id,
+        dir_size,
+        dir_file_count
+    FROM
+        scan_dirs
+    WHERE
+        scan_id = coalesce(@SCAN_ID, (select MAX(rowid) FROM scans), 0)
+    UNION ALL
+    SELECT
+        MAX(scan_id),
+        dir_id,
+        SUM(entry_size),
+        COUNT(file_id)
+    FROM
+        scansets
+        JOIN versions ON version_id = versions.rowid
+        JOIN files ON file_id = files.id
+    WHERE
+        scan_id = coalesce(@SCAN_ID, (select MAX(rowid) FROM scans), 0)
+        AND NOT EXISTS (SELECT 1 FROM scan_dirs WHERE scan_id = coalesce(@SCAN_ID, (select MAX(rowid) FROM scans), 0))
+    GROUP BY
+        dir_id
+    ORDER BY
+        3 DESC
+    LIMIT
+        coalesce(@TOP, 10)) AS large_dirs
+    LEFT JOIN dir_paths ON large_dirs.dir_id = dir_paths.id
 ORDER BY
-    SUM(entry_size) DESC
-LIMIT
-    coalesce(@TOP, 10)
+    dir_size DESC
@@ -8,6 +8,11 @@
 -- means that their paths are relative and don't start with a
 -- directory separator or with a drive letter.
 --
+-- Extension and EXIF counts and the largest file size are not kept
+-- in directory totals, so files are read from scansets. Tree totals
+-- of top directories of completed scans are also listed by
+-- sql/list-large-dir-trees.sql without reading scansets.
+--
 SELECT
     substring(path, 1, MAX(instr(path, '\'), instr(path, '/'))) AS top_dir,
     COUNT(name) AS file_count,
@@ -19,7 +24,7 @@ SELECT
 FROM
     scansets
     JOIN versions ON version_id = versions.rowid
-    JOIN files ON file_id = files.rowid
+    JOIN file_paths AS files ON file_id = files.id
 WHERE
     scansets.scan_id = coalesce(@SCAN_ID, (select MAX(rowid) FROM scans), 0)
 GROUP BY
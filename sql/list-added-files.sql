@@ -17,7 +17,7 @@ SELECT
 FROM 
     scansets
     JOIN versions ON version_id = versions.rowid 
-    JOIN files ON file_id = files.rowid 
+    JOIN file_paths AS files ON file_id = files.id 
 WHERE scan_id = coalesce(@SCAN_ID, (SELECT MAX(rowid) FROM scans), 0)
     -- a current scan file is added if its file_id, which is synonymous to path, does not exist in the base scan
     AND file_id NOT IN (
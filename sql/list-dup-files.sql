@@ -21,7 +21,7 @@ SELECT
 FROM
     scansets oss
     JOIN versions ON oss.version_id = versions.rowid
-    JOIN files ON file_id = files.rowid
+    JOIN file_paths AS files ON file_id = files.id
 WHERE
     oss.scan_id = coalesce(@SCAN_ID, (select MAX(rowid) FROM scans), 0) AND
     hash IN (
@@ -12,7 +12,7 @@ FROM
     json_tree(Exiv2Json) AS json_field,
     scansets
     JOIN versions ON version_id = versions.rowid 
-    JOIN files ON file_id = files.rowid 
+    JOIN file_paths AS files ON file_id = files.id 
     JOIN exif ON exif_id = exif.rowid
 WHERE
     scan_id = coalesce(@SCAN_ID, (SELECT MAX(rowid) FROM scans), 0)
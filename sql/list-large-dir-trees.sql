@@ -0,0 +1,33 @@
+--
+-- sqlite3 -line -cmd ".param set @SCAN_ID N" -cmd ".param set @TOP M" sqlite.db < sql/list-large-dir-trees.sql
+--
+-- Lists directory trees with the largest size of all files under
+-- each directory, using directory totals maintained during scans.
+-- If SCAN_ID is omitted, the last one is used. If TOP is omitted,
+-- top 10 directories will be listed.
+--
+-- Directory totals are only available for completed scans. Files
+-- without a directory are reported in the `.` directory.
+--
+SELECT
+    scan_id,
+    coalesce(dir_paths.path, '.') AS dir,
+    round(total_size/1000./1000., 3) AS tree_size_mb,
+    file_count AS tree_file_count,
+    round(dir_size/1000./1000., 3) AS dir_size_mb,
+    dir_file_count,
+    datetime(max_mod_time, 'unixepoch') AS max_mod_time
+FROM
+    (SELECT
+        *
+    FROM
+        scan_dirs
+    WHERE
+        scan_id = coalesce(@SCAN_ID, (select MAX(rowid) FROM scans), 0)
+    ORDER BY
+        total_size DESC
+    LIMIT
+        coalesce(@TOP, 10)) AS top_dirs
+    LEFT JOIN dir_paths ON top_dirs.dir_id = dir_paths.id
+ORDER BY
+    total_size DESC
@@ -15,7 +15,7 @@ SELECT
 FROM 
     scansets
     JOIN versions ON version_id = versions.rowid 
-    JOIN files ON file_id = files.rowid 
+    JOIN file_paths AS files ON file_id = files.id 
 WHERE
     scan_id = coalesce(@SCAN_ID, (select MAX(rowid) FROM scans), 0)
 ORDER BY
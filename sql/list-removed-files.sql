@@ -17,7 +17,7 @@ SELECT
 FROM 
     scansets
     JOIN versions ON version_id = versions.rowid 
-    JOIN files ON file_id = files.rowid 
+    JOIN file_paths AS files ON file_id = files.id 
 WHERE scan_id = coalesce(@BASE_SCAN_ID, @SCAN_ID-1, (SELECT MAX(rowid) FROM scans)-1, 0)
     -- a base scan file is removed if its file_id, which is synonymous to path, does not exist in the current scan
     AND file_id NOT IN (
@@ -19,7 +19,7 @@ SELECT
 FROM
     scansets
     JOIN versions ON version_id = versions.rowid
-    JOIN files ON file_id = files.rowid
+    JOIN file_paths AS files ON file_id = files.id
     JOIN scans on scan_id = scans.rowid
 WHERE
     name = @FILENAME COLLATE NOCASE
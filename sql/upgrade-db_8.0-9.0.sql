@@ -0,0 +1,255 @@
+--
+-- This script upgrades the database schema from version 8.0 to
+-- version 9.0.
+--
+-- sqlite3 sqlite.db < upgrade-db_8.0-9.0.sql
+--
+-- Version literals are not used because .param does not work in
+-- PRAGMA. Search for VER_FROM and VER_TO comments to identify
+-- where versions must be updated.
+--
+
+-- stop and exit if any statement triggered an error
+.bail on
+
+BEGIN TRANSACTION;
+
+.print Checking current database version
+
+--
+-- Make sure the current database version is what we expect.
+--
+-- SQLite does not have conditional script statements, so
+-- we trigger a SQL constraint error instead when the user
+-- version doesn't match the expected value.
+--
+CREATE TEMPORARY TABLE user_version_trap (
+  never_null INTEGER NOT NULL
+);
+
+-- the value in WHEN is the expected version
+INSERT INTO user_version_trap VALUES (
+  CASE (select user_version from pragma_user_version())
+    WHEN 80 THEN 1                          -- VER_FROM
+    ELSE NULL
+  END
+);
+
+--                                             VER_TO
+.print Upgrading database to version 9.0
+
+CREATE TABLE IF NOT EXISTS upgrades (
+  upgrade_from INTEGER NOT NULL PRIMARY KEY,
+  upgrade_to INTEGER NOT NULL,
+  upgrade_time INTEGER NOT NULL
+);
+
+--
+-- unixepoch() was added in SQLite 3.38.0 - use strftime() instead
+--
+INSERT INTO upgrades (
+  upgrade_from,
+  upgrade_to,
+  upgrade_time
+) VALUES (
+  (select user_version from pragma_user_version()),
+  90,                                       -- VER_TO
+  CAST(strftime('%s', 'now') AS INTEGER)
+);
+
+CREATE TABLE hash_checkpoints (
+  id INTEGER NOT NULL PRIMARY KEY,
+  scan_id INTEGER NOT NULL,
+  path TEXT NOT NULL,
+  mod_time INTEGER NOT NULL,
+  entry_size INTEGER NOT NULL,
+  file_inode INTEGER,
+  hash_type VARCHAR(32) NOT NULL,
+  hashed_size INTEGER NOT NULL,
+  hash_state BLOB NOT NULL,
+  checkpoint_time INTEGER NOT NULL
+);
+
+CREATE UNIQUE INDEX ix_hash_checkpoints_scan_path ON hash_checkpoints (scan_id, path);
+
+CREATE TABLE scan_tuning (
+  id INTEGER NOT NULL PRIMARY KEY,
+  scan_id INTEGER NOT NULL,
+  scan_paths TEXT NOT NULL,
+  thread_count INTEGER NOT NULL,
+  mb_hash_max INTEGER,
+  buffer_size INTEGER NOT NULL
+);
+
+CREATE INDEX ix_scan_tuning_scan_paths ON scan_tuning (scan_paths, scan_id);
+
+CREATE TABLE scan_cursors (
+  id INTEGER NOT NULL PRIMARY KEY,
+  scan_id INTEGER NOT NULL,
+  scan_path TEXT NOT NULL,
+  cursor_path TEXT
+);
+
+CREATE INDEX ix_scan_cursors_scan ON scan_cursors (scan_id);
+
+--
+-- scan_dirs is upserted for every scanned file and is clustered on
+-- its primary key, so each upsert takes a single b-tree search
+--
+CREATE TABLE scan_dirs (
+  scan_id INTEGER NOT NULL,
+  dir_id INTEGER NOT NULL,
+  dir_file_count INTEGER NOT NULL,
+  dir_size INTEGER NOT NULL,
+  dir_max_mod_time INTEGER,
+  dir_rollup_hash TEXT,
+  file_count INTEGER,
+  total_size INTEGER,
+  max_mod_time INTEGER,
+  rollup_hash TEXT,
+  PRIMARY KEY (scan_id, dir_id)
+) WITHOUT ROWID;
+
+--
+-- Secondary indexes dropped for the first scan in a database are
+-- recorded in deferred_indexes until they are rebuilt
+--
+CREATE TABLE deferred_indexes (
+  id INTEGER NOT NULL PRIMARY KEY,
+  scan_id INTEGER NOT NULL,
+  name TEXT NOT NULL,
+  sql TEXT NOT NULL
+);
+
+--
+-- Completed scans record the range of their scanset identifiers and
+-- scan totals, and scansets of other scans are found via their scan
+-- index, so scan-scoped queries do not read all scanset records
+--
+ALTER TABLE scans ADD COLUMN first_scanset_id INTEGER;
+
+ALTER TABLE scans ADD COLUMN last_scanset_id INTEGER;
+
+ALTER TABLE scans ADD COLUMN file_count INTEGER;
+
+ALTER TABLE scans ADD COLUMN total_size INTEGER;
+
+.print Indexing scansets by scan
+
+CREATE INDEX ix_scansets_scan ON scansets (scan_id);
+
+.print Recording totals of completed scans
+
+UPDATE scans SET (first_scanset_id, last_scanset_id, file_count, total_size) = (
+    SELECT MIN(scansets.id), MAX(scansets.id), COUNT(*), COALESCE(SUM(entry_size), 0)
+    FROM scansets JOIN versions ON version_id = versions.rowid
+    WHERE scan_id = scans.rowid
+  )
+  WHERE completed_time IS NOT NULL AND (last_update_time IS NULL OR completed_time > last_update_time);
+
+ALTER TABLE versions ADD COLUMN fingerprint TEXT;
+
+ALTER TABLE versions ADD COLUMN verified_time INTEGER;
+
+--
+-- Last versions of files were never verified and are scrubbed first.
+-- Earlier versions remain NULL, which keeps them out of the index.
+--
+UPDATE versions SET verified_time = 0
+  WHERE hash IS NOT NULL AND
+    NOT EXISTS (SELECT * FROM versions AS later_versions WHERE later_versions.file_id = versions.file_id AND later_versions.version > versions.version);
+
+CREATE INDEX ix_versions_verified_time ON versions (verified_time) WHERE hash IS NOT NULL AND verified_time IS NOT NULL;
+
+--
+-- File paths are split into directory records, each with a directory
+-- name and a trailing path separator, and file names, which reference
+-- their directory records. Directory paths of files are obtained by
+-- removing file names from file paths and the last character of each
+-- directory path is the path separator of the platform on which it
+-- was recorded, so the same separator is used to split each path
+-- into parent directories.
+--
+CREATE TABLE dirs (
+  id INTEGER NOT NULL PRIMARY KEY,
+  parent_id INTEGER NOT NULL,
+  name TEXT NOT NULL
+);
+
+CREATE UNIQUE INDEX ix_dirs_parent_name ON dirs (parent_id, name);
+
+.print Collecting directory paths
+
+CREATE TEMPORARY TABLE dir_path_ids (
+  id INTEGER NOT NULL PRIMARY KEY,
+  path TEXT NOT NULL UNIQUE,
+  parent_path TEXT NOT NULL
+);
+
+--
+-- rtrim removes all trailing characters other than the separator,
+-- which leaves the parent path with its trailing separator. Parent
+-- directories are inserted first because their paths are shorter.
+--
+WITH RECURSIVE all_dir_paths (path) AS (
+  SELECT substr(path, 1, length(path) - length(name)) FROM files
+  UNION
+  SELECT rtrim(substr(path, 1, length(path) - 1), replace(substr(path, 1, length(path) - 1), substr(path, -1), ''))
+  FROM all_dir_paths
+  WHERE path <> ''
+)
+INSERT INTO dir_path_ids (path, parent_path)
+  SELECT path, rtrim(substr(path, 1, length(path) - 1), replace(substr(path, 1, length(path) - 1), substr(path, -1), ''))
+  FROM all_dir_paths
+  WHERE path <> ''
+  ORDER BY length(path), path;
+
+INSERT INTO dirs (id, parent_id, name)
+  SELECT dir_path_ids.id, coalesce(parent_path_ids.id, 0), substr(dir_path_ids.path, length(dir_path_ids.parent_path) + 1)
+  FROM dir_path_ids
+    LEFT JOIN dir_path_ids AS parent_path_ids ON parent_path_ids.path = dir_path_ids.parent_path
+  ORDER BY dir_path_ids.id;
+
+.print Replacing file paths with directory identifiers
+
+CREATE TABLE dir_files (
+  id INTEGER NOT NULL PRIMARY KEY,
+  dir_id INTEGER NOT NULL,
+  name TEXT NOT NULL,
+  ext TEXT
+);
+
+INSERT INTO dir_files (id, dir_id, name, ext)
+  SELECT files.id, coalesce(dir_path_ids.id, 0), files.name, files.ext
+  FROM files
+    LEFT JOIN dir_path_ids ON dir_path_ids.path = substr(files.path, 1, length(files.path) - length(files.name))
+  ORDER BY files.id;
+
+DROP TABLE dir_path_ids;
+
+DROP INDEX ix_files_path;
+
+DROP TABLE files;
+
+ALTER TABLE dir_files RENAME TO files;
+
+CREATE UNIQUE INDEX ix_files_dir_name ON files (dir_id, name);
+
+CREATE VIEW dir_paths AS
+  WITH RECURSIVE dir_tree (id, path) AS (
+    SELECT id, name FROM dirs WHERE parent_id = 0
+    UNION ALL
+    SELECT dirs.id, dir_tree.path || dirs.name FROM dirs JOIN dir_tree ON dirs.parent_id = dir_tree.id
+  )
+  SELECT id, path FROM dir_tree;
+
+CREATE VIEW file_paths AS
+  SELECT files.id, files.dir_id, files.name, files.ext, coalesce(dir_paths.path, '') || files.name AS path
+  FROM files LEFT JOIN dir_paths ON files.dir_id = dir_paths.id;
+
+--
+-- Set the target database version
+--
+PRAGMA user_version=90;                     -- VER_TO
+
+COMMIT TRANSACTION;
@@ -0,0 +1,237 @@
+#include "autotuner.h"
+
+#include <fstream>
+#include <string>
+#include <charconv>
+#include <stdexcept>
+#include <algorithm>
+
+namespace fit {
+
+autotuner_t::autotuner_t(std::vector<tuning_param_t>&& params, std::chrono::steady_clock::duration window, double threshold) :
+      params(std::move(params)),
+      window(window),
+      threshold(threshold)
+{
+   for(const tuning_param_t& param : this->params) {
+      if(param.min_value > param.max_value || param.value < param.min_value || param.value > param.max_value)
+         throw std::logic_error("A tuning parameter value must be within its range");
+
+      if(param.multiplicative && !param.min_value)
+         throw std::logic_error("A multiplicative tuning parameter cannot have a zero minimum value");
+   }
+
+   if(this->params.empty())
+      settled = true;
+}
+
+size_t autotuner_t::step_value(const tuning_param_t& param, int direction)
+{
+   if(direction > 0)
+      return param.multiplicative ? std::min(param.value * 2, param.max_value) : std::min(param.value + 1, param.max_value);
+
+   if(param.value <= param.min_value)
+      return param.min_value;
+
+   return param.multiplicative ? std::max(param.value / 2, param.min_value) : param.value - 1;
+}
+
+void autotuner_t::next_direction(void)
+{
+   if(direction > 0)
+      direction = -1;
+   else {
+      direction = 1;
+      param_index = (param_index + 1) % params.size();
+   }
+}
+
+//
+// Steps the current parameter in the current direction, or, if it
+// is at the end of its range, tries other directions and parameters.
+// Returns `false` and settles the tuner if no parameter can be moved
+// in any direction.
+//
+bool autotuner_t::start_trial(void)
+{
+   for(size_t i = 0; i < params.size() * 2; i++) {
+      tuning_param_t& param = params[param_index];
+
+      size_t value = step_value(param, direction);
+
+      if(value != param.value) {
+         trial_prev_value = param.value;
+         param.value = value;
+         return true;
+      }
+
+      next_direction();
+   }
+
+   settled = true;
+
+   return false;
+}
+
+//
+// Reports cumulative processed size and file count at `now`. Returns
+// `true` if any of the parameter values was changed and should be
+// applied by the caller.
+//
+bool autotuner_t::update(std::chrono::steady_clock::time_point now, uint64_t processed_size, uint64_t processed_files)
+{
+   if(settled)
+      return false;
+
+   if(!window_start.has_value() || processed_size < window_start_size || processed_files < window_start_files) {
+      window_start = now;
+      window_start_size = processed_size;
+      window_start_files = processed_files;
+      return false;
+   }
+
+   if(now - window_start.value() < window)
+      return false;
+
+   double secs = std::chrono::duration<double>(now - window_start.value()).count();
+
+   throughput_t throughput = {
+      static_cast<double>(processed_size - window_start_size) / secs,
+      static_cast<double>(processed_files - window_start_files) / secs
+   };
+
+   window_start = now;
+   window_start_size = processed_size;
+   window_start_files = processed_files;
+
+   if(!baseline.has_value()) {
+      baseline = throughput;
+      return start_trial();
+   }
+
+   // there is always a trial in progress when there is a baseline
+   if(is_better(throughput, baseline.value(), threshold)) {
+      // keep climbing in the same direction from the new baseline
+      baseline = throughput;
+      trial_prev_value.reset();
+      failed_trials = 0;
+      return start_trial();
+   }
+
+   params[param_index].value = trial_prev_value.value();
+   trial_prev_value.reset();
+
+   // throughput may have changed for reasons other than tuning, so measure it again with accepted values
+   baseline.reset();
+
+   if(++failed_trials >= params.size() * 2)
+      settled = true;
+   else
+      next_direction();
+
+   return true;
+}
+
+size_t autotuner_t::get_value(size_t index) const
+{
+   return params.at(index).value;
+}
+
+size_t autotuner_t::get_accepted_value(size_t index) const
+{
+   if(trial_prev_value.has_value() && index == param_index)
+      return trial_prev_value.value();
+
+   return params.at(index).value;
+}
+
+bool autotuner_t::is_settled(void) const
+{
+   return settled;
+}
+
+bool autotuner_t::is_better(const throughput_t& a, const throughput_t& b, double threshold)
+{
+   if(a.bytes_per_sec > b.bytes_per_sec * (1. + threshold) && a.files_per_sec >= b.files_per_sec * (1. - threshold))
+      return true;
+
+   if(a.files_per_sec > b.files_per_sec * (1. + threshold) && a.bytes_per_sec >= b.bytes_per_sec * (1. - threshold))
+      return true;
+
+   return false;
+}
+
+//
+// Parses the cgroup v2 `cpu.max` value, which contains a quota and
+// a period in microseconds, and returns the number of CPUs allowed
+// by the quota or an empty value if there is no limit.
+//
+std::optional<double> autotuner_t::parse_cgroup_cpu_max(std::string_view cpu_max)
+{
+   size_t space = cpu_max.find(' ');
+
+   if(space == std::string_view::npos)
+      return std::nullopt;
+
+   std::string_view quota_str = cpu_max.substr(0, space);
+   std::string_view period_str = cpu_max.substr(space + 1);
+
+   while(!period_str.empty() && (period_str.back() == '\n' || period_str.back() == '\r' || period_str.back() == ' '))
+      period_str.remove_suffix(1);
+
+   if(quota_str == "max")
+      return std::nullopt;
+
+   uint64_t quota = 0, period = 0;
+
+   if(std::from_chars(quota_str.data(), quota_str.data() + quota_str.size(), quota).ec != std::errc() || !quota)
+      return std::nullopt;
+
+   if(std::from_chars(period_str.data(), period_str.data() + period_str.size(), period).ec != std::errc() || !period)
+      return std::nullopt;
+
+   return static_cast<double>(quota) / static_cast<double>(period);
+}
+
+//
+// Parses the cgroup v2 `memory.max` value, which is either a byte
+// count or `max`, if there is no limit.
+//
+std::optional<uint64_t> autotuner_t::parse_cgroup_memory_max(std::string_view memory_max)
+{
+   while(!memory_max.empty() && (memory_max.back() == '\n' || memory_max.back() == '\r' || memory_max.back() == ' '))
+      memory_max.remove_suffix(1);
+
+   uint64_t limit = 0;
+
+   std::from_chars_result result = std::from_chars(memory_max.data(), memory_max.data() + memory_max.size(), limit);
+
+   if(result.ec != std::errc() || result.ptr != memory_max.data() + memory_max.size() || !limit)
+      return std::nullopt;
+
+   return limit;
+}
+
+std::optional<double> autotuner_t::get_cgroup_cpu_limit(void)
+{
+   std::ifstream cpu_max("/sys/fs/cgroup/cpu.max");
+   std::string line;
+
+   if(!cpu_max || !std::getline(cpu_max, line))
+      return std::nullopt;
+
+   return parse_cgroup_cpu_max(line);
+}
+
+std::optional<uint64_t> autotuner_t::get_cgroup_memory_limit(void)
+{
+   std::ifstream memory_max("/sys/fs/cgroup/memory.max");
+   std::string line;
+
+   if(!memory_max || !std::getline(memory_max, line))
+      return std::nullopt;
+
+   return parse_cgroup_memory_max(line);
+}
+
+}
@@ -0,0 +1,102 @@
+#ifndef FIT_AUTOTUNER_H
+#define FIT_AUTOTUNER_H
+
+#include <vector>
+#include <chrono>
+#include <optional>
+#include <string_view>
+
+#include <cstdint>
+
+namespace fit {
+
+//
+// A hill-climbing tuner for scan parameters, such as thread count
+// and buffer size.
+//
+// The caller reports cumulative processed size and processed file
+// counts via `update`, which measures throughput within fixed-length
+// windows. After a baseline window is measured, one parameter is
+// stepped in one direction and if throughput improves in the next
+// window, the parameter keeps climbing in the same direction.
+// Otherwise, the parameter is reverted, a new baseline is measured
+// and the opposite direction or the next parameter is tried.
+//
+// Throughput is considered better if either processed size or file
+// count per second improves by more than the threshold, while the
+// other measure does not drop by more than the threshold. Once all
+// parameters fail to improve throughput in both directions, the
+// tuner settles on the current values.
+//
+class autotuner_t {
+   public:
+      struct tuning_param_t {
+         size_t value;
+         size_t min_value;
+         size_t max_value;
+         bool multiplicative;          // if true, the value is doubled or halved, otherwise incremented or decremented
+      };
+
+      struct throughput_t {
+         double bytes_per_sec;
+         double files_per_sec;
+      };
+
+   private:
+      std::vector<tuning_param_t> params;
+
+      std::chrono::steady_clock::duration window;
+
+      double threshold;
+
+      // current measurement window
+      std::optional<std::chrono::steady_clock::time_point> window_start;
+      uint64_t window_start_size = 0;
+      uint64_t window_start_files = 0;
+
+      // throughput with the current accepted parameter values (empty if a new baseline is needed)
+      std::optional<throughput_t> baseline;
+
+      size_t param_index = 0;
+      int direction = 1;
+
+      // the accepted value of the parameter being tried, if a trial is in progress
+      std::optional<size_t> trial_prev_value;
+
+      // number of consecutive trials that did not improve throughput
+      size_t failed_trials = 0;
+
+      bool settled = false;
+
+   private:
+      bool start_trial(void);
+
+      void next_direction(void);
+
+      static size_t step_value(const tuning_param_t& param, int direction);
+
+   public:
+      autotuner_t(std::vector<tuning_param_t>&& params, std::chrono::steady_clock::duration window, double threshold);
+
+      bool update(std::chrono::steady_clock::time_point now, uint64_t processed_size, uint64_t processed_files);
+
+      size_t get_value(size_t index) const;
+
+      size_t get_accepted_value(size_t index) const;
+
+      bool is_settled(void) const;
+
+      static bool is_better(const throughput_t& a, const throughput_t& b, double threshold);
+
+      static std::optional<double> parse_cgroup_cpu_max(std::string_view cpu_max);
+
+      static std::optional<uint64_t> parse_cgroup_memory_max(std::string_view memory_max);
+
+      static std::optional<double> get_cgroup_cpu_limit(void);
+
+      static std::optional<uint64_t> get_cgroup_memory_limit(void);
+};
+
+}
+
+#endif // FIT_AUTOTUNER_H
@@ -0,0 +1,255 @@
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "cpu_topology.h"
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <filesystem>
+#include <stdexcept>
+#include <thread>
+
+namespace fit {
+
+cpu_topology_t::cpu_topology_t(std::vector<numa_node_t>&& nodes) :
+      nodes(std::move(nodes))
+{
+   if(this->nodes.empty() || std::any_of(this->nodes.begin(), this->nodes.end(), [] (const numa_node_t& node) {return node.cpus.empty();}))
+      throw std::logic_error("CPU topology cannot have empty NUMA nodes");
+
+   size_t max_node_cpus = std::max_element(this->nodes.begin(), this->nodes.end(), [] (const numa_node_t& a, const numa_node_t& b) {return a.cpus.size() < b.cpus.size();})->cpus.size();
+
+   for(size_t i = 0; i < max_node_cpus; i++) {
+      for(const numa_node_t& node : this->nodes) {
+         if(i < node.cpus.size())
+            interleaved_cpus.push_back(node.cpus[i]);
+      }
+   }
+}
+
+//
+// Reads NUMA nodes from sysfs on Linux and queries them via the NUMA
+// API on Windows, where only CPUs in the first processor group are
+// used.
+//
+cpu_topology_t cpu_topology_t::detect(void)
+{
+   std::vector<numa_node_t> nodes;
+
+   #ifdef _WIN32
+   DWORD_PTR process_mask = 0, system_mask = 0;
+
+   if(!GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask))
+      process_mask = 0;
+
+   ULONG highest_node = 0;
+
+   if(GetNumaHighestNodeNumber(&highest_node)) {
+      for(ULONG node_id = 0; node_id <= highest_node; node_id++) {
+         ULONGLONG node_mask = 0;
+
+         if(!GetNumaNodeProcessorMask(static_cast<UCHAR>(node_id), &node_mask))
+            continue;
+
+         numa_node_t node = {static_cast<unsigned>(node_id), {}};
+
+         for(unsigned cpu = 0; cpu < sizeof(DWORD_PTR) * 8; cpu++) {
+            if((node_mask & process_mask) & (static_cast<ULONGLONG>(1) << cpu))
+               node.cpus.push_back(cpu);
+         }
+
+         if(!node.cpus.empty())
+            nodes.push_back(std::move(node));
+      }
+   }
+   #else
+   cpu_set_t process_cpus;
+
+   CPU_ZERO(&process_cpus);
+
+   bool process_cpus_known = sched_getaffinity(0, sizeof(process_cpus), &process_cpus) == 0;
+
+   std::error_code errcode;
+
+   for(std::filesystem::directory_iterator node_dir("/sys/devices/system/node", errcode), end; !errcode && node_dir != end; node_dir.increment(errcode)) {
+      std::string node_name = node_dir->path().filename().string();
+
+      unsigned node_id = 0;
+
+      if(node_name.compare(0, 4, "node") || std::from_chars(node_name.data() + 4, node_name.data() + node_name.size(), node_id).ptr != node_name.data() + node_name.size())
+         continue;
+
+      std::ifstream cpulist_stream(node_dir->path() / "cpulist");
+      std::string cpulist;
+
+      if(!cpulist_stream || !std::getline(cpulist_stream, cpulist))
+         continue;
+
+      std::optional<std::vector<unsigned>> cpus = parse_cpu_list(cpulist);
+
+      if(!cpus.has_value())
+         continue;
+
+      numa_node_t node = {node_id, {}};
+
+      for(unsigned cpu : cpus.value()) {
+         if(!process_cpus_known || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &process_cpus)))
+            node.cpus.push_back(cpu);
+      }
+
+      if(!node.cpus.empty())
+         nodes.push_back(std::move(node));
+   }
+   #endif
+
+   // directory iteration order is unspecified
+   std::sort(nodes.begin(), nodes.end(), [] (const numa_node_t& a, const numa_node_t& b) {return a.node_id < b.node_id;});
+
+   if(nodes.empty()) {
+      numa_node_t node = {0, {}};
+
+      for(unsigned cpu = 0; cpu < std::max(std::thread::hardware_concurrency(), 1u); cpu++)
+         node.cpus.push_back(cpu);
+
+      nodes.push_back(std::move(node));
+   }
+
+   return cpu_topology_t(std::move(nodes));
+}
+
+const std::vector<cpu_topology_t::numa_node_t>& cpu_topology_t::get_nodes(void) const
+{
+   return nodes;
+}
+
+//
+// Returns CPUs a thread with `thread_index` should run on, which are
+// either all CPUs of one node, if `node_cpus` is `true`, or a single
+// CPU. Threads are assigned to nodes round-robin in either case, so
+// a few threads are spread across all nodes.
+//
+std::vector<unsigned> cpu_topology_t::get_thread_cpus(size_t thread_index, bool node_cpus) const
+{
+   if(node_cpus)
+      return nodes[thread_index % nodes.size()].cpus;
+
+   return {interleaved_cpus[thread_index % interleaved_cpus.size()]};
+}
+
+//
+// Pins the calling thread to `cpus` and returns `false` if it cannot
+// be done.
+//
+bool cpu_topology_t::set_thread_affinity(const std::vector<unsigned>& cpus)
+{
+   #ifdef _WIN32
+   DWORD_PTR thread_mask = 0;
+
+   for(unsigned cpu : cpus) {
+      if(cpu < sizeof(DWORD_PTR) * 8)
+         thread_mask |= static_cast<DWORD_PTR>(1) << cpu;
+   }
+
+   return thread_mask && SetThreadAffinityMask(GetCurrentThread(), thread_mask) != 0;
+   #else
+   cpu_set_t thread_cpus;
+
+   CPU_ZERO(&thread_cpus);
+
+   for(unsigned cpu : cpus) {
+      if(cpu < CPU_SETSIZE)
+         CPU_SET(cpu, &thread_cpus);
+   }
+
+   return CPU_COUNT(&thread_cpus) && pthread_setaffinity_np(pthread_self(), sizeof(thread_cpus), &thread_cpus) == 0;
+   #endif
+}
+
+//
+// Parses a Linux CPU list, such as `0-3,8-11`, and returns an empty
+// value if the list is malformed.
+//
+std::optional<std::vector<unsigned>> cpu_topology_t::parse_cpu_list(std::string_view cpu_list)
+{
+   std::vector<unsigned> cpus;
+
+   while(!cpu_list.empty() && (cpu_list.back() == '\n' || cpu_list.back() == '\r' || cpu_list.back() == ' '))
+      cpu_list.remove_suffix(1);
+
+   // nodes without CPUs have empty lists
+   if(cpu_list.empty())
+      return cpus;
+
+   const char *cp = cpu_list.data();
+   const char *end = cpu_list.data() + cpu_list.size();
+
+   while(cp < end) {
+      unsigned first = 0, last = 0;
+
+      std::from_chars_result result = std::from_chars(cp, end, first);
+
+      if(result.ec != std::errc())
+         return std::nullopt;
+
+      last = first;
+
+      if(result.ptr < end && *result.ptr == '-') {
+         result = std::from_chars(result.ptr + 1, end, last);
+
+         if(result.ec != std::errc() || last < first)
+            return std::nullopt;
+      }
+
+      for(unsigned cpu = first; cpu <= last; cpu++)
+         cpus.push_back(cpu);
+
+      if(result.ptr == end)
+         break;
+
+      // a trailing comma is also an error
+      if(*result.ptr != ',' || result.ptr + 1 == end)
+         return std::nullopt;
+
+      cp = result.ptr + 1;
+   }
+
+   return cpus;
+}
+
+//
+// Formats CPU numbers as a CPU list, with consecutive numbers
+// collapsed into ranges.
+//
+std::string cpu_topology_t::format_cpu_list(const std::vector<unsigned>& cpus)
+{
+   std::string cpu_list;
+
+   for(size_t i = 0; i < cpus.size(); i++) {
+      size_t last = i;
+
+      while(last + 1 < cpus.size() && cpus[last + 1] == cpus[last] + 1)
+         last++;
+
+      if(!cpu_list.empty())
+         cpu_list += ',';
+
+      cpu_list += std::to_string(cpus[i]);
+
+      if(last != i) {
+         cpu_list += '-';
+         cpu_list += std::to_string(cpus[last]);
+      }
+
+      i = last;
+   }
+
+   return cpu_list;
+}
+
+}
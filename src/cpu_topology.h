@@ -0,0 +1,53 @@
+#ifndef FIT_CPU_TOPOLOGY_H
+#define FIT_CPU_TOPOLOGY_H
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <optional>
+
+namespace fit {
+
+//
+// CPUs grouped by NUMA node, which is used to pin file tracker
+// threads to cores or nodes, so their buffers, which are allocated
+// and first touched in those threads, stay in the memory of the node
+// that reads and hashes them.
+//
+// Only CPUs this process is allowed to run on are included, so the
+// topology may be narrowed down via `taskset` or `numactl`. A system
+// without NUMA information is described as a single node with all
+// available CPUs.
+//
+class cpu_topology_t {
+   public:
+      struct numa_node_t {
+         unsigned node_id;
+         std::vector<unsigned> cpus;
+      };
+
+   private:
+      std::vector<numa_node_t> nodes;
+
+      // CPUs of all nodes interleaved, so consecutive threads are spread across nodes
+      std::vector<unsigned> interleaved_cpus;
+
+   public:
+      cpu_topology_t(std::vector<numa_node_t>&& nodes);
+
+      static cpu_topology_t detect(void);
+
+      const std::vector<numa_node_t>& get_nodes(void) const;
+
+      std::vector<unsigned> get_thread_cpus(size_t thread_index, bool node_cpus) const;
+
+      static bool set_thread_affinity(const std::vector<unsigned>& cpus);
+
+      static std::optional<std::vector<unsigned>> parse_cpu_list(std::string_view cpu_list);
+
+      static std::string format_cpu_list(const std::vector<unsigned>& cpus);
+};
+
+}
+
+#endif // FIT_CPU_TOPOLOGY_H
@@ -0,0 +1,207 @@
+#include "deferred_indexes.h"
+
+#include "sqlite.h"
+#include "format.h"
+
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <chrono>
+
+using namespace std::literals::string_view_literals;
+using namespace std::literals::string_literals;
+
+namespace fit {
+
+//
+// Secondary indexes of file versions are updated in random order
+// while files are inserted, which makes the first scan of a large
+// file tree slow. These indexes are dropped before the first scan
+// and their definitions are saved in the same transaction, so they
+// can be rebuilt from sorted keys after the scan or, if the scan is
+// interrupted, on the next run. Unique indexes are not deferred,
+// so duplicate versions or scanset entries, such as for files found
+// via overlapping scan paths or bind mounts, are rejected when they
+// are inserted, rather than failing to rebuild an index after the
+// scan. Indexes of directories and files are used to look up
+// scanned files and are not deferred either.
+//
+// Returns the number of deferred indexes or -1 if indexes could not
+// be deferred, in which case all indexes remain in place.
+//
+int defer_scan_indexes(int64_t scan_id, sqlite3 *file_scan_db)
+{
+   char *errmsg = nullptr;
+   int errcode = SQLITE_OK;
+
+   int index_count = 0;
+
+   if(sqlite3_exec(file_scan_db, "BEGIN TRANSACTION", nullptr, nullptr, &errmsg) != SQLITE_OK) {
+      sqlite3_free(errmsg);
+      return -1;
+   }
+
+   try {
+      sqlite_stmt_t stmt_save_index("save deferred index"sv);
+
+      //                                                                                                                  1                                                   2
+      std::string_view sql_save_index = "INSERT INTO deferred_indexes (scan_id, name, sql) SELECT ?, name, sql FROM sqlite_master WHERE type = 'index' AND name = ?"sv;
+
+      stmt_save_index.prepare(file_scan_db, sql_save_index);
+
+      for(std::string_view index_name : {"ix_versions_hash"sv, "ix_versions_verified_time"sv}) {
+         sqlite_param_binder_t save_index_stmt = stmt_save_index.get_param_binder();
+
+         save_index_stmt.bind_param(scan_id);
+         save_index_stmt.bind_param(std::u8string_view(reinterpret_cast<const char8_t*>(index_name.data()), index_name.size()));
+
+         if((errcode = sqlite3_step(stmt_save_index)) != SQLITE_DONE)
+            throw std::runtime_error(FMTNS::format("Cannot save a deferred index ({:s})", sqlite3_errstr(errcode)));
+
+         // indexes removed from the database by the user are not restored
+         if(sqlite3_changes(file_scan_db) == 0)
+            continue;
+
+         save_index_stmt.release();
+
+         if(sqlite3_exec(file_scan_db, FMTNS::format("DROP INDEX {:s}", index_name).c_str(), nullptr, nullptr, &errmsg) != SQLITE_OK)
+            throw std::runtime_error(FMTNS::format("Cannot drop index {:s} ({:s})", index_name, std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get()));
+
+         index_count++;
+      }
+
+      if((errcode = stmt_save_index.finalize()) != SQLITE_OK)
+         throw std::runtime_error("Cannot finalize a deferred index statement ("s + sqlite3_errstr(errcode) + ")");
+   }
+   catch (const std::exception&) {
+      sqlite3_exec(file_scan_db, "ROLLBACK TRANSACTION", nullptr, nullptr, nullptr);
+      return -1;
+   }
+
+   if(sqlite3_exec(file_scan_db, "COMMIT TRANSACTION", nullptr, nullptr, &errmsg) != SQLITE_OK) {
+      sqlite3_free(errmsg);
+      sqlite3_exec(file_scan_db, "ROLLBACK TRANSACTION", nullptr, nullptr, nullptr);
+      return -1;
+   }
+
+   return index_count;
+}
+
+//
+// Returns names of indexes deferred by the first scan that have not
+// been rebuilt yet, in the order in which they were deferred.
+//
+std::vector<std::string> select_deferred_index_names(sqlite3 *file_scan_db)
+{
+   int errcode = SQLITE_OK;
+
+   std::vector<std::string> index_names;
+
+   sqlite_stmt_t stmt_deferred_index_names("deferred index names"sv);
+
+   //                                                       0
+   std::string_view sql_deferred_index_names = "SELECT name FROM deferred_indexes ORDER BY id"sv;
+
+   stmt_deferred_index_names.prepare(file_scan_db, sql_deferred_index_names);
+
+   while((errcode = sqlite3_step(stmt_deferred_index_names)) == SQLITE_ROW)
+      index_names.emplace_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt_deferred_index_names, 0)), sqlite3_column_bytes(stmt_deferred_index_names, 0));
+
+   if(errcode != SQLITE_DONE)
+      throw std::runtime_error(FMTNS::format("Cannot select deferred index names ({:s})", sqlite3_errstr(errcode)));
+
+   if((errcode = stmt_deferred_index_names.finalize()) != SQLITE_OK)
+      throw std::runtime_error("Cannot finalize a deferred index names statement ("s + sqlite3_errstr(errcode) + ")");
+
+   return index_names;
+}
+
+//
+// Rebuilds indexes deferred by the first scan. Each index is created
+// in the same transaction in which its definition is removed, so an
+// interrupted rebuild continues with the remaining indexes on the next
+// run. SQLite sorts index keys before building an index, and large
+// sorts may use up to -t helper threads.
+//
+// Returns the number of rebuilt indexes.
+//
+int rebuild_deferred_indexes(const options_t& options, sqlite3 *file_scan_db, print_stream_t& print_stream)
+{
+   char *errmsg = nullptr;
+   int errcode = SQLITE_OK;
+
+   // index names, definitions and scans that deferred them are read before any of the indexes are created
+   std::vector<std::tuple<std::u8string, std::u8string, int64_t>> deferred_indexes;
+
+   sqlite_stmt_t stmt_deferred_indexes("deferred indexes"sv);
+
+   //                                                    0    1        2
+   std::string_view sql_deferred_indexes = "SELECT name, sql, scan_id FROM deferred_indexes ORDER BY id"sv;
+
+   stmt_deferred_indexes.prepare(file_scan_db, sql_deferred_indexes);
+
+   while((errcode = sqlite3_step(stmt_deferred_indexes)) == SQLITE_ROW) {
+      deferred_indexes.emplace_back(std::u8string(reinterpret_cast<const char8_t*>(sqlite3_column_text(stmt_deferred_indexes, 0)), sqlite3_column_bytes(stmt_deferred_indexes, 0)),
+                                    std::u8string(reinterpret_cast<const char8_t*>(sqlite3_column_text(stmt_deferred_indexes, 1)), sqlite3_column_bytes(stmt_deferred_indexes, 1)),
+                                    sqlite3_column_int64(stmt_deferred_indexes, 2));
+   }
+
+   if(errcode != SQLITE_DONE)
+      throw std::runtime_error(FMTNS::format("Cannot select deferred indexes ({:s})", sqlite3_errstr(errcode)));
+
+   if((errcode = stmt_deferred_indexes.finalize()) != SQLITE_OK)
+      throw std::runtime_error("Cannot finalize a deferred indexes statement ("s + sqlite3_errstr(errcode) + ")");
+
+   if(deferred_indexes.empty())
+      return 0;
+
+   std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+   print_stream.info("Building {:d} indexes deferred by scan {:d}", deferred_indexes.size(), std::get<2>(deferred_indexes.front()));
+
+   if(sqlite3_exec(file_scan_db, FMTNS::format("PRAGMA threads={:d}", options.thread_count).c_str(), nullptr, nullptr, &errmsg) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot set the number of SQLite helper threads ({:s})", std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get()));
+
+   sqlite_stmt_t stmt_delete_index("delete deferred index"sv);
+
+   //                                                                                1
+   std::string_view sql_delete_index = "DELETE FROM deferred_indexes WHERE name = ?"sv;
+
+   stmt_delete_index.prepare(file_scan_db, sql_delete_index);
+
+   for(const std::tuple<std::u8string, std::u8string, int64_t>& deferred_index : deferred_indexes) {
+      if(sqlite3_exec(file_scan_db, "BEGIN TRANSACTION", nullptr, nullptr, &errmsg) != SQLITE_OK)
+         throw std::runtime_error(FMTNS::format("Cannot start a transaction to build index {:s} ({:s})", u8sv(std::get<0>(deferred_index)), std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get()));
+
+      try {
+         if(sqlite3_exec(file_scan_db, reinterpret_cast<const char*>(std::get<1>(deferred_index).c_str()), nullptr, nullptr, &errmsg) != SQLITE_OK)
+            throw std::runtime_error(FMTNS::format("Cannot build index {:s} ({:s})", u8sv(std::get<0>(deferred_index)), std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get()));
+
+         sqlite_param_binder_t delete_index_stmt = stmt_delete_index.get_param_binder();
+
+         delete_index_stmt.bind_param(std::get<0>(deferred_index));
+
+         if((errcode = sqlite3_step(stmt_delete_index)) != SQLITE_DONE)
+            throw std::runtime_error(FMTNS::format("Cannot delete deferred index {:s} ({:s})", u8sv(std::get<0>(deferred_index)), sqlite3_errstr(errcode)));
+      }
+      catch (const std::exception&) {
+         sqlite3_exec(file_scan_db, "ROLLBACK TRANSACTION", nullptr, nullptr, nullptr);
+         throw;
+      }
+
+      if(sqlite3_exec(file_scan_db, "COMMIT TRANSACTION", nullptr, nullptr, &errmsg) != SQLITE_OK) {
+         std::string error = FMTNS::format("Cannot commit index {:s} ({:s})", u8sv(std::get<0>(deferred_index)), std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get());
+         sqlite3_exec(file_scan_db, "ROLLBACK TRANSACTION", nullptr, nullptr, nullptr);
+         throw std::runtime_error(error);
+      }
+   }
+
+   if((errcode = stmt_delete_index.finalize()) != SQLITE_OK)
+      throw std::runtime_error("Cannot finalize a deferred index statement ("s + sqlite3_errstr(errcode) + ")");
+
+   print_stream.info("Built {:d} indexes in {:s}", deferred_indexes.size(), hr_time(std::chrono::steady_clock::now()-start_time));
+
+   return static_cast<int>(deferred_indexes.size());
+}
+
+}
@@ -0,0 +1,25 @@
+#ifndef FIT_DEFERRED_INDEXES_H
+#define FIT_DEFERRED_INDEXES_H
+
+#include "print_stream.h"
+
+#include "fit.h"
+
+#include <sqlite3.h>
+
+#include <string>
+#include <vector>
+
+#include <cstdint>
+
+namespace fit {
+
+int defer_scan_indexes(int64_t scan_id, sqlite3 *file_scan_db);
+
+std::vector<std::string> select_deferred_index_names(sqlite3 *file_scan_db);
+
+int rebuild_deferred_indexes(const options_t& options, sqlite3 *file_scan_db, print_stream_t& print_stream);
+
+}
+
+#endif // FIT_DEFERRED_INDEXES_H
@@ -0,0 +1,118 @@
+#include "dir_cache.h"
+
+#include "format.h"
+
+#include <stdexcept>
+
+namespace fit {
+
+dir_cache_t::dir_cache_t(size_t max_dir_count) :
+      max_dir_count(max_dir_count)
+{
+}
+
+//
+// Returns the offset of the file name in a file path, which is also
+// the length of the directory path, including the trailing separator.
+//
+size_t dir_cache_t::get_file_name_offset(std::u8string_view filepath, char8_t path_sep)
+{
+   size_t sep_pos = filepath.rfind(path_sep);
+
+   return sep_pos == std::u8string_view::npos ? 0 : sep_pos + 1;
+}
+
+//
+// Looks up each directory in the path that is not in the cache,
+// starting from the closest one found in the cache, or from the top
+// directory. Directories that are not found are not cached because
+// they may be inserted by other connections.
+//
+std::optional<int64_t> dir_cache_t::find_dir_path_id(const std::u8string& dir_path, char8_t path_sep, const dir_finder_t& find_dir)
+{
+   if(dir_path.empty())
+      return NO_DIR_ID;
+
+   if(std::unordered_map<std::u8string, int64_t>::const_iterator dir_id = dir_ids.find(dir_path); dir_id != dir_ids.end())
+      return dir_id->second;
+
+   // the parent path ends at the separator before the trailing one, if there is one
+   size_t name_offset = get_file_name_offset(std::u8string_view(dir_path).substr(0, dir_path.size() - 1), path_sep);
+
+   std::optional<int64_t> parent_id = find_dir_path_id(dir_path.substr(0, name_offset), path_sep, find_dir);
+
+   if(!parent_id.has_value())
+      return std::nullopt;
+
+   std::optional<int64_t> dir_id = find_dir(parent_id.value(), dir_path.substr(name_offset));
+
+   if(!dir_id.has_value())
+      return std::nullopt;
+
+   if(dir_ids.size() >= max_dir_count)
+      dir_ids.clear();
+
+   dir_ids.emplace(dir_path, dir_id.value());
+
+   return dir_id;
+}
+
+std::optional<int64_t> dir_cache_t::find_dir_id(std::u8string_view filepath, char8_t path_sep, const dir_finder_t& find_dir)
+{
+   return find_dir_path_id(std::u8string(filepath.substr(0, get_file_name_offset(filepath, path_sep))), path_sep, find_dir);
+}
+
+int64_t dir_cache_t::get_dir_id(std::u8string_view filepath, char8_t path_sep, const dir_inserter_t& insert_dir)
+{
+   std::optional<int64_t> dir_id = find_dir_path_id(std::u8string(filepath.substr(0, get_file_name_offset(filepath, path_sep))), path_sep,
+         [&insert_dir] (int64_t parent_id, const std::u8string& dir_name) -> std::optional<int64_t>
+         {
+            return insert_dir(parent_id, dir_name);
+         });
+
+   // this is an assert-type exception - the inserter always returns a directory identifier
+   if(!dir_id.has_value())
+      throw std::logic_error("dir_id cannot be empty at this point");
+
+   return dir_id.value();
+}
+
+//
+// Parent directories are always inserted before their subdirectories,
+// so a parent identifier that is not less than the directory identifier
+// indicates a damaged directory tree, which otherwise may be looked up
+// in an endless loop.
+//
+std::u8string dir_cache_t::get_dir_path(int64_t dir_id, const dir_reader_t& read_dir)
+{
+   if(dir_id == NO_DIR_ID)
+      return std::u8string();
+
+   if(std::unordered_map<int64_t, std::u8string>::const_iterator dir_path = dir_paths.find(dir_id); dir_path != dir_paths.end())
+      return dir_path->second;
+
+   int64_t parent_id = NO_DIR_ID;
+   std::u8string dir_name;
+
+   read_dir(dir_id, parent_id, dir_name);
+
+   if(parent_id >= dir_id)
+      throw std::runtime_error(FMTNS::format("Directory {:d} has a bad parent directory {:d}", dir_id, parent_id));
+
+   std::u8string dir_path = get_dir_path(parent_id, read_dir) + dir_name;
+
+   if(dir_paths.size() >= max_dir_count)
+      dir_paths.clear();
+
+   dir_paths.emplace(dir_id, dir_path);
+
+   return dir_path;
+}
+
+void dir_cache_t::clear(void)
+{
+   dir_ids.clear();
+   dir_paths.clear();
+}
+
+}
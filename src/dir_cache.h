@@ -0,0 +1,77 @@
+#ifndef FIT_DIR_CACHE_H
+#define FIT_DIR_CACHE_H
+
+#include <string>
+#include <string_view>
+#include <optional>
+#include <unordered_map>
+#include <functional>
+
+#include <cstdint>
+
+namespace fit {
+
+//
+// Maps directory paths to directory identifiers and directory
+// identifiers to directory paths, so each directory record is
+// looked up in the database only once, while it stays in the
+// cache.
+//
+// Directories are stored as a tree of directory names, each with
+// a trailing path separator, so a directory path is a sequence of
+// directory names from the top directory, which has the parent
+// identifier `NO_DIR_ID`, and a file path is the directory path
+// followed by the file name. For example, `/abc/x.txt` is stored
+// as directories `/` and `abc/` and the file name `x.txt`, and
+// `abc\x.txt`, relative to some base path, as the directory `abc\`
+// and the file name `x.txt`. Files without a directory have the
+// directory identifier `NO_DIR_ID`.
+//
+// Directory records are looked up and inserted via callbacks, so
+// the cache can be used with any database connection. Each map is
+// cleared when it reaches the maximum number of directories.
+//
+class dir_cache_t {
+   public:
+      static constexpr const int64_t NO_DIR_ID = 0;
+
+      static constexpr const size_t DEFAULT_MAX_DIR_COUNT = 64 * 1024;
+
+      // returns a directory identifier for a parent identifier and a directory name, if one exists
+      using dir_finder_t = std::function<std::optional<int64_t> (int64_t parent_id, const std::u8string& dir_name)>;
+
+      // returns a directory identifier for a parent identifier and a directory name, which is inserted if not found
+      using dir_inserter_t = std::function<int64_t (int64_t parent_id, const std::u8string& dir_name)>;
+
+      // returns a parent identifier and a directory name for a directory identifier
+      using dir_reader_t = std::function<void (int64_t dir_id, int64_t& parent_id, std::u8string& dir_name)>;
+
+   private:
+      size_t max_dir_count;
+
+      // directory identifiers mapped by directory paths with a trailing separator
+      std::unordered_map<std::u8string, int64_t> dir_ids;
+
+      // directory paths with a trailing separator mapped by directory identifiers
+      std::unordered_map<int64_t, std::u8string> dir_paths;
+
+   private:
+      std::optional<int64_t> find_dir_path_id(const std::u8string& dir_path, char8_t path_sep, const dir_finder_t& find_dir);
+
+   public:
+      dir_cache_t(size_t max_dir_count = DEFAULT_MAX_DIR_COUNT);
+
+      std::optional<int64_t> find_dir_id(std::u8string_view filepath, char8_t path_sep, const dir_finder_t& find_dir);
+
+      int64_t get_dir_id(std::u8string_view filepath, char8_t path_sep, const dir_inserter_t& insert_dir);
+
+      std::u8string get_dir_path(int64_t dir_id, const dir_reader_t& read_dir);
+
+      void clear(void);
+
+      static size_t get_file_name_offset(std::u8string_view filepath, char8_t path_sep);
+};
+
+}
+
+#endif // FIT_DIR_CACHE_H
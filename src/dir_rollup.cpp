@@ -0,0 +1,173 @@
+#include "dir_rollup.h"
+#include "dir_cache.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <charconv>
+
+namespace fit {
+
+// 64-bit FNV-1a parameters
+static constexpr const uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325;
+static constexpr const uint64_t FNV_PRIME = 0x100000001b3;
+
+//
+// A SplitMix64 finalizer, which spreads FNV-1a bits over the entire
+// lane and derives different lane seeds from lane numbers.
+//
+static uint64_t mix_bits(uint64_t value)
+{
+   value ^= value >> 30;
+   value *= 0xbf58476d1ce4e5b9;
+   value ^= value >> 27;
+   value *= 0x94d049bb133111eb;
+   value ^= value >> 31;
+
+   return value;
+}
+
+rollup_hash_t::rollup_hash_t(std::u8string_view entry_name, std::string_view hexhash)
+{
+   for(size_t i = 0; i < LANE_COUNT; i++) {
+      uint64_t lane = mix_bits(FNV_OFFSET_BASIS + i);
+
+      for(char8_t ch : entry_name)
+         lane = (lane ^ static_cast<uint8_t>(ch)) * FNV_PRIME;
+
+      // a null character cannot appear in names and separates names from hashes
+      lane *= FNV_PRIME;
+
+      for(char ch : hexhash)
+         lane = (lane ^ static_cast<uint8_t>(ch)) * FNV_PRIME;
+
+      lanes[i] = mix_bits(lane);
+   }
+}
+
+rollup_hash_t rollup_hash_t::from_hex(std::string_view hexhash)
+{
+   rollup_hash_t rollup_hash;
+
+   if(hexhash.size() != HEX_SIZE)
+      throw std::runtime_error("A rollup hash must be " + std::to_string(HEX_SIZE) + " hex characters long");
+
+   for(size_t i = 0; i < LANE_COUNT; i++) {
+      const char *lane_hex = hexhash.data() + i * sizeof(uint64_t) * 2;
+
+      std::from_chars_result result = std::from_chars(lane_hex, lane_hex + sizeof(uint64_t) * 2, rollup_hash.lanes[i], 16);
+
+      if(result.ec != std::errc() || result.ptr != lane_hex + sizeof(uint64_t) * 2)
+         throw std::runtime_error("A rollup hash contains invalid hex characters");
+   }
+
+   return rollup_hash;
+}
+
+std::string rollup_hash_t::to_hex(void) const
+{
+   static constexpr const char hex_digits[] = "0123456789abcdef";
+
+   std::string hexhash(HEX_SIZE, '0');
+
+   for(size_t i = 0; i < LANE_COUNT; i++) {
+      uint64_t lane = lanes[i];
+
+      for(size_t k = sizeof(uint64_t) * 2; k > 0; k--, lane >>= 4)
+         hexhash[i * sizeof(uint64_t) * 2 + k - 1] = hex_digits[lane & 0xF];
+   }
+
+   return hexhash;
+}
+
+rollup_hash_t& rollup_hash_t::operator += (const rollup_hash_t& other)
+{
+   // unsigned overflow wraps around, which makes addition order irrelevant
+   for(size_t i = 0; i < LANE_COUNT; i++)
+      lanes[i] += other.lanes[i];
+
+   return *this;
+}
+
+dir_totals_t& dir_totals_t::operator += (const dir_totals_t& other)
+{
+   file_count += other.file_count;
+   total_size += other.total_size;
+
+   if(other.max_mod_time.has_value())
+      max_mod_time = std::max(max_mod_time.value_or(other.max_mod_time.value()), other.max_mod_time.value());
+
+   rollup_hash += other.rollup_hash;
+
+   return *this;
+}
+
+dir_rollup_builder_t::dir_rollup_builder_t(std::vector<int64_t>&& root_dir_ids, dir_handler_t&& report_dir, dir_reader_t&& read_dir) :
+      root_dir_ids(std::move(root_dir_ids)),
+      report_dir(std::move(report_dir)),
+      read_dir(std::move(read_dir))
+{
+}
+
+//
+// Reports tree totals of a directory and adds them to the totals of
+// its parent, hashing the rollup hash of the directory with its name,
+// so the parent rollup hash changes when a subdirectory is renamed.
+//
+void dir_rollup_builder_t::complete_dir(int64_t dir_id, int64_t parent_id, const std::u8string& dir_name, const dir_totals_t& tree_totals)
+{
+   report_dir(dir_id, tree_totals);
+
+   if(dir_id == dir_cache_t::NO_DIR_ID || std::find(root_dir_ids.begin(), root_dir_ids.end(), dir_id) != root_dir_ids.end())
+      return;
+
+   dir_totals_t parent_totals = tree_totals;
+
+   // directory names end with a native path separator, which is hashed as `/`, so rollup hashes are the same on all platforms
+   parent_totals.rollup_hash = rollup_hash_t(std::u8string(dir_name, 0, dir_name.empty() ? 0 : dir_name.size() - 1) + u8"/", tree_totals.rollup_hash.to_hex());
+
+   pending_dirs[parent_id] += parent_totals;
+}
+
+//
+// Completes pending directories with identifiers greater than
+// `dir_id`, which have no files of their own and will not be added,
+// or all of them, if `dir_id` is null. Completed directories may add
+// new pending parent directories, which are completed in the same
+// loop.
+//
+void dir_rollup_builder_t::complete_pending_dirs(const int64_t *dir_id)
+{
+   while(!pending_dirs.empty() && (!dir_id || std::prev(pending_dirs.end())->first > *dir_id)) {
+      std::map<int64_t, dir_totals_t>::node_type pending_dir = pending_dirs.extract(std::prev(pending_dirs.end()));
+
+      int64_t parent_id = dir_cache_t::NO_DIR_ID;
+      std::u8string dir_name;
+
+      if(pending_dir.key() != dir_cache_t::NO_DIR_ID)
+         read_dir(pending_dir.key(), parent_id, dir_name);
+
+      complete_dir(pending_dir.key(), parent_id, dir_name, pending_dir.mapped());
+   }
+}
+
+void dir_rollup_builder_t::add_dir(int64_t dir_id, int64_t parent_id, const std::u8string& dir_name, const dir_totals_t& dir_totals)
+{
+   complete_pending_dirs(&dir_id);
+
+   dir_totals_t tree_totals = dir_totals;
+
+   // all subdirectories have been added at this point
+   if(std::map<int64_t, dir_totals_t>::iterator pending_dir = pending_dirs.find(dir_id); pending_dir != pending_dirs.end()) {
+      tree_totals += pending_dir->second;
+      pending_dirs.erase(pending_dir);
+   }
+
+   complete_dir(dir_id, parent_id, dir_name, tree_totals);
+}
+
+void dir_rollup_builder_t::finish(void)
+{
+   complete_pending_dirs(nullptr);
+}
+
+}
@@ -0,0 +1,113 @@
+#ifndef FIT_DIR_ROLLUP_H
+#define FIT_DIR_ROLLUP_H
+
+#include <string>
+#include <string_view>
+#include <array>
+#include <vector>
+#include <map>
+#include <optional>
+#include <functional>
+
+#include <cstdint>
+
+namespace fit {
+
+//
+// An order-independent hash of directory entries, which is the sum
+// of entry hashes computed from entry names and their file hashes or
+// rollup hashes of subdirectories. Entry hashes are added in 64-bit
+// lanes, modulo 2^64, so rollup hashes of files completed in any
+// order, by any number of threads or scan runs, can be combined into
+// the same directory rollup hash.
+//
+// Entry hashes are not cryptographic and are only intended to find
+// identical file trees, not to detect deliberate changes, which are
+// covered by file hashes.
+//
+class rollup_hash_t {
+   public:
+      static constexpr const size_t LANE_COUNT = 4;
+
+      static constexpr const size_t HEX_SIZE = LANE_COUNT * sizeof(uint64_t) * 2;
+
+   private:
+      std::array<uint64_t, LANE_COUNT> lanes = {};
+
+   public:
+      rollup_hash_t(void) = default;
+
+      rollup_hash_t(std::u8string_view entry_name, std::string_view hexhash);
+
+      static rollup_hash_t from_hex(std::string_view hexhash);
+
+      std::string to_hex(void) const;
+
+      rollup_hash_t& operator += (const rollup_hash_t& other);
+
+      bool operator == (const rollup_hash_t& other) const = default;
+};
+
+//
+// File count, size, last modification time and rollup hash of files
+// either directly in a directory or in its entire file tree.
+//
+struct dir_totals_t {
+   uint64_t file_count = 0;
+   uint64_t total_size = 0;
+   std::optional<int64_t> max_mod_time;
+   rollup_hash_t rollup_hash;
+
+   dir_totals_t& operator += (const dir_totals_t& other);
+};
+
+//
+// Builds totals of directory trees from totals of files directly in
+// each directory, which must be added in the descending order of
+// directory identifiers. Parent directories are always inserted
+// before their subdirectories, so all subdirectories are added
+// before their parent directory. Totals of a directory are reported
+// as soon as they are known, including parent directories without
+// any files, which are read via `read_dir`, up to one of the root
+// directories.
+//
+// Directory identifiers, parent identifiers and directory names are
+// the same as in `dir_cache_t`, where `NO_DIR_ID` is the directory
+// of files without a directory, which has no parent.
+//
+// Only totals of subdirectories waiting for their parent directory
+// are kept in memory.
+//
+class dir_rollup_builder_t {
+   public:
+      using dir_handler_t = std::function<void (int64_t dir_id, const dir_totals_t&)>;
+
+      // returns a parent identifier and a directory name for a directory identifier
+      using dir_reader_t = std::function<void (int64_t dir_id, int64_t& parent_id, std::u8string& dir_name)>;
+
+   private:
+      std::vector<int64_t> root_dir_ids;
+
+      dir_handler_t report_dir;
+
+      dir_reader_t read_dir;
+
+      // combined totals of subdirectories, mapped by their parent identifier
+      std::map<int64_t, dir_totals_t> pending_dirs;
+
+   private:
+      void complete_dir(int64_t dir_id, int64_t parent_id, const std::u8string& dir_name, const dir_totals_t& tree_totals);
+
+      void complete_pending_dirs(const int64_t *dir_id);
+
+   public:
+      dir_rollup_builder_t(std::vector<int64_t>&& root_dir_ids, dir_handler_t&& report_dir, dir_reader_t&& read_dir);
+
+      void add_dir(int64_t dir_id, int64_t parent_id, const std::u8string& dir_name, const dir_totals_t& dir_totals);
+
+      void finish(void);
+};
+
+}
+
+#endif // FIT_DIR_ROLLUP_H
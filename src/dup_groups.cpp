@@ -0,0 +1,54 @@
+#include "dup_groups.h"
+
+#include <algorithm>
+
+namespace fit {
+
+//
+// Reads scanset files in the order of their hashes and reports each
+// group of two or more files with the same hash and hash type as soon
+// as the next hash is read. Files without a hash are skipped. Only
+// files of the current group are kept in memory.
+//
+dup_group_counts_t group_duplicates(const scan_entry_reader_t& read_entry, const dup_group_handler_t& report_group)
+{
+   dup_group_counts_t group_counts;
+
+   std::vector<scan_entry_t> dup_group;
+
+   auto flush_group = [&group_counts, &dup_group, &report_group] ()
+   {
+      if(dup_group.size() > 1) {
+         std::sort(dup_group.begin(), dup_group.end(), [] (const scan_entry_t& entry1, const scan_entry_t& entry2) {return entry1.path < entry2.path;});
+
+         // files with the same hash have the same size
+         uint64_t wasted_size = static_cast<uint64_t>(dup_group.front().entry_size) * (dup_group.size() - 1);
+
+         report_group(dup_group, wasted_size);
+
+         group_counts.dup_groups++;
+         group_counts.dup_files += dup_group.size();
+         group_counts.wasted_size += wasted_size;
+      }
+
+      dup_group.clear();
+   };
+
+   scan_entry_t scan_entry;
+
+   while(read_entry(scan_entry)) {
+      if(!scan_entry.hash.has_value())
+         continue;
+
+      if(!dup_group.empty() && (dup_group.front().hash != scan_entry.hash || dup_group.front().hash_type != scan_entry.hash_type))
+         flush_group();
+
+      dup_group.push_back(std::move(scan_entry));
+   }
+
+   flush_group();
+
+   return group_counts;
+}
+
+}
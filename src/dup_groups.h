@@ -0,0 +1,29 @@
+#ifndef FIT_DUP_GROUPS_H
+#define FIT_DUP_GROUPS_H
+
+#include "scan_diff.h"
+
+#include <vector>
+#include <functional>
+
+#include <cstdint>
+
+namespace fit {
+
+struct dup_group_counts_t {
+   uint64_t dup_groups = 0;
+   uint64_t dup_files = 0;
+   uint64_t wasted_size = 0;           // size of all files in each group, except one
+};
+
+//
+// Receives files with the same hash, sorted by path, and the size
+// that would be reclaimed if only one of these files was kept.
+//
+using dup_group_handler_t = std::function<void (const std::vector<scan_entry_t>&, uint64_t)>;
+
+dup_group_counts_t group_duplicates(const scan_entry_reader_t& read_entry, const dup_group_handler_t& report_group);
+
+}
+
+#endif // FIT_DUP_GROUPS_H
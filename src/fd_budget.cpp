@@ -0,0 +1,132 @@
+#include "fd_budget.h"
+
+#ifdef _WIN32
+#include <cstdio>          // for _setmaxstdio
+#else
+#include <sys/resource.h>  // for getrlimit
+#endif
+
+#include <stdexcept>
+#include <algorithm>
+
+namespace fit {
+
+fd_budget_t::fd_budget_t(size_t max_fds) :
+      max_fds(max_fds),
+      available_fds(max_fds)
+{
+   if(!max_fds)
+      throw std::runtime_error("File descriptor budget cannot be empty");
+}
+
+size_t fd_budget_t::max_size(void) const
+{
+   return max_fds;
+}
+
+size_t fd_budget_t::available(void)
+{
+   std::lock_guard<std::mutex> budget_lock(budget_mtx);
+
+   return available_fds;
+}
+
+bool fd_budget_t::try_acquire(void)
+{
+   std::lock_guard<std::mutex> budget_lock(budget_mtx);
+
+   if(!available_fds)
+      return false;
+
+   available_fds--;
+
+   return true;
+}
+
+//
+// Waits until a file descriptor becomes available or `abort_wait`
+// is set to `true`, in which case `false` is returned and nothing
+// is acquired. Time spent waiting is accumulated and may be
+// obtained via `get_wait_time`.
+//
+bool fd_budget_t::acquire(const std::atomic<bool>& abort_wait)
+{
+   std::unique_lock<std::mutex> budget_lock(budget_mtx);
+
+   if(available_fds) {
+      available_fds--;
+      return true;
+   }
+
+   std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+   // abort_wait is not tied to this condition variable, so check it periodically
+   while(!available_fds && !abort_wait)
+      budget_cv.wait_for(budget_lock, std::chrono::milliseconds(100));
+
+   wait_time += (std::chrono::steady_clock::now() - start_time).count();
+
+   if(!available_fds)
+      return false;
+
+   available_fds--;
+
+   return true;
+}
+
+void fd_budget_t::release(void) noexcept
+{
+   {
+      std::lock_guard<std::mutex> budget_lock(budget_mtx);
+
+      // this is an assert-type condition - more releases than acquisitions indicate a logic error
+      if(available_fds < max_fds)
+         available_fds++;
+   }
+
+   budget_cv.notify_one();
+}
+
+std::chrono::steady_clock::duration fd_budget_t::get_wait_time(void) const
+{
+   return std::chrono::steady_clock::duration(wait_time.load());
+}
+
+//
+// Returns the maximum number of files that may be open by this
+// process. The soft limit is raised up to the hard limit, where
+// the platform allows it, so it can be used for larger number of
+// hash jobs and threads.
+//
+size_t fd_budget_t::get_open_file_limit(void)
+{
+   #ifdef _WIN32
+   // CRT streams are limited separately from OS handles (the default is 512 and the maximum is 8192)
+   if(_getmaxstdio() < 8192)
+      _setmaxstdio(8192);
+
+   return static_cast<size_t>(_getmaxstdio());
+   #else
+   struct rlimit fd_limit;
+
+   if(getrlimit(RLIMIT_NOFILE, &fd_limit) != 0)
+      throw std::runtime_error("Cannot obtain the maximum number of open files");
+
+   // the hard limit may be unlimited, which is not practical to use
+   rlim_t max_fds = fd_limit.rlim_max == RLIM_INFINITY ? 65536 : std::min<rlim_t>(fd_limit.rlim_max, 65536);
+
+   if(fd_limit.rlim_cur != RLIM_INFINITY && fd_limit.rlim_cur < max_fds) {
+      rlim_t cur_fds = fd_limit.rlim_cur;
+
+      fd_limit.rlim_cur = max_fds;
+
+      // if the soft limit cannot be raised, use the current one
+      if(setrlimit(RLIMIT_NOFILE, &fd_limit) != 0)
+         return static_cast<size_t>(cur_fds);
+   }
+
+   return static_cast<size_t>(fd_limit.rlim_cur == RLIM_INFINITY ? max_fds : fd_limit.rlim_cur);
+   #endif
+}
+
+}
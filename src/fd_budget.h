@@ -0,0 +1,74 @@
+#ifndef FIT_FD_BUDGET_H
+#define FIT_FD_BUDGET_H
+
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+#include <cstdio>
+#include <cstddef>
+
+namespace fit {
+
+//
+// A process-wide budget of file descriptors that may be open at the
+// same time by all file trackers.
+//
+// Each open file being hashed holds one unit of this budget, which
+// is acquired right before the file is opened and released when the
+// file is closed. Callers holding any units must never wait for
+// more units to become available, which would deadlock if all
+// other callers were waiting for units held by this caller. Such
+// callers should use `try_acquire` and continue processing files
+// they already have open, which will eventually release some units.
+//
+class fd_budget_t {
+   private:
+      std::mutex budget_mtx;
+      std::condition_variable budget_cv;
+
+      size_t max_fds;               // maximum number of file descriptors in this budget
+
+      size_t available_fds;         // number of file descriptors that may be acquired
+
+      std::atomic<std::chrono::steady_clock::rep> wait_time = 0;
+
+   public:
+      fd_budget_t(size_t max_fds);
+
+      size_t max_size(void) const;
+
+      size_t available(void);
+
+      bool try_acquire(void);
+
+      bool acquire(const std::atomic<bool>& abort_wait);
+
+      void release(void) noexcept;
+
+      std::chrono::steady_clock::duration get_wait_time(void) const;
+
+      static size_t get_open_file_limit(void);
+};
+
+//
+// A deleter for files opened against a file descriptor budget,
+// which returns a descriptor unit to the budget when the file
+// is closed.
+//
+struct budget_file_deleter_t {
+   fd_budget_t *fd_budget = nullptr;
+
+   void operator () (FILE *file)
+   {
+      std::fclose(file);
+
+      if(fd_budget)
+         fd_budget->release();
+   }
+};
+
+}
+
+#endif // FIT_FD_BUDGET_H
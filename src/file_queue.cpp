@@ -0,0 +1,65 @@
+#include "file_queue.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace fit {
+
+file_queue_t::file_queue_t(size_t window_size) :
+      window_size(window_size)
+{
+}
+
+void file_queue_t::push(std::filesystem::directory_entry&& dir_entry, uint64_t file_size)
+{
+   files.push({std::move(dir_entry), file_size, next_sequence++});
+}
+
+std::filesystem::directory_entry file_queue_t::pop(void)
+{
+   if(!window_size) {
+      if(files.empty())
+         throw std::logic_error("Cannot take a file from an empty file queue");
+
+      std::filesystem::directory_entry dir_entry = std::move(files.front().dir_entry);
+      files.pop();
+      return dir_entry;
+   }
+
+   // start the next batch with files at the front of the queue
+   if(batch.empty()) {
+      if(files.empty())
+         throw std::logic_error("Cannot take a file from an empty file queue");
+
+      while(!files.empty() && batch.size() < window_size) {
+         batch.push_back(std::move(files.front()));
+         files.pop();
+      }
+
+      std::make_heap(batch.begin(), batch.end());
+   }
+
+   std::pop_heap(batch.begin(), batch.end());
+
+   std::filesystem::directory_entry dir_entry = std::move(batch.back().dir_entry);
+   batch.pop_back();
+
+   return dir_entry;
+}
+
+bool file_queue_t::empty(void) const
+{
+   return files.empty() && batch.empty();
+}
+
+size_t file_queue_t::size(void) const
+{
+   return files.size() + batch.size();
+}
+
+bool file_queue_t::is_ordered_by_size(void) const
+{
+   return window_size != 0;
+}
+
+}
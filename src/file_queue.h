@@ -0,0 +1,65 @@
+#ifndef FIT_FILE_QUEUE_H
+#define FIT_FILE_QUEUE_H
+
+#include <queue>
+#include <vector>
+#include <filesystem>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace fit {
+
+//
+// A queue of files to be hashed, which hands out files either in the
+// order they were queued or, if a look-ahead window is specified, in
+// batches of up to that many files, largest files first.
+//
+// Each batch is taken from the front of the queue when the previous
+// batch is exhausted, so files are never moved ahead of files in an
+// earlier batch and small files fill gaps left by large files within
+// each batch. Files of the same size are handed out in the order they
+// were queued.
+//
+// This class is not thread-safe and should be protected by the same
+// mutex as used for other queue operations.
+//
+class file_queue_t {
+   private:
+      struct queued_file_t {
+         std::filesystem::directory_entry dir_entry;
+         uint64_t file_size;
+         uint64_t sequence;
+
+         bool operator < (const queued_file_t& other) const
+         {
+            return file_size < other.file_size || (file_size == other.file_size && sequence > other.sequence);
+         }
+      };
+
+   private:
+      size_t window_size;                       // zero if files are handed out in the queued order
+
+      std::queue<queued_file_t> files;
+
+      std::vector<queued_file_t> batch;         // a max-heap of files in the current batch
+
+      uint64_t next_sequence = 0;
+
+   public:
+      file_queue_t(size_t window_size = 0);
+
+      void push(std::filesystem::directory_entry&& dir_entry, uint64_t file_size = 0);
+
+      std::filesystem::directory_entry pop(void);
+
+      bool empty(void) const;
+
+      size_t size(void) const;
+
+      bool is_ordered_by_size(void) const;
+};
+
+}
+
+#endif // FIT_FILE_QUEUE_H
@@ -1,5 +1,8 @@
 #include "file_tracker.h"
 #include "format.h"
+#include "cpu_topology.h"
+#include "memory_db.h"
+#include "wal_checkpointer.h"
 
 #include "fit.h"
 
@@ -12,12 +15,16 @@ extern "C" {
 
 #ifdef _WIN32
 #include <cwchar>    // for _wfopen
+#else
+#include <sys/stat.h>   // for stat, fstat
+#include <cerrno>
 #endif
 
 #include <stdexcept>
 #include <chrono>
 #include <algorithm>
 #include <array>
+#include <iterator>
 
 #include <cstring>
 
@@ -62,43 +69,80 @@ constexpr size_t file_tracker_t::HASH_HEX_SIZE = HASH_BIN_SIZE * 2;
 constexpr std::string_view file_tracker_t::HASH_TYPE = mb_file_hasher_t::traits::HASH_TYPE;
 #endif
 
-file_tracker_t::file_tracker_t(const options_t& options, std::optional<int64_t>& scan_id, std::optional<int64_t>& base_scan_id, std::queue<std::filesystem::directory_entry>& files, std::mutex& files_mtx, progress_info_t& progress_info, print_stream_t& print_stream) :
+file_tracker_t::file_tracker_t(const options_t& options, std::optional<int64_t>& scan_id, std::optional<int64_t>& base_scan_id, file_queue_t& files, std::mutex& files_mtx, progress_info_t& progress_info, fd_budget_t& fd_budget, hardlink_map_t& hardlink_map, rate_limiter_t& rate_limiter, print_stream_t& print_stream) :
       options(options),
       print_stream(print_stream),
       scan_id(scan_id),
       base_scan_id(base_scan_id),
-      file_buffer(new unsigned char[options.buffer_size]),
       files(files),
       files_mtx(files_mtx),
+      read_size_limit(options.buffer_size),
       progress_info(progress_info),
+      fd_budget(fd_budget),
+      hardlink_map(hardlink_map),
+      rate_limiter(rate_limiter),
       EXIF_exts(parse_EXIF_exts(options)),
       exif_reader(options),
+      stmt_insert_dir("insert dir"sv),
       stmt_insert_file("insert file"sv),
       stmt_insert_version("insert version"sv),
+      stmt_retire_versions("retire versions"sv),
       stmt_insert_scanset_entry("insert scanset entry"sv),
       stmt_insert_exif("insert exif"sv),
+      stmt_upsert_scan_dir("upsert scan dir"sv),
+      stmt_find_dir("find dir"sv),
       stmt_find_last_version("find last version"sv),
       stmt_find_scan_version("find scan version"sv),
+      stmt_update_verified_time("update verified time"sv),
+      stmt_insert_new_file("insert new file"sv),
       stmt_begin_txn("begin transaction"sv),
       stmt_commit_txn("commit transaction"sv),
       stmt_rollback_txn("rollback transaction"sv)
 #ifndef NO_SSE_AVX
-      , mb_hasher(*this, options.buffer_size, options.mb_hash_max)
+      , stmt_find_hash_checkpoint("find hash checkpoint"sv),
+      stmt_delete_hash_checkpoint("delete hash checkpoint"sv),
+      stmt_save_hash_checkpoint("save hash checkpoint"sv),
+      stmt_update_fingerprint("update fingerprint"sv),
+      mb_hasher(*this, options.buffer_size, options.mb_hash_max)
 #endif
 {
    init_scan_db_conn();
 
    init_base_scan_stmts();
 
+   // scrubs record when each matching file was verified, so the next scrub can start with other files
+   if(options.scrub_files)
+      init_scrub_stmts();
+
+#ifndef NO_SSE_AVX
+   mb_hasher.set_start_handler(&file_tracker_t::start_file);
+
+   mb_hash_limit = options.mb_hash_max;
+#endif
+
    if(scan_id.has_value()) {
       init_new_scan_stmts();
       init_transaction_stmts();
+
+#ifndef NO_SSE_AVX
+      // hash checkpoints are only maintained for the current scan and are never used in verification scans
+      if(options.hash_checkpoint_interval) {
+         init_hash_checkpoint_stmts();
+
+         mb_hasher.set_checkpoint_handler(&file_tracker_t::save_hash_checkpoint, options.hash_checkpoint_interval);
+      }
+
+      if(options.fingerprint_files)
+         init_fingerprint_stmts();
+#endif
    }
 
    if(options.report_removed_files) {
       // if there is a base scan, set up a scanset bitmap, so we can track removed files (i.e. remaining bits in scanset_bitmap)
       if(base_scan_id.has_value())
          scanset_bitmap = scanset_bitmap_t(get_scanset_rowid_range(file_scan_db, base_scan_id.value()));
+
+      init_new_file_stmts();
    }
 }
 
@@ -110,32 +154,62 @@ file_tracker_t::file_tracker_t(file_tracker_t&& other) :
       file_buffer(std::move(other.file_buffer)),
       files(other.files),
       files_mtx(other.files_mtx),
-      progress_info(other.progress_info),
       file_tracker_thread(std::move(other.file_tracker_thread)),
+      paused(other.paused.load()),
+      mb_hash_limit(other.mb_hash_limit.load()),
+      read_size_limit(other.read_size_limit.load()),
+      cpu_affinity(std::move(other.cpu_affinity)),
+      progress_info(other.progress_info),
+      fd_budget(other.fd_budget),
+      hardlink_map(other.hardlink_map),
+      rate_limiter(other.rate_limiter),
       file_scan_db(other.file_scan_db),
+      stmt_insert_dir(std::move(other.stmt_insert_dir)),
       stmt_insert_file(std::move(other.stmt_insert_file)),
       stmt_insert_version(std::move(other.stmt_insert_version)),
+      stmt_retire_versions(std::move(other.stmt_retire_versions)),
       stmt_insert_scanset_entry(std::move(other.stmt_insert_scanset_entry)),
       stmt_insert_exif(std::move(other.stmt_insert_exif)),
+      stmt_upsert_scan_dir(std::move(other.stmt_upsert_scan_dir)),
+      stmt_find_dir(std::move(other.stmt_find_dir)),
       stmt_find_last_version(std::move(other.stmt_find_last_version)),
       stmt_find_scan_version(std::move(other.stmt_find_scan_version)),
+      stmt_update_verified_time(std::move(other.stmt_update_verified_time)),
+      stmt_insert_new_file(std::move(other.stmt_insert_new_file)),
       stmt_begin_txn(std::move(other.stmt_begin_txn)),
       stmt_commit_txn(std::move(other.stmt_commit_txn)),
       stmt_rollback_txn(std::move(other.stmt_rollback_txn)),
       EXIF_exts(std::move(other.EXIF_exts)),
       exif_reader(std::move(other.exif_reader)),
-      scanset_bitmap(std::move(other.scanset_bitmap))
+      scanset_bitmap(std::move(other.scanset_bitmap)),
+      dir_cache(std::move(other.dir_cache))
 #ifndef NO_SSE_AVX
-      , mb_hasher(*this, options.buffer_size, other.mb_hasher.max_jobs())
+      , stmt_find_hash_checkpoint(std::move(other.stmt_find_hash_checkpoint)),
+      stmt_delete_hash_checkpoint(std::move(other.stmt_delete_hash_checkpoint)),
+      stmt_save_hash_checkpoint(std::move(other.stmt_save_hash_checkpoint)),
+      stmt_update_fingerprint(std::move(other.stmt_update_fingerprint)),
+      mb_hasher(*this, options.buffer_size, other.mb_hasher.max_jobs())
 #endif
 {
    other.file_scan_db = nullptr;
+
+#ifndef NO_SSE_AVX
+   mb_hasher.set_start_handler(&file_tracker_t::start_file);
+
+   if(stmt_save_hash_checkpoint)
+      mb_hasher.set_checkpoint_handler(&file_tracker_t::save_hash_checkpoint, options.hash_checkpoint_interval);
+#endif
 }
 
 file_tracker_t::~file_tracker_t(void)
 {
    int errcode = SQLITE_OK;
 
+   if(stmt_find_dir) {
+      if((errcode = stmt_find_dir.finalize()) != SQLITE_OK)
+         print_stream.error("Cannot finalize SQLite statement to find a directory ({:s})", sqlite3_errstr(errcode));
+   }
+
    if(stmt_find_last_version) {
       if((errcode = stmt_find_last_version.finalize()) != SQLITE_OK)
          print_stream.error("Cannot finalize SQLite statement to find the last file version ({:s})", sqlite3_errstr(errcode));
@@ -146,6 +220,21 @@ file_tracker_t::~file_tracker_t(void)
          print_stream.error("Cannot finalize SQLite statement to find the base file version ({:s})", sqlite3_errstr(errcode));
    }
 
+   if(stmt_update_verified_time) {
+      if((errcode = stmt_update_verified_time.finalize()) != SQLITE_OK)
+         print_stream.error("Cannot finalize SQLite statement to update a verified time ({:s})", sqlite3_errstr(errcode));
+   }
+
+   if(stmt_insert_new_file) {
+      if((errcode = stmt_insert_new_file.finalize()) != SQLITE_OK)
+         print_stream.error("Cannot finalize SQLite statement to insert a new file ({:s})", sqlite3_errstr(errcode));
+   }
+
+   if(stmt_insert_dir) {
+      if((errcode = stmt_insert_dir.finalize()) != SQLITE_OK)
+         print_stream.error("Cannot finalize SQLite statement to insert a directory ({:s})", sqlite3_errstr(errcode));
+   }
+
    if(stmt_insert_file) {
       if((errcode = stmt_insert_file.finalize()) != SQLITE_OK)
          print_stream.error("Cannot finalize SQLite statement to insert a file ({:s})", sqlite3_errstr(errcode));
@@ -156,6 +245,11 @@ file_tracker_t::~file_tracker_t(void)
          print_stream.error("Cannot finalize SQLite statement to insert a version ({:s})", sqlite3_errstr(errcode));
    }
 
+   if(stmt_retire_versions) {
+      if((errcode = stmt_retire_versions.finalize()) != SQLITE_OK)
+         print_stream.error("Cannot finalize SQLite statement to retire versions ({:s})", sqlite3_errstr(errcode));
+   }
+
    if(stmt_insert_scanset_entry) {
       if((errcode = stmt_insert_scanset_entry.finalize()) != SQLITE_OK)
          print_stream.error("Cannot finalize SQLite statement to insert a scanset file ({:s})", sqlite3_errstr(errcode));
@@ -166,6 +260,11 @@ file_tracker_t::~file_tracker_t(void)
          print_stream.error("Cannot finalize SQLite statement to insert an EXIF record ({:s})", sqlite3_errstr(errcode));
    }
 
+   if(stmt_upsert_scan_dir) {
+      if((errcode = stmt_upsert_scan_dir.finalize()) != SQLITE_OK)
+         print_stream.error("Cannot finalize SQLite statement to update a scan directory ({:s})", sqlite3_errstr(errcode));
+   }
+
    if(stmt_begin_txn) {
       if((errcode = stmt_begin_txn.finalize()) != SQLITE_OK)
          print_stream.error("Cannot finalize SQLite statement to begin a transaction ({:s})", sqlite3_errstr(errcode));
@@ -181,6 +280,28 @@ file_tracker_t::~file_tracker_t(void)
          print_stream.error("Cannot finalize SQLite statement to rollback a transaction ({:s})", sqlite3_errstr(errcode));
    }
 
+#ifndef NO_SSE_AVX
+   if(stmt_find_hash_checkpoint) {
+      if((errcode = stmt_find_hash_checkpoint.finalize()) != SQLITE_OK)
+         print_stream.error("Cannot finalize SQLite statement to find a hash checkpoint ({:s})", sqlite3_errstr(errcode));
+   }
+
+   if(stmt_delete_hash_checkpoint) {
+      if((errcode = stmt_delete_hash_checkpoint.finalize()) != SQLITE_OK)
+         print_stream.error("Cannot finalize SQLite statement to delete a hash checkpoint ({:s})", sqlite3_errstr(errcode));
+   }
+
+   if(stmt_save_hash_checkpoint) {
+      if((errcode = stmt_save_hash_checkpoint.finalize()) != SQLITE_OK)
+         print_stream.error("Cannot finalize SQLite statement to save a hash checkpoint ({:s})", sqlite3_errstr(errcode));
+   }
+
+   if(stmt_update_fingerprint) {
+      if((errcode = stmt_update_fingerprint.finalize()) != SQLITE_OK)
+         print_stream.error("Cannot finalize SQLite statement to update a file fingerprint ({:s})", sqlite3_errstr(errcode));
+   }
+#endif
+
    if(file_scan_db) {
       if((errcode = sqlite3_close(file_scan_db)) != SQLITE_OK)
          print_stream.error("Failed to close the SQLite database ({:s})", sqlite3_errstr(errcode));
@@ -191,11 +312,29 @@ void file_tracker_t::init_scan_db_conn(void)
 {
    int errcode = SQLITE_OK;
 
-   if((errcode = sqlite3_open_v2(reinterpret_cast<const char*>(options.db_path.u8string().c_str()), &file_scan_db, SQLITE_OPEN_READWRITE, nullptr)) != SQLITE_OK)
-      throw std::runtime_error(sqlite3_errstr(errcode));
+   // a memory database keeps its rollback journal in memory and does not support WAL
+   if(options.memory_db_size.has_value()) {
+      if((errcode = sqlite3_open_v2(memory_db_t::MEMORY_DB_URI.data(), &file_scan_db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_URI, nullptr)) != SQLITE_OK)
+         throw std::runtime_error(sqlite3_errstr(errcode));
+   }
+   else if(options.verify_files && !options.scrub_files) {
+      bool immutable = options.immutable_db;
+
+      // verification without scrubbing never changes the database, which may be shared by all connections via the system file cache
+      if((errcode = open_sqlite_readonly(options.db_path, &file_scan_db, immutable)) != SQLITE_OK)
+         throw std::runtime_error(sqlite3_errstr(errcode));
+   }
+   else {
+      if((errcode = sqlite3_open_v2(reinterpret_cast<const char*>(options.db_path.u8string().c_str()), &file_scan_db, SQLITE_OPEN_READWRITE, nullptr)) != SQLITE_OK)
+         throw std::runtime_error(sqlite3_errstr(errcode));
 
-   if(!set_sqlite_journal_mode(file_scan_db, print_stream))
-      print_stream.warning("Cannot set SQLite journal mode to WAL (will run slower)");
+      if(!set_sqlite_journal_mode(file_scan_db, print_stream))
+         print_stream.warning("Cannot set SQLite journal mode to WAL (will run slower)");
+      else {
+         // WAL pages are copied into the database file by the checkpointer thread, so inserts do not wait for checkpoints
+         sqlite3_wal_hook(file_scan_db, wal_checkpointer_t::wal_hook_cb, nullptr);
+      }
+   }
 
    //
    // SQLite keeps calling sqlite_busy_handler_cb for this amount
@@ -214,18 +353,29 @@ void file_tracker_t::init_new_scan_stmts(void)
    int errcode = SQLITE_OK;
 
    //
-   // insert statement for new file records                  1    2     3
+   // Insert statement for new directory records. Another tracker may
+   // have inserted the same directory since it was looked up, which
+   // is ignored and the directory is looked up again.
+   //                                                       1         2
+   std::string_view sql_insert_dir = "INSERT INTO dirs (parent_id, name) VALUES (?, ?) "
+                                       "ON CONFLICT (parent_id, name) DO NOTHING"sv;
+
+   if((errcode = stmt_insert_dir.prepare(file_scan_db, sql_insert_dir)) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot prepare a SQLite statement to insert a directory ({:s})", sqlite3_errstr(errcode)));
+
    //
-   std::string_view sql_insert_file = "INSERT INTO files (name, ext, path) VALUES (?, ?, ?)"sv;
+   // insert statement for new file records                    1      2    3
+   //
+   std::string_view sql_insert_file = "INSERT INTO files (dir_id, name, ext) VALUES (?, ?, ?)"sv;
 
    if((errcode = stmt_insert_file.prepare(file_scan_db, sql_insert_file)) != SQLITE_OK)
       throw std::runtime_error(FMTNS::format("Cannot prepare a SQLite statement to insert a file ({:s})", sqlite3_errstr(errcode)));
 
    //
-   // insert statement for new file version records                   1        2         3           4          5          6     7        8
+   // insert statement for new file version records                   1        2         3           4          5          6     7        8            9             10
    //
-   std::string_view sql_insert_version = "INSERT INTO versions (file_id, version, mod_time, entry_size, read_size, hash_type, hash, exif_id) "
-                                          "VALUES (?, ?, ?, ?, ?, ?, ?, ?)"sv;
+   std::string_view sql_insert_version = "INSERT INTO versions (file_id, version, mod_time, entry_size, read_size, hash_type, hash, exif_id, fingerprint, verified_time) "
+                                          "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)"sv;
 
    if((errcode = stmt_insert_version.prepare(file_scan_db, sql_insert_version)) != SQLITE_OK)
       throw std::runtime_error(FMTNS::format("Cannot prepare a SQLite statement to insert a file version ({:s})", sqlite3_errstr(errcode)));
@@ -233,6 +383,14 @@ void file_tracker_t::init_new_scan_stmts(void)
    if((errcode = sqlite3_bind_text(stmt_insert_version, 6, HASH_TYPE.data(), static_cast<int>(HASH_TYPE.size()), SQLITE_TRANSIENT)) != SQLITE_OK)
       throw std::runtime_error(FMTNS::format("Cannot bind a hash type for a SQLite statement to insert a file version ({:s})", sqlite3_errstr(errcode)));
 
+   //
+   // update statement that removes earlier versions of a file from the scrub index                 1               2
+   //
+   std::string_view sql_retire_versions = "UPDATE versions SET verified_time = NULL WHERE file_id = ? AND version < ? AND verified_time IS NOT NULL"sv;
+
+   if((errcode = stmt_retire_versions.prepare(file_scan_db, sql_retire_versions)) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot prepare a SQLite statement to retire file versions ({:s})", sqlite3_errstr(errcode)));
+
    //
    // insert statement for scanset file records                            1           2
    //
@@ -269,6 +427,32 @@ void file_tracker_t::init_new_scan_stmts(void)
 
    if((errcode = stmt_insert_exif.prepare(file_scan_db, sql_insert_exif)) != SQLITE_OK)
       throw std::runtime_error(FMTNS::format("Cannot prepare a SQLite statement to insert an EXIF record ({:s})", sqlite3_errstr(errcode)));
+
+   //
+   // Totals of files directly in each directory are updated in the
+   // same transaction as scanset records, so they remain accurate
+   // for scans that are continued with -u. Rollup hashes cannot be
+   // added in SQL without overflowing 64-bit integers, so they are
+   // added by a function registered for this connection.
+   //
+   if((errcode = sqlite3_create_function_v2(file_scan_db, "fit_rollup_add", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, nullptr, sqlite_rollup_add_cb, nullptr, nullptr, nullptr)) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot register a SQLite function to add rollup hashes ({:s})", sqlite3_errstr(errcode)));
+
+   //
+   // insert or update statement for scan directories                                                                                                   1  2     3  4  5
+   //
+   std::string_view sql_upsert_scan_dir = "INSERT INTO scan_dirs (scan_id, dir_id, dir_file_count, dir_size, dir_max_mod_time, dir_rollup_hash) VALUES (?, ?, 1, ?, ?, ?) "
+                                             "ON CONFLICT (scan_id, dir_id) DO UPDATE SET "
+                                                "dir_file_count = dir_file_count + 1, "
+                                                "dir_size = dir_size + excluded.dir_size, "
+                                                "dir_max_mod_time = max(coalesce(dir_max_mod_time, excluded.dir_max_mod_time), excluded.dir_max_mod_time), "
+                                                "dir_rollup_hash = fit_rollup_add(dir_rollup_hash, excluded.dir_rollup_hash)"sv;
+
+   if((errcode = stmt_upsert_scan_dir.prepare(file_scan_db, sql_upsert_scan_dir)) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot prepare a SQLite statement to update a scan directory ({:s})", sqlite3_errstr(errcode)));
+
+   if((errcode = sqlite3_bind_int64(stmt_upsert_scan_dir, 1, scan_id.value())) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot bind a scan ID for a SQLite statement to update a scan directory ({:s})", sqlite3_errstr(errcode)));
 }
 
 void file_tracker_t::init_transaction_stmts(void)
@@ -298,6 +482,19 @@ void file_tracker_t::init_base_scan_stmts(void)
 {
    int errcode = SQLITE_OK;
 
+   //
+   // A select statement to look up a directory by its name and its
+   // parent directory, which is used to find directory identifiers
+   // of file paths.
+   //
+   // columns:                                 0
+   std::string_view sql_find_dir = "SELECT id FROM dirs "
+   // parameters:                                    1            2
+                                       "WHERE parent_id = ? AND name = ?"sv;
+
+   if((errcode = stmt_find_dir.prepare(file_scan_db, sql_find_dir)) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot prepare a SQLite statement to find a directory ({:s})", sqlite3_errstr(errcode)));
+
    //
    // A select statement to look-up the latest file version by
    // file path (used only when a new or an interrupted scanset
@@ -325,11 +522,11 @@ void file_tracker_t::init_base_scan_stmts(void)
    // a file record cannot exist without a version record and if
    // there's any version record, there will be a file record).
    // 
-   // columns:                                            0         1          2     3               4        5        6               7
-   std::string_view sql_find_last_version = "SELECT version, mod_time, hash_type, hash, versions.rowid, file_id, scan_id, scansets.rowid "
+   // columns:                                            0         1          2     3               4        5        6               7           8            9
+   std::string_view sql_find_last_version = "SELECT version, mod_time, hash_type, hash, versions.rowid, file_id, scan_id, scansets.rowid, entry_size, fingerprint "
                                        "FROM versions JOIN files ON file_id = files.rowid JOIN scansets ON version_id = versions.rowid "
-   // parameters:                                    1
-                                       "WHERE path = ? "
+   // parameters:                                      1                  2
+                                       "WHERE dir_id = ? AND files.name = ? "
                                        "ORDER BY version DESC, scan_id DESC LIMIT 1"sv;
 
    if((errcode = stmt_find_last_version.prepare(file_scan_db, sql_find_last_version)) != SQLITE_OK)
@@ -339,16 +536,122 @@ void file_tracker_t::init_base_scan_stmts(void)
    // A select statement to look up a file version by file path
    // and a specific scan identifier (used only for verifications).
    // 
-   // columns:                                                 0         1          2     3               4        5        6               7
-   std::string_view sql_find_scan_file_version = "SELECT version, mod_time, hash_type, hash, versions.rowid, file_id, scan_id, scansets.rowid "
+   // columns:                                                 0         1          2     3               4        5        6               7           8            9
+   std::string_view sql_find_scan_file_version = "SELECT version, mod_time, hash_type, hash, versions.rowid, file_id, scan_id, scansets.rowid, entry_size, fingerprint "
                                        "FROM versions JOIN files ON file_id = files.rowid JOIN scansets ON version_id = versions.rowid "
-   // parameters:                                    1               2
-                                       "WHERE path = ? AND scan_id = ?"sv;
+   // parameters:                                      1                  2               3
+                                       "WHERE dir_id = ? AND files.name = ? AND scan_id = ?"sv;
 
    if((errcode = stmt_find_scan_version.prepare(file_scan_db, sql_find_scan_file_version)) != SQLITE_OK)
       throw std::runtime_error(FMTNS::format("Cannot prepare a SQLite statement to find the base file version ({:s})", sqlite3_errstr(errcode)));
 }
 
+void file_tracker_t::init_scrub_stmts(void)
+{
+   int errcode = SQLITE_OK;
+
+   //
+   // update statement for versions of files verified in a scrub                1              2
+   //
+   std::string_view sql_update_verified_time = "UPDATE versions SET verified_time = ? WHERE rowid = ?"sv;
+
+   if((errcode = stmt_update_verified_time.prepare(file_scan_db, sql_update_verified_time)) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot prepare a SQLite statement to update a verified time ({:s})", sqlite3_errstr(errcode)));
+}
+
+//
+// New files found while tracking removed files are reported after the
+// scan, so they can be matched against removed files with the same
+// hash. They are kept in a temporary table of this connection, which
+// SQLite moves to a temporary file when it outgrows the page cache,
+// so scans against an unrelated base scan, which find every file as
+// new, do not keep all file paths in memory. Temporary tables can be
+// created in read-only connections used in verification scans.
+//
+void file_tracker_t::init_new_file_stmts(void)
+{
+   int errcode = SQLITE_OK;
+
+   char *errmsg = nullptr;
+
+   // hash is NULL for zero-length files, which are never matched against removed files
+   if(sqlite3_exec(file_scan_db, "CREATE TEMP TABLE new_files (filepath TEXT NOT NULL, file_size INTEGER NOT NULL, hash TEXT)", nullptr, nullptr, &errmsg) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot create a table for new files ({:s})", std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get()));
+
+   //
+   // insert statement for new files                                                         1           2      3
+   //
+   std::string_view sql_insert_new_file = "INSERT INTO temp.new_files (filepath, file_size, hash) VALUES (?, ?, ?)"sv;
+
+   if((errcode = stmt_insert_new_file.prepare(file_scan_db, sql_insert_new_file)) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot prepare a SQLite statement to insert a new file ({:s})", sqlite3_errstr(errcode)));
+}
+
+void file_tracker_t::init_hash_checkpoint_stmts(void)
+{
+#ifndef NO_SSE_AVX
+   int errcode = SQLITE_OK;
+
+   //
+   // A select statement to look up a hash checkpoint saved for
+   // a file in the current scan while it was being hashed, before
+   // the scan was interrupted.
+   // 
+   // columns:                                                0           1           2          3            4           5
+   std::string_view sql_find_hash_checkpoint = "SELECT mod_time, entry_size, file_inode, hash_type, hashed_size, hash_state "
+                                       "FROM hash_checkpoints "
+   // parameters:                                    1             2
+                                       "WHERE scan_id = ? AND path = ?"sv;
+
+   if((errcode = stmt_find_hash_checkpoint.prepare(file_scan_db, sql_find_hash_checkpoint)) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot prepare a SQLite statement to find a hash checkpoint ({:s})", sqlite3_errstr(errcode)));
+
+   if((errcode = sqlite3_bind_int64(stmt_find_hash_checkpoint, 1, scan_id.value())) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot bind a scan ID for a SQLite statement to find a hash checkpoint ({:s})", sqlite3_errstr(errcode)));
+
+   //
+   // delete statement for hash checkpoints of hashed files                                  1             2
+   //
+   std::string_view sql_delete_hash_checkpoint = "DELETE FROM hash_checkpoints WHERE scan_id = ? AND path = ?"sv;
+
+   if((errcode = stmt_delete_hash_checkpoint.prepare(file_scan_db, sql_delete_hash_checkpoint)) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot prepare a SQLite statement to delete a hash checkpoint ({:s})", sqlite3_errstr(errcode)));
+
+   if((errcode = sqlite3_bind_int64(stmt_delete_hash_checkpoint, 1, scan_id.value())) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot bind a scan ID for a SQLite statement to delete a hash checkpoint ({:s})", sqlite3_errstr(errcode)));
+
+   //
+   // insert statement for hash checkpoints, replacing any previous checkpoint for the same file
+   //                                                                        1     2         3           4           5          6            7           8                9
+   std::string_view sql_save_hash_checkpoint = "INSERT OR REPLACE INTO hash_checkpoints (scan_id, path, mod_time, entry_size, file_inode, hash_type, hashed_size, hash_state, checkpoint_time) "
+                                                "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)"sv;
+
+   if((errcode = stmt_save_hash_checkpoint.prepare(file_scan_db, sql_save_hash_checkpoint)) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot prepare a SQLite statement to save a hash checkpoint ({:s})", sqlite3_errstr(errcode)));
+
+   if((errcode = sqlite3_bind_int64(stmt_save_hash_checkpoint, 1, scan_id.value())) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot bind a scan ID for a SQLite statement to save a hash checkpoint ({:s})", sqlite3_errstr(errcode)));
+
+   if((errcode = sqlite3_bind_text(stmt_save_hash_checkpoint, 6, HASH_TYPE.data(), static_cast<int>(HASH_TYPE.size()), SQLITE_TRANSIENT)) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot bind a hash type for a SQLite statement to save a hash checkpoint ({:s})", sqlite3_errstr(errcode)));
+#endif
+}
+
+void file_tracker_t::init_fingerprint_stmts(void)
+{
+#ifndef NO_SSE_AVX
+   int errcode = SQLITE_OK;
+
+   //
+   // update statement for fingerprints of existing versions recorded without one   1              2
+   //
+   std::string_view sql_update_fingerprint = "UPDATE versions SET fingerprint = ? WHERE rowid = ?"sv;
+
+   if((errcode = stmt_update_fingerprint.prepare(file_scan_db, sql_update_fingerprint)) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot prepare a SQLite statement to update a file fingerprint ({:s})", sqlite3_errstr(errcode)));
+#endif
+}
+
 time_t file_tracker_t::file_time_to_time_t(const std::chrono::file_clock::time_point& file_time)
 {
 #if defined(_MSC_VER) || (defined(__GNUC__) && __GNUC__ >= 13)
@@ -417,10 +720,33 @@ bool file_tracker_t::set_sqlite_journal_mode(sqlite3 *file_scan_db, print_stream
    return have_wal;
 }
 
+//
+// Completed scans record the range of their scanset identifiers in
+// the scan record and the range of other scans is looked up at both
+// ends of the scan range in ix_scansets_scan.
+//
 std::tuple<uint64_t, uint64_t> file_tracker_t::get_scanset_rowid_range(sqlite3 *file_scan_db, int64_t scan_id)
 {
    int errcode = SQLITE_OK;
 
+   sqlite_stmt_t stmt_scan_range("scanset range"sv);
+
+   //                                                                                                   1
+   std::string_view sql_scan_range = "SELECT first_scanset_id, last_scanset_id FROM scans WHERE rowid = ?"sv;
+
+   if((errcode = stmt_scan_range.prepare(file_scan_db, sql_scan_range)) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot prepare a statement to select the scanset range for scan {:d} ({:s})"sv, scan_id, sqlite3_errstr(errcode)));
+
+   sqlite_param_binder_t scan_range_stmt = stmt_scan_range.get_param_binder();
+
+   scan_range_stmt.bind_param(scan_id);
+
+   if((errcode = sqlite3_step(stmt_scan_range)) != SQLITE_ROW)
+      throw std::runtime_error(FMTNS::format("Cannot select the scanset range for scan {:d} ({:s})"sv, scan_id, sqlite3_errstr(errcode)));
+
+   if(sqlite3_column_type(stmt_scan_range, 0) != SQLITE_NULL && sqlite3_column_type(stmt_scan_range, 1) != SQLITE_NULL)
+      return std::make_tuple(static_cast<uint64_t>(sqlite3_column_int64(stmt_scan_range, 0)), static_cast<uint64_t>(sqlite3_column_int64(stmt_scan_range, 1)));
+
    std::array<uint64_t, 2> scanset_rowid_range = {0};
 
    for(size_t i = 0; i < sizeof(scanset_rowid_range)/sizeof(scanset_rowid_range)[0]; i++) {
@@ -464,9 +790,12 @@ void file_tracker_t::hash_file(const std::filesystem::path& filepath, uint64_t&
 
    size_t lastread = 0;
 
-   while((lastread = std::fread(file_buffer.get(), 1, options.buffer_size, file.get())) != 0) {
+   while((lastread = std::fread(file_buffer.get(), 1, std::min(options.buffer_size, read_size_limit.load()), file.get())) != 0) {
       sha256_update(&ctx, file_buffer.get(), lastread);
       filesize += lastread;
+      progress_info.read_size += lastread;
+
+      rate_limiter.take_bytes(lastread, abort_scan);
    }
 
    if(std::ferror(file.get()))
@@ -487,41 +816,141 @@ void file_tracker_t::hash_file(const std::filesystem::path& filepath, uint64_t&
    }
 }
 #else
-file_tracker_t::mb_file_hasher_t::param_tuple_t file_tracker_t::open_file(version_record_result_t&& version_record, std::filesystem::directory_entry&& dir_entry) const
+//
+// Files are not opened when hash jobs are submitted, but rather in
+// start_file, right before the first data block is read, so jobs
+// waiting to be started do not hold file descriptors.
+//
+file_tracker_t::mb_file_hasher_t::param_tuple_t file_tracker_t::open_file(version_record_result_t&& version_record, std::filesystem::directory_entry&& dir_entry, std::optional<file_link_id_t>&& link_id) const
 {
-   //
-   // The narrow character version of fopen will fail to open files
-   // with names containing characters that cannot be converted to
-   // the current Windows character set. Use the non-standard
-   // _wfopen to work around this problem.
-   //
-   #ifdef _WIN32
-   std::unique_ptr<FILE, file_handle_deleter_t> file(_wfopen(dir_entry.path().wstring().c_str(), L"rb"));
-   #else
-   std::unique_ptr<FILE, file_handle_deleter_t> file(fopen(reinterpret_cast<const char*>(dir_entry.path().u8string().c_str()), "rb"));
-   #endif
+   // FILE*, file_size, version_record, dir_entry, file_read_error_t, hash_checkpoint, fingerprint_pass, fingerprint, link_id
+   return std::make_tuple(std::unique_ptr<FILE, budget_file_deleter_t>(), 0, std::move(version_record), std::move(dir_entry), std::nullopt, false, false, std::nullopt, std::move(link_id));
+}
 
-   if(!file)
-      throw std::runtime_error(FMTNS::format("Cannot open a file ({:s})", strerror(errno)));
+file_tracker_t::mb_file_hasher_t::param_tuple_t file_tracker_t::open_file_at(version_record_result_t&& version_record, std::filesystem::directory_entry&& dir_entry, uint64_t&& offset, std::optional<file_link_id_t>&& link_id) const
+{
+   mb_file_hasher_t::param_tuple_t args = open_file(std::move(version_record), std::move(dir_entry), std::move(link_id));
+
+   // the hashed file size includes data hashed before the checkpoint and is used as a file offset in start_file
+   std::get<mbh_arg_file_size>(args) = offset;
+   std::get<mbh_arg_hash_checkpoint>(args) = true;
+
+   return args;
+}
+
+file_tracker_t::mb_file_hasher_t::param_tuple_t file_tracker_t::open_file_sampled(version_record_result_t&& version_record, std::filesystem::directory_entry&& dir_entry, std::optional<file_link_id_t>&& link_id) const
+{
+   mb_file_hasher_t::param_tuple_t args = open_file(std::move(version_record), std::move(dir_entry), std::move(link_id));
+
+   std::get<mbh_arg_fingerprint_pass>(args) = true;
+
+   return args;
+}
+
+file_tracker_t::mb_file_hasher_t::param_tuple_t file_tracker_t::open_file_fingerprinted(version_record_result_t&& version_record, std::filesystem::directory_entry&& dir_entry, std::string&& fingerprint, std::optional<file_link_id_t>&& link_id) const
+{
+   mb_file_hasher_t::param_tuple_t args = open_file(std::move(version_record), std::move(dir_entry), std::move(link_id));
+
+   // keep the fingerprint computed in the fingerprint pass, so it can be recorded along with the file hash
+   std::get<mbh_arg_fingerprint>(args) = std::move(fingerprint);
+
+   return args;
+}
+
+//
+// Opens the file for a hash job within the file descriptor budget.
+// If `wait` is `false` and the budget is exhausted, the job is not
+// started and `false` is returned. If the file cannot be opened,
+// the error is stored in job arguments and will be reported when
+// the job is completed.
+//
+bool file_tracker_t::start_file(mb_file_hasher_t::param_tuple_t& args, bool wait) const noexcept
+{
+   try {
+      if(!fd_budget.try_acquire()) {
+         if(!wait || !fd_budget.acquire(abort_scan))
+            return false;
+      }
+
+      const std::filesystem::directory_entry& dir_entry = std::get<mbh_arg_dir_entry>(args);
+
+      //
+      // The narrow character version of fopen will fail to open files
+      // with names containing characters that cannot be converted to
+      // the current Windows character set. Use the non-standard
+      // _wfopen to work around this problem.
+      //
+      #ifdef _WIN32
+      FILE *file_handle = _wfopen(dir_entry.path().wstring().c_str(), L"rb");
+      #else
+      FILE *file_handle = fopen(reinterpret_cast<const char*>(dir_entry.path().u8string().c_str()), "rb");
+      #endif
+
+      if(!file_handle) {
+         int open_errno = errno;
+
+         fd_budget.release();
+
+         throw std::runtime_error(FMTNS::format("Cannot open a file ({:s})", strerror(open_errno)));
+      }
+
+      std::unique_ptr<FILE, budget_file_deleter_t>& file = std::get<mbh_arg_file_handle>(args);
+
+      // the file descriptor will be returned to the budget when the file is closed
+      file = std::unique_ptr<FILE, budget_file_deleter_t>(file_handle, budget_file_deleter_t{&fd_budget});
+
+      // continue reading after the data hashed before a hash checkpoint, if there is one
+      uint64_t offset = std::get<mbh_arg_file_size>(args);
+
+      if(offset && !seek_file(file.get(), offset))
+         throw std::runtime_error(FMTNS::format("Cannot seek to a hash checkpoint at {:d} ({:s})", offset, strerror(errno)));
+   }
+   catch (const std::exception& error) {
+      std::get<mbh_arg_file_read_error>(args).emplace(error.what());
+      std::get<mbh_arg_file_handle>(args).reset();
+   }
+   catch (...) {
+      std::get<mbh_arg_file_read_error>(args).emplace(FMTNS::format("Unexpected error caught while opening {:s}", u8sv(std::get<mbh_arg_dir_entry>(args).path().u8string())));
+      std::get<mbh_arg_file_handle>(args).reset();
+   }
 
-   // FILE*, file_size, version_record, dir_entry, file_read_error_t
-   return std::make_tuple(std::move(file), 0, std::move(version_record), std::move(dir_entry), std::nullopt);
+   return true;
 }
 
 bool file_tracker_t::read_file(unsigned char *file_buffer, size_t buf_size, size_t& data_size, mb_file_hasher_t::param_tuple_t& args) const noexcept
 {
+   // if the file could not be opened in start_file, keep the original error
+   if(std::get<mbh_arg_file_read_error>(args).has_value()) {
+      data_size = 0;
+      std::get<mbh_arg_file_size>(args) = 0;
+      return false;
+   }
+
    try {
-      std::unique_ptr<FILE, file_handle_deleter_t>& file = std::get<mbh_arg_file_handle>(args);
+      std::unique_ptr<FILE, budget_file_deleter_t>& file = std::get<mbh_arg_file_handle>(args);
       uint64_t& file_size = std::get<mbh_arg_file_size>(args);
 
-      data_size = std::fread(file_buffer, 1, buf_size, file.get());
+      if(!file)
+         throw std::logic_error("Cannot read a file that is not open");
+
+      data_size = std::fread(file_buffer, 1, std::min(buf_size, read_size_limit.load()), file.get());
 
       if(std::ferror(file.get()))
          throw std::runtime_error(FMTNS::format("Cannot read a file ({:s})", strerror(errno)));
 
       file_size += data_size;
 
-      return feof(file.get()) == 0;
+      progress_info.read_size += data_size;
+
+      rate_limiter.take_bytes(data_size, abort_scan);
+
+      // release the file handle as soon as all data is read, so it is not held while the last block is being hashed
+      if(feof(file.get())) {
+         file.reset();
+         return false;
+      }
+
+      return true;
    }
    catch (const std::exception& error) {
       // std::optional<file_read_error_t>
@@ -537,100 +966,294 @@ bool file_tracker_t::read_file(unsigned char *file_buffer, size_t buf_size, size
    // reset the number of bytes read so far because it is irrelevant and misleading in this case
    std::get<mbh_arg_file_size>(args) = 0;
 
+   std::get<mbh_arg_file_handle>(args).reset();
+
    return false;
 }
-#endif      
 
-int64_t file_tracker_t::insert_file_record(const std::u8string& filepath, const std::filesystem::directory_entry& dir_entry)
+//
+// Reads FINGERPRINT_BLOCK_COUNT blocks of FINGERPRINT_BLOCK_SIZE
+// bytes from the file being fingerprinted, at offsets computed by
+// get_fingerprint_block_offset. The file size in job arguments
+// tracks the amount of sampled data, which determines the block
+// being read and the offset within that block.
+//
+bool file_tracker_t::read_file_sampled(unsigned char *file_buffer, size_t buf_size, size_t& data_size, mb_file_hasher_t::param_tuple_t& args) const noexcept
 {
-   int64_t file_id = 0;
-   int errcode = SQLITE_OK;
+   // same as in read_file
+   if(std::get<mbh_arg_file_read_error>(args).has_value()) {
+      data_size = 0;
+      std::get<mbh_arg_file_size>(args) = 0;
+      return false;
+   }
 
-   sqlite_param_binder_t insert_file_stmt = stmt_insert_file.get_param_binder();
+   try {
+      std::unique_ptr<FILE, budget_file_deleter_t>& file = std::get<mbh_arg_file_handle>(args);
+      uint64_t& file_size = std::get<mbh_arg_file_size>(args);
 
-   insert_file_stmt.bind_param(dir_entry.path().filename().u8string());
+      if(!file)
+         throw std::logic_error("Cannot sample a file that is not open");
 
-   if(dir_entry.path().extension().empty())
-      insert_file_stmt.bind_param(nullptr);
-   else
-      insert_file_stmt.bind_param(dir_entry.path().extension().u8string());
+      size_t block_index = static_cast<size_t>(file_size / FINGERPRINT_BLOCK_SIZE);
+      size_t block_offset = static_cast<size_t>(file_size % FINGERPRINT_BLOCK_SIZE);
 
-   insert_file_stmt.bind_param(filepath);
-            
-   if((errcode = sqlite3_step(stmt_insert_file)) != SQLITE_DONE)
-      throw std::runtime_error(FMTNS::format("Cannot insert a file record for {:s} ({:s})", u8sv(filepath), sqlite3_errstr(errcode)));
+      // reposition the file only when starting a new block, so smaller buffers can read blocks sequentially
+      if(!block_offset) {
+         uint64_t offset = get_fingerprint_block_offset(block_index, std::get<mbh_arg_dir_entry>(args).file_size());
 
-   file_id = sqlite3_last_insert_rowid(file_scan_db);
+         if(!seek_file(file.get(), offset))
+            throw std::runtime_error(FMTNS::format("Cannot seek to a sampled block at {:d} ({:s})", offset, strerror(errno)));
+      }
 
-   insert_file_stmt.reset();
+      size_t read_size = std::min(buf_size, FINGERPRINT_BLOCK_SIZE - block_offset);
 
-   return file_id;
-}
+      data_size = std::fread(file_buffer, 1, read_size, file.get());
 
-int64_t file_tracker_t::insert_exif_record(const std::u8string& filepath, const std::vector<exif::field_value_t>& exif_fields, const exif::field_bitset_t& field_bitset)
-{
-   int64_t exif_id = 0;
+      if(std::ferror(file.get()))
+         throw std::runtime_error(FMTNS::format("Cannot read a file ({:s})", strerror(errno)));
 
-   int errcode = SQLITE_OK;
+      // sampled blocks are always within the file, unless it was truncated after it was queued
+      if(data_size != read_size)
+         throw std::runtime_error("A file was truncated while being sampled");
 
-   sqlite_param_binder_t insert_exif_stmt = stmt_insert_exif.get_param_binder();
+      file_size += data_size;
 
-   for(size_t i = 0; i < exif_fields.size(); i++) {
-      if(!field_bitset.test(i))
-         insert_exif_stmt.bind_param(nullptr);
-      else {
-         if(std::holds_alternative<int64_t>(exif_fields[i]))
-            insert_exif_stmt.bind_param(std::get<int64_t>(exif_fields[i]));
-         else if(std::holds_alternative<std::u8string>(exif_fields[i]))
-            insert_exif_stmt.bind_param(std::get<std::u8string>(exif_fields[i]));
-         else
-            throw std::runtime_error(FMTNS::format("Bad field value in EXIF record for {:s} ({:d})", u8sv(filepath), i));
+      progress_info.read_size += data_size;
+
+      rate_limiter.take_bytes(data_size, abort_scan);
+
+      if(file_size == FINGERPRINT_BLOCK_COUNT * FINGERPRINT_BLOCK_SIZE) {
+         file.reset();
+         return false;
       }
+
+      return true;
+   }
+   catch (const std::exception& error) {
+      // std::optional<file_read_error_t>
+      std::get<mbh_arg_file_read_error>(args).emplace(error.what());
+   }
+   catch (...) {
+      std::get<mbh_arg_file_read_error>(args).emplace(FMTNS::format("Unexpected error caught while sampling {:s}", u8sv(std::get<mbh_arg_dir_entry>(args).path().u8string())));
    }
 
-   if((errcode = sqlite3_step(stmt_insert_exif)) != SQLITE_DONE)
-      throw std::runtime_error(FMTNS::format("Cannot insert an EXIF record for {:s} ({:s})", u8sv(filepath), sqlite3_errstr(errcode)));
+   data_size = 0;
 
-   // get the row ID for the new EXIF record
-   exif_id = sqlite3_last_insert_rowid(file_scan_db);
+   std::get<mbh_arg_file_size>(args) = 0;
 
-   insert_exif_stmt.reset();
+   std::get<mbh_arg_file_handle>(args).reset();
 
-   return exif_id;
+   return false;
 }
 
-file_tracker_t::version_record_result_t file_tracker_t::select_version_record(const std::u8string& filepath)
+//
+// Hash states are stored as a blob, with digest words in the byte
+// order used by isa-l_crypto, followed by bytes of the partial hash
+// block, if there are any. Saving a checkpoint is not considered as
+// critical and failures are reported as warnings, so the file can
+// still be hashed.
+//
+void file_tracker_t::save_hash_checkpoint(const mb_file_hasher_t::hash_state_t& hash_state, mb_file_hasher_t::param_tuple_t& args) const noexcept
 {
-   int errcode = SQLITE_OK;
+   const std::filesystem::directory_entry& dir_entry = std::get<mbh_arg_dir_entry>(args);
 
-   // for regular scans select the latest available version and for verification select the one from base_scan_id, if one exists
-   sqlite_stmt_t& stmt_find_version = options.verify_files ? stmt_find_scan_version : stmt_find_last_version;
+   try {
+      int errcode = SQLITE_OK;
 
-   sqlite_param_binder_t find_version_stmt = stmt_find_version.get_param_binder();
+      unsigned char hash_state_blob[sizeof(hash_state.digest) + sizeof(hash_state.partial_block)];
 
-   find_version_stmt.bind_param(filepath);
+      memcpy(hash_state_blob, hash_state.digest, sizeof(hash_state.digest));
+      memcpy(hash_state_blob + sizeof(hash_state.digest), hash_state.partial_block, hash_state.partial_block_length);
 
-   if(options.verify_files)
-      find_version_stmt.bind_param(base_scan_id.value());
+      std::optional<uint64_t> file_inode = get_file_inode(std::get<mbh_arg_file_handle>(args).get());
 
-   errcode = sqlite3_step(stmt_find_version);
+      sqlite_param_binder_t save_hash_checkpoint_stmt = stmt_save_hash_checkpoint.get_param_binder();
 
-   if(errcode != SQLITE_DONE && errcode != SQLITE_ROW)
-      throw std::runtime_error(FMTNS::format("Failed to find a version for {:s} ({:s})"sv, u8sv(filepath), sqlite3_errstr(errcode)));
+      // scan_id
+      save_hash_checkpoint_stmt.skip_param();
 
-   if(errcode == SQLITE_DONE)
-      return version_record_result_t{std::nullopt};
+      if(options.base_path.empty())
+         save_hash_checkpoint_stmt.bind_param(dir_entry.path().u8string());
+      else
+         save_hash_checkpoint_stmt.bind_param(dir_entry.path().lexically_relative(options.base_path).u8string());
 
-   version_record_result_t version_record_result{std::make_optional<version_record_t>(stmt_find_version)};
+      save_hash_checkpoint_stmt.bind_param(static_cast<int64_t>(file_time_to_time_t(dir_entry.last_write_time())));
+      save_hash_checkpoint_stmt.bind_param(static_cast<int64_t>(dir_entry.file_size()));
 
-   //
-   // Reset the select statement to release read locks acquired above
-   // before starting a transaction. Without this step, some insert
-   // statements will fail with SQLITE_BUSY because of possible
-   // resource deadlocks, which are reported immediately and without
-   // calling the busy handler.
-   //
-   find_version_stmt.reset();
+      if(file_inode.has_value())
+         save_hash_checkpoint_stmt.bind_param(static_cast<int64_t>(file_inode.value()));
+      else
+         save_hash_checkpoint_stmt.bind_param(nullptr);
+
+      // hash_type
+      save_hash_checkpoint_stmt.skip_param();
+
+      save_hash_checkpoint_stmt.bind_param(static_cast<int64_t>(hash_state.total_length));
+      save_hash_checkpoint_stmt.bind_param(hash_state_blob, sizeof(hash_state.digest) + hash_state.partial_block_length);
+      save_hash_checkpoint_stmt.bind_param(std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()));
+
+      if((errcode = sqlite3_step(stmt_save_hash_checkpoint)) != SQLITE_DONE)
+         throw std::runtime_error(sqlite3_errstr(errcode));
+
+      std::get<mbh_arg_hash_checkpoint>(args) = true;
+   }
+   catch (const std::exception& error) {
+      print_stream.warning("Cannot save a hash checkpoint for \"{:s}\" ({:s})", u8sv(to_ascii_path(dir_entry.path())), error.what());
+   }
+   catch (...) {
+      print_stream.warning("Cannot save a hash checkpoint for \"{:s}\"", u8sv(to_ascii_path(dir_entry.path())));
+   }
+}
+#endif      
+
+std::optional<int64_t> file_tracker_t::select_dir_record(int64_t parent_id, const std::u8string& dir_name)
+{
+   int errcode = SQLITE_OK;
+
+   sqlite_param_binder_t find_dir_stmt = stmt_find_dir.get_param_binder();
+
+   find_dir_stmt.bind_param(parent_id);
+   find_dir_stmt.bind_param(dir_name);
+
+   errcode = sqlite3_step(stmt_find_dir);
+
+   if(errcode != SQLITE_DONE && errcode != SQLITE_ROW)
+      throw std::runtime_error(FMTNS::format("Failed to find a directory {:s} ({:s})"sv, u8sv(dir_name), sqlite3_errstr(errcode)));
+
+   if(errcode == SQLITE_DONE)
+      return std::nullopt;
+
+   return sqlite3_column_int64(stmt_find_dir, 0);
+}
+
+int64_t file_tracker_t::insert_dir_record(int64_t parent_id, const std::u8string& dir_name)
+{
+   int errcode = SQLITE_OK;
+
+   sqlite_param_binder_t insert_dir_stmt = stmt_insert_dir.get_param_binder();
+
+   insert_dir_stmt.bind_param(parent_id);
+   insert_dir_stmt.bind_param(dir_name);
+
+   if((errcode = sqlite3_step(stmt_insert_dir)) != SQLITE_DONE)
+      throw std::runtime_error(FMTNS::format("Cannot insert a directory record for {:s} ({:s})", u8sv(dir_name), sqlite3_errstr(errcode)));
+
+   if(sqlite3_changes(file_scan_db))
+      return sqlite3_last_insert_rowid(file_scan_db);
+
+   std::optional<int64_t> dir_id = select_dir_record(parent_id, dir_name);
+
+   if(!dir_id.has_value())
+      throw std::runtime_error(FMTNS::format("Cannot find an existing directory record for {:s}", u8sv(dir_name)));
+
+   return dir_id.value();
+}
+
+int64_t file_tracker_t::insert_file_record(const std::u8string& filepath, const std::filesystem::directory_entry& dir_entry)
+{
+   int64_t file_id = 0;
+   int errcode = SQLITE_OK;
+
+   // directories are inserted within the file transaction, so the directory insert is the first write that locks the database
+   int64_t dir_id = dir_cache.get_dir_id(filepath, std::filesystem::path::preferred_separator,
+         [this] (int64_t parent_id, const std::u8string& dir_name) {return insert_dir_record(parent_id, dir_name);});
+
+   sqlite_param_binder_t insert_file_stmt = stmt_insert_file.get_param_binder();
+
+   insert_file_stmt.bind_param(dir_id);
+
+   insert_file_stmt.bind_param(std::u8string_view(filepath).substr(dir_cache_t::get_file_name_offset(filepath, std::filesystem::path::preferred_separator)));
+
+   if(dir_entry.path().extension().empty())
+      insert_file_stmt.bind_param(nullptr);
+   else
+      insert_file_stmt.bind_param(dir_entry.path().extension().u8string());
+            
+   if((errcode = sqlite3_step(stmt_insert_file)) != SQLITE_DONE)
+      throw std::runtime_error(FMTNS::format("Cannot insert a file record for {:s} ({:s})", u8sv(filepath), sqlite3_errstr(errcode)));
+
+   file_id = sqlite3_last_insert_rowid(file_scan_db);
+
+   insert_file_stmt.reset();
+
+   return file_id;
+}
+
+int64_t file_tracker_t::insert_exif_record(const std::u8string& filepath, const std::vector<exif::field_value_t>& exif_fields, const exif::field_bitset_t& field_bitset)
+{
+   int64_t exif_id = 0;
+
+   int errcode = SQLITE_OK;
+
+   sqlite_param_binder_t insert_exif_stmt = stmt_insert_exif.get_param_binder();
+
+   for(size_t i = 0; i < exif_fields.size(); i++) {
+      if(!field_bitset.test(i))
+         insert_exif_stmt.bind_param(nullptr);
+      else {
+         if(std::holds_alternative<int64_t>(exif_fields[i]))
+            insert_exif_stmt.bind_param(std::get<int64_t>(exif_fields[i]));
+         else if(std::holds_alternative<std::u8string>(exif_fields[i]))
+            insert_exif_stmt.bind_param(std::get<std::u8string>(exif_fields[i]));
+         else
+            throw std::runtime_error(FMTNS::format("Bad field value in EXIF record for {:s} ({:d})", u8sv(filepath), i));
+      }
+   }
+
+   if((errcode = sqlite3_step(stmt_insert_exif)) != SQLITE_DONE)
+      throw std::runtime_error(FMTNS::format("Cannot insert an EXIF record for {:s} ({:s})", u8sv(filepath), sqlite3_errstr(errcode)));
+
+   // get the row ID for the new EXIF record
+   exif_id = sqlite3_last_insert_rowid(file_scan_db);
+
+   insert_exif_stmt.reset();
+
+   return exif_id;
+}
+
+file_tracker_t::version_record_result_t file_tracker_t::select_version_record(const std::u8string& filepath)
+{
+   int errcode = SQLITE_OK;
+
+   // file paths are queried with their original separators when using a database from another platform
+   char8_t path_sep = options.query_path_sep.value_or(std::filesystem::path::preferred_separator);
+
+   // there are no file records in a directory that was never recorded
+   std::optional<int64_t> dir_id = dir_cache.find_dir_id(filepath, path_sep,
+         [this] (int64_t parent_id, const std::u8string& dir_name) {return select_dir_record(parent_id, dir_name);});
+
+   if(!dir_id.has_value())
+      return version_record_result_t{std::nullopt};
+
+   // for regular scans select the latest available version and for verification select the one from base_scan_id, if one exists
+   sqlite_stmt_t& stmt_find_version = options.verify_files ? stmt_find_scan_version : stmt_find_last_version;
+
+   sqlite_param_binder_t find_version_stmt = stmt_find_version.get_param_binder();
+
+   find_version_stmt.bind_param(dir_id.value());
+   find_version_stmt.bind_param(std::u8string_view(filepath).substr(dir_cache_t::get_file_name_offset(filepath, path_sep)));
+
+   if(options.verify_files)
+      find_version_stmt.bind_param(base_scan_id.value());
+
+   errcode = sqlite3_step(stmt_find_version);
+
+   if(errcode != SQLITE_DONE && errcode != SQLITE_ROW)
+      throw std::runtime_error(FMTNS::format("Failed to find a version for {:s} ({:s})"sv, u8sv(filepath), sqlite3_errstr(errcode)));
+
+   if(errcode == SQLITE_DONE)
+      return version_record_result_t{std::nullopt};
+
+   version_record_result_t version_record_result{std::make_optional<version_record_t>(stmt_find_version)};
+
+   //
+   // Reset the select statement to release read locks acquired above
+   // before starting a transaction. Without this step, some insert
+   // statements will fail with SQLITE_BUSY because of possible
+   // resource deadlocks, which are reported immediately and without
+   // calling the busy handler.
+   //
+   find_version_stmt.reset();
 
    if(version_record_result.hexhash().has_value()) {
       if(version_record_result.hash_type() == HASH_TYPE) {
@@ -644,7 +1267,7 @@ file_tracker_t::version_record_result_t file_tracker_t::select_version_record(co
    return version_record_result;
 }
 
-int64_t file_tracker_t::insert_version_record(const std::u8string& filepath, int64_t file_id, int64_t version, int64_t filesize, const std::filesystem::directory_entry& dir_entry, unsigned char hexhash_file[], std::optional<int64_t> exif_id)
+int64_t file_tracker_t::insert_version_record(const std::u8string& filepath, int64_t file_id, int64_t version, int64_t filesize, const std::filesystem::directory_entry& dir_entry, unsigned char hexhash_file[], std::optional<int64_t> exif_id, const std::optional<std::string>& fingerprint)
 {
    int64_t version_id = 0;
 
@@ -686,6 +1309,14 @@ int64_t file_tracker_t::insert_version_record(const std::u8string& filepath, int
    else
       insert_version_stmt.bind_param(nullptr);
 
+   if(fingerprint.has_value())
+      insert_version_stmt.bind_param(std::u8string_view(reinterpret_cast<const char8_t*>(fingerprint.value().data()), fingerprint.value().size()));
+   else
+      insert_version_stmt.bind_param(nullptr);
+
+   // file data was just hashed, so new versions are not scrubbed before versions that were verified earlier
+   insert_version_stmt.bind_param(static_cast<int64_t>(std::chrono::system_clock::to_time_t(std::chrono::system_clock::now())));
+
    //
    // If we get SQLITE_BUSY after the busy handler runs for allowed
    // amount of time, report this file as failed. The most likely
@@ -700,6 +1331,23 @@ int64_t file_tracker_t::insert_version_record(const std::u8string& filepath, int
 
    insert_version_stmt.reset();
 
+   //
+   // Earlier versions of this file cannot be scrubbed against their
+   // hashes anymore and are removed from the partial verified_time
+   // index, so scrubs do not step over them in every run.
+   //
+   if(version > 1) {
+      sqlite_param_binder_t retire_versions_stmt = stmt_retire_versions.get_param_binder();
+
+      retire_versions_stmt.bind_param(file_id);
+      retire_versions_stmt.bind_param(version);
+
+      if((errcode = sqlite3_step(stmt_retire_versions)) != SQLITE_DONE)
+         throw std::runtime_error(FMTNS::format("Cannot retire earlier versions of {:s} ({:s})", u8sv(filepath), sqlite3_errstr(errcode)));
+
+      retire_versions_stmt.reset();
+   }
+
    return version_id;
 }
 
@@ -720,6 +1368,176 @@ void file_tracker_t::insert_scanset_record(const std::u8string& filepath, int64_
    insert_scanset_file_stmt.reset();
 }
 
+//
+// Records a new file, which is reported after removed files are known.
+// `hexhash_file` is `nullptr` for zero-length files.
+//
+void file_tracker_t::insert_new_file_record(const std::u8string& filepath, uint64_t file_size, unsigned char hexhash_file[])
+{
+   int errcode = SQLITE_OK;
+
+   sqlite_param_binder_t insert_new_file_stmt = stmt_insert_new_file.get_param_binder();
+
+   insert_new_file_stmt.bind_param(filepath);
+   insert_new_file_stmt.bind_param(static_cast<int64_t>(file_size));
+
+   if(!hexhash_file)
+      insert_new_file_stmt.bind_param(nullptr);
+   else
+      insert_new_file_stmt.bind_param(std::u8string_view(reinterpret_cast<const char8_t*>(hexhash_file), HASH_HEX_SIZE));
+
+   if((errcode = sqlite3_step(stmt_insert_new_file)) != SQLITE_DONE)
+      throw std::runtime_error(FMTNS::format("Cannot insert a new file record for {:s} ({:s})", u8sv(filepath), sqlite3_errstr(errcode)));
+
+   insert_new_file_stmt.reset();
+}
+
+//
+// Adds a file to the totals of its directory in the current scan.
+// The file name and hash are added to the rollup hash, so identical
+// directories have the same rollup hash.
+//
+void file_tracker_t::upsert_scan_dir_record(const std::u8string& filepath, const std::filesystem::directory_entry& dir_entry, int64_t filesize, unsigned char hexhash_file[])
+{
+   int errcode = SQLITE_OK;
+
+   // the directory record was inserted with the file record, if it was not in the database
+   int64_t dir_id = dir_cache.get_dir_id(filepath, std::filesystem::path::preferred_separator,
+         [this] (int64_t parent_id, const std::u8string& dir_name) {return insert_dir_record(parent_id, dir_name);});
+
+   // zero-length files have no hash and only their names are hashed
+   rollup_hash_t rollup_hash(dir_entry.path().filename().u8string(), filesize ? std::string_view(reinterpret_cast<const char*>(hexhash_file), HASH_HEX_SIZE) : std::string_view());
+
+   std::string rollup_hexhash = rollup_hash.to_hex();
+
+   sqlite_param_binder_t upsert_scan_dir_stmt = stmt_upsert_scan_dir.get_param_binder();
+
+   // scan_id
+   upsert_scan_dir_stmt.skip_param();
+
+   upsert_scan_dir_stmt.bind_param(dir_id);
+
+   upsert_scan_dir_stmt.bind_param(static_cast<int64_t>(dir_entry.file_size()));
+   upsert_scan_dir_stmt.bind_param(static_cast<int64_t>(file_time_to_time_t(dir_entry.last_write_time())));
+   upsert_scan_dir_stmt.bind_param(std::u8string_view(reinterpret_cast<const char8_t*>(rollup_hexhash.data()), rollup_hexhash.size()));
+
+   if((errcode = sqlite3_step(stmt_upsert_scan_dir)) != SQLITE_DONE)
+      throw std::runtime_error(FMTNS::format("Cannot update a scan directory record for {:s} ({:s})", u8sv(filepath), sqlite3_errstr(errcode)));
+
+   upsert_scan_dir_stmt.reset();
+}
+
+void file_tracker_t::update_verified_time(const std::u8string& filepath, int64_t version_id)
+{
+   int errcode = SQLITE_OK;
+
+   sqlite_param_binder_t update_verified_time_stmt = stmt_update_verified_time.get_param_binder();
+
+   update_verified_time_stmt.bind_param(static_cast<int64_t>(std::chrono::system_clock::to_time_t(std::chrono::system_clock::now())));
+
+   update_verified_time_stmt.bind_param(version_id);
+
+   if((errcode = sqlite3_step(stmt_update_verified_time)) != SQLITE_DONE)
+      throw std::runtime_error(FMTNS::format("Cannot update a verified time for {:s} ({:s})", u8sv(filepath), sqlite3_errstr(errcode)));
+
+   update_verified_time_stmt.reset();
+}
+
+#ifndef NO_SSE_AVX
+std::optional<file_tracker_t::mb_file_hasher_t::hash_state_t> file_tracker_t::select_hash_checkpoint(const std::u8string& filepath, const std::filesystem::directory_entry& dir_entry, const file_stat_t& file_stat)
+{
+   int errcode = SQLITE_OK;
+
+   std::optional<mb_file_hasher_t::hash_state_t> hash_state;
+
+   sqlite_param_binder_t find_hash_checkpoint_stmt = stmt_find_hash_checkpoint.get_param_binder();
+
+   // scan_id
+   find_hash_checkpoint_stmt.skip_param();
+
+   find_hash_checkpoint_stmt.bind_param(filepath);
+
+   errcode = sqlite3_step(stmt_find_hash_checkpoint);
+
+   if(errcode != SQLITE_DONE && errcode != SQLITE_ROW)
+      throw std::runtime_error(FMTNS::format("Failed to find a hash checkpoint for {:s} ({:s})"sv, u8sv(filepath), sqlite3_errstr(errcode)));
+
+   if(errcode == SQLITE_DONE)
+      return std::nullopt;
+
+   std::optional<int64_t> file_inode;
+
+   if(sqlite3_column_type(stmt_find_hash_checkpoint, 2) != SQLITE_NULL)
+      file_inode = sqlite3_column_int64(stmt_find_hash_checkpoint, 2);
+
+   std::string_view hash_type(reinterpret_cast<const char*>(sqlite3_column_text(stmt_find_hash_checkpoint, 3)), sqlite3_column_bytes(stmt_find_hash_checkpoint, 3));
+
+   uint64_t hashed_size = static_cast<uint64_t>(sqlite3_column_int64(stmt_find_hash_checkpoint, 4));
+
+   const unsigned char *hash_state_blob = static_cast<const unsigned char*>(sqlite3_column_blob(stmt_find_hash_checkpoint, 5));
+   size_t hash_state_size = static_cast<size_t>(sqlite3_column_bytes(stmt_find_hash_checkpoint, 5));
+
+   if(hash_type != HASH_TYPE || hash_state_size < sizeof(hash_state->digest) || hash_state_size - sizeof(hash_state->digest) >= sizeof(hash_state->partial_block) || hashed_size > file_stat.file_size)
+      print_stream.warning("Ignoring a bad hash checkpoint for \"{:s}\"", u8sv(filepath));
+   else {
+      // a hash checkpoint can only be used if the file didn't change since it was saved
+      if(sqlite3_column_int64(stmt_find_hash_checkpoint, 0) != static_cast<int64_t>(file_time_to_time_t(dir_entry.last_write_time())) ||
+            static_cast<uint64_t>(sqlite3_column_int64(stmt_find_hash_checkpoint, 1)) != file_stat.file_size ||
+            file_inode.has_value() != file_stat.file_link_id.has_value() ||
+            (file_inode.has_value() && static_cast<uint64_t>(file_inode.value()) != file_stat.file_link_id.value().inode))
+         print_stream.info("Ignoring a hash checkpoint for a changed file \"{:s}\"", u8sv(filepath));
+      else {
+         hash_state.emplace();
+
+         memcpy(hash_state->digest, hash_state_blob, sizeof(hash_state->digest));
+
+         hash_state->total_length = hashed_size;
+
+         hash_state->partial_block_length = static_cast<uint32_t>(hash_state_size - sizeof(hash_state->digest));
+         memcpy(hash_state->partial_block, hash_state_blob + sizeof(hash_state->digest), hash_state->partial_block_length);
+      }
+   }
+
+   // release read locks before starting a transaction (see select_version_record)
+   find_hash_checkpoint_stmt.reset();
+
+   return hash_state;
+}
+
+void file_tracker_t::delete_hash_checkpoint(const std::u8string& filepath)
+{
+   int errcode = SQLITE_OK;
+
+   sqlite_param_binder_t delete_hash_checkpoint_stmt = stmt_delete_hash_checkpoint.get_param_binder();
+
+   // scan_id
+   delete_hash_checkpoint_stmt.skip_param();
+
+   delete_hash_checkpoint_stmt.bind_param(filepath);
+
+   if((errcode = sqlite3_step(stmt_delete_hash_checkpoint)) != SQLITE_DONE)
+      throw std::runtime_error(FMTNS::format("Cannot delete a hash checkpoint for {:s} ({:s})", u8sv(filepath), sqlite3_errstr(errcode)));
+
+   delete_hash_checkpoint_stmt.reset();
+}
+
+void file_tracker_t::update_version_fingerprint(const std::u8string& filepath, int64_t version_id, const std::string& fingerprint)
+{
+   int errcode = SQLITE_OK;
+
+   sqlite_param_binder_t update_fingerprint_stmt = stmt_update_fingerprint.get_param_binder();
+
+   update_fingerprint_stmt.bind_param(std::u8string_view(reinterpret_cast<const char8_t*>(fingerprint.data()), fingerprint.size()));
+
+   update_fingerprint_stmt.bind_param(version_id);
+
+   if((errcode = sqlite3_step(stmt_update_fingerprint)) != SQLITE_DONE)
+      throw std::runtime_error(FMTNS::format("Cannot update a fingerprint for {:s} ({:s})", u8sv(filepath), sqlite3_errstr(errcode)));
+
+   update_fingerprint_stmt.reset();
+}
+#endif
+
 void file_tracker_t::begin_transaction(const std::u8string& filepath)
 {
    int errcode = sqlite3_step(stmt_begin_txn);
@@ -738,12 +1556,108 @@ void file_tracker_t::commit_transaction(const std::u8string& filepath)
 
 void file_tracker_t::rollback_transaction(const std::u8string& filepath)
 {
+   // directories inserted in this transaction are rolled back and must not be used from the cache
+   dir_cache.clear();
+
    int errcode = sqlite3_step(stmt_rollback_txn);
 
    if(errcode != SQLITE_DONE)
       print_stream.error("Cannot rollback a SQLite transaction for {:s} ({:s})", u8sv(filepath), sqlite3_errstr(errcode));
 }
 
+//
+// Queues files that were waiting for another hard link to be hashed
+// to be processed again.
+//
+void file_tracker_t::requeue_files(std::vector<std::filesystem::directory_entry>&& dir_entries)
+{
+   if(dir_entries.empty())
+      return;
+
+   std::lock_guard<std::mutex> files_lock(files_mtx);
+
+   for(std::filesystem::directory_entry& dir_entry : dir_entries)
+      files.push(std::move(dir_entry));
+}
+
+//
+// Returns the inode of an open file, so a file that is being hashed
+// is not looked up again by its path.
+//
+std::optional<uint64_t> file_tracker_t::get_file_inode(FILE *file)
+{
+   #ifdef _WIN32
+   // checkpoints are compared against stat_file, which does not obtain file index values on Windows
+   return std::nullopt;
+   #else
+   struct stat file_stat;
+
+   if(!file || fstat(fileno(file), &file_stat) != 0)
+      return std::nullopt;
+
+   return static_cast<uint64_t>(file_stat.st_ino);
+   #endif
+}
+
+//
+// Queries file attributes with a single `stat` call. On Windows,
+// directory entries already hold file sizes obtained while reading
+// directories, and hard link counts and file index values are only
+// available via open file handles, so they are not queried.
+//
+// Throws the same exception as `directory_entry::file_size` if the
+// file cannot be queried.
+//
+file_tracker_t::file_stat_t file_tracker_t::stat_file(const std::filesystem::directory_entry& dir_entry)
+{
+   file_stat_t file_stat;
+
+   #ifdef _WIN32
+   file_stat.file_size = dir_entry.file_size();
+   #else
+   struct stat fs_stat;
+
+   if(stat(reinterpret_cast<const char*>(dir_entry.path().u8string().c_str()), &fs_stat) != 0)
+      throw std::filesystem::filesystem_error("Cannot query file attributes", dir_entry.path(), std::error_code(errno, std::generic_category()));
+
+   file_stat.file_size = static_cast<uint64_t>(fs_stat.st_size);
+   file_stat.link_count = static_cast<uint64_t>(fs_stat.st_nlink);
+   file_stat.file_link_id = file_link_id_t{static_cast<uint64_t>(fs_stat.st_dev), static_cast<uint64_t>(fs_stat.st_ino)};
+   #endif
+
+   return file_stat;
+}
+
+bool file_tracker_t::seek_file(FILE *file, uint64_t offset)
+{
+   // the standard fseek takes a long, which is 32-bit on Windows
+   #ifdef _WIN32
+   return _fseeki64(file, static_cast<int64_t>(offset), SEEK_SET) == 0;
+   #else
+   return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+   #endif
+}
+
+#ifndef NO_SSE_AVX
+//
+// The first and the last sampled blocks are aligned with the file
+// start and end, and the blocks in between are spread evenly across
+// the file and are aligned on 4K boundaries. Files must be at least
+// FINGERPRINT_MIN_FILE_SIZE bytes long, so sampled blocks never
+// overlap.
+//
+uint64_t file_tracker_t::get_fingerprint_block_offset(size_t block_index, uint64_t entry_size)
+{
+   if(block_index == 0)
+      return 0;
+
+   if(block_index >= FINGERPRINT_BLOCK_COUNT - 1)
+      return entry_size - FINGERPRINT_BLOCK_SIZE;
+
+   return (entry_size - FINGERPRINT_BLOCK_SIZE) / (FINGERPRINT_BLOCK_COUNT - 1) * block_index & ~UINT64_C(4095);
+}
+#endif
+
 std::u8string file_tracker_t::to_ascii_path(const std::filesystem::path& fspath)
 {
    #ifdef _WIN32
@@ -794,6 +1708,17 @@ void file_tracker_t::run(void)
 {
    int errcode = SQLITE_OK;
 
+   //
+   // Memory is placed on the NUMA node of the thread that touches it
+   // first, so this thread is pinned before its file buffer is
+   // allocated. Multi-buffer hash contexts and SQLite page cache are
+   // allocated on first use, which also happens in this thread.
+   //
+   if(!cpu_affinity.empty() && !cpu_topology_t::set_thread_affinity(cpu_affinity))
+      print_stream.warning("Cannot pin a file tracker thread to CPUs {:s}", cpu_topology_t::format_cpu_list(cpu_affinity));
+
+   file_buffer.reset(new unsigned char[options.buffer_size]);
+
    // a file path string buffer
    std::u8string filepath;
 
@@ -812,7 +1737,11 @@ void file_tracker_t::run(void)
 
       version_record_result_t version_record;
 
-      if(files.empty()) {
+      // a file link identifier if this tracker is hashing a file with multiple hard links
+      std::optional<file_link_id_t> link_id;
+
+      // a paused tracker finishes hash jobs in progress as if the queue was empty
+      if(files.empty() || paused) {
 #ifdef NO_SSE_AVX
          if(true) {
 #else
@@ -833,17 +1762,39 @@ void file_tracker_t::run(void)
             continue;
          }
       }
+#ifdef NO_SSE_AVX
       else {
-         dir_entry = std::move(files.front());
-         files.pop();
+         dir_entry = files.pop();
+      }
+#else
+      //
+      // Files that failed to match their fingerprints are submitted
+      // for hashing in the job slot released by the fingerprint pass,
+      // so there may be no job slots left for another file, in which
+      // case dir_entry is left empty to get the next hash result. The
+      // same applies when the job limit was lowered while tuning.
+      //
+      else if(mb_hasher.available_jobs() && mb_hasher.active_jobs() < mb_hash_limit) {
+         dir_entry = files.pop();
       }
+#endif
 
       files_lock.unlock();
 
+      // each file is counted against the file rate limit, whether its data is read or not
+      if(dir_entry.has_value())
+         rate_limiter.take_files(1, abort_scan);
+
       try {
          bool hash_match = false;                              // if true, the file didn't change; if false, a new version will be created
+         bool hash_checkpoint = false;                         // if true, there may be a hash checkpoint record for this file
+         bool size_mismatch = false;                           // if true, the file size is different from the base version and the file was not hashed
          uint64_t filesize = 0;                                // hashed file size
          unsigned char hexhash_file[HASH_HEX_SIZE + 1] = {};   // file hash; should not be accessed if filesize == 0
+         std::optional<std::string> fingerprint;               // a hex file fingerprint, if one was computed
+         std::optional<uint64_t> sampled_size;                 // bytes read for a matching fingerprint, if the file was not hashed
+         std::optional<hardlink_map_t::link_hash_t> link_hash; // a hash computed for another hard link of this file
+         file_stat_t file_stat;                                // file size, links and inode, if dir_entry is not empty
 
          // dir_entry will be empty when we are finalizing last few hash jobs
          if(dir_entry.has_value()) {
@@ -884,6 +1835,20 @@ void file_tracker_t::run(void)
 
             // attempt to find a version record for the file in question
             version_record = select_version_record(!options.query_path_sep.has_value() ? filepath : filepath_query);
+
+            // files that are skipped below when continuing a scan are not queried
+            if(!options.update_last_scanset || !version_record.has_value() || version_record.scanset_scan_id() != scan_id)
+               file_stat = stat_file(dir_entry.value());
+
+            //
+            // When verifying files, a file with a size different from the
+            // one recorded in the base scan has been changed and there is
+            // no need to read and hash it, unless asked otherwise.
+            //
+            if(options.verify_files && !options.hash_size_mismatch &&
+                  version_record.has_value() && version_record.scanset_scan_id() == base_scan_id.value() &&
+                  version_record.entry_size() != static_cast<int64_t>(file_stat.file_size))
+               size_mismatch = true;
          }
 
          //
@@ -899,7 +1864,42 @@ void file_tracker_t::run(void)
             std::optional<int64_t> file_id;           // a file identifier (same as version_id)
             std::optional<int64_t> exif_id;           // an EXIF data identifier (same as version_id)
 
-            if(!hash_match) {
+            //
+            // Files with multiple hard links are hashed only once per scan.
+            // If another link of this file is being hashed, the directory
+            // entry is moved into the hard link map and will be queued
+            // again when the hash is available.
+            //
+            if(dir_entry.has_value() && !size_mismatch && file_stat.file_size != 0 && file_stat.link_count > 1 && file_stat.file_link_id.has_value()) {
+               link_id = file_stat.file_link_id;
+
+               hardlink_map_t::link_state_t link_state = hardlink_map.find_link(link_id.value(), file_stat.link_count, dir_entry.value(), link_hash);
+
+               if(link_state == hardlink_map_t::link_state_t::waiting) {
+                  files_lock.lock();
+                  continue;
+               }
+
+               // only the link owner computes the hash
+               if(link_state == hardlink_map_t::link_state_t::hashed)
+                  link_id.reset();
+            }
+
+            if(link_hash.has_value()) {
+               filesize = link_hash.value().file_size;
+               memcpy(hexhash_file, link_hash.value().hexhash.data(), HASH_HEX_SIZE);
+
+               // the version record was selected for this file above, not restored from a hash job
+               if(version_record.has_value()) {
+                  version = version_record.version();
+                  version_id = version_record.version_id();
+                  file_id = version_record.file_id();
+               }
+
+               progress_info.linked_files++;
+               progress_info.linked_size += filesize;
+            }
+            else if(!hash_match && !size_mismatch) {
 #ifdef NO_SSE_AVX
                hash_file(dir_entry.value().path(), filesize, hexhash_file);
 #else
@@ -912,11 +1912,37 @@ void file_tracker_t::run(void)
                   // will be empty for new files, which is expected.
                   //
                   try {
-                     mb_hasher.submit_job(&file_tracker_t::open_file, &file_tracker_t::read_file, std::move(version_record), std::move(dir_entry).value());
+                     std::optional<mb_file_hasher_t::hash_state_t> hash_state;
+
+                     // hash checkpoints are saved only against the current scan, so look them up only for large files when continuing a scan
+                     if(stmt_find_hash_checkpoint && options.update_last_scanset && file_stat.file_size >= options.hash_checkpoint_interval)
+                        hash_state = select_hash_checkpoint(filepath, dir_entry.value(), file_stat);
+
+                     if(!hash_state.has_value()) {
+                        // if requested, large files are fingerprinted first to find out whether they need to be hashed
+                        if(options.fingerprint_files && file_stat.file_size >= FINGERPRINT_MIN_FILE_SIZE)
+                           mb_hasher.submit_job(&file_tracker_t::open_file_sampled, &file_tracker_t::read_file_sampled, std::move(version_record), std::move(dir_entry).value(), std::optional<file_link_id_t>(link_id));
+                        // small files are read entirely and closed right away, so they don't hold file handles while they are waiting to be hashed
+                        else if(file_stat.file_size < options.buffer_size)
+                           mb_hasher.submit_preloaded_job(&file_tracker_t::open_file, &file_tracker_t::read_file, std::move(version_record), std::move(dir_entry).value(), std::optional<file_link_id_t>(link_id));
+                        else
+                           mb_hasher.submit_job(&file_tracker_t::open_file, &file_tracker_t::read_file, std::move(version_record), std::move(dir_entry).value(), std::optional<file_link_id_t>(link_id));
+                     }
+                     else {
+                        print_stream.info("Resuming hashing at {:s} for \"{:s}\"", hr_bytes(hash_state.value().total_length), u8sv(filepath));
+
+                        mb_hasher.resume_job(hash_state.value(), &file_tracker_t::open_file_at, &file_tracker_t::read_file, std::move(version_record), std::move(dir_entry).value(), static_cast<uint64_t>(hash_state.value().total_length), std::optional<file_link_id_t>(link_id));
+                     }
+
+                     // the link identifier will be returned with the hash job arguments
+                     link_id.reset();
                   }
                   catch (const std::exception& error) {
                      progress_info.failed_files++;
 
+                     if(link_id.has_value())
+                        requeue_files(hardlink_map.release_link(link_id.value()));
+
                      //
                      // If we failed to open a file (submit_job won't read any data),
                      // the hash job slot remains available and we can just continue
@@ -930,7 +1956,7 @@ void file_tracker_t::run(void)
                   }
 
                   // if the multi-buffer hasher can accept more parallel jobs, get another file
-                  if(mb_hasher.available_jobs() > 0) {
+                  if(mb_hasher.available_jobs() > 0 && mb_hasher.active_jobs() < mb_hash_limit) {
                      files_lock.lock();
                      continue;
                   }
@@ -938,13 +1964,21 @@ void file_tracker_t::run(void)
 
                uint32_t isa_mb_hash[mb_file_hasher_t::traits::HASH_UINT32_SIZE];
 
-               std::optional<mb_file_hasher_t::param_tuple_t> args = mb_hasher.get_hash(isa_mb_hash);
+               std::optional<mb_file_hasher_t::param_tuple_t> args = mb_hasher.get_hash(isa_mb_hash, &abort_scan);
+
+               // there will be no hash result if the scan is being aborted
+               if(!args.has_value()) {
+                  files_lock.lock();
+                  break;
+               }
 
                // close the file handle explicitly to avoid keeping it open while handling hashing results
                std::get<mbh_arg_file_handle>(args.value()).reset();
 
                dir_entry = std::move(std::get<mbh_arg_dir_entry>(args.value()));
 
+               link_id = std::get<mbh_arg_link_id>(args.value());
+
                // invalid UCS-2 code points have been filtered out when directory entries were pulled from the queue
                if(options.base_path.empty())
                   filepath = dir_entry.value().path().u8string();
@@ -955,6 +1989,10 @@ void file_tracker_t::run(void)
                if(std::get<mbh_arg_file_read_error>(args.value()).has_value()) {
                   progress_info.failed_files++;
 
+                  // other links of this file will be hashed by whichever tracker finds them first
+                  if(link_id.has_value())
+                     requeue_files(hardlink_map.release_link(link_id.value()));
+
                   // same as when calling mb_hasher.submit_job
                   print_stream.error("Cannot hash a file ({:s}) for \"{:s}\"", std::get<mbh_arg_file_read_error>(args.value()).value().error, u8sv(filepath));
                   files_lock.lock();
@@ -963,6 +2001,8 @@ void file_tracker_t::run(void)
 
                filesize = std::get<mbh_arg_file_size>(args.value());
 
+               hash_checkpoint = std::get<mbh_arg_hash_checkpoint>(args.value());
+
                // hash for zero-length files should not be evaluated
                if(filesize)
                   mb_file_hasher_t::isa_mb_hash_to_hex(isa_mb_hash, hexhash_file);
@@ -981,16 +2021,60 @@ void file_tracker_t::run(void)
                   version_id = std::nullopt;
                   file_id = std::nullopt;
                }
+
+               fingerprint = std::move(std::get<mbh_arg_fingerprint>(args.value()));
+
+               if(std::get<mbh_arg_fingerprint_pass>(args.value())) {
+                  fingerprint.emplace(reinterpret_cast<const char*>(hexhash_file), HASH_HEX_SIZE);
+
+                  //
+                  // If the file size and the fingerprint are the same as in the
+                  // base version of this file, consider the file unchanged and
+                  // use the base version hash, which will be matched below.
+                  // Otherwise, submit this file for hashing in its entirety,
+                  // which will take the job slot that was just released.
+                  //
+                  if(version_record.has_value() && version_record.scanset_scan_id() == base_scan_id &&
+                        version_record.hexhash().has_value() && version_record.fingerprint() == fingerprint &&
+                        version_record.entry_size() == static_cast<int64_t>(dir_entry.value().file_size())) {
+                     memcpy(hexhash_file, version_record.hexhash().value().data(), HASH_HEX_SIZE);
+
+                     // the base version hash covers the entire file, which is the size recorded for this version and other links
+                     sampled_size = filesize;
+                     filesize = dir_entry.value().file_size();
+
+                     progress_info.skipped_files++;
+                     progress_info.skipped_size += filesize - sampled_size.value();
+                  }
+                  else {
+                     try {
+                        mb_hasher.submit_job(&file_tracker_t::open_file_fingerprinted, &file_tracker_t::read_file, std::move(version_record), std::move(dir_entry).value(), std::move(fingerprint).value(), std::optional<file_link_id_t>(link_id));
+                     }
+                     catch (const std::exception& error) {
+                        progress_info.failed_files++;
+
+                        if(link_id.has_value())
+                           requeue_files(hardlink_map.release_link(link_id.value()));
+
+                        print_stream.error("Cannot submit a hashing job ({:s}) for \"{:s}\" ", error.what(), u8sv(filepath));
+                     }
+
+                     files_lock.lock();
+                     continue;
+                  }
+               }
 #endif
+            }
 
-               //
-               // Only consider a version record if it was included in the
-               // base scan. Otherwise, this record describes a file that
-               // was deleted before the base scan.
-               // 
-               // Within a suitable version record, consider a NULL hash
-               // field as a match for zero-length files.
-               //
+            //
+            // Only consider a version record if it was included in the
+            // base scan. Otherwise, this record describes a file that
+            // was deleted before the base scan.
+            // 
+            // Within a suitable version record, consider a NULL hash
+            // field as a match for zero-length files.
+            //
+            if(!size_mismatch) {
                hash_match = version_record.has_value() && version_record.scanset_scan_id() == base_scan_id.value() &&
                               ((filesize == 0 && !version_record.hexhash().has_value()) ||
                                  (version_record.hexhash().has_value() && 
@@ -1013,8 +2097,8 @@ void file_tracker_t::run(void)
 
             // only keep track of removed files if a full recursive verification scan is requested
             if(options.report_removed_files) {
-               // if there's a version record, clear its rowid in the scanset bitmap of the base scan
-               if(version_record.has_value() && !scanset_bitmap.empty())
+               // if there's a version record in the base scan, clear its rowid in the scanset bitmap of the base scan (scans may find older versions)
+               if(version_record.has_value() && version_record.scanset_scan_id() == base_scan_id && !scanset_bitmap.empty())
                   scanset_bitmap.clear_rowid(version_record.scanset_rowid());
             }
 
@@ -1024,12 +2108,21 @@ void file_tracker_t::run(void)
 
             // hash_match == false if there's no version record, or it's not from the last scan or the hash didn't match
             if(!hash_match) {
-               // handle the mismatched hash based on whether we are verifying or scanning
-               if(options.verify_files) {
+               //
+               // Mismatched files are classified when verifying files and
+               // when scanning with -R, so a scan can record a new scanset
+               // and report differences against the base scan in one pass.
+               //
+               if(options.verify_files || options.report_removed_files) {
                   // differentiate between new, modified and changed files (a scanned file with a version in scan 1 and no version in a base scan 2, is a new file)
                   if(!version_record.has_value() || (base_scan_id.has_value() && version_record.scanset_scan_id() != base_scan_id.value())) {
-                     progress_info.new_files++;
-                     print_stream.warning(   "new file: {:s} ({:s})", u8sv(filepath), hr_bytes(dir_entry.value().file_size()));
+                     // new files are reported after removed files are known, so moved files can be reported as such
+                     if(options.report_removed_files)
+                        insert_new_file_record(filepath, dir_entry.value().file_size(), filesize ? hexhash_file : nullptr);
+                     else {
+                        progress_info.new_files++;
+                        print_stream.warning(   "new file: {:s} ({:s})", u8sv(filepath), hr_bytes(dir_entry.value().file_size()));
+                     }
                   }
                   else {
                      if(version_record.mod_time() != static_cast<int64_t>(file_time_to_time_t(dir_entry.value().last_write_time()))) {
@@ -1042,7 +2135,8 @@ void file_tracker_t::run(void)
                      }
                   }
                }
-               else {
+
+               if(!options.verify_files) {
                   //
                   // Check if this file is a picture and we need to check for EXIF
                   // data. We don't try to figure out if EXIF changed and store an
@@ -1069,13 +2163,21 @@ void file_tracker_t::run(void)
                   // unique in the queue, so there is no danger of a version
                   // conflict.
                   //
-                  version_id = insert_version_record(filepath, file_id.value(), version+1, filesize, dir_entry.value(), hexhash_file, exif_id);
+                  version_id = insert_version_record(filepath, file_id.value(), version+1, filesize, dir_entry.value(), hexhash_file, exif_id, fingerprint);
                }
 
                // update the number of unmatched files and their size
                progress_info.unmatched_files++;
-               progress_info.unmatched_size += filesize;
+               progress_info.unmatched_size += size_mismatch ? dir_entry.value().file_size() : filesize;
+
+               // keep track of files that were classified without reading their data
+               if(size_mismatch) {
+                  progress_info.skipped_files++;
+                  progress_info.skipped_size += dir_entry.value().file_size();
+               }
             }
+            else if(stmt_update_verified_time)
+               update_verified_time(filepath, version_record.version_id());
 
             if(!options.verify_files) {
                // this is an assert-type exception - version_id will either be one of the existing versions or a new one
@@ -1085,6 +2187,18 @@ void file_tracker_t::run(void)
                // insert a scanset record with the new or existing version ID
                insert_scanset_record(filepath, version_id.value());
 
+               upsert_scan_dir_record(filepath, dir_entry.value(), filesize, hexhash_file);
+
+#ifndef NO_SSE_AVX
+               // the hash checkpoint is no longer needed once the file version is recorded in the scanset
+               if(hash_checkpoint)
+                  delete_hash_checkpoint(filepath);
+
+               // record fingerprints for matching versions that were recorded without one
+               if(hash_match && fingerprint.has_value() && version_record.fingerprint() != fingerprint)
+                  update_version_fingerprint(filepath, version_id.value(), fingerprint.value());
+#endif
+
                commit_transaction(filepath);
             }
          }
@@ -1093,17 +2207,29 @@ void file_tracker_t::run(void)
          if(!dir_entry.has_value())
             throw std::logic_error("dir_entry cannot be empty at this point");
 
+         // other links of this file that were found while it was being hashed will be processed again
+         if(link_id.has_value())
+            requeue_files(hardlink_map.set_link_hash(link_id.value(), {filesize, std::string(reinterpret_cast<const char*>(hexhash_file), HASH_HEX_SIZE)}));
+
          //
-         // Update stats for processed files
+         // Update stats for processed files (files with reused hashes were not read)
          //
          progress_info.processed_files++;
-         progress_info.processed_size += options.update_last_scanset ? dir_entry.value().file_size() : filesize;
+         progress_info.processed_size += options.update_last_scanset ? dir_entry.value().file_size() : link_hash.has_value() ? 0 : sampled_size.value_or(filesize);
       }
       catch (const std::exception& error) {
          progress_info.failed_files++;
 
          print_stream.error("Cannot process file \"{:s}\" ({:s})", u8sv(filepath), error.what());
 
+         // remaining files cannot be recorded either, so the scan is stopped and may be continued with a larger -M value
+         if(options.memory_db_size.has_value() && sqlite3_errcode(file_scan_db) == SQLITE_FULL && !abort_scan.exchange(true))
+            print_stream.error("The memory database reached its size limit ({:s})", hr_bytes(options.memory_db_size.value()));
+
+         // let other links of this file be hashed by the next tracker that finds them
+         if(link_id.has_value())
+            requeue_files(hardlink_map.release_link(link_id.value()));
+
          // if we started a transaction, roll it back
          if(!sqlite3_get_autocommit(file_scan_db)) {
             rollback_transaction(filepath);
@@ -1113,6 +2239,24 @@ void file_tracker_t::run(void)
       // need to lock to access the queue
       files_lock.lock();
    }
+
+   files_lock.unlock();
+
+#ifndef NO_SSE_AVX
+   //
+   // If the scan is being aborted, save hash states of all files
+   // that are still being hashed, so hashing can be resumed from
+   // these checkpoints when the scan is continued.
+   //
+   if(abort_scan && stmt_save_hash_checkpoint) {
+      try {
+         mb_hasher.checkpoint_jobs();
+      }
+      catch (const std::exception& error) {
+         print_stream.error("Cannot save hash checkpoints ({:s})", error.what());
+      }
+   }
+#endif
 }
 
 int file_tracker_t::sqlite_busy_handler_cb(void*, int count)
@@ -1135,6 +2279,25 @@ int file_tracker_t::sqlite_busy_handler_cb(void*, int count)
    return 1;
 }
 
+void file_tracker_t::sqlite_rollup_add_cb(sqlite3_context *sqlite_context, int argc, sqlite3_value **argv)
+{
+   try {
+      rollup_hash_t rollup_hash;
+
+      for(int i = 0; i < argc; i++) {
+         if(sqlite3_value_type(argv[i]) != SQLITE_NULL)
+            rollup_hash += rollup_hash_t::from_hex(std::string_view(reinterpret_cast<const char*>(sqlite3_value_text(argv[i])), sqlite3_value_bytes(argv[i])));
+      }
+
+      std::string rollup_hexhash = rollup_hash.to_hex();
+
+      sqlite3_result_text(sqlite_context, rollup_hexhash.data(), static_cast<int>(rollup_hexhash.size()), SQLITE_TRANSIENT);
+   }
+   catch (const std::exception& error) {
+      sqlite3_result_error(sqlite_context, error.what(), -1);
+   }
+}
+
 void file_tracker_t::initialize(print_stream_t& print_stream)
 {
    exif::exif_reader_t::initialize(print_stream);
@@ -1145,6 +2308,38 @@ void file_tracker_t::cleanup(print_stream_t& print_stream) noexcept
    exif::exif_reader_t::cleanup(print_stream);
 }
 
+//
+// Prepares a select statement that reads directory records, so file
+// paths can be assembled from directory names via `dir_cache_t`.
+//
+void file_tracker_t::prepare_read_dir_stmt(sqlite3 *file_scan_db, sqlite_stmt_t& stmt_read_dir)
+{
+   int errcode = SQLITE_OK;
+
+   // columns:                                       0     1
+   std::string_view sql_read_dir = "SELECT parent_id, name FROM dirs "
+   // parameters:                              1
+                                       "WHERE id = ?"sv;
+
+   if((errcode = stmt_read_dir.prepare(file_scan_db, sql_read_dir)) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot prepare a SQLite statement to read a directory ({:s})", sqlite3_errstr(errcode)));
+}
+
+void file_tracker_t::read_dir_record(sqlite_stmt_t& stmt_read_dir, int64_t dir_id, int64_t& parent_id, std::u8string& dir_name)
+{
+   int errcode = SQLITE_OK;
+
+   sqlite_param_binder_t read_dir_stmt = stmt_read_dir.get_param_binder();
+
+   read_dir_stmt.bind_param(dir_id);
+
+   if((errcode = sqlite3_step(stmt_read_dir)) != SQLITE_ROW)
+      throw std::runtime_error(FMTNS::format("The directory record {:d} must be in the database ({:s})"sv, dir_id, sqlite3_errstr(errcode)));
+
+   parent_id = sqlite3_column_int64(stmt_read_dir, 0);
+   dir_name.assign(reinterpret_cast<const char8_t*>(sqlite3_column_text(stmt_read_dir, 1)), static_cast<size_t>(sqlite3_column_bytes(stmt_read_dir, 1)));
+}
+
 void file_tracker_t::start(void)
 {
    file_tracker_thread = std::thread(&file_tracker_t::run, this);
@@ -1161,21 +2356,106 @@ void file_tracker_t::join(void)
       file_tracker_thread.join();
 }
 
-void file_tracker_t::update_file_removals(const file_tracker_t& other)
+//
+// Changes scan parameters of a running file tracker. Multi-buffer
+// contexts and file buffers are allocated for the maximum values
+// in options, so a lower job limit and read size just use fewer of
+// those, while a paused tracker completes hash jobs in progress and
+// idles until it is resumed.
+//
+void file_tracker_t::set_tuning(bool paused, size_t mb_hash_limit, size_t read_size_limit)
+{
+   this->paused = paused;
+#ifndef NO_SSE_AVX
+   this->mb_hash_limit = std::clamp<size_t>(mb_hash_limit, 1, options.mb_hash_max);
+#endif
+   this->read_size_limit = std::clamp<size_t>(read_size_limit, 1, options.buffer_size);
+}
+
+//
+// Must be called before the tracker is started.
+//
+void file_tracker_t::set_cpu_affinity(std::vector<unsigned>&& cpus)
 {
+   cpu_affinity = std::move(cpus);
+}
+
+void file_tracker_t::update_file_removals(file_tracker_t& other)
+{
+   int errcode = SQLITE_OK;
+
    scanset_bitmap.update(other.scanset_bitmap);
+
+   // new files of the other tracker are copied one at a time from its connection
+   sqlite_stmt_t stmt_select_new_files("select new files"sv);
+
+   // columns:                                             0          1     2
+   std::string_view sql_select_new_files = "SELECT filepath, file_size, hash FROM temp.new_files ORDER BY rowid"sv;
+
+   if((errcode = stmt_select_new_files.prepare(other.file_scan_db, sql_select_new_files)) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot prepare a SQLite statement to select new files ({:s})", sqlite3_errstr(errcode)));
+
+   while((errcode = sqlite3_step(stmt_select_new_files)) == SQLITE_ROW) {
+      sqlite_param_binder_t insert_new_file_stmt = stmt_insert_new_file.get_param_binder();
+
+      insert_new_file_stmt.bind_param(std::u8string_view(reinterpret_cast<const char8_t*>(sqlite3_column_text(stmt_select_new_files, 0)), static_cast<size_t>(sqlite3_column_bytes(stmt_select_new_files, 0))));
+      insert_new_file_stmt.bind_param(sqlite3_column_int64(stmt_select_new_files, 1));
+
+      if(sqlite3_column_type(stmt_select_new_files, 2) == SQLITE_NULL)
+         insert_new_file_stmt.bind_param(nullptr);
+      else
+         insert_new_file_stmt.bind_param(std::u8string_view(reinterpret_cast<const char8_t*>(sqlite3_column_text(stmt_select_new_files, 2)), static_cast<size_t>(sqlite3_column_bytes(stmt_select_new_files, 2))));
+
+      if((errcode = sqlite3_step(stmt_insert_new_file)) != SQLITE_DONE)
+         throw std::runtime_error(FMTNS::format("Cannot copy a new file record ({:s})", sqlite3_errstr(errcode)));
+
+      insert_new_file_stmt.reset();
+   }
+
+   if(errcode != SQLITE_DONE)
+      throw std::runtime_error(FMTNS::format("Cannot select new files ({:s})", sqlite3_errstr(errcode)));
+
+   if((errcode = stmt_select_new_files.finalize()) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot finalize a SQLite statement to select new files ({:s})", sqlite3_errstr(errcode)));
 }
 
+//
+// Reports files of the base scan that were not found in this scan as
+// removed, unless one of the new files has the same hash, in which
+// case the new file is reported as moved from the removed file path.
+// Removed files are read from the database one at a time and each
+// is looked up by hash in the temporary table of new files, which
+// is indexed only after all new files were recorded. Each new file
+// may be matched to one removed file. Hashes are compared without
+// hash types, same as in `sql/list-moved-files.sql`.
+//
+// Moved files are deleted from the table of new files, which are
+// reported by `report_new_files`.
+//
 void file_tracker_t::report_file_removals(void)
 {
    if(!scanset_bitmap.empty() && !abort_scan) {
       int errcode = SQLITE_OK;
 
+      char *errmsg = nullptr;
+
       scanset_bitmap_t::const_iterator end_it = scanset_bitmap.end();
 
+      if(sqlite3_exec(file_scan_db, "CREATE INDEX temp.ix_new_files_hash ON new_files (hash)", nullptr, nullptr, &errmsg) != SQLITE_OK)
+         throw std::runtime_error(FMTNS::format("Cannot create a hash index for new files ({:s})", std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get()));
+
       sqlite_stmt_t stmt_find_scanset_file("find scanset file"sv);
+      sqlite_stmt_t stmt_find_new_file("find new file"sv);
+      sqlite_stmt_t stmt_delete_new_file("delete new file"sv);
+      sqlite_stmt_t stmt_read_dir("read dir"sv);
+
+      prepare_read_dir_stmt(file_scan_db, stmt_read_dir);
 
-      std::string_view sql_find_scanset_file = "SELECT path, entry_size FROM scansets "
+      // a file path string buffer
+      std::u8string filepath;
+
+      // columns:                                                      0           1           2     3
+      std::string_view sql_find_scanset_file = "SELECT dir_id, files.name, entry_size, hash FROM scansets "
                                                    "JOIN versions ON scansets.version_id = versions.rowid "
                                                    "JOIN files ON file_id = files.rowid "
                                                    "WHERE scansets.rowid = ?"sv;
@@ -1183,6 +2463,20 @@ void file_tracker_t::report_file_removals(void)
       if((errcode = stmt_find_scanset_file.prepare(file_scan_db, sql_find_scanset_file)) != SQLITE_OK)
          throw std::runtime_error(FMTNS::format("Cannot prepare a find scanset file statement ({:s})"sv, sqlite3_errstr(errcode)));
 
+      // columns:                                         0         1          2
+      std::string_view sql_find_new_file = "SELECT rowid, filepath, file_size FROM temp.new_files "
+      // parameters:                                 1
+                                                   "WHERE hash = ? LIMIT 1"sv;
+
+      if((errcode = stmt_find_new_file.prepare(file_scan_db, sql_find_new_file)) != SQLITE_OK)
+         throw std::runtime_error(FMTNS::format("Cannot prepare a find new file statement ({:s})"sv, sqlite3_errstr(errcode)));
+
+      // parameters:                                                          1
+      std::string_view sql_delete_new_file = "DELETE FROM temp.new_files WHERE rowid = ?"sv;
+
+      if((errcode = stmt_delete_new_file.prepare(file_scan_db, sql_delete_new_file)) != SQLITE_OK)
+         throw std::runtime_error(FMTNS::format("Cannot prepare a delete new file statement ({:s})"sv, sqlite3_errstr(errcode)));
+
       for(scanset_bitmap_t::const_iterator it = scanset_bitmap.begin(); it != end_it; ++it) {
          sqlite_param_binder_t find_scanset_file_stmt = stmt_find_scanset_file.get_param_binder();
 
@@ -1191,10 +2485,44 @@ void file_tracker_t::report_file_removals(void)
          if((errcode = sqlite3_step(stmt_find_scanset_file)) != SQLITE_ROW)
             throw std::runtime_error(FMTNS::format("The scanset file record for rowid {:d} must be in the database ({:s})"sv, *it, sqlite3_errstr(errcode)));
 
-         progress_info.removed_files++;
-         progress_info.removed_size += sqlite3_column_int64(stmt_find_scanset_file, 1);
+         filepath = dir_cache.get_dir_path(sqlite3_column_int64(stmt_find_scanset_file, 0),
+               [&stmt_read_dir] (int64_t dir_id, int64_t& parent_id, std::u8string& dir_name) {read_dir_record(stmt_read_dir, dir_id, parent_id, dir_name);});
+
+         filepath.append(reinterpret_cast<const char8_t*>(sqlite3_column_text(stmt_find_scanset_file, 1)), static_cast<size_t>(sqlite3_column_bytes(stmt_find_scanset_file, 1)));
 
-         print_stream.warning("removed : {:s} ({:s})", reinterpret_cast<const char*>(sqlite3_column_text(stmt_find_scanset_file, 0)), hr_bytes(sqlite3_column_int64(stmt_find_scanset_file, 1)));
+         std::optional<int64_t> new_file_id;
+
+         // zero-length files have no hashes and are never matched
+         if(sqlite3_column_type(stmt_find_scanset_file, 3) != SQLITE_NULL) {
+            sqlite_param_binder_t find_new_file_stmt = stmt_find_new_file.get_param_binder();
+
+            find_new_file_stmt.bind_param(std::u8string_view(reinterpret_cast<const char8_t*>(sqlite3_column_text(stmt_find_scanset_file, 3)), static_cast<size_t>(sqlite3_column_bytes(stmt_find_scanset_file, 3))));
+
+            if((errcode = sqlite3_step(stmt_find_new_file)) == SQLITE_ROW) {
+               new_file_id = sqlite3_column_int64(stmt_find_new_file, 0);
+
+               progress_info.moved_files++;
+
+               print_stream.warning("moved   : {:s} ({:s}) from {:s}", std::string_view(reinterpret_cast<const char*>(sqlite3_column_text(stmt_find_new_file, 1)), static_cast<size_t>(sqlite3_column_bytes(stmt_find_new_file, 1))), hr_bytes(sqlite3_column_int64(stmt_find_new_file, 2)), u8sv(filepath));
+            }
+            else if(errcode != SQLITE_DONE)
+               throw std::runtime_error(FMTNS::format("Cannot find a new file for {:s} ({:s})"sv, u8sv(filepath), sqlite3_errstr(errcode)));
+         }
+
+         if(new_file_id.has_value()) {
+            sqlite_param_binder_t delete_new_file_stmt = stmt_delete_new_file.get_param_binder();
+
+            delete_new_file_stmt.bind_param(new_file_id.value());
+
+            if((errcode = sqlite3_step(stmt_delete_new_file)) != SQLITE_DONE)
+               throw std::runtime_error(FMTNS::format("Cannot delete a moved file record for {:s} ({:s})"sv, u8sv(filepath), sqlite3_errstr(errcode)));
+         }
+         else {
+            progress_info.removed_files++;
+            progress_info.removed_size += sqlite3_column_int64(stmt_find_scanset_file, 2);
+
+            print_stream.warning("removed : {:s} ({:s})", u8sv(filepath), hr_bytes(sqlite3_column_int64(stmt_find_scanset_file, 2)));
+         }
 
          if(abort_scan) {
             // there's no waiting for other threads to stop at this point - just notify that we didn't report all removed files
@@ -1207,10 +2535,44 @@ void file_tracker_t::report_file_removals(void)
          // report removed files only if we identified any
          if(progress_info.removed_files)
             print_stream.warning("Identified {:d} removed files ({:s})", progress_info.removed_files.load(), hr_bytes(progress_info.removed_size.load()));
+
+         if(progress_info.moved_files)
+            print_stream.warning("Identified {:d} moved files", progress_info.moved_files.load());
       }
    }
 }
 
+//
+// Reports new files found while tracking removed files, which is done
+// after removed files are reported, so moved files are not reported as
+// new. New files are also reported for interrupted scans, which do not
+// report removed files.
+//
+void file_tracker_t::report_new_files(void)
+{
+   int errcode = SQLITE_OK;
+
+   sqlite_stmt_t stmt_select_new_files("select new files"sv);
+
+   // columns:                                             0          1
+   std::string_view sql_select_new_files = "SELECT filepath, file_size FROM temp.new_files ORDER BY rowid"sv;
+
+   if((errcode = stmt_select_new_files.prepare(file_scan_db, sql_select_new_files)) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot prepare a SQLite statement to select new files ({:s})", sqlite3_errstr(errcode)));
+
+   while((errcode = sqlite3_step(stmt_select_new_files)) == SQLITE_ROW) {
+      progress_info.new_files++;
+
+      print_stream.warning("new file: {:s} ({:s})", std::string_view(reinterpret_cast<const char*>(sqlite3_column_text(stmt_select_new_files, 0)), static_cast<size_t>(sqlite3_column_bytes(stmt_select_new_files, 0))), hr_bytes(sqlite3_column_int64(stmt_select_new_files, 1)));
+   }
+
+   if(errcode != SQLITE_DONE)
+      throw std::runtime_error(FMTNS::format("Cannot select new files ({:s})", sqlite3_errstr(errcode)));
+
+   if((errcode = stmt_select_new_files.finalize()) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot finalize a SQLite statement to select new files ({:s})", sqlite3_errstr(errcode)));
+}
+
 }
 
 #ifndef NO_SSE_AVX
@@ -4,6 +4,12 @@
 #include "print_stream.h"
 #include "exif_reader.h"
 #include "scanset_bitmap.h"
+#include "fd_budget.h"
+#include "hardlink_map.h"
+#include "file_queue.h"
+#include "rate_limiter.h"
+#include "dir_rollup.h"
+#include "dir_cache.h"
 
 #include "fit.h"
 
@@ -54,6 +60,20 @@ struct progress_info_t {
 
    std::atomic<uint64_t> removed_files = 0;
    std::atomic<uint64_t> removed_size = 0;
+
+   // new files with the same hash as one of the removed files
+   std::atomic<uint64_t> moved_files = 0;
+
+   // files classified without reading their data and their size
+   std::atomic<uint64_t> skipped_files = 0;
+   std::atomic<uint64_t> skipped_size = 0;
+
+   // hard-linked files that reused a hash computed for another link and their size
+   std::atomic<uint64_t> linked_files = 0;
+   std::atomic<uint64_t> linked_size = 0;
+
+   // bytes read from files, which, unlike processed size, grows while large files are being hashed
+   std::atomic<uint64_t> read_size = 0;
 };
 
 //
@@ -64,8 +84,8 @@ class file_tracker_t {
       static constexpr const int DB_BUSY_TIMEOUT = 1000;
 
       // same field order as in the select statement (stmt_find_version)
-      // version, mod_time, hash_type, hash, versions.rowid, file_id, scan_id
-      typedef sqlite_record_t<int64_t, int64_t, std::string, std::optional<std::string>, int64_t, int64_t, int64_t, int64_t> version_record_t;
+      // version, mod_time, hash_type, hash, versions.rowid, file_id, scan_id, scansets.rowid, entry_size, fingerprint
+      typedef sqlite_record_t<int64_t, int64_t, std::string, std::optional<std::string>, int64_t, int64_t, int64_t, int64_t, int64_t, std::optional<std::string>> version_record_t;
 
       //
       // A wrapper for the file version select statement result tuple,
@@ -97,6 +117,10 @@ class file_tracker_t {
          int64_t scanset_scan_id(void) const {return version_record.value().get_field<6>();}
 
          int64_t scanset_rowid(void) const {return version_record.value().get_field<7>();}
+
+         int64_t entry_size(void) const {return version_record.value().get_field<8>();}
+
+         const std::optional<std::string>& fingerprint(void) const {return version_record.value().get_field<9>();}
       };
 
       //
@@ -116,22 +140,50 @@ class file_tracker_t {
          std::string    error;
       };
 
+      //
+      // File attributes queried once for each file, which are reused
+      // for size checks, hard links and hash checkpoints. Link counts
+      // and inodes are not available via file paths on Windows.
+      //
+      struct file_stat_t {
+         uint64_t       file_size = 0;
+         uint64_t       link_count = 1;
+         std::optional<file_link_id_t> file_link_id;   // device and inode of the file data
+      };
+
 #ifndef NO_SSE_AVX
       typedef mb_hasher_t<mb_sha256_traits, file_tracker_t,
                            // param_tuple_t
-                           std::unique_ptr<FILE, file_handle_deleter_t>,
+                           std::unique_ptr<FILE, budget_file_deleter_t>,
                            uint64_t,
                            version_record_result_t,
                            std::filesystem::directory_entry,
-                           std::optional<file_read_error_t>> mb_file_hasher_t;
+                           std::optional<file_read_error_t>,
+                           bool,
+                           bool,
+                           std::optional<std::string>,
+                           std::optional<file_link_id_t>> mb_file_hasher_t;
 
       enum mb_hasher_param_t {
          mbh_arg_file_handle,
          mbh_arg_file_size,
          mbh_arg_version_record_result,
          mbh_arg_dir_entry,
-         mbh_arg_file_read_error
+         mbh_arg_file_read_error,
+         mbh_arg_hash_checkpoint,         // true if a hash checkpoint record may exist for this file
+         mbh_arg_fingerprint_pass,        // true if sampled file blocks are being hashed, instead of the entire file
+         mbh_arg_fingerprint,             // a hex file fingerprint computed in a fingerprint pass (optional)
+         mbh_arg_link_id                  // a file link identifier if this file has other hard links (optional)
       };
+
+      // size of each sampled file block hashed into a fingerprint
+      static constexpr const size_t FINGERPRINT_BLOCK_SIZE = 64 * 1024;
+
+      // number of sampled blocks, which includes the first and the last block of the file
+      static constexpr const size_t FINGERPRINT_BLOCK_COUNT = 6;
+
+      // smaller files are always hashed entirely
+      static constexpr const uint64_t FINGERPRINT_MIN_FILE_SIZE = 4 * 1024 * 1024;
 #endif
 
       static const size_t HASH_BIN_SIZE;
@@ -150,40 +202,81 @@ class file_tracker_t {
       // the scan ID against which files will be compared (empty for initial scans; cannot be empty for verification scans)
       std::optional<int64_t> base_scan_id;
 
+      // allocated in the tracker thread, after it is pinned to its CPUs, if there are any
       std::unique_ptr<unsigned char[]> file_buffer;
 
-      std::queue<std::filesystem::directory_entry>& files;
+      file_queue_t& files;
       std::mutex& files_mtx;
 
       std::thread file_tracker_thread;
 
       std::atomic<bool> stop_request = 0;
 
+      // a paused tracker finishes its hash jobs, but does not take new files from the queue
+      std::atomic<bool> paused = false;
+
+      // a maximum number of hash jobs in progress and a maximum size of file reads, which may be lowered while scanning
+      std::atomic<size_t> mb_hash_limit = 1;
+      std::atomic<size_t> read_size_limit;
+
+      // CPUs this tracker thread runs on (empty if the thread is not pinned)
+      std::vector<unsigned> cpu_affinity;
+
       progress_info_t& progress_info;
 
+      // file descriptor budget shared by all file trackers
+      fd_budget_t& fd_budget;
+
+      // files with multiple hard links shared by file trackers of one device pool
+      hardlink_map_t& hardlink_map;
+
+      // byte and file rate limits shared by all file trackers
+      rate_limiter_t& rate_limiter;
+
       std::vector<std::u8string> EXIF_exts;
 
       exif::exif_reader_t exif_reader;
 
       scanset_bitmap_t scanset_bitmap;
 
+      // directory identifiers of directories in file paths
+      dir_cache_t dir_cache;
+
 #ifndef NO_SSE_AVX
       mb_file_hasher_t mb_hasher;
 #endif
       sqlite3 *file_scan_db = nullptr;
 
+      sqlite_stmt_t stmt_insert_dir;
       sqlite_stmt_t stmt_insert_file;
       sqlite_stmt_t stmt_insert_version;
+      sqlite_stmt_t stmt_retire_versions;
       sqlite_stmt_t stmt_insert_scanset_entry;
       sqlite_stmt_t stmt_insert_exif;
+      sqlite_stmt_t stmt_upsert_scan_dir;
 
+      sqlite_stmt_t stmt_find_dir;
       sqlite_stmt_t stmt_find_last_version;
       sqlite_stmt_t stmt_find_scan_version;
 
+      sqlite_stmt_t stmt_update_verified_time;
+
+      sqlite_stmt_t stmt_insert_new_file;
+
       sqlite_stmt_t stmt_begin_txn;
       sqlite_stmt_t stmt_commit_txn;
       sqlite_stmt_t stmt_rollback_txn;
 
+#ifndef NO_SSE_AVX
+      sqlite_stmt_t stmt_find_hash_checkpoint;
+      sqlite_stmt_t stmt_delete_hash_checkpoint;
+
+      // hash checkpoints are saved from within mb_hasher, which may only call const member functions
+      mutable sqlite_stmt_t stmt_save_hash_checkpoint;
+
+      sqlite_stmt_t stmt_update_fingerprint;
+#endif
+
    private:
       void init_scan_db_conn(void);
 
@@ -193,37 +286,83 @@ class file_tracker_t {
 
       void init_base_scan_stmts(void);
 
+      void init_hash_checkpoint_stmts(void);
+
+      void init_fingerprint_stmts(void);
+
+      void init_scrub_stmts(void);
+
+      void init_new_file_stmts(void);
+
+      std::optional<int64_t> select_dir_record(int64_t parent_id, const std::u8string& dir_name);
+
+      int64_t insert_dir_record(int64_t parent_id, const std::u8string& dir_name);
+
       int64_t insert_file_record(const std::u8string& filepath, const std::filesystem::directory_entry& dir_entry);
 
       int64_t insert_exif_record(const std::u8string& filepath, const std::vector<exif::field_value_t>& exif_fields, const exif::field_bitset_t& field_bitset);
 
       version_record_result_t select_version_record(const std::u8string& filepath);
 
-      int64_t insert_version_record(const std::u8string& filepath, int64_t file_id, int64_t version, int64_t filesize, const std::filesystem::directory_entry& dir_entry, unsigned char hexhash_file[], std::optional<int64_t> exif_id);
+      int64_t insert_version_record(const std::u8string& filepath, int64_t file_id, int64_t version, int64_t filesize, const std::filesystem::directory_entry& dir_entry, unsigned char hexhash_file[], std::optional<int64_t> exif_id, const std::optional<std::string>& fingerprint);
 
       void insert_scanset_record(const std::u8string& filepath, int64_t version_id);
 
+      void upsert_scan_dir_record(const std::u8string& filepath, const std::filesystem::directory_entry& dir_entry, int64_t filesize, unsigned char hexhash_file[]);
+
+      void update_verified_time(const std::u8string& filepath, int64_t version_id);
+
+      void insert_new_file_record(const std::u8string& filepath, uint64_t file_size, unsigned char hexhash_file[]);
+
       void begin_transaction(const std::u8string& filepath);
 
       void commit_transaction(const std::u8string& filepath);
 
       void rollback_transaction(const std::u8string& filepath);
 
+      void requeue_files(std::vector<std::filesystem::directory_entry>&& dir_entries);
+
+#ifndef NO_SSE_AVX
+      std::optional<mb_file_hasher_t::hash_state_t> select_hash_checkpoint(const std::u8string& filepath, const std::filesystem::directory_entry& dir_entry, const file_stat_t& file_stat);
+
+      void delete_hash_checkpoint(const std::u8string& filepath);
+
+      void update_version_fingerprint(const std::u8string& filepath, int64_t version_id, const std::string& fingerprint);
+#endif
+
       void hash_file(const std::filesystem::path& filepath, uint64_t& filesize, unsigned char hexhash[]);
 
       void run(void);
 
 #ifndef NO_SSE_AVX
-      mb_file_hasher_t::param_tuple_t open_file(version_record_result_t&& version_record, std::filesystem::directory_entry&& dir_entry) const;
+      mb_file_hasher_t::param_tuple_t open_file(version_record_result_t&& version_record, std::filesystem::directory_entry&& dir_entry, std::optional<file_link_id_t>&& link_id) const;
+      mb_file_hasher_t::param_tuple_t open_file_at(version_record_result_t&& version_record, std::filesystem::directory_entry&& dir_entry, uint64_t&& offset, std::optional<file_link_id_t>&& link_id) const;
+      mb_file_hasher_t::param_tuple_t open_file_sampled(version_record_result_t&& version_record, std::filesystem::directory_entry&& dir_entry, std::optional<file_link_id_t>&& link_id) const;
+      mb_file_hasher_t::param_tuple_t open_file_fingerprinted(version_record_result_t&& version_record, std::filesystem::directory_entry&& dir_entry, std::string&& fingerprint, std::optional<file_link_id_t>&& link_id) const;
+      bool start_file(mb_file_hasher_t::param_tuple_t& args, bool wait) const noexcept;
       bool read_file(unsigned char *file_buffer, size_t buf_size, size_t& data_size, mb_file_hasher_t::param_tuple_t& args) const noexcept;
+      bool read_file_sampled(unsigned char *file_buffer, size_t buf_size, size_t& data_size, mb_file_hasher_t::param_tuple_t& args) const noexcept;
+      void save_hash_checkpoint(const mb_file_hasher_t::hash_state_t& hash_state, mb_file_hasher_t::param_tuple_t& args) const noexcept;
 #endif
 
       static time_t file_time_to_time_t(const std::chrono::file_clock::time_point& file_time);
 
       static std::u8string to_ascii_path(const std::filesystem::path& fspath);
 
+      static std::optional<uint64_t> get_file_inode(FILE *file);
+
+      static file_stat_t stat_file(const std::filesystem::directory_entry& dir_entry);
+
+      static bool seek_file(FILE *file, uint64_t offset);
+
+#ifndef NO_SSE_AVX
+      static uint64_t get_fingerprint_block_offset(size_t block_index, uint64_t entry_size);
+#endif
+
       static int sqlite_busy_handler_cb(void*, int count);
 
+      static void sqlite_rollup_add_cb(sqlite3_context *sqlite_context, int argc, sqlite3_value **argv);
+
       static std::vector<std::u8string> parse_EXIF_exts(const options_t& options);
 
       static bool set_sqlite_journal_mode(sqlite3 *file_scan_db, print_stream_t& print_stream);
@@ -231,7 +370,7 @@ class file_tracker_t {
       static std::tuple<uint64_t, uint64_t> get_scanset_rowid_range(sqlite3 *file_scan_db, int64_t scan_id);
 
    public:
-      file_tracker_t(const options_t& options, std::optional<int64_t>& scan_id, std::optional<int64_t>& base_scan_id, std::queue<std::filesystem::directory_entry>& files, std::mutex& files_mtx, progress_info_t& progress_info, print_stream_t& print_stream);
+      file_tracker_t(const options_t& options, std::optional<int64_t>& scan_id, std::optional<int64_t>& base_scan_id, file_queue_t& files, std::mutex& files_mtx, progress_info_t& progress_info, fd_budget_t& fd_budget, hardlink_map_t& hardlink_map, rate_limiter_t& rate_limiter, print_stream_t& print_stream);
 
       file_tracker_t(file_tracker_t&& other);
 
@@ -241,15 +380,25 @@ class file_tracker_t {
 
       static void cleanup(print_stream_t& print_stream) noexcept;
 
+      static void prepare_read_dir_stmt(sqlite3 *file_scan_db, sqlite_stmt_t& stmt_read_dir);
+
+      static void read_dir_record(sqlite_stmt_t& stmt_read_dir, int64_t dir_id, int64_t& parent_id, std::u8string& dir_name);
+
       void start(void);
 
       void stop(void);
 
       void join(void);
 
-      void update_file_removals(const file_tracker_t& other);
+      void set_tuning(bool paused, size_t mb_hash_limit, size_t read_size_limit);
+
+      void set_cpu_affinity(std::vector<unsigned>&& cpus);
+
+      void update_file_removals(file_tracker_t& other);
 
       void report_file_removals(void);
+
+      void report_new_files(void);
 };
 
 }
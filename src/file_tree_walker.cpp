@@ -1,5 +1,7 @@
 #include "file_tree_walker.h"
 #include "format.h"
+#include "cpu_topology.h"
+#include "sorted_dir_walker.h"
 
 #include "fit.h"
 
@@ -12,12 +14,24 @@
 #include <vector>
 #include <queue>
 #include <chrono>
+#include <fstream>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sysmacros.h>   // for major, minor
+#endif
 
 #include <cstdlib>
 #include <cstdio>
 #include <cstdint>
 #include <cinttypes>
 
+using namespace std::literals::string_view_literals;
+
 namespace fit {
 
 // defined in fit.cpp
@@ -27,10 +41,352 @@ file_tree_walker_t::file_tree_walker_t(const options_t& options, std::optional<i
       options(options),
       print_stream(print_stream),
       scan_id(scan_id),
-      base_scan_id(base_scan_id)
+      base_scan_id(base_scan_id),
+      device_pools(make_device_pools(options)),
+      fd_budget(get_fd_budget_size(device_pools))
+{
+   if(options.rate_limits.has_value())
+      rate_limit_schedule = rate_limit_schedule_t::parse(options.rate_limits.value());
+   else if(!options.rate_limits_file.empty()) {
+      rate_limits_file_time = std::filesystem::last_write_time(options.rate_limits_file);
+      rate_limit_schedule = read_rate_limits_file(options.rate_limits_file);
+   }
+
+   for(std::unique_ptr<device_pool_t>& device_pool : device_pools) {
+      for(size_t i = 0; i < device_pool->thread_count; i++)
+         device_pool->file_trackers.emplace_back(options, scan_id, base_scan_id, device_pool->files, device_pool->files_mtx, device_pool->progress_info, fd_budget, device_pool->hardlink_map, rate_limiter, print_stream);
+
+      // start with -t, -H and -s values, which may be replaced with stored ones via set_device_tuning
+      if(options.autotune) {
+#ifndef NO_SSE_AVX
+         init_autotuner(*device_pool, options.autotune_thread_count, options.autotune_mb_hash_max, options.autotune_buffer_size);
+#else
+         init_autotuner(*device_pool, options.autotune_thread_count, 1, options.autotune_buffer_size);
+#endif
+      }
+   }
+}
+
+//
+// Groups scan paths by their storage devices. Rotational devices are
+// processed with no more than `-T` threads and all other devices are
+// processed with `-t` threads.
+//
+std::vector<std::unique_ptr<file_tree_walker_t::device_pool_t>> file_tree_walker_t::make_device_pools(const options_t& options)
+{
+   std::vector<std::unique_ptr<device_pool_t>> device_pools;
+
+   for(const std::filesystem::path& scan_path : options.scan_paths) {
+      std::optional<uint64_t> device_id = get_device_id(scan_path);
+
+      std::vector<std::unique_ptr<device_pool_t>>::iterator pool_it = std::find_if(device_pools.begin(), device_pools.end(),
+                              [&device_id] (const std::unique_ptr<device_pool_t>& device_pool) {return device_pool->device_id == device_id;});
+
+      if(pool_it != device_pools.end()) {
+         (*pool_it)->scan_paths.push_back(scan_path);
+         continue;
+      }
+
+      std::unique_ptr<device_pool_t>& device_pool = device_pools.emplace_back(std::make_unique<device_pool_t>());
+
+      device_pool->device_id = device_id;
+      device_pool->scan_paths.push_back(scan_path);
+      device_pool->files = file_queue_t(options.schedule_window);
+
+      if(device_id.has_value())
+         get_device_info(device_id.value(), device_pool->device_name, device_pool->rotational);
+
+      device_pool->thread_count = device_pool->rotational.value_or(false) ? std::min(options.thread_count, options.rotational_thread_count) : options.thread_count;
+   }
+
+   return device_pools;
+}
+
+std::optional<uint64_t> file_tree_walker_t::get_device_id(const std::filesystem::path& scan_path)
+{
+   #ifdef _WIN32
+   // device numbers are not available on Windows and all scan paths are processed as if they were on the same device
+   return std::nullopt;
+   #else
+   struct stat path_stat;
+
+   if(stat(reinterpret_cast<const char*>(scan_path.u8string().c_str()), &path_stat) != 0)
+      return std::nullopt;
+
+   return static_cast<uint64_t>(path_stat.st_dev);
+   #endif
+}
+
+//
+// Looks up the block device for `device_id` in sysfs on Linux and
+// reads its rotational flag. Partitions do not have their own queue
+// attributes, which are read from their parent disks instead. Device
+// types remain unknown on other platforms and for devices without
+// block device entries, such as network shares.
+//
+void file_tree_walker_t::get_device_info(uint64_t device_id, std::string& device_name, std::optional<bool>& rotational)
+{
+   #ifdef __linux__
+   std::error_code errcode;
+
+   std::filesystem::path sysfs_path = std::filesystem::canonical(FMTNS::format("/sys/dev/block/{:d}:{:d}", major(static_cast<dev_t>(device_id)), minor(static_cast<dev_t>(device_id))), errcode);
+
+   if(errcode) {
+      device_name = FMTNS::format("{:d}:{:d}", major(static_cast<dev_t>(device_id)), minor(static_cast<dev_t>(device_id)));
+      return;
+   }
+
+   device_name = sysfs_path.filename().string();
+
+   std::filesystem::path rotational_path = sysfs_path / "queue" / "rotational";
+
+   if(!std::filesystem::exists(rotational_path, errcode))
+      rotational_path = sysfs_path.parent_path() / "queue" / "rotational";
+
+   std::ifstream rotational_file(rotational_path);
+
+   int rotational_value = 0;
+
+   if(rotational_file >> rotational_value)
+      rotational = rotational_value != 0;
+   #else
+   device_name = std::to_string(device_id);
+   #endif
+}
+
+//
+// File trackers share a budget of file descriptors that may be open
+// for hashing at the same time, which leaves a reserve for standard
+// streams, SQLite database files and journals, directory iterators
+// and EXIF readers in each thread.
+//
+size_t file_tree_walker_t::get_fd_budget_size(const std::vector<std::unique_ptr<device_pool_t>>& device_pools)
+{
+   size_t thread_count = 0;
+
+   for(const std::unique_ptr<device_pool_t>& device_pool : device_pools)
+      thread_count += device_pool->thread_count;
+
+   size_t reserved_fds = 64 + thread_count * 4;
+
+   size_t max_fds = fd_budget_t::get_open_file_limit();
+
+   // each thread must be able to hash at least one file
+   if(max_fds < reserved_fds + thread_count)
+      return thread_count;
+
+   return max_fds - reserved_fds;
+}
+
+//
+// Device pools are identified by their scan paths when tuned scan
+// parameters are stored, so the next scan of the same directories
+// starts with parameters tuned in the previous scan.
+//
+std::u8string file_tree_walker_t::get_tuning_key(const device_pool_t& device_pool)
+{
+   std::u8string tuning_key;
+
+   for(const std::filesystem::path& scan_path : device_pool.scan_paths) {
+      if(!tuning_key.empty())
+         tuning_key += u8'\n';
+
+      tuning_key += scan_path.u8string();
+   }
+
+   return tuning_key;
+}
+
+//
+// Initial values are clamped to the ranges of the tuner, which are
+// limited by the number of file trackers in the pool, as well as by
+// multi-buffer contexts and file buffers allocated in each tracker.
+//
+void file_tree_walker_t::init_autotuner(device_pool_t& device_pool, size_t thread_count, size_t mb_hash_max, size_t buffer_size)
+{
+   size_t min_buffer_size = std::min(AUTOTUNE_MIN_BUFFER_SIZE, options.buffer_size);
+
+   std::vector<autotuner_t::tuning_param_t> params = {
+      {std::clamp<size_t>(thread_count, 1, device_pool.thread_count), 1, device_pool.thread_count, false},
+#ifndef NO_SSE_AVX
+      {std::clamp<size_t>(mb_hash_max, 1, options.mb_hash_max), 1, options.mb_hash_max, true},
+#else
+      {1, 1, 1, true},
+#endif
+      {std::clamp<size_t>(buffer_size, min_buffer_size, options.buffer_size), min_buffer_size, options.buffer_size, true}
+   };
+
+   device_pool.autotuner.emplace(std::move(params), AUTOTUNE_WINDOW, .05);
+
+   apply_tuning(device_pool);
+}
+
+void file_tree_walker_t::apply_tuning(device_pool_t& device_pool)
+{
+   const autotuner_t& autotuner = device_pool.autotuner.value();
+
+   for(size_t i = 0; i < device_pool.file_trackers.size(); i++)
+      device_pool.file_trackers[i].set_tuning(i >= autotuner.get_value(atp_thread_count), autotuner.get_value(atp_mb_hash_max), autotuner.get_value(atp_buffer_size));
+}
+
+void file_tree_walker_t::update_tuning(device_pool_t& device_pool)
+{
+   autotuner_t& autotuner = device_pool.autotuner.value();
+
+   if(autotuner.is_settled())
+      return;
+
+   if(!autotuner.update(std::chrono::steady_clock::now(), device_pool.progress_info.read_size, device_pool.progress_info.processed_files))
+      return;
+
+   apply_tuning(device_pool);
+
+   if(autotuner.is_settled()) {
+      print_stream.info("Tuned device {:s} to {:d} threads, {:d} hash jobs and {:s} buffers",
+                        device_pool.device_name.empty() ? "(unknown)" : device_pool.device_name,
+                        autotuner.get_value(atp_thread_count), autotuner.get_value(atp_mb_hash_max), hr_bytes(autotuner.get_value(atp_buffer_size)));
+   }
+}
+
+std::string file_tree_walker_t::format_rate_limits(const rate_limits_t& rate_limits)
+{
+   if(!rate_limits.files_per_sec)
+      return hr_bytes(rate_limits.bytes_per_sec) + "/sec";
+
+   if(!rate_limits.bytes_per_sec)
+      return std::to_string(rate_limits.files_per_sec) + " files/sec";
+
+   return FMTNS::format("{:s}/sec and {:d} files/sec", hr_bytes(rate_limits.bytes_per_sec), rate_limits.files_per_sec);
+}
+
+//
+// Reads a rate limit schedule from a file, which may contain schedule
+// entries on separate lines, in addition to separating them with
+// commas, and may have empty lines and comment lines starting with
+// `#`.
+//
+rate_limit_schedule_t file_tree_walker_t::read_rate_limits_file(const std::filesystem::path& rate_limits_file)
+{
+   std::ifstream rate_limits_stream(rate_limits_file);
+
+   if(!rate_limits_stream)
+      throw std::runtime_error(FMTNS::format("Cannot open the rate limits file \"{:s}\"", u8sv(rate_limits_file.u8string())));
+
+   std::string schedule;
+   std::string line;
+
+   while(std::getline(rate_limits_stream, line)) {
+      line.erase(std::remove_if(line.begin(), line.end(), [] (char c) {return c == ' ' || c == '\t' || c == '\r';}), line.end());
+
+      if(line.empty() || line.front() == '#')
+         continue;
+
+      if(!schedule.empty())
+         schedule += ',';
+
+      schedule += line;
+   }
+
+   return rate_limit_schedule_t::parse(schedule);
+}
+
+//
+// Applies rate limits for the current time of day and picks up any
+// changes in the rate limits file, which is checked once a second.
+// A rate limits file that cannot be read or parsed is reported and
+// the last good schedule remains in effect.
+//
+void file_tree_walker_t::update_rate_limits(void)
 {
-   for(size_t i = 0; i < options.thread_count; i++)
-      file_trackers.emplace_back(options, scan_id, base_scan_id, files, files_mtx, progress_info, print_stream);
+   if(!rate_limit_schedule.has_value())
+      return;
+
+   std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+   if(now < rate_limits_check_time)
+      return;
+
+   rate_limits_check_time = now + std::chrono::seconds(1);
+
+   if(!options.rate_limits_file.empty()) {
+      std::error_code errcode;
+
+      std::filesystem::file_time_type file_time = std::filesystem::last_write_time(options.rate_limits_file, errcode);
+
+      if(!errcode && file_time != rate_limits_file_time) {
+         rate_limits_file_time = file_time;
+
+         try {
+            rate_limit_schedule = read_rate_limits_file(options.rate_limits_file);
+         }
+         catch (const std::exception& error) {
+            print_stream.warning("Cannot use updated rate limits ({:s})", error.what());
+         }
+      }
+   }
+
+   rate_limits_t rate_limits = rate_limit_schedule.value().get_limits(std::chrono::system_clock::now());
+
+   if(rate_limits != rate_limiter.get_limits()) {
+      rate_limiter.set_limits(rate_limits);
+
+      if(!rate_limits.bytes_per_sec && !rate_limits.files_per_sec)
+         print_stream.info("File reads are no longer limited");
+      else
+         print_stream.info("Limiting file reads to {:s}", format_rate_limits(rate_limits));
+   }
+}
+
+//
+// Pins file tracker threads to CPUs or NUMA nodes. Threads are
+// counted across device pools, so threads of each pool are spread
+// over all nodes and threads of different pools do not share CPUs
+// until all CPUs are used.
+//
+void file_tree_walker_t::set_thread_affinity(void)
+{
+   if(options.thread_affinity == thread_affinity_t::none)
+      return;
+
+   cpu_topology_t cpu_topology = cpu_topology_t::detect();
+
+   for(const cpu_topology_t::numa_node_t& node : cpu_topology.get_nodes())
+      print_stream.info("Found NUMA node {:d} with CPUs {:s}", node.node_id, cpu_topology_t::format_cpu_list(node.cpus));
+
+   size_t thread_index = 0;
+
+   for(std::unique_ptr<device_pool_t>& device_pool : device_pools) {
+      for(file_tracker_t& file_tracker : device_pool->file_trackers)
+         file_tracker.set_cpu_affinity(cpu_topology.get_thread_cpus(thread_index++, options.thread_affinity == thread_affinity_t::nodes));
+   }
+
+   print_stream.info("Pinning {:d} file tracker threads to {:s}", thread_index, options.thread_affinity == thread_affinity_t::nodes ? "NUMA nodes" : "CPUs");
+}
+
+//
+// Takes files that were not started yet out of the queue of each
+// device pool and keeps the first of them in walk order, which is
+// also the path order, as the cursor of the current scan path. Scans
+// end when files in progress are processed.
+//
+void file_tree_walker_t::stop_at_time_limit(void)
+{
+   print_stream.info("Time limit reached, finishing files in progress");
+
+   for(std::unique_ptr<device_pool_t>& device_pool : device_pools) {
+      std::lock_guard<std::mutex> files_lock(device_pool->files_mtx);
+
+      device_pool->time_limit_reached = true;
+
+      while(!device_pool->files.empty()) {
+         std::filesystem::directory_entry dir_entry = device_pool->files.pop();
+
+         if(!device_pool->time_limit_cursor.has_value() || dir_entry.path() < device_pool->time_limit_cursor.value())
+            device_pool->time_limit_cursor = dir_entry.path();
+
+         device_pool->queued_files--;
+      }
+   }
 }
 
 void file_tree_walker_t::initialize(print_stream_t& print_stream)
@@ -45,19 +401,46 @@ void file_tree_walker_t::cleanup(print_stream_t& print_stream) noexcept
 
 void file_tree_walker_t::report_progress(void)
 {
-   if(!progress_info.unmatched_files) {
+   if(!get_progress_total(&progress_info_t::unmatched_files)) {
       print_stream.info("Processed {:s} in {:d} files",
-                        hr_bytes(progress_info.processed_size.load()), progress_info.processed_files.load());
+                        hr_bytes(get_progress_total(&progress_info_t::processed_size)), get_progress_total(&progress_info_t::processed_files));
    }
    else {
       print_stream.info("Processed {:s} in {:d} files ({:d}/{:s} {:s})",
-                        hr_bytes(progress_info.processed_size.load()), progress_info.processed_files.load(),
-                        progress_info.unmatched_files.load(), hr_bytes(progress_info.unmatched_size.load()),
+                        hr_bytes(get_progress_total(&progress_info_t::processed_size)), get_progress_total(&progress_info_t::processed_files),
+                        get_progress_total(&progress_info_t::unmatched_files), hr_bytes(get_progress_total(&progress_info_t::unmatched_size)),
                         options.verify_files ? "changed" : "updated");
    }
 
-   if(progress_info.failed_files)
-      print_stream.info("Failed to process {:d} files", progress_info.failed_files.load());
+   if(get_progress_total(&progress_info_t::failed_files))
+      print_stream.info("Failed to process {:d} files", get_progress_total(&progress_info_t::failed_files));
+}
+
+void file_tree_walker_t::report_device_progress(void)
+{
+   for(const std::unique_ptr<device_pool_t>& device_pool : device_pools) {
+      std::chrono::steady_clock::duration elapsed = device_pool->end_time.value_or(std::chrono::steady_clock::now()) - device_pool->start_time;
+
+      double elapsed_sec = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() / 1000.;
+
+      print_stream.info("Device {:s} ({:s}, {:d} threads): processed {:s} in {:d} files in {:s} ({:s}/sec)",
+                        device_pool->device_name.empty() ? "(unknown)" : device_pool->device_name,
+                        !device_pool->rotational.has_value() ? "unknown type" : device_pool->rotational.value() ? "rotational" : "non-rotational",
+                        device_pool->thread_count,
+                        hr_bytes(device_pool->progress_info.processed_size.load()), device_pool->progress_info.processed_files.load(),
+                        hr_time(elapsed),
+                        hr_bytes(elapsed_sec > 0 ? static_cast<uint64_t>(device_pool->progress_info.processed_size.load() / elapsed_sec + .5) : 0));
+   }
+}
+
+uint64_t file_tree_walker_t::get_progress_total(std::atomic<uint64_t> progress_info_t::*progress_field) const
+{
+   uint64_t total = 0;
+
+   for(const std::unique_ptr<device_pool_t>& device_pool : device_pools)
+      total += (device_pool->progress_info.*progress_field).load();
+
+   return total;
 }
 
 void file_tree_walker_t::handle_abort_scan(bool& abort_scan_reported)
@@ -70,76 +453,133 @@ void file_tree_walker_t::handle_abort_scan(bool& abort_scan_reported)
    }
 }
 
-template <typename dir_iter_t>
-void file_tree_walker_t::walk_tree(void)
+//
+// Queues regular files from `dir_range` and returns `false` if the
+// scan was aborted or ran out of time before all files were queued.
+//
+// Time-limited scans walk directories in sorted order and files of
+// each scan path are taken from the queue before the next scan path
+// is walked, so files remaining in the queue when the time limit runs
+// out belong to the current scan path and the first of them is where
+// the next run of the scan resumes.
+//
+template <typename dir_range_t>
+bool file_tree_walker_t::queue_files(device_pool_t& device_pool, const std::filesystem::path& scan_path, dir_range_t&& dir_range)
 {
-   static const char *enum_files_error_msg = "Cannot enumerate files";
+   for(const std::filesystem::directory_entry& dir_entry : dir_range) {
+      //
+      // A symlink is also presented as a regular file and we want to
+      // skip symbolic links because if their targets are under the
+      // same base path, we will pick them up in the appropriate
+      // file type and if they are outside of the base path, then
+      // they should not be included at all (e.g. if a target is
+      // on a different volume in a recursive scan or in a different
+      // directory in a non-recursive scan).
+      //
+      if(!dir_entry.is_symlink() && dir_entry.is_regular_file()) {
+         uint64_t file_size = 0;
 
-   bool abort_scan_reported = false;
+         // obtain file size before the queue is locked (files that cannot be queried are queued as empty)
+         if(device_pool.files.is_ordered_by_size()) {
+            std::error_code errcode;
 
-   // start hasher threads
-   for(size_t i = 0; i < file_trackers.size(); i++)
-      file_trackers[i].start();
+            if((file_size = dir_entry.file_size(errcode)) == static_cast<uintmax_t>(-1))
+               file_size = 0;
+         }
 
-   uint64_t queued_files = 0;
+         std::unique_lock<std::mutex> files_lock(device_pool.files_mtx);
 
-   // set the report time a few seconds into the fiture
-   std::chrono::steady_clock::time_point report_time = std::chrono::steady_clock::now() + std::chrono::seconds(options.progress_interval);
+         if(device_pool.time_limit_reached) {
+            device_pool.scan_cursors.push_back({scan_path.u8string(), device_pool.time_limit_cursor.value_or(dir_entry.path()).lexically_relative(scan_path).u8string()});
+            time_limit_reached = true;
+            return false;
+         }
+
+         device_pool.files.push(std::filesystem::directory_entry(dir_entry), file_size);
+
+         device_pool.queued_files++;
+
+         //
+         // If we reached the maximum queue size, let it process some of
+         // the queue before piling up more files.
+         //
+         if(device_pool.files.size() > MAX_FILE_QUEUE_SIZE) {
+            while(!abort_scan && device_pool.files.size() > (MAX_FILE_QUEUE_SIZE*3)/4) {
+               files_lock.unlock();
+
+               std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+               files_lock.lock();
+            }
+         }
+
+         if(abort_scan)
+            return false;
+      }
+   }
+
+   if(time_limit_end != std::chrono::steady_clock::time_point()) {
+      std::unique_lock<std::mutex> files_lock(device_pool.files_mtx);
+
+      while(!abort_scan && !device_pool.time_limit_reached && !device_pool.files.empty()) {
+         files_lock.unlock();
+
+         std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+         files_lock.lock();
+      }
+
+      if(device_pool.time_limit_cursor.has_value()) {
+         device_pool.scan_cursors.push_back({scan_path.u8string(), device_pool.time_limit_cursor.value().lexically_relative(scan_path).u8string()});
+         time_limit_reached = true;
+         return false;
+      }
+   }
+
+   return true;
+}
+
+template <typename dir_iter_t>
+void file_tree_walker_t::walk_device_tree(device_pool_t& device_pool)
+{
+   static const char *enum_files_error_msg = "Cannot enumerate files";
 
    try {
       std::filesystem::directory_options dir_it_opts = options.skip_no_access_paths ? std::filesystem::directory_options::skip_permission_denied : std::filesystem::directory_options::none;
 
-      for(const std::filesystem::path& scan_path : options.scan_paths) {
-         print_stream.info("{:s} \"{:s}\"", options.verify_files ? "Verifying" : "Scanning", u8sv(scan_path.u8string()));
-
-         for(const std::filesystem::directory_entry& dir_entry : dir_iter_t(scan_path, dir_it_opts)) {
-            //
-            // A symlink is also presented as a regular file and we want to
-            // skip symbolic links because if their targets are under the
-            // same base path, we will pick them up in the appropriate
-            // file type and if they are outside of the base path, then
-            // they should not be included at all (e.g. if a target is
-            // on a different volume in a recursive scan or in a different
-            // directory in a non-recursive scan).
-            //
-            if(!dir_entry.is_symlink() && dir_entry.is_regular_file()) {
-               std::unique_lock<std::mutex> files_lock(files_mtx);
-
-               files.push(dir_entry);
-
-               queued_files++;
-
-               //
-               // If we reached the maximum queue size, let it process some of
-               // the queue before piling up more files.
-               //
-               if(files.size() > MAX_FILE_QUEUE_SIZE) {
-                  while(!abort_scan && files.size() > (MAX_FILE_QUEUE_SIZE*3)/4) {
-                     files_lock.unlock();
-
-                     std::this_thread::sleep_for(std::chrono::milliseconds(100));
-
-                     // if we are past the report time, print current stats and compute the next report time
-                     if(options.progress_interval && std::chrono::steady_clock::now() > report_time) {
-                        report_progress();
-                        report_time = std::chrono::steady_clock::now() + std::chrono::seconds(options.progress_interval);
-                     }
-
-                     files_lock.lock();
-                  }
-               }
+      for(const std::filesystem::path& scan_path : device_pool.scan_paths) {
+         std::optional<scan_cursor_t> resume_cursor;
 
-               if(abort_scan) {
-                  handle_abort_scan(abort_scan_reported);
-                  break;
-               }
-            }
+         for(const scan_cursor_t& scan_cursor : resume_cursors) {
+            if(scan_cursor.scan_path == scan_path.u8string())
+               resume_cursor = scan_cursor;
          }
 
-         if(abort_scan) {
-            handle_abort_scan(abort_scan_reported);
-            break;
+         if(resume_cursor.has_value() && !resume_cursor.value().cursor_path.has_value()) {
+            print_stream.info("Skipping \"{:s}\", which was completed in an earlier run", u8sv(scan_path.u8string()));
+            device_pool.scan_cursors.push_back(std::move(resume_cursor.value()));
+            continue;
+         }
+
+         bool queued_all = false;
+
+         if(resume_cursor.has_value()) {
+            print_stream.info("Resuming \"{:s}\" at \"{:s}\"", u8sv(scan_path.u8string()), u8sv(resume_cursor.value().cursor_path.value()));
+            queued_all = queue_files(device_pool, scan_path, sorted_dir_walker_t(scan_path, options.recursive_scan, dir_it_opts, std::filesystem::path(resume_cursor.value().cursor_path.value())));
          }
+         else {
+            print_stream.info("{:s} \"{:s}\"", options.verify_files ? "Verifying" : "Scanning", u8sv(scan_path.u8string()));
+
+            if(options.time_limit != std::chrono::seconds::zero())
+               queued_all = queue_files(device_pool, scan_path, sorted_dir_walker_t(scan_path, options.recursive_scan, dir_it_opts));
+            else
+               queued_all = queue_files(device_pool, scan_path, dir_iter_t(scan_path, dir_it_opts));
+         }
+
+         if(!queued_all)
+            break;
+
+         device_pool.scan_cursors.push_back({scan_path.u8string(), std::nullopt});
       }
    }
    catch (const std::filesystem::filesystem_error& error) {
@@ -176,42 +616,333 @@ void file_tree_walker_t::walk_tree(void)
       interrupted_scan = true;
    }
 
-   // wait for all file hasher threads to process all queued files
-   while(!abort_scan && (progress_info.processed_files + progress_info.failed_files) != queued_files) {
+   // tell the main thread that queued_files will not change anymore
+   device_pool.files_queued = true;
+}
+
+//
+// Queues files of the base scan to the device pools with their scan
+// paths, starting with files verified longest ago, until the combined
+// size of queued files reaches the scrub size, or until the time limit
+// runs out. Files are selected once for all device pools, in batches
+// read in the order of the partial `verified_time` index and keyed on
+// the last verification time and version of the previous batch, so no
+// read transaction is held open between batches and files verified in
+// this run are not selected again.
+//
+// Files that no longer exist are reported as removed and do not count
+// against the scrub size.
+//
+void file_tree_walker_t::scrub_files(void)
+{
+   try {
+      int errcode = SQLITE_OK;
+
+      sqlite3 *db_handle = nullptr;
+
+      // the database handle is allocated even if it cannot be opened
+      errcode = sqlite3_open_v2(reinterpret_cast<const char*>(options.db_path.u8string().c_str()), &db_handle, SQLITE_OPEN_READONLY, nullptr);
+
+      std::unique_ptr<sqlite3, sqlite_db_deleter_t> file_scan_db(db_handle);
+
+      if(errcode != SQLITE_OK)
+         throw std::runtime_error(FMTNS::format("Cannot open the database to select files to scrub ({:s})", sqlite3_errstr(errcode)));
+
+      sqlite_stmt_t stmt_scrub_files("scrub files"sv);
+      sqlite_stmt_t stmt_read_dir("read dir"sv);
+
+      file_tracker_t::prepare_read_dir_stmt(file_scan_db.get(), stmt_read_dir);
+
+      // file paths are assembled from directory names, which are looked up once per directory
+      dir_cache_t dir_cache;
+
+      //
+      // Versions replaced in later scans have NULL values in verified_time
+      // and are not in the index, so only the last version of each file is
+      // scrubbed, and versions recorded before verification times were
+      // tracked have zero values and are scrubbed first. Zero-length files
+      // are not in the index and have no data to verify. The unary plus
+      // keeps ix_scansets_scan from being used for scan_id, which would
+      // sort all versions in the scan before the first one is returned.
+      //
+      // columns:                                             0              1       2           3           4
+      std::string_view sql_scrub_files = "SELECT versions.rowid, verified_time, dir_id, files.name, entry_size "
+                                          "FROM versions JOIN scansets ON version_id = versions.rowid JOIN files ON file_id = files.rowid "
+      // parameters:                                        1                                                           2  3                       4
+                                          "WHERE +scan_id = ? AND hash IS NOT NULL AND (verified_time, versions.rowid) > (?, ?) AND verified_time < ? "
+      // parameters:                                                     5
+                                          "ORDER BY verified_time, versions.rowid LIMIT ?"sv;
+
+      if((errcode = stmt_scrub_files.prepare(file_scan_db.get(), sql_scrub_files)) != SQLITE_OK)
+         throw std::runtime_error(FMTNS::format("Cannot prepare a SQLite statement to select files to scrub ({:s})", sqlite3_errstr(errcode)));
+
+      for(const std::unique_ptr<device_pool_t>& device_pool : device_pools) {
+         for(const std::filesystem::path& scan_path : device_pool->scan_paths)
+            print_stream.info("Scrubbing \"{:s}\"", u8sv(scan_path.u8string()));
+      }
+
+      // files verified in this run are stamped with this time or later
+      int64_t scrub_start_time = static_cast<int64_t>(std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()));
+
+      // combined size of files queued in all device pools
+      uint64_t scrub_queued_size = 0;
+
+      // the key of the last selected version, which precedes all versions
+      int64_t last_verified_time = -1;
+      int64_t last_version_id = 0;
+
+      bool scrub_done = false;
+
+      while(!scrub_done) {
+         sqlite_param_binder_t scrub_files_stmt = stmt_scrub_files.get_param_binder();
+
+         scrub_files_stmt.bind_param(base_scan_id.value());
+         scrub_files_stmt.bind_param(last_verified_time);
+         scrub_files_stmt.bind_param(last_version_id);
+         scrub_files_stmt.bind_param(scrub_start_time);
+         scrub_files_stmt.bind_param(static_cast<int64_t>(SCRUB_BATCH_SIZE));
+
+         size_t batch_files = 0;
+
+         while(!(scrub_done = abort_scan || (options.scrub_size && scrub_queued_size >= options.scrub_size)) && (errcode = sqlite3_step(stmt_scrub_files)) == SQLITE_ROW) {
+            batch_files++;
+
+            last_version_id = sqlite3_column_int64(stmt_scrub_files, 0);
+            last_verified_time = sqlite3_column_int64(stmt_scrub_files, 1);
+
+            std::u8string filepath = dir_cache.get_dir_path(sqlite3_column_int64(stmt_scrub_files, 2),
+                  [&stmt_read_dir] (int64_t dir_id, int64_t& parent_id, std::u8string& dir_name) {file_tracker_t::read_dir_record(stmt_read_dir, dir_id, parent_id, dir_name);});
+
+            filepath.append(reinterpret_cast<const char8_t*>(sqlite3_column_text(stmt_scrub_files, 3)), static_cast<size_t>(sqlite3_column_bytes(stmt_scrub_files, 3)));
+
+            uint64_t entry_size = static_cast<uint64_t>(sqlite3_column_int64(stmt_scrub_files, 4));
+
+            // paths recorded on another platform are queried with their original separators
+            if(options.query_path_sep.has_value())
+               std::replace(filepath.begin(), filepath.end(), options.query_path_sep.value(), static_cast<char8_t>(std::filesystem::path::preferred_separator));
+
+            std::filesystem::path file_path = options.base_path.empty() ? std::filesystem::path(filepath) : options.base_path / filepath;
+
+            std::vector<std::unique_ptr<device_pool_t>>::iterator device_pool_it = std::find_if(device_pools.begin(), device_pools.end(),
+                  [this, &file_path] (const std::unique_ptr<device_pool_t>& device_pool) {return is_scan_path_file(*device_pool, file_path);});
+
+            if(device_pool_it == device_pools.end())
+               continue;
+
+            device_pool_t& device_pool = **device_pool_it;
+
+            std::error_code fs_errcode;
+
+            std::filesystem::directory_entry dir_entry(file_path, fs_errcode);
+
+            if(fs_errcode || dir_entry.is_symlink(fs_errcode) || !dir_entry.is_regular_file(fs_errcode)) {
+               device_pool.progress_info.removed_files++;
+               device_pool.progress_info.removed_size += entry_size;
+
+               print_stream.warning("removed : {:s} ({:s})", u8sv(filepath), hr_bytes(entry_size));
+               continue;
+            }
+
+            std::unique_lock<std::mutex> files_lock(device_pool.files_mtx);
+
+            // the time limit stops all device pools at once
+            if(device_pool.time_limit_reached) {
+               scrub_done = true;
+               break;
+            }
+
+            device_pool.files.push(std::move(dir_entry), entry_size);
+
+            device_pool.queued_files++;
+
+            scrub_queued_size += entry_size;
+
+            // same as in queue_files
+            if(device_pool.files.size() > MAX_FILE_QUEUE_SIZE) {
+               while(!abort_scan && device_pool.files.size() > (MAX_FILE_QUEUE_SIZE*3)/4) {
+                  files_lock.unlock();
+
+                  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+                  files_lock.lock();
+               }
+            }
+         }
+
+         if(!scrub_done && errcode != SQLITE_DONE)
+            throw std::runtime_error(FMTNS::format("Cannot select files to scrub ({:s})", sqlite3_errstr(errcode)));
+
+         // a short batch is the last one
+         if(batch_files < SCRUB_BATCH_SIZE)
+            scrub_done = true;
+
+         // ends the read transaction of this batch
+         scrub_files_stmt.release();
+      }
+
+      if((errcode = stmt_scrub_files.finalize()) != SQLITE_OK)
+         throw std::runtime_error(FMTNS::format("Cannot finalize a SQLite statement to select files to scrub ({:s})", sqlite3_errstr(errcode)));
+   }
+   catch (const std::exception& error) {
+      print_stream.error("Cannot scrub files ({:s})", error.what());
+      interrupted_scan = true;
+   }
+
+   // same as in walk_device_tree
+   for(std::unique_ptr<device_pool_t>& device_pool : device_pools)
+      device_pool->files_queued = true;
+}
+
+//
+// Returns `true` if `file_path` is in one of the scan paths of this
+// device pool, or in one of their subdirectories in recursive scans.
+//
+bool file_tree_walker_t::is_scan_path_file(const device_pool_t& device_pool, const std::filesystem::path& file_path) const
+{
+   for(const std::filesystem::path& scan_path : device_pool.scan_paths) {
+      std::filesystem::path rel_path = file_path.lexically_relative(scan_path);
+
+      if(rel_path.empty() || *rel_path.begin() == ".." || rel_path == ".")
+         continue;
+
+      if(options.recursive_scan || std::next(rel_path.begin()) == rel_path.end())
+         return true;
+   }
+
+   return false;
+}
+
+template <typename dir_iter_t>
+void file_tree_walker_t::walk_tree(void)
+{
+   bool abort_scan_reported = false;
+
+   bool time_limit_stopped = false;
+
+   // apply initial rate limits before any files are read
+   update_rate_limits();
+
+   set_thread_affinity();
+
+   if(options.time_limit != std::chrono::seconds::zero())
+      time_limit_end = std::chrono::steady_clock::now() + options.time_limit;
+
+   // start hasher threads and a walker thread for each device
+   for(std::unique_ptr<device_pool_t>& device_pool : device_pools) {
+      // only report devices if they are processed differently from what was requested
+      if(device_pools.size() > 1 || device_pool->thread_count != options.thread_count) {
+         print_stream.info("Using {:d} threads for {:s} device {:s}", device_pool->thread_count,
+                           !device_pool->rotational.has_value() ? "unknown type" : device_pool->rotational.value() ? "rotational" : "non-rotational",
+                           device_pool->device_name.empty() ? "(unknown)" : device_pool->device_name);
+      }
+
+      for(size_t i = 0; i < device_pool->file_trackers.size(); i++)
+         device_pool->file_trackers[i].start();
+
+      if(device_pool->autotuner.has_value()) {
+         const autotuner_t& autotuner = device_pool->autotuner.value();
+
+         print_stream.info("Tuning device {:s} starting with {:d} threads, {:d} hash jobs and {:s} buffers",
+                           device_pool->device_name.empty() ? "(unknown)" : device_pool->device_name,
+                           autotuner.get_value(atp_thread_count), autotuner.get_value(atp_mb_hash_max), hr_bytes(autotuner.get_value(atp_buffer_size)));
+      }
+
+      device_pool->start_time = std::chrono::steady_clock::now();
+
+      // scrubs queue files selected from the database for all devices, rather than walking scan paths
+      if(!options.scrub_files)
+         device_pool->walker_thread = std::thread(&file_tree_walker_t::walk_device_tree<dir_iter_t>, this, std::ref(*device_pool));
+   }
+
+   if(options.scrub_files)
+      scrub_thread = std::thread(&file_tree_walker_t::scrub_files, this);
+
+   // set the report time a few seconds into the fiture
+   std::chrono::steady_clock::time_point report_time = std::chrono::steady_clock::now() + std::chrono::seconds(options.progress_interval);
+
+   // wait for all file hasher threads to process all queued files on all devices
+   while(!abort_scan) {
+      bool all_devices_done = true;
+
+      for(std::unique_ptr<device_pool_t>& device_pool : device_pools) {
+         if(device_pool->end_time.has_value())
+            continue;
+
+         // files_queued must be checked first, so queued_files is final when it is compared
+         if(device_pool->files_queued && (device_pool->progress_info.processed_files + device_pool->progress_info.failed_files) == device_pool->queued_files)
+            device_pool->end_time = std::chrono::steady_clock::now();
+         else {
+            all_devices_done = false;
+
+            if(device_pool->autotuner.has_value())
+               update_tuning(*device_pool);
+         }
+      }
+
+      if(all_devices_done)
+         break;
+
+      if(!time_limit_stopped && time_limit_end != std::chrono::steady_clock::time_point() && std::chrono::steady_clock::now() >= time_limit_end) {
+         stop_at_time_limit();
+         time_limit_stopped = true;
+      }
+
+      update_rate_limits();
+
       std::this_thread::sleep_for(std::chrono::milliseconds(100));
 
       if(options.progress_interval && std::chrono::steady_clock::now() > report_time) {
          report_progress();
          report_time = std::chrono::steady_clock::now() + std::chrono::seconds(options.progress_interval);
       }
+   }
 
-      if(abort_scan) {
-         handle_abort_scan(abort_scan_reported);
-         break;
-      }
+   if(abort_scan)
+      handle_abort_scan(abort_scan_reported);
+
+   // walker threads stop enumerating files when the scan is aborted
+   if(scrub_thread.joinable())
+      scrub_thread.join();
+
+   for(std::unique_ptr<device_pool_t>& device_pool : device_pools) {
+      if(device_pool->walker_thread.joinable())
+         device_pool->walker_thread.join();
    }
 
    // tell all file hasher threads to stop
-   for(size_t i = 0; i < file_trackers.size(); i++)
-      file_trackers[i].stop();
+   for(std::unique_ptr<device_pool_t>& device_pool : device_pools) {
+      for(size_t i = 0; i < device_pool->file_trackers.size(); i++)
+         device_pool->file_trackers[i].stop();
+   }
+
+   // collect combined file removal information in the first file tracker
+   file_tracker_t& first_tracker = device_pools.front()->file_trackers.front();
 
    // and wait until they actually stop
-   for(size_t i = 0; i < file_trackers.size(); i++) {
-      file_trackers[i].join();
+   for(std::unique_ptr<device_pool_t>& device_pool : device_pools) {
+      for(size_t i = 0; i < device_pool->file_trackers.size(); i++) {
+         device_pool->file_trackers[i].join();
 
-      if(options.report_removed_files) {
-         // collect combined file removal information in the first file tracker
-         if(i != 0)
-            file_trackers.front().update_file_removals(file_trackers[i]);
+         if(options.report_removed_files) {
+            if(&device_pool->file_trackers[i] != &first_tracker)
+               first_tracker.update_file_removals(device_pool->file_trackers[i]);
+         }
       }
    }
 
    // reporting removed files only works in a completeded full recursive scan
    if(!interrupted_scan && options.report_removed_files) {
       // allow the file tracker to report file removals, if any were identified
-      file_trackers.front().report_file_removals();
+      first_tracker.report_file_removals();
    }
 
+   // new files are reported after removed files, so those matching removed files are reported as moved
+   if(options.report_removed_files)
+      first_tracker.report_new_files();
+
+   if(device_pools.size() > 1)
+      report_device_progress();
+
    // make it visible that the scan was interrupted (the exception may be hidden behind subsequent messages)
    if(interrupted_scan) { 
       if(options.verify_files)
@@ -223,37 +954,146 @@ void file_tree_walker_t::walk_tree(void)
 
 bool file_tree_walker_t::was_scan_completed(void) const
 {
-   return !interrupted_scan;
+   return !interrupted_scan && !time_limit_reached;
+}
+
+bool file_tree_walker_t::was_time_limit_reached(void) const
+{
+   return time_limit_reached;
 }
 
 uint64_t file_tree_walker_t::get_processed_files(void) const
 {
-   return progress_info.processed_files.load();
+   return get_progress_total(&progress_info_t::processed_files);
 }
 
 uint64_t file_tree_walker_t::get_processed_size(void) const
 {
-   return progress_info.processed_size.load();
+   return get_progress_total(&progress_info_t::processed_size);
 }
 
 uint64_t file_tree_walker_t::get_modified_files(void) const
 {
-   return progress_info.modified_files.load();
+   return get_progress_total(&progress_info_t::modified_files);
 }
 
 uint64_t file_tree_walker_t::get_new_files(void) const
 {
-   return progress_info.new_files.load();
+   return get_progress_total(&progress_info_t::new_files);
 }
 
 uint64_t file_tree_walker_t::get_changed_files(void) const
 {
-   return progress_info.changed_files.load();
+   return get_progress_total(&progress_info_t::changed_files);
 }
 
 uint64_t file_tree_walker_t::get_removed_files(void) const
 {
-   return progress_info.removed_files.load();
+   return get_progress_total(&progress_info_t::removed_files);
+}
+
+uint64_t file_tree_walker_t::get_moved_files(void) const
+{
+   return get_progress_total(&progress_info_t::moved_files);
+}
+
+uint64_t file_tree_walker_t::get_skipped_files(void) const
+{
+   return get_progress_total(&progress_info_t::skipped_files);
+}
+
+uint64_t file_tree_walker_t::get_skipped_size(void) const
+{
+   return get_progress_total(&progress_info_t::skipped_size);
+}
+
+uint64_t file_tree_walker_t::get_linked_files(void) const
+{
+   return get_progress_total(&progress_info_t::linked_files);
+}
+
+uint64_t file_tree_walker_t::get_linked_size(void) const
+{
+   return get_progress_total(&progress_info_t::linked_size);
+}
+
+size_t file_tree_walker_t::get_fd_budget(void) const
+{
+   return fd_budget.max_size();
+}
+
+std::chrono::steady_clock::duration file_tree_walker_t::get_fd_wait_time(void) const
+{
+   return fd_budget.get_wait_time();
+}
+
+std::chrono::steady_clock::duration file_tree_walker_t::get_rate_limit_wait_time(void) const
+{
+   return rate_limiter.get_wait_time();
+}
+
+//
+// Returns the last accepted scan parameters of each tuned device
+// pool. Values being tried when the scan ended are not included.
+//
+std::vector<file_tree_walker_t::device_tuning_t> file_tree_walker_t::get_device_tuning(void) const
+{
+   std::vector<device_tuning_t> device_tuning;
+
+   for(const std::unique_ptr<device_pool_t>& device_pool : device_pools) {
+      if(!device_pool->autotuner.has_value())
+         continue;
+
+      const autotuner_t& autotuner = device_pool->autotuner.value();
+
+      device_tuning.push_back({get_tuning_key(*device_pool),
+                                 autotuner.get_accepted_value(atp_thread_count),
+                                 autotuner.get_accepted_value(atp_mb_hash_max),
+                                 autotuner.get_accepted_value(atp_buffer_size)});
+   }
+
+   return device_tuning;
+}
+
+//
+// Restarts tuning of the device pool with the same scan paths from
+// the specified parameters. This must be called before walk_tree.
+//
+void file_tree_walker_t::set_device_tuning(const device_tuning_t& device_tuning)
+{
+   for(std::unique_ptr<device_pool_t>& device_pool : device_pools) {
+      if(device_pool->autotuner.has_value() && get_tuning_key(*device_pool) == device_tuning.scan_paths)
+         init_autotuner(*device_pool, device_tuning.thread_count, device_tuning.mb_hash_max, device_tuning.buffer_size);
+   }
+}
+
+//
+// Returns scan paths that were completed or stopped when the time
+// limit ran out. Cursors are only valid if all queued files were
+// processed, so none are returned for aborted scans. Scan paths in
+// the same device pool that were not reached, or failed, have no
+// cursors and will be scanned from the start in the next run.
+//
+std::vector<file_tree_walker_t::scan_cursor_t> file_tree_walker_t::get_scan_cursors(void) const
+{
+   std::vector<scan_cursor_t> scan_cursors;
+
+   if(abort_scan)
+      return scan_cursors;
+
+   for(const std::unique_ptr<device_pool_t>& device_pool : device_pools)
+      scan_cursors.insert(scan_cursors.end(), device_pool->scan_cursors.begin(), device_pool->scan_cursors.end());
+
+   return scan_cursors;
+}
+
+//
+// Sets cursors saved in the previous run of this scan, which must be
+// done before walk_tree.
+//
+void file_tree_walker_t::set_scan_cursors(std::vector<scan_cursor_t>&& scan_cursors)
+{
+   resume_cursors = std::move(scan_cursors);
 }
 
 }
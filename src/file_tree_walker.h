@@ -3,6 +3,8 @@
 
 #include "file_tracker.h"
 #include "print_stream.h"
+#include "autotuner.h"
+#include "rate_limiter.h"
 
 #include "fit.h"
 
@@ -14,6 +16,9 @@
 #include <thread>
 #include <vector>
 #include <queue>
+#include <chrono>
+#include <memory>
+#include <optional>
 
 #include <cstdlib>
 #include <cstdint>
@@ -25,9 +30,94 @@ namespace fit {
 // hashers to compute and store file checksums.
 //
 class file_tree_walker_t {
+   public:
+      //
+      // Scan parameters of a device pool, which are identified by the
+      // scan paths of that pool, one per line.
+      //
+      struct device_tuning_t {
+         std::u8string scan_paths;
+         size_t thread_count;
+         size_t mb_hash_max;
+         size_t buffer_size;
+      };
+
+      //
+      // The first file in a scan path that was not processed when
+      // the time limit ran out, so the next run of a scan can resume
+      // at that file. A scan path without a cursor path was completed.
+      //
+      struct scan_cursor_t {
+         std::u8string scan_path;
+         std::optional<std::u8string> cursor_path;     // relative to scan_path
+      };
+
    private:
       static constexpr const size_t MAX_FILE_QUEUE_SIZE = 5000;
 
+      // number of versions selected at a time for a scrub
+      static constexpr const size_t SCRUB_BATCH_SIZE = 1000;
+
+      // throughput is measured for this long before each tuning step
+      static constexpr const std::chrono::seconds AUTOTUNE_WINDOW = std::chrono::seconds(5);
+
+      // smallest read size tried when tuning buffer size
+      static constexpr const size_t AUTOTUNE_MIN_BUFFER_SIZE = 64 * 1024;
+
+      enum autotune_param_t {
+         atp_thread_count,
+         atp_mb_hash_max,
+         atp_buffer_size
+      };
+
+      //
+      // Scan paths on the same storage device are enumerated one after
+      // another into the file queue of a device pool, which is hashed
+      // by its own set of file trackers. Device pools are processed at
+      // the same time, so slow devices do not hold back fast ones.
+      //
+      // Note that files on other devices mounted under a scan path are
+      // processed in the pool of that scan path.
+      //
+      struct device_pool_t {
+         std::optional<uint64_t> device_id;           // empty if device identifiers are not available
+
+         std::string device_name;                     // a block device name or a device number (may be empty)
+
+         std::optional<bool> rotational;              // empty if the device type could not be determined
+
+         std::vector<std::filesystem::path> scan_paths;
+
+         size_t thread_count = 0;
+
+         std::vector<file_tracker_t> file_trackers;
+
+         file_queue_t files;
+         std::mutex files_mtx;
+
+         progress_info_t progress_info;
+
+         // files with multiple hard links found by file trackers of this pool, which requeue waiting links into this pool's queue
+         hardlink_map_t hardlink_map;
+
+         std::atomic<uint64_t> queued_files = 0;
+
+         std::atomic<bool> files_queued = false;      // true when all scan paths have been enumerated
+
+         std::thread walker_thread;                   // not started in scrubs, which use scrub_thread
+
+         std::chrono::steady_clock::time_point start_time;
+         std::optional<std::chrono::steady_clock::time_point> end_time;
+
+         std::optional<autotuner_t> autotuner;        // empty if scan parameters are not being tuned
+
+         std::vector<scan_cursor_t> scan_cursors;     // scan paths completed or stopped by the time limit
+
+         bool time_limit_reached = false;             // guarded by files_mtx
+
+         std::optional<std::filesystem::path> time_limit_cursor;  // the first queued file not started before the time limit (guarded by files_mtx)
+      };
+
    private:
       const options_t& options;
 
@@ -37,18 +127,77 @@ class file_tree_walker_t {
 
       std::optional<int64_t> base_scan_id;
 
-      std::vector<file_tracker_t>   file_trackers;
+      // scan paths grouped by storage device
+      std::vector<std::unique_ptr<device_pool_t>> device_pools;
+
+      // must be constructed before file trackers, which hold a reference to it
+      fd_budget_t fd_budget;
+
+      // byte and file rate limits for all file trackers
+      rate_limiter_t rate_limiter;
+
+      std::optional<rate_limit_schedule_t> rate_limit_schedule;
+
+      // modification time of the rate limits file when it was last read
+      std::filesystem::file_time_type rate_limits_file_time;
+
+      std::chrono::steady_clock::time_point rate_limits_check_time;
+
+      std::atomic<bool> interrupted_scan = false;
 
-      std::queue<std::filesystem::directory_entry> files;
-      std::mutex files_mtx;
+      // when the time limit runs out, file trackers finish files in progress, but do not start new ones
+      std::chrono::steady_clock::time_point time_limit_end;
 
-      progress_info_t progress_info;
+      // true if any of the scan paths was stopped by the time limit
+      std::atomic<bool> time_limit_reached = false;
 
-      bool interrupted_scan = false;
+      // cursors saved in the previous time-limited run of this scan
+      std::vector<scan_cursor_t> resume_cursors;
+
+      // selects files for a scrub and queues them in all device pools
+      std::thread scrub_thread;
 
    private:
       void handle_abort_scan(bool& aborted_scan_reported);
 
+      template <typename dir_iter_t>
+      void walk_device_tree(device_pool_t& device_pool);
+
+      template <typename dir_range_t>
+      bool queue_files(device_pool_t& device_pool, const std::filesystem::path& scan_path, dir_range_t&& dir_range);
+
+      void scrub_files(void);
+
+      bool is_scan_path_file(const device_pool_t& device_pool, const std::filesystem::path& file_path) const;
+
+      void report_device_progress(void);
+
+      void init_autotuner(device_pool_t& device_pool, size_t thread_count, size_t mb_hash_max, size_t buffer_size);
+
+      void apply_tuning(device_pool_t& device_pool);
+
+      void update_tuning(device_pool_t& device_pool);
+
+      void update_rate_limits(void);
+
+      void set_thread_affinity(void);
+
+      void stop_at_time_limit(void);
+
+      uint64_t get_progress_total(std::atomic<uint64_t> progress_info_t::*progress_field) const;
+
+      static std::vector<std::unique_ptr<device_pool_t>> make_device_pools(const options_t& options);
+
+      static std::optional<uint64_t> get_device_id(const std::filesystem::path& scan_path);
+
+      static void get_device_info(uint64_t device_id, std::string& device_name, std::optional<bool>& rotational);
+
+      static size_t get_fd_budget_size(const std::vector<std::unique_ptr<device_pool_t>>& device_pools);
+
+      static std::u8string get_tuning_key(const device_pool_t& device_pool);
+
+      static std::string format_rate_limits(const rate_limits_t& rate_limits);
+
    public:
       file_tree_walker_t(const options_t& options, std::optional<int64_t>& scan_id, std::optional<int64_t>& base_scan_id, print_stream_t& print_stream);
 
@@ -56,6 +205,8 @@ class file_tree_walker_t {
 
       static void cleanup(print_stream_t& print_stream) noexcept;
 
+      static rate_limit_schedule_t read_rate_limits_file(const std::filesystem::path& rate_limits_file);
+
       void report_progress(void);
 
       template <typename dir_iter_t>
@@ -71,6 +222,26 @@ class file_tree_walker_t {
       uint64_t get_changed_files(void) const;
 
       uint64_t get_removed_files(void) const;
+      uint64_t get_moved_files(void) const;
+
+      uint64_t get_skipped_files(void) const;
+      uint64_t get_skipped_size(void) const;
+
+      uint64_t get_linked_files(void) const;
+      uint64_t get_linked_size(void) const;
+
+      size_t get_fd_budget(void) const;
+      std::chrono::steady_clock::duration get_fd_wait_time(void) const;
+
+      std::chrono::steady_clock::duration get_rate_limit_wait_time(void) const;
+
+      std::vector<device_tuning_t> get_device_tuning(void) const;
+      void set_device_tuning(const device_tuning_t& device_tuning);
+
+      bool was_time_limit_reached(void) const;
+
+      std::vector<scan_cursor_t> get_scan_cursors(void) const;
+      void set_scan_cursors(std::vector<scan_cursor_t>&& scan_cursors);
 };
 
 }
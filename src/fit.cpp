@@ -4,6 +4,15 @@
 // Copyright (c) 2023, Stone Steps Inc.
 //
 #include "file_tree_walker.h"
+#include "scan_diff.h"
+#include "dup_groups.h"
+#include "dir_rollup.h"
+#include "dir_cache.h"
+#include "deferred_indexes.h"
+#include "memory_db.h"
+#include "wal_checkpointer.h"
+#include "autotuner.h"
+#include "rate_limiter.h"
 #include "print_stream.h"
 #include "sqlite.h"
 #include "unicode.h"
@@ -20,12 +29,15 @@
 #include <csignal>
 #include <cstdarg>
 #include <cstring>
+#include <cmath>
 
 #include <string>
 #include <stdexcept>
 #include <filesystem>
 #include <mutex>
 #include <atomic>
+#include <thread>
+#include <algorithm>
 #include <vector>
 #include <queue>
 #include <chrono>
@@ -84,8 +96,26 @@ static const char *copyright = "Copyright (c) 2026 Stone Steps Inc.";
 //   v7.0   Added scans.completed_time
 // 
 //   v8.0   Added scans.last_update_time, scans.cumulative_duration, scans.times_updated
+// 
+//   v9.0   Added tables hash_checkpoints, scan_tuning, scan_cursors, scan_dirs, dirs, deferred_indexes, views dir_paths, file_paths,
+//          versions.fingerprint, versions.verified_time, files.dir_id; replaced files.path with dirs;
+//          added scans.first_scanset_id, scans.last_scanset_id, scans.file_count, scans.total_size,
+//          index ix_scansets_scan
 //
-static const int DB_SCHEMA_VERSION = 80;
+static const int DB_SCHEMA_VERSION = 90;
+
+// upper limits for tuned scan parameters, which may be lowered to fit within cgroup CPU and memory limits
+static constexpr const size_t AUTOTUNE_MAX_THREAD_COUNT = 64;
+static constexpr const size_t AUTOTUNE_MAX_BUFFER_SIZE = 4 * 1024 * 1024;
+#ifndef NO_SSE_AVX
+static constexpr const size_t AUTOTUNE_MAX_MB_HASH = 32;
+#endif
+
+// how often a memory database is saved into the database file while files are scanned
+static constexpr const std::chrono::minutes MEMORY_DB_SAVE_INTERVAL(15);
+
+// memory for file buffers when there is no cgroup memory limit
+static constexpr const uint64_t AUTOTUNE_MEMORY_BUDGET = 1024 * 1024 * 1024;
 
 std::atomic<bool> abort_scan = false;
 
@@ -119,20 +149,34 @@ void print_usage(void)
    fputs("    -m message   - optional scan description\n", stdout);
    fputs("    -r           - recursive scan\n", stdout);
    fputs("    -v [scan]    - verify scanned files against last or specified scan (default: last)\n", stdout);
+   fputs("    -V [size]    - verify files verified longest ago, up to this size or the -B time limit\n", stdout);
 #ifndef NO_SSE_AVX
    fputs("    -H number    - multi-buffer hash maximum (default: 8, min: 1, max: 32)\n", stdout);
+   fputs("    -K size      - hash checkpoint interval for large files, in 1024 units (default: 1G, min: 16M, 0: none)\n", stdout);
+   fputs("    -P           - skip hashing large files with unchanged sampled fingerprints\n", stdout);
 #endif
    fputs("    -t number    - file hasher thread count (default: 4, min: 1, max: 64)\n", stdout);
+   fputs("    -T number    - file hasher thread count for rotational drives (default: 2, min: 1, max: 64)\n", stdout);
    fputs("    -s size      - file buffer size (default: 524288, min: 512, max: 16777216)\n", stdout);
+   fputs("    -A           - tune -t, -H and -s while scanning, starting with their values\n", stdout);
+   fputs("    -L [number]  - hash largest files first within this many queued files (default: 1000, max: 5000)\n", stdout);
+   fputs("    -Q limits    - limit file reads to bytes[/files] per second, optionally scheduled, or @path\n", stdout);
+   fputs("    -N kind      - pin file hasher threads (default: none, choice: cores, nodes)\n", stdout);
+   fputs("    -B duration  - stop queuing files after this time (e.g. 4h, 1h30m) and continue later with -u\n", stdout);
    fputs("    -i seconds   - progress reporting interval (default: 10, min: 1)\n", stdout);
    fputs("    -u           - continue last scan (update last scanset)\n", stdout);
+   fputs("    -M size      - scan against a copy of the database in memory, up to this size, saved every 15 minutes\n", stdout);
    fputs("    -l path      - log file path\n", stdout);
    fputs("    -a           - skip restricted access directories\n", stdout);
    fputs("    -X [ext,...] - EXIF file extensions (default: .jpg.cr2.dng.nef.tif.heif.webp, none: no EXIF)\n", stdout);
    fputs("    -J           - store EXIF obtained from Exiv2 as JSON\n", stdout);
    fputs("    -S kind      - path separator for querying the database (default: none, choice: Windows, POSIX)\n", stdout);
-   fputs("    -R           - report removed files in verification scans\n", stdout);
+   fputs("    -R           - report removed files in verification scans and all differences in scans\n", stdout);
+   fputs("    -F           - hash files with a changed size in verification scans\n", stdout);
    fputs("    -?           - this help\n", stdout);
+   fputs("    --diff base scan - list files added, removed, changed and moved between two scans as tab-separated values\n", stdout);
+   fputs("    --dups scan [size] - list files with the same hash in a scan, optionally at least this size, as tab-separated values\n", stdout);
+   fputs("    --immutable-db - with -v, read a database that nothing changes while it is verified, such as on read-only media\n", stdout);
 
    fputc('\n', stdout);
 }
@@ -153,7 +197,7 @@ options_t parse_options(int argc, char *argv[])
       size_t opt_i = i;
 
       // conditions should match the loop with same option conditions following the switch for options with values
-      if(*(argv[i]+1) != 'm' && *(argv[i]+1) != 'd' && *(argv[i]+1) != 'a') {
+      if(*(argv[i]+1) != 'm' && *(argv[i]+1) != 'd' && *(argv[i]+1) != 'a' && *(argv[i]+1) != 'M') {
          if(i > 1)
             options.all += ' ';
 
@@ -167,6 +211,25 @@ options_t parse_options(int argc, char *argv[])
             options.print_usage = true;
          else if(!strncmp(argv[i]+2, "ver", 3))
             options.print_version = true;
+         else if(!strcmp(argv[i]+2, "immutable-db"))
+            options.immutable_db = true;
+         else if(!strcmp(argv[i]+2, "diff")) {
+            if(i+2 >= argc || *(argv[i+1]) == '-' || *(argv[i+2]) == '-')
+               throw std::runtime_error("Missing scan identifiers to compare");
+
+            options.diff_base_scan_id = atoll(argv[++i]);
+            options.diff_scan_id = atoll(argv[++i]);
+         }
+         else if(!strcmp(argv[i]+2, "dups")) {
+            if(i+1 == argc || *(argv[i+1]) == '-')
+               throw std::runtime_error("Missing scan identifier to search for duplicates");
+
+            options.dups_scan_id = atoll(argv[++i]);
+
+            // without a size, duplicates of all sizes are listed
+            if(i+1 < argc && *(argv[i+1]) != '-')
+               options.dups_min_size = parse_size(argv[++i]);
+         }
          else
             throw std::runtime_error(FMTNS::format("Invalid long option {:s}", argv[i]));
       }
@@ -234,6 +297,18 @@ options_t parse_options(int argc, char *argv[])
                if(i+1 < argc && *(argv[i+1]) != '-')
                   options.verify_scan_id = atoi(argv[++i]);
 
+               break;
+            case 'V':
+               // a scrub is a verification scan of files selected from the base scan
+               options.verify_files = true;
+               options.scrub_files = true;
+
+               // without a size, files are verified until the time limit runs out or all of them are verified
+               if(i+1 < argc && *(argv[i+1]) != '-') {
+                  if(!(options.scrub_size = parse_size(argv[++i])))
+                     throw std::runtime_error("The scrub size must be a positive size");
+               }
+
                break;
             case 't':
                if(i+1 == argc || *(argv[i+1]) == '-')
@@ -241,6 +316,12 @@ options_t parse_options(int argc, char *argv[])
 
                options.thread_count = atoi(argv[++i]);
                break;
+            case 'T':
+               if(i+1 == argc || *(argv[i+1]) == '-')
+                  throw std::runtime_error("Missing rotational drive thread count value");
+
+               options.rotational_thread_count = atoi(argv[++i]);
+               break;
             case 's':
                if(i+1 == argc || *(argv[i+1]) == '-')
                   throw std::runtime_error("Missing buffer size value");
@@ -282,6 +363,15 @@ options_t parse_options(int argc, char *argv[])
 
                options.mb_hash_max = atoi(argv[++i]);
                break;
+            case 'K':
+               if(i+1 == argc || *(argv[i+1]) == '-')
+                  throw std::runtime_error("Missing hash checkpoint interval value");
+
+               options.hash_checkpoint_interval = parse_size(argv[++i], true);
+               break;
+            case 'P':
+               options.fingerprint_files = true;
+               break;
    #endif
             case 'S':
                if(i+1 == argc || *(argv[i+1]) == '-')
@@ -302,6 +392,61 @@ options_t parse_options(int argc, char *argv[])
             case 'R':
                options.report_removed_files = true;
                break;
+            case 'F':
+               options.hash_size_mismatch = true;
+               break;
+            case 'A':
+               options.autotune = true;
+               break;
+            case 'Q':
+               if(i+1 == argc || *(argv[i+1]) == '-')
+                  throw std::runtime_error("Missing rate limits value");
+
+               // a rate limits file is checked for changes while scanning
+               if(*argv[++i] == '@')
+                  options.rate_limits_file = argv[i]+1;
+               else
+                  options.rate_limits = argv[i];
+               break;
+            case 'L':
+               // the window size is optional, but if it is specified, it must be valid
+               if(i+1 < argc && *(argv[i+1]) != '-') {
+                  if(!(options.schedule_window = atoi(argv[++i])))
+                     throw std::runtime_error("Invalid look-ahead window size");
+               }
+               else
+                  options.schedule_window = 1000;
+               break;
+            case 'B':
+               if(i+1 == argc || *(argv[i+1]) == '-')
+                  throw std::runtime_error("Missing time limit value");
+
+               options.time_limit = parse_duration(argv[++i]);
+
+               if(options.time_limit == std::chrono::seconds::zero())
+                  throw std::runtime_error("The time limit must be a positive duration");
+
+               break;
+            case 'M':
+               if(i+1 == argc || *(argv[i+1]) == '-')
+                  throw std::runtime_error("Missing memory database size value");
+
+               if(!(options.memory_db_size = parse_size(argv[++i])).value())
+                  throw std::runtime_error("The memory database size must be a positive size");
+
+               break;
+            case 'N':
+               if(i+1 == argc || *(argv[i+1]) == '-')
+                  throw std::runtime_error("Missing thread affinity value");
+
+               if(!strcmp(argv[++i], "cores"))
+                  options.thread_affinity = thread_affinity_t::cores;
+               else if(!strcmp(argv[i], "nodes"))
+                  options.thread_affinity = thread_affinity_t::nodes;
+               else
+                  throw std::runtime_error("The thread affinity must be either cores or nodes");
+
+               break;
             case 'h':
             case '?':
                options.print_usage = true;
@@ -316,9 +461,11 @@ options_t parse_options(int argc, char *argv[])
       // wrapping values that may contain spaces in double quotes. Skip
       // `-d` to allow additional directories and `-m` because we want
       // to collect only the original message (it may get messy tracking
-      // multiple messages).
+      // multiple messages). Skip `-M`, which only changes where the
+      // database is kept while scanning, so scans may be continued
+      // with a different memory database size or without one.
       // 
-      if(opt_i != i && *(argv[opt_i]+1) != 'm' && *(argv[opt_i]+1) != 'd') {
+      if(opt_i != i && *(argv[opt_i]+1) != 'm' && *(argv[opt_i]+1) != 'd' && *(argv[opt_i]+1) != 'M') {
          // wrap arguments that may have spaces in quotes
          if(strchr("blp", *(argv[opt_i]+1)))
             options.all = options.all + u8" \"" + reinterpret_cast<const char8_t*>(argv[i]) + u8"\"";
@@ -330,21 +477,130 @@ options_t parse_options(int argc, char *argv[])
    return options;
 }
 
+//
+// Threads, multi-buffer contexts and file buffers are created for the
+// values of -t, -H and -s, which become tuning maximums when scan
+// parameters are tuned, while the original values are used as the
+// starting point. Maximums are derived from cgroup CPU and memory
+// limits, where available, and never go below the original values.
+//
+void set_autotune_maximums(options_t& options)
+{
+   options.autotune_thread_count = options.thread_count;
+   options.autotune_buffer_size = options.buffer_size;
+
+   size_t cpu_count = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+   if(std::optional<double> cpu_limit = autotuner_t::get_cgroup_cpu_limit(); cpu_limit.has_value())
+      cpu_count = std::min(cpu_count, std::max<size_t>(static_cast<size_t>(std::ceil(cpu_limit.value())), 1));
+
+   // scan threads spend much of their time waiting for file reads and database updates
+   options.thread_count = std::max(options.thread_count, std::min<size_t>(cpu_count * 2, AUTOTUNE_MAX_THREAD_COUNT));
+   options.buffer_size = std::max(options.buffer_size, AUTOTUNE_MAX_BUFFER_SIZE);
+
+#ifndef NO_SSE_AVX
+   options.autotune_mb_hash_max = options.mb_hash_max;
+   options.mb_hash_max = std::max(options.mb_hash_max, AUTOTUNE_MAX_MB_HASH);
+
+   size_t& mb_hash_max = options.mb_hash_max;
+   size_t min_mb_hash_max = options.autotune_mb_hash_max;
+#else
+   size_t mb_hash_max = 1;
+   size_t min_mb_hash_max = 1;
+#endif
+
+   // each thread has its own file buffer and one more buffer for each multi-buffer hash job
+   uint64_t memory_budget = autotuner_t::get_cgroup_memory_limit().value_or(AUTOTUNE_MEMORY_BUDGET * 4) / 4;
+
+   while(static_cast<uint64_t>(options.thread_count) * (mb_hash_max + 1) * options.buffer_size > memory_budget) {
+      if(options.buffer_size > options.autotune_buffer_size)
+         options.buffer_size = std::max(options.buffer_size / 2, options.autotune_buffer_size);
+      else if(mb_hash_max > min_mb_hash_max)
+         mb_hash_max = std::max(mb_hash_max / 2, min_mb_hash_max);
+      else if(options.thread_count > options.autotune_thread_count)
+         options.thread_count--;
+      else
+         break;
+   }
+}
+
 void verify_options(options_t& options)
 {
-   if(options.report_removed_files && !options.verify_files)
-      throw std::runtime_error("The -R option can only be used with -v");
+   if(options.diff_scan_id.has_value()) {
+      if(options.diff_base_scan_id.value() <= 0 || options.diff_scan_id.value() <= 0 || options.diff_base_scan_id.value() == options.diff_scan_id.value())
+         throw std::runtime_error("The --diff option requires two different scan identifiers");
+
+      if(options.verify_files || options.update_last_scanset || options.report_removed_files)
+         throw std::runtime_error("The --diff option cannot be used with -v, -V, -u or -R");
+
+      if(options.dups_scan_id.has_value())
+         throw std::runtime_error("The --diff option cannot be used with --dups");
+   }
+
+   if(options.dups_scan_id.has_value()) {
+      if(options.dups_scan_id.value() <= 0)
+         throw std::runtime_error("The --dups option requires a scan identifier");
+
+      if(options.verify_files || options.update_last_scanset || options.report_removed_files)
+         throw std::runtime_error("The --dups option cannot be used with -v, -V, -u or -R");
+   }
+
+   // scans with -R report differences against the last scan and cannot be continued, which would skip files processed earlier
+   if(options.report_removed_files && !options.verify_files && options.update_last_scanset)
+      throw std::runtime_error("The -R option cannot be used with -u");
+
+   if(options.report_removed_files && options.time_limit != std::chrono::seconds::zero())
+      throw std::runtime_error("The -R option cannot be used with -B");
+
+   if(options.hash_size_mismatch && !options.verify_files)
+      throw std::runtime_error("The -F option can only be used with -v");
 
    if(options.thread_count == 0 || options.thread_count > 64)
       throw std::runtime_error("Invalid thread count");
 
+   if(options.rotational_thread_count == 0 || options.rotational_thread_count > 64)
+      throw std::runtime_error("Invalid rotational drive thread count");
+
    if(options.buffer_size < 512 || options.buffer_size > 16*1024*1024)
       throw std::runtime_error("Invalid file buffer size");
 
+   if(options.schedule_window > 5000)
+      throw std::runtime_error("Invalid look-ahead window size");
+
+   if(options.time_limit != std::chrono::seconds::zero() && options.verify_files && !options.scrub_files)
+      throw std::runtime_error("The -B option cannot be used with -v, unless -V is used");
+
+   // verification scans do not change file records and read the database file directly
+   if(options.memory_db_size.has_value() && options.verify_files)
+      throw std::runtime_error("The -M option cannot be used with -v or -V");
+
+   if(options.immutable_db && (!options.verify_files || options.scrub_files))
+      throw std::runtime_error("The --immutable-db option can only be used with -v");
+
+   if(options.report_removed_files && options.scrub_files)
+      throw std::runtime_error("The -R option cannot be used with -V, which reports removed files it selected");
+
+   // validate rate limits before the scan starts (a rate limits file may be changed later)
+   if(options.rate_limits.has_value())
+      rate_limit_schedule_t::parse(options.rate_limits.value());
+   else if(!options.rate_limits_file.empty())
+      file_tree_walker_t::read_rate_limits_file(options.rate_limits_file);
+
+#ifndef NO_SSE_AVX
+   if(options.hash_checkpoint_interval && options.hash_checkpoint_interval < 16*1024*1024)
+      throw std::runtime_error("Invalid hash checkpoint interval");
+
+   if(options.fingerprint_files && options.verify_files)
+      throw std::runtime_error("The -P option cannot be used with -v");
+#endif
+
    // round buffer size up to the nearest 512 or 4096 boundary, if it's not already there
    size_t block_size = options.buffer_size < 4096 ? 512 : 4096;
    options.buffer_size += (block_size - options.buffer_size % block_size) % block_size;
 
+   if(options.autotune)
+      set_autotune_maximums(options);
+
    if(options.progress_interval < 0)
       throw std::runtime_error("The progress reporting interval must be a positive number");
 
@@ -452,11 +708,21 @@ sqlite3 *open_sqlite_database(const options_t& options, int& schema_version, pri
 
    char *errmsg = nullptr;
    int errcode = SQLITE_OK;
-   int sqlite_flags = options.verify_files ? SQLITE_OPEN_READONLY : SQLITE_OPEN_READWRITE;
+   int sqlite_flags = options.verify_files || options.diff_scan_id.has_value() || options.dups_scan_id.has_value() ? SQLITE_OPEN_READONLY : SQLITE_OPEN_READWRITE;
 
    try {
+      bool immutable = options.immutable_db;
+
+      // verification without scrubbing never changes the database and may read it as immutable, if asked, such as from read-only media
+      if(options.verify_files && !options.scrub_files) {
+         if((errcode = open_sqlite_readonly(options.db_path, &file_scan_db, immutable)) == SQLITE_OK && options.immutable_db && !immutable)
+            print_stream.warning("The database WAL has changes that were not saved in the database file and cannot be read as immutable");
+      }
+      else
+         errcode = sqlite3_open_v2(reinterpret_cast<const char*>(options.db_path.u8string().c_str()), &file_scan_db, sqlite_flags, nullptr);
+
       // attempt to open an existing database first
-      if((errcode = sqlite3_open_v2(reinterpret_cast<const char*>(options.db_path.u8string().c_str()), &file_scan_db, sqlite_flags, nullptr)) == SQLITE_OK) {
+      if(errcode == SQLITE_OK) {
          sqlite_stmt_t user_version_stmt("PRAGMA user_version"sv);
 
          if((errcode = user_version_stmt.prepare(file_scan_db, "PRAGMA user_version;"sv)) != SQLITE_OK)
@@ -473,7 +739,7 @@ sqlite3 *open_sqlite_database(const options_t& options, int& schema_version, pri
             fputs(FMTNS::format("Cannot finalize SQLite statement for a database schema version ({:s})", sqlite3_errstr(errcode)).c_str(), stderr);
       }
       else {
-         if(options.verify_files)
+         if(options.verify_files || options.diff_scan_id.has_value() || options.dups_scan_id.has_value())
             throw std::runtime_error(FMTNS::format("Cannot open a SQLite database in {:s}", u8sv(options.db_path.generic_u8string())));
 
          // attempt to create a new database
@@ -482,16 +748,41 @@ sqlite3 *open_sqlite_database(const options_t& options, int& schema_version, pri
 
          print_stream.info("Creating a new SQLite database {:s}", u8sv(options.db_path.generic_u8string()));
 
+         // dirs table
+         if(sqlite3_exec(file_scan_db, "CREATE TABLE dirs ("
+                                          "id INTEGER NOT NULL PRIMARY KEY,"
+                                          "parent_id INTEGER NOT NULL,"
+                                          "name TEXT NOT NULL);", nullptr, nullptr, &errmsg) != SQLITE_OK)
+            throw std::runtime_error("Cannot create table 'dirs' ("s + std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get() + ")");
+
+         if(sqlite3_exec(file_scan_db, "CREATE UNIQUE INDEX ix_dirs_parent_name ON dirs (parent_id, name);", nullptr, nullptr, &errmsg) != SQLITE_OK)
+            throw std::runtime_error("Cannot create a parent name index for 'dirs' ("s + std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get() + ")");
+
          // files table
          if(sqlite3_exec(file_scan_db, "CREATE TABLE files ("
                                           "id INTEGER NOT NULL PRIMARY KEY,"
+                                          "dir_id INTEGER NOT NULL,"
                                           "name TEXT NOT NULL,"
-                                          "ext TEXT,"
-                                          "path TEXT NOT NULL);", nullptr, nullptr, &errmsg) != SQLITE_OK)
+                                          "ext TEXT);", nullptr, nullptr, &errmsg) != SQLITE_OK)
             throw std::runtime_error("Cannot create table 'files' ("s + std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get() + ")");
 
-         if(sqlite3_exec(file_scan_db, "CREATE UNIQUE INDEX ix_files_path ON files (path);", nullptr, nullptr, &errmsg) != SQLITE_OK)
-            throw std::runtime_error("Cannot create path index for 'files' ("s + std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get());
+         if(sqlite3_exec(file_scan_db, "CREATE UNIQUE INDEX ix_files_dir_name ON files (dir_id, name);", nullptr, nullptr, &errmsg) != SQLITE_OK)
+            throw std::runtime_error("Cannot create a directory name index for 'files' ("s + std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get() + ")");
+
+         // directory and file paths for SQL scripts, which are not used by fit
+         if(sqlite3_exec(file_scan_db, "CREATE VIEW dir_paths AS "
+                                          "WITH RECURSIVE dir_tree (id, path) AS ("
+                                             "SELECT id, name FROM dirs WHERE parent_id = 0 "
+                                             "UNION ALL "
+                                             "SELECT dirs.id, dir_tree.path || dirs.name FROM dirs JOIN dir_tree ON dirs.parent_id = dir_tree.id"
+                                          ") "
+                                          "SELECT id, path FROM dir_tree;", nullptr, nullptr, &errmsg) != SQLITE_OK)
+            throw std::runtime_error("Cannot create view 'dir_paths' ("s + std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get() + ")");
+
+         if(sqlite3_exec(file_scan_db, "CREATE VIEW file_paths AS "
+                                          "SELECT files.id, files.dir_id, files.name, files.ext, coalesce(dir_paths.path, '') || files.name AS path "
+                                          "FROM files LEFT JOIN dir_paths ON files.dir_id = dir_paths.id;", nullptr, nullptr, &errmsg) != SQLITE_OK)
+            throw std::runtime_error("Cannot create view 'file_paths' ("s + std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get() + ")");
 
          // versions table
          if(sqlite3_exec(file_scan_db, "CREATE TABLE versions ("
@@ -503,7 +794,9 @@ sqlite3 *open_sqlite_database(const options_t& options, int& schema_version, pri
                                           "read_size INTEGER NOT NULL, "
                                           "exif_id INTEGER, "
                                           "hash_type VARCHAR(32) NOT NULL,"
-                                          "hash TEXT);", nullptr, nullptr, &errmsg) != SQLITE_OK)
+                                          "hash TEXT,"
+                                          "fingerprint TEXT,"
+                                          "verified_time INTEGER);", nullptr, nullptr, &errmsg) != SQLITE_OK)
             throw std::runtime_error("Cannot create table 'versions' ("s + std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get() + ")");
 
          if(sqlite3_exec(file_scan_db, "CREATE UNIQUE INDEX ix_versions_file ON versions (file_id, version);", nullptr, nullptr, &errmsg) != SQLITE_OK)
@@ -512,6 +805,10 @@ sqlite3 *open_sqlite_database(const options_t& options, int& schema_version, pri
          if(sqlite3_exec(file_scan_db, "CREATE INDEX ix_versions_hash ON versions (hash, hash_type);", nullptr, nullptr, &errmsg) != SQLITE_OK)
             throw std::runtime_error("Cannot create a hash index for 'versions' ("s + std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get() + ")");
 
+         // zero-length files have no data to verify and earlier versions of files cannot be verified, so neither is indexed for scrubs
+         if(sqlite3_exec(file_scan_db, "CREATE INDEX ix_versions_verified_time ON versions (verified_time) WHERE hash IS NOT NULL AND verified_time IS NOT NULL;", nullptr, nullptr, &errmsg) != SQLITE_OK)
+            throw std::runtime_error("Cannot create a verified time index for 'versions' ("s + std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get() + ")");
+
          // exif table
          if(sqlite3_exec(file_scan_db, "CREATE TABLE exif ("
                                           "id INTEGER NOT NULL PRIMARY KEY,"
@@ -545,7 +842,11 @@ sqlite3 *open_sqlite_database(const options_t& options, int& schema_version, pri
                                           "cumulative_duration INTEGER,"
                                           "base_path TEXT,"
                                           "options TEXT NOT NULL,"
-                                          "message TEXT);", nullptr, nullptr, &errmsg) != SQLITE_OK)
+                                          "message TEXT,"
+                                          "first_scanset_id INTEGER,"
+                                          "last_scanset_id INTEGER,"
+                                          "file_count INTEGER,"
+                                          "total_size INTEGER);", nullptr, nullptr, &errmsg) != SQLITE_OK)
             throw std::runtime_error("Cannot create table 'scans' ("s + std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get() + ")");
 
          if(sqlite3_exec(file_scan_db, "CREATE INDEX ix_scans_timestamp ON scans (scan_time);", nullptr, nullptr, &errmsg) != SQLITE_OK)
@@ -561,6 +862,74 @@ sqlite3 *open_sqlite_database(const options_t& options, int& schema_version, pri
          if(sqlite3_exec(file_scan_db, "CREATE UNIQUE INDEX ix_scansets_version_scan ON scansets (version_id, scan_id);", nullptr, nullptr, &errmsg) != SQLITE_OK)
             throw std::runtime_error("Cannot create a unique scan version index for 'scansets' ("s + std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get() + ")");
 
+         // records of each scan are appended in the index order, so this index is not deferred during the first scan
+         if(sqlite3_exec(file_scan_db, "CREATE INDEX ix_scansets_scan ON scansets (scan_id);", nullptr, nullptr, &errmsg) != SQLITE_OK)
+            throw std::runtime_error("Cannot create a scan index for 'scansets' ("s + std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get() + ")");
+
+         // hash_checkpoints table
+         if(sqlite3_exec(file_scan_db, "CREATE TABLE hash_checkpoints ("
+                                          "id INTEGER NOT NULL PRIMARY KEY,"
+                                          "scan_id INTEGER NOT NULL,"
+                                          "path TEXT NOT NULL,"
+                                          "mod_time INTEGER NOT NULL,"
+                                          "entry_size INTEGER NOT NULL,"
+                                          "file_inode INTEGER,"
+                                          "hash_type VARCHAR(32) NOT NULL,"
+                                          "hashed_size INTEGER NOT NULL,"
+                                          "hash_state BLOB NOT NULL,"
+                                          "checkpoint_time INTEGER NOT NULL);", nullptr, nullptr, &errmsg) != SQLITE_OK)
+            throw std::runtime_error("Cannot create table 'hash_checkpoints' ("s + std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get() + ")");
+
+         if(sqlite3_exec(file_scan_db, "CREATE UNIQUE INDEX ix_hash_checkpoints_scan_path ON hash_checkpoints (scan_id, path);", nullptr, nullptr, &errmsg) != SQLITE_OK)
+            throw std::runtime_error("Cannot create a unique scan path index for 'hash_checkpoints' ("s + std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get() + ")");
+
+         // scan_tuning table
+         if(sqlite3_exec(file_scan_db, "CREATE TABLE scan_tuning ("
+                                          "id INTEGER NOT NULL PRIMARY KEY,"
+                                          "scan_id INTEGER NOT NULL,"
+                                          "scan_paths TEXT NOT NULL,"
+                                          "thread_count INTEGER NOT NULL,"
+                                          "mb_hash_max INTEGER,"
+                                          "buffer_size INTEGER NOT NULL);", nullptr, nullptr, &errmsg) != SQLITE_OK)
+            throw std::runtime_error("Cannot create table 'scan_tuning' ("s + std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get() + ")");
+
+         if(sqlite3_exec(file_scan_db, "CREATE INDEX ix_scan_tuning_scan_paths ON scan_tuning (scan_paths, scan_id);", nullptr, nullptr, &errmsg) != SQLITE_OK)
+            throw std::runtime_error("Cannot create a scan paths index for 'scan_tuning' ("s + std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get() + ")");
+
+         // scan_cursors table
+         if(sqlite3_exec(file_scan_db, "CREATE TABLE scan_cursors ("
+                                          "id INTEGER NOT NULL PRIMARY KEY,"
+                                          "scan_id INTEGER NOT NULL,"
+                                          "scan_path TEXT NOT NULL,"
+                                          "cursor_path TEXT);", nullptr, nullptr, &errmsg) != SQLITE_OK)
+            throw std::runtime_error("Cannot create table 'scan_cursors' ("s + std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get() + ")");
+
+         if(sqlite3_exec(file_scan_db, "CREATE INDEX ix_scan_cursors_scan ON scan_cursors (scan_id);", nullptr, nullptr, &errmsg) != SQLITE_OK)
+            throw std::runtime_error("Cannot create a scan index for 'scan_cursors' ("s + std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get() + ")");
+
+         // scan_dirs table is upserted for every file and is clustered on its key, so each upsert is a single b-tree search
+         if(sqlite3_exec(file_scan_db, "CREATE TABLE scan_dirs ("
+                                          "scan_id INTEGER NOT NULL,"
+                                          "dir_id INTEGER NOT NULL,"
+                                          "dir_file_count INTEGER NOT NULL,"
+                                          "dir_size INTEGER NOT NULL,"
+                                          "dir_max_mod_time INTEGER,"
+                                          "dir_rollup_hash TEXT,"
+                                          "file_count INTEGER,"
+                                          "total_size INTEGER,"
+                                          "max_mod_time INTEGER,"
+                                          "rollup_hash TEXT,"
+                                          "PRIMARY KEY (scan_id, dir_id)) WITHOUT ROWID;", nullptr, nullptr, &errmsg) != SQLITE_OK)
+            throw std::runtime_error("Cannot create table 'scan_dirs' ("s + std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get() + ")");
+
+         // deferred_indexes table
+         if(sqlite3_exec(file_scan_db, "CREATE TABLE deferred_indexes ("
+                                          "id INTEGER NOT NULL PRIMARY KEY,"
+                                          "scan_id INTEGER NOT NULL,"
+                                          "name TEXT NOT NULL,"
+                                          "sql TEXT NOT NULL);", nullptr, nullptr, &errmsg) != SQLITE_OK)
+            throw std::runtime_error("Cannot create table 'deferred_indexes' ("s + std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get() + ")");
+
          // set the current database schema version
          if(sqlite3_exec(file_scan_db, ("PRAGMA user_version="+std::to_string(DB_SCHEMA_VERSION)+";").c_str(), nullptr, nullptr, &errmsg) != SQLITE_OK)
             throw std::runtime_error("Cannot set the database schema version ("s + std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get() + ")");
@@ -634,14 +1003,27 @@ int64_t insert_scan_record(const options_t& options, sqlite3 *file_scan_db)
    return scan_id;
 }
 
+//
+// Completed scans record the range of their scanset identifiers and
+// scan totals, so scan-scoped queries do not need to look up all
+// scanset records to find them.
+//
 int complete_scan_record(int64_t scan_id, sqlite3 *file_scan_db)
 {
    int errcode = SQLITE_OK;
 
    sqlite_stmt_t stmt_complete_scan("complete scan"sv);
 
-   //                                                                    1               2
-   std::string_view sql_complete_scan = "UPDATE scans SET completed_time=? WHERE rowid = ?"sv;
+   //                                                                    1
+   std::string_view sql_complete_scan = "UPDATE scans SET completed_time=?, "
+                                          "(first_scanset_id, last_scanset_id, file_count, total_size) = ("
+                                             "SELECT MIN(scansets.id), MAX(scansets.id), COUNT(*), COALESCE(SUM(entry_size), 0) "
+                                             "FROM scansets JOIN versions ON version_id = versions.rowid "
+   //                                                         2
+                                             "WHERE scan_id = ?"
+                                          ") "
+   //                                                    3
+                                          "WHERE rowid = ?"sv;
 
    stmt_complete_scan.prepare(file_scan_db, sql_complete_scan);
 
@@ -649,6 +1031,7 @@ int complete_scan_record(int64_t scan_id, sqlite3 *file_scan_db)
 
    complete_scan_stmt.bind_param(std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()));
    complete_scan_stmt.bind_param(scan_id);
+   complete_scan_stmt.bind_param(scan_id);
 
    errcode = sqlite3_step(stmt_complete_scan);
 
@@ -685,14 +1068,413 @@ int update_scan_duration(const options_t& options, int64_t scan_id, int64_t scan
    return sqlite3_changes(file_scan_db);
 }
 
+int delete_hash_checkpoints(int64_t scan_id, sqlite3 *file_scan_db)
+{
+   int errcode = SQLITE_OK;
+
+   sqlite_stmt_t stmt_delete_hash_checkpoints("delete hash checkpoints"sv);
+
+   //                                                                                   1
+   std::string_view sql_delete_hash_checkpoints = "DELETE FROM hash_checkpoints WHERE scan_id = ?"sv;
+
+   stmt_delete_hash_checkpoints.prepare(file_scan_db, sql_delete_hash_checkpoints);
+
+   sqlite_param_binder_t delete_hash_checkpoints_stmt = stmt_delete_hash_checkpoints.get_param_binder();
+
+   delete_hash_checkpoints_stmt.bind_param(scan_id);
+
+   errcode = sqlite3_step(stmt_delete_hash_checkpoints);
+
+   if(errcode != SQLITE_DONE)
+      return -1;
+
+   // return the number of hash checkpoints that were left behind
+   return sqlite3_changes(file_scan_db);
+}
+
+//
+// Selects scan path positions saved when the last run of this scan
+// ran out of time.
+//
+std::vector<file_tree_walker_t::scan_cursor_t> select_scan_cursors(int64_t scan_id, sqlite3 *file_scan_db)
+{
+   std::vector<file_tree_walker_t::scan_cursor_t> scan_cursors;
+
+   int errcode = SQLITE_OK;
+
+   sqlite_stmt_t stmt_scan_cursors("scan cursors"sv);
+
+   //                                                                                                1
+   std::string_view sql_scan_cursors = "SELECT scan_path, cursor_path FROM scan_cursors WHERE scan_id = ? ORDER BY id"sv;
+
+   stmt_scan_cursors.prepare(file_scan_db, sql_scan_cursors);
+
+   sqlite_param_binder_t scan_cursors_stmt = stmt_scan_cursors.get_param_binder();
+
+   scan_cursors_stmt.bind_param(scan_id);
+
+   while((errcode = sqlite3_step(stmt_scan_cursors)) == SQLITE_ROW) {
+      file_tree_walker_t::scan_cursor_t scan_cursor;
+
+      scan_cursor.scan_path.assign(reinterpret_cast<const char8_t*>(sqlite3_column_text(stmt_scan_cursors, 0)), sqlite3_column_bytes(stmt_scan_cursors, 0));
+
+      if(sqlite3_column_type(stmt_scan_cursors, 1) != SQLITE_NULL)
+         scan_cursor.cursor_path.emplace(reinterpret_cast<const char8_t*>(sqlite3_column_text(stmt_scan_cursors, 1)), sqlite3_column_bytes(stmt_scan_cursors, 1));
+
+      scan_cursors.push_back(std::move(scan_cursor));
+   }
+
+   if(errcode != SQLITE_DONE)
+      throw std::runtime_error(FMTNS::format("Cannot select scan cursors ({:s})", sqlite3_errstr(errcode)));
+
+   scan_cursors_stmt.release();
+
+   if((errcode = stmt_scan_cursors.finalize()) != SQLITE_OK)
+      throw std::runtime_error("Cannot finalize a scan cursors statement ("s + sqlite3_errstr(errcode) + ")");
+
+   return scan_cursors;
+}
+
+int delete_scan_cursors(int64_t scan_id, sqlite3 *file_scan_db)
+{
+   int errcode = SQLITE_OK;
+
+   sqlite_stmt_t stmt_delete_scan_cursors("delete scan cursors"sv);
+
+   //                                                                           1
+   std::string_view sql_delete_scan_cursors = "DELETE FROM scan_cursors WHERE scan_id = ?"sv;
+
+   stmt_delete_scan_cursors.prepare(file_scan_db, sql_delete_scan_cursors);
+
+   sqlite_param_binder_t delete_scan_cursors_stmt = stmt_delete_scan_cursors.get_param_binder();
+
+   delete_scan_cursors_stmt.bind_param(scan_id);
+
+   errcode = sqlite3_step(stmt_delete_scan_cursors);
+
+   if(errcode != SQLITE_DONE)
+      return -1;
+
+   return sqlite3_changes(file_scan_db);
+}
+
+//
+// Computes totals of directory trees in a completed scan from totals
+// of files directly in each directory, which are updated by file
+// trackers, and stores them in the same records. Totals are rolled
+// up to parent directories in the descending order of directory
+// identifiers, which places subdirectories before their parents,
+// up to directories of scan paths. Records are added for directories
+// without files of their own. Returns the number of updated
+// directories or -1 if totals could not be stored.
+//
+int update_scan_dir_totals(const options_t& options, int64_t scan_id, sqlite3 *file_scan_db)
+{
+   char *errmsg = nullptr;
+   int errcode = SQLITE_OK;
+
+   // tree totals are collected before they are stored, so directories being selected are not updated
+   std::vector<std::pair<int64_t, dir_totals_t>> tree_totals;
+
+   if(sqlite3_exec(file_scan_db, "BEGIN TRANSACTION", nullptr, nullptr, &errmsg) != SQLITE_OK) {
+      sqlite3_free(errmsg);
+      return -1;
+   }
+
+   try {
+      sqlite_stmt_t stmt_find_dir("find dir"sv);
+      sqlite_stmt_t stmt_read_dir("read dir"sv);
+
+      dir_cache_t dir_cache;
+
+      //                                       0                             1            2
+      std::string_view sql_find_dir = "SELECT id FROM dirs WHERE parent_id = ? AND name = ?"sv;
+
+      stmt_find_dir.prepare(file_scan_db, sql_find_dir);
+
+      file_tracker_t::prepare_read_dir_stmt(file_scan_db, stmt_read_dir);
+
+      //
+      // Directories of scan paths are looked up in the same form as
+      // file paths, with a trailing separator. A scan path that is the
+      // same as the base path has files without a directory. Scan
+      // paths without any scanned files may have no directory record.
+      //
+      std::vector<int64_t> root_dir_ids;
+
+      for(const std::filesystem::path& scan_path : options.scan_paths) {
+         std::u8string root_path = options.base_path.empty() ? scan_path.u8string() : scan_path.lexically_relative(options.base_path).u8string();
+
+         if(root_path == u8".") {
+            root_dir_ids.push_back(dir_cache_t::NO_DIR_ID);
+            continue;
+         }
+
+         if(root_path.empty() || root_path.back() != std::filesystem::path::preferred_separator)
+            root_path.push_back(std::filesystem::path::preferred_separator);
+
+         std::optional<int64_t> root_dir_id = dir_cache.find_dir_id(root_path, std::filesystem::path::preferred_separator,
+               [&stmt_find_dir] (int64_t parent_id, const std::u8string& dir_name) -> std::optional<int64_t>
+               {
+                  sqlite_param_binder_t find_dir_stmt = stmt_find_dir.get_param_binder();
+
+                  find_dir_stmt.bind_param(parent_id);
+                  find_dir_stmt.bind_param(dir_name);
+
+                  int errcode = sqlite3_step(stmt_find_dir);
+
+                  if(errcode == SQLITE_DONE)
+                     return std::nullopt;
+
+                  if(errcode != SQLITE_ROW)
+                     throw std::runtime_error(FMTNS::format("Cannot find a scan directory ({:s})", sqlite3_errstr(errcode)));
+
+                  return sqlite3_column_int64(stmt_find_dir, 0);
+               });
+
+         if(root_dir_id.has_value())
+            root_dir_ids.push_back(root_dir_id.value());
+      }
+
+      dir_rollup_builder_t dir_rollup_builder(std::move(root_dir_ids), [&tree_totals] (int64_t dir_id, const dir_totals_t& dir_totals)
+            {
+               tree_totals.emplace_back(dir_id, dir_totals);
+            },
+            [&stmt_read_dir] (int64_t dir_id, int64_t& parent_id, std::u8string& dir_name)
+            {
+               file_tracker_t::read_dir_record(stmt_read_dir, dir_id, parent_id, dir_name);
+            });
+
+      sqlite_stmt_t stmt_scan_dirs("scan dirs"sv);
+
+      // files without a directory have no directory record and no parent
+      //                                               0                      1                          2                    3            4             5                6
+      std::string_view sql_scan_dirs = "SELECT scan_dirs.dir_id, coalesce(dirs.parent_id, 0), coalesce(dirs.name, ''), dir_file_count, dir_size, dir_max_mod_time, dir_rollup_hash "
+                                          "FROM scan_dirs LEFT JOIN dirs ON scan_dirs.dir_id = dirs.id "
+      //                                                   1
+                                          "WHERE scan_id = ? ORDER BY scan_dirs.dir_id DESC"sv;
+
+      stmt_scan_dirs.prepare(file_scan_db, sql_scan_dirs);
+
+      sqlite_param_binder_t scan_dirs_stmt = stmt_scan_dirs.get_param_binder();
+
+      scan_dirs_stmt.bind_param(scan_id);
+
+      while((errcode = sqlite3_step(stmt_scan_dirs)) == SQLITE_ROW) {
+         dir_totals_t dir_totals;
+
+         dir_totals.file_count = sqlite3_column_int64(stmt_scan_dirs, 3);
+         dir_totals.total_size = sqlite3_column_int64(stmt_scan_dirs, 4);
+
+         if(sqlite3_column_type(stmt_scan_dirs, 5) != SQLITE_NULL)
+            dir_totals.max_mod_time = sqlite3_column_int64(stmt_scan_dirs, 5);
+
+         if(sqlite3_column_type(stmt_scan_dirs, 6) != SQLITE_NULL)
+            dir_totals.rollup_hash = rollup_hash_t::from_hex(std::string_view(reinterpret_cast<const char*>(sqlite3_column_text(stmt_scan_dirs, 6)), sqlite3_column_bytes(stmt_scan_dirs, 6)));
+
+         dir_rollup_builder.add_dir(sqlite3_column_int64(stmt_scan_dirs, 0), sqlite3_column_int64(stmt_scan_dirs, 1),
+               std::u8string(reinterpret_cast<const char8_t*>(sqlite3_column_text(stmt_scan_dirs, 2)), sqlite3_column_bytes(stmt_scan_dirs, 2)), dir_totals);
+      }
+
+      if(errcode != SQLITE_DONE)
+         throw std::runtime_error(FMTNS::format("Cannot select scan directories ({:s})", sqlite3_errstr(errcode)));
+
+      dir_rollup_builder.finish();
+
+      scan_dirs_stmt.release();
+
+      if((errcode = stmt_scan_dirs.finalize()) != SQLITE_OK)
+         throw std::runtime_error("Cannot finalize a scan directories statement ("s + sqlite3_errstr(errcode) + ")");
+
+      sqlite_stmt_t stmt_upsert_scan_dir("update scan dir totals"sv);
+
+      //                                                                                                                                                                   1  2        3  4  5  6
+      std::string_view sql_upsert_scan_dir = "INSERT INTO scan_dirs (scan_id, dir_id, dir_file_count, dir_size, file_count, total_size, max_mod_time, rollup_hash) VALUES (?, ?, 0, 0, ?, ?, ?, ?) "
+                                                "ON CONFLICT (scan_id, dir_id) DO UPDATE SET "
+                                                   "file_count = excluded.file_count, "
+                                                   "total_size = excluded.total_size, "
+                                                   "max_mod_time = excluded.max_mod_time, "
+                                                   "rollup_hash = excluded.rollup_hash"sv;
+
+      stmt_upsert_scan_dir.prepare(file_scan_db, sql_upsert_scan_dir);
+
+      for(const std::pair<int64_t, dir_totals_t>& dir_totals : tree_totals) {
+         sqlite_param_binder_t upsert_scan_dir_stmt = stmt_upsert_scan_dir.get_param_binder();
+
+         std::string rollup_hexhash = dir_totals.second.rollup_hash.to_hex();
+
+         upsert_scan_dir_stmt.bind_param(scan_id);
+         upsert_scan_dir_stmt.bind_param(dir_totals.first);
+         upsert_scan_dir_stmt.bind_param(static_cast<int64_t>(dir_totals.second.file_count));
+         upsert_scan_dir_stmt.bind_param(static_cast<int64_t>(dir_totals.second.total_size));
+
+         if(dir_totals.second.max_mod_time.has_value())
+            upsert_scan_dir_stmt.bind_param(dir_totals.second.max_mod_time.value());
+         else
+            upsert_scan_dir_stmt.bind_param(nullptr);
+
+         upsert_scan_dir_stmt.bind_param(std::u8string_view(reinterpret_cast<const char8_t*>(rollup_hexhash.data()), rollup_hexhash.size()));
+
+         if((errcode = sqlite3_step(stmt_upsert_scan_dir)) != SQLITE_DONE)
+            throw std::runtime_error(FMTNS::format("Cannot update scan directory totals ({:s})", sqlite3_errstr(errcode)));
+      }
+
+      if((errcode = stmt_upsert_scan_dir.finalize()) != SQLITE_OK)
+         throw std::runtime_error("Cannot finalize a scan directory totals statement ("s + sqlite3_errstr(errcode) + ")");
+   }
+   catch (const std::exception&) {
+      sqlite3_exec(file_scan_db, "ROLLBACK TRANSACTION", nullptr, nullptr, nullptr);
+      return -1;
+   }
+
+   if(sqlite3_exec(file_scan_db, "COMMIT TRANSACTION", nullptr, nullptr, &errmsg) != SQLITE_OK) {
+      sqlite3_free(errmsg);
+      sqlite3_exec(file_scan_db, "ROLLBACK TRANSACTION", nullptr, nullptr, nullptr);
+      return -1;
+   }
+
+   return static_cast<int>(tree_totals.size());
+}
+
+//
+// Replaces scan cursors saved in earlier runs of this scan. Returns
+// the number of inserted cursors or -1 if any of them could not be
+// saved, in which case no cursors are saved.
+//
+int insert_scan_cursors(int64_t scan_id, const std::vector<file_tree_walker_t::scan_cursor_t>& scan_cursors, sqlite3 *file_scan_db)
+{
+   char *errmsg = nullptr;
+   int errcode = SQLITE_OK;
+
+   if(sqlite3_exec(file_scan_db, "BEGIN TRANSACTION", nullptr, nullptr, &errmsg) != SQLITE_OK) {
+      sqlite3_free(errmsg);
+      return -1;
+   }
+
+   try {
+      if(delete_scan_cursors(scan_id, file_scan_db) < 0)
+         throw std::runtime_error("Cannot delete scan cursors");
+
+      sqlite_stmt_t stmt_insert_scan_cursor("insert scan cursor"sv);
+
+      //                                                                                                   1  2  3
+      std::string_view sql_insert_scan_cursor = "INSERT INTO scan_cursors (scan_id, scan_path, cursor_path) VALUES (?, ?, ?)"sv;
+
+      stmt_insert_scan_cursor.prepare(file_scan_db, sql_insert_scan_cursor);
+
+      for(const file_tree_walker_t::scan_cursor_t& scan_cursor : scan_cursors) {
+         sqlite_param_binder_t insert_scan_cursor_stmt = stmt_insert_scan_cursor.get_param_binder();
+
+         insert_scan_cursor_stmt.bind_param(scan_id);
+         insert_scan_cursor_stmt.bind_param(scan_cursor.scan_path);
+
+         if(scan_cursor.cursor_path.has_value())
+            insert_scan_cursor_stmt.bind_param(scan_cursor.cursor_path.value());
+         else
+            insert_scan_cursor_stmt.bind_param(nullptr);
+
+         if((errcode = sqlite3_step(stmt_insert_scan_cursor)) != SQLITE_DONE)
+            throw std::runtime_error(FMTNS::format("Cannot insert a scan cursor ({:s})", sqlite3_errstr(errcode)));
+      }
+
+      if((errcode = stmt_insert_scan_cursor.finalize()) != SQLITE_OK)
+         throw std::runtime_error("Cannot finalize a scan cursor statement ("s + sqlite3_errstr(errcode) + ")");
+   }
+   catch (const std::exception&) {
+      sqlite3_exec(file_scan_db, "ROLLBACK TRANSACTION", nullptr, nullptr, nullptr);
+      return -1;
+   }
+
+   if(sqlite3_exec(file_scan_db, "COMMIT TRANSACTION", nullptr, nullptr, &errmsg) != SQLITE_OK) {
+      sqlite3_free(errmsg);
+      sqlite3_exec(file_scan_db, "ROLLBACK TRANSACTION", nullptr, nullptr, nullptr);
+      return -1;
+   }
+
+   return static_cast<int>(scan_cursors.size());
+}
+
+//
+// Looks up scan parameters tuned in the most recent scan of the same
+// scan paths, so tuning may start where it left off.
+//
+std::optional<file_tree_walker_t::device_tuning_t> select_scan_tuning(const std::u8string& scan_paths, sqlite3 *file_scan_db)
+{
+   std::optional<file_tree_walker_t::device_tuning_t> device_tuning;
+
+   int errcode = SQLITE_OK;
+
+   sqlite_stmt_t stmt_scan_tuning("scan tuning"sv);
+
+   //                                                                                                             1
+   std::string_view sql_scan_tuning = "SELECT thread_count, mb_hash_max, buffer_size FROM scan_tuning WHERE scan_paths = ? ORDER BY scan_id DESC, id DESC LIMIT 1"sv;
+
+   stmt_scan_tuning.prepare(file_scan_db, sql_scan_tuning);
+
+   sqlite_param_binder_t scan_tuning_stmt = stmt_scan_tuning.get_param_binder();
+
+   scan_tuning_stmt.bind_param(scan_paths);
+
+   errcode = sqlite3_step(stmt_scan_tuning);
+
+   if(errcode == SQLITE_ROW) {
+      device_tuning = {scan_paths,
+                        static_cast<size_t>(sqlite3_column_int64(stmt_scan_tuning, 0)),
+                        // multi-buffer hash jobs are not recorded if the project is built without SSE/AVX
+                        static_cast<size_t>(sqlite3_column_type(stmt_scan_tuning, 1) == SQLITE_NULL ? 1 : sqlite3_column_int64(stmt_scan_tuning, 1)),
+                        static_cast<size_t>(sqlite3_column_int64(stmt_scan_tuning, 2))};
+   }
+   else if(errcode != SQLITE_DONE)
+      throw std::runtime_error(FMTNS::format("Cannot select scan tuning ({:s})", sqlite3_errstr(errcode)));
+
+   scan_tuning_stmt.release();
+
+   if((errcode = stmt_scan_tuning.finalize()) != SQLITE_OK)
+      throw std::runtime_error("Cannot finalize a scan tuning statement ("s + sqlite3_errstr(errcode) + ")");
+
+   return device_tuning;
+}
+
+int insert_scan_tuning(int64_t scan_id, const file_tree_walker_t::device_tuning_t& device_tuning, sqlite3 *file_scan_db)
+{
+   int errcode = SQLITE_OK;
+
+   sqlite_stmt_t stmt_insert_scan_tuning("insert scan tuning"sv);
+
+   //                                                                                                                      1  2  3  4  5
+   std::string_view sql_insert_scan_tuning = "INSERT INTO scan_tuning (scan_id, scan_paths, thread_count, mb_hash_max, buffer_size) VALUES (?, ?, ?, ?, ?)"sv;
+
+   stmt_insert_scan_tuning.prepare(file_scan_db, sql_insert_scan_tuning);
+
+   sqlite_param_binder_t insert_scan_tuning_stmt = stmt_insert_scan_tuning.get_param_binder();
+
+   insert_scan_tuning_stmt.bind_param(scan_id);
+   insert_scan_tuning_stmt.bind_param(device_tuning.scan_paths);
+   insert_scan_tuning_stmt.bind_param(static_cast<int64_t>(device_tuning.thread_count));
+#ifndef NO_SSE_AVX
+   insert_scan_tuning_stmt.bind_param(static_cast<int64_t>(device_tuning.mb_hash_max));
+#else
+   insert_scan_tuning_stmt.bind_param(nullptr);
+#endif
+   insert_scan_tuning_stmt.bind_param(static_cast<int64_t>(device_tuning.buffer_size));
+
+   errcode = sqlite3_step(stmt_insert_scan_tuning);
+
+   if(errcode != SQLITE_DONE)
+      return 0;
+
+   return sqlite3_changes(file_scan_db);
+}
+
 void set_last_scan_update_time(int64_t scan_id, sqlite3 *file_scan_db)
 {
    int errcode = SQLITE_OK;
 
    sqlite_stmt_t stmt_scan_update_time("last scan update time"sv);
 
-   //                                                                    1               2
-   std::string_view sql_complete_scan = "UPDATE scans SET last_update_time=? WHERE rowid = ?"sv;
+   // scanset range and totals are recorded again when the updated scan is completed
+   //                                                                      1                                                                                              2
+   std::string_view sql_complete_scan = "UPDATE scans SET last_update_time=?, first_scanset_id=NULL, last_scanset_id=NULL, file_count=NULL, total_size=NULL WHERE rowid = ?"sv;
 
    stmt_scan_update_time.prepare(file_scan_db, sql_complete_scan);
 
@@ -913,6 +1695,14 @@ std::tuple<std::optional<int64_t>, std::optional<int64_t>> obtain_base_scan_and_
          throw std::runtime_error(FMTNS::format("Cannot verify files against the scan {:d} with a different recursion selection", base_scan_id.value()));
    }
    else {
+      if(options.report_removed_files && base_scan_id.has_value()) {
+         if(!completed_scan)
+            throw std::runtime_error(FMTNS::format("Cannot report differences against an incomplete scan {:d} (continue it without -R)", base_scan_id.value()));
+
+         if(options.recursive_scan != recursive_scan)
+            throw std::runtime_error(FMTNS::format("Cannot report differences against the scan {:d} with a different recursion selection", base_scan_id.value()));
+      }
+
       if(!options.update_last_scanset && base_scan_id.has_value() && !completed_scan) {
          options.update_last_scanset = true;
          options.all += u8" -u";
@@ -941,6 +1731,193 @@ std::tuple<std::optional<int64_t>, std::optional<int64_t>> obtain_base_scan_and_
    return std::make_tuple(base_scan_id, scan_id);
 }
 
+bool select_scan_exists(int64_t scan_id, sqlite3 *file_scan_db)
+{
+   int errcode = SQLITE_OK;
+
+   sqlite_stmt_t stmt_scan_exists("scan exists"sv);
+
+   std::string_view sql_scan_exists = "SELECT 1 FROM scans WHERE scans.rowid = ?"sv;
+
+   stmt_scan_exists.prepare(file_scan_db, sql_scan_exists);
+
+   sqlite_param_binder_t scan_exists_stmt = stmt_scan_exists.get_param_binder();
+
+   scan_exists_stmt.bind_param(scan_id);
+
+   errcode = sqlite3_step(stmt_scan_exists);
+
+   if(errcode != SQLITE_ROW && errcode != SQLITE_DONE)
+      throw std::runtime_error(FMTNS::format("Cannot select scan {:d} ({:s})", scan_id, sqlite3_errstr(errcode)));
+
+   bool scan_exists = errcode == SQLITE_ROW;
+
+   scan_exists_stmt.release();
+
+   if((errcode = stmt_scan_exists.finalize()) != SQLITE_OK)
+      throw std::runtime_error("Cannot finalize a scan exists statement ("s + sqlite3_errstr(errcode) + ")");
+
+   return scan_exists;
+}
+
+//
+// Reads the next scanset file selected with file_id, version_id,
+// dir_id, name, mod_time, entry_size, hash_type and hash columns,
+// in this order, and returns false when there are no more files.
+// File paths are assembled from directory names, which are read
+// with `stmt_read_dir` once per directory, while it is cached.
+//
+bool read_scan_entry(sqlite_stmt_t& stmt_scanset, dir_cache_t& dir_cache, sqlite_stmt_t& stmt_read_dir, scan_entry_t& scan_entry)
+{
+   int errcode = sqlite3_step(stmt_scanset);
+
+   if(errcode == SQLITE_DONE)
+      return false;
+
+   if(errcode != SQLITE_ROW)
+      throw std::runtime_error(FMTNS::format("Cannot select scanset files ({:s})", sqlite3_errstr(errcode)));
+
+   scan_entry.file_id = sqlite3_column_int64(stmt_scanset, 0);
+   scan_entry.version_id = sqlite3_column_int64(stmt_scanset, 1);
+   scan_entry.path = dir_cache.get_dir_path(sqlite3_column_int64(stmt_scanset, 2),
+         [&stmt_read_dir] (int64_t dir_id, int64_t& parent_id, std::u8string& dir_name) {file_tracker_t::read_dir_record(stmt_read_dir, dir_id, parent_id, dir_name);});
+   scan_entry.path.append(reinterpret_cast<const char8_t*>(sqlite3_column_text(stmt_scanset, 3)), sqlite3_column_bytes(stmt_scanset, 3));
+   scan_entry.mod_time = sqlite3_column_int64(stmt_scanset, 4);
+   scan_entry.entry_size = sqlite3_column_int64(stmt_scanset, 5);
+   scan_entry.hash_type.assign(reinterpret_cast<const char*>(sqlite3_column_text(stmt_scanset, 6)), sqlite3_column_bytes(stmt_scanset, 6));
+
+   if(sqlite3_column_type(stmt_scanset, 7) != SQLITE_NULL)
+      scan_entry.hash.emplace(reinterpret_cast<const char*>(sqlite3_column_text(stmt_scanset, 7)), sqlite3_column_bytes(stmt_scanset, 7));
+   else
+      scan_entry.hash.reset();
+
+   return true;
+}
+
+//
+// Writes files added, removed, changed and moved between two scans
+// to stdout as tab-separated values. Both scansets are selected in
+// the order of file identifiers, which SQLite reads from the file
+// version index without sorting, and are merged in a single pass.
+// Only added and removed files are kept in memory until both
+// scansets are read, to find moved files.
+//
+void diff_scans(int64_t base_scan_id, int64_t scan_id, sqlite3 *file_scan_db)
+{
+   for(int64_t diff_scan_id : {base_scan_id, scan_id}) {
+      if(!select_scan_exists(diff_scan_id, file_scan_db))
+         throw std::runtime_error(FMTNS::format("Cannot find scan {:d} in the database", diff_scan_id));
+   }
+
+   int errcode = SQLITE_OK;
+
+   //                                                      0        1       2           3         4           5          6     7
+   std::string_view sql_scanset = "SELECT versions.file_id, versions.rowid, dir_id, files.name, mod_time, entry_size, hash_type, hash "
+                                     "FROM scansets "
+                                        "JOIN versions ON version_id = versions.rowid "
+                                        "JOIN files ON versions.file_id = files.rowid "
+                                     "WHERE scan_id = ? "
+                                     "ORDER BY versions.file_id"sv;
+
+   sqlite_stmt_t stmt_base_scanset("base scanset"sv);
+   sqlite_stmt_t stmt_scanset("scanset"sv);
+   sqlite_stmt_t stmt_read_dir("read dir"sv);
+
+   dir_cache_t dir_cache;
+
+   file_tracker_t::prepare_read_dir_stmt(file_scan_db, stmt_read_dir);
+
+   stmt_base_scanset.prepare(file_scan_db, sql_scanset);
+   stmt_scanset.prepare(file_scan_db, sql_scanset);
+
+   sqlite_param_binder_t base_scanset_stmt = stmt_base_scanset.get_param_binder();
+   sqlite_param_binder_t scanset_stmt = stmt_scanset.get_param_binder();
+
+   base_scanset_stmt.bind_param(base_scan_id);
+   scanset_stmt.bind_param(scan_id);
+
+   auto format_entry = [] (const scan_entry_t *scan_entry) -> std::string
+   {
+      if(!scan_entry)
+         return "\t\t\t\t"s;
+
+      return FMTNS::format("\t{:s}\t{:d}\t{:d}\t{:s}", u8sv(scan_entry->path), scan_entry->entry_size, scan_entry->mod_time, scan_entry->hash.has_value() ? scan_entry->hash.value() : ""s);
+   };
+
+   fputs("change\tpath\tentry_size\tmod_time\thash\tbase_path\tbase_entry_size\tbase_mod_time\tbase_hash\n", stdout);
+
+   diff_scansets([&] (scan_entry_t& scan_entry) {return read_scan_entry(stmt_base_scanset, dir_cache, stmt_read_dir, scan_entry);},
+                 [&] (scan_entry_t& scan_entry) {return read_scan_entry(stmt_scanset, dir_cache, stmt_read_dir, scan_entry);},
+                 [&] (scan_change_t scan_change, const scan_entry_t *base_entry, const scan_entry_t *scan_entry)
+                 {
+                    const char *change = scan_change == scan_change_t::added ? "added" :
+                                         scan_change == scan_change_t::removed ? "removed" :
+                                         scan_change == scan_change_t::changed ? "changed" : "moved";
+
+                    fputs(FMTNS::format("{:s}{:s}{:s}\n", change, format_entry(scan_entry), format_entry(base_entry)).c_str(), stdout);
+                 });
+
+   base_scanset_stmt.release();
+   scanset_stmt.release();
+
+   if((errcode = stmt_base_scanset.finalize()) != SQLITE_OK)
+      throw std::runtime_error("Cannot finalize a base scanset statement ("s + sqlite3_errstr(errcode) + ")");
+
+   if((errcode = stmt_scanset.finalize()) != SQLITE_OK)
+      throw std::runtime_error("Cannot finalize a scanset statement ("s + sqlite3_errstr(errcode) + ")");
+}
+
+//
+// Writes groups of files with the same hash in a scan to stdout as
+// tab-separated values, one file per line. Scanset files are selected
+// in the order of hashes, which SQLite reads from the hash index
+// without sorting, so only files of one group are kept in memory.
+// Files smaller than `min_size` are not selected.
+//
+void list_dup_files(int64_t scan_id, uint64_t min_size, sqlite3 *file_scan_db)
+{
+   if(!select_scan_exists(scan_id, file_scan_db))
+      throw std::runtime_error(FMTNS::format("Cannot find scan {:d} in the database", scan_id));
+
+   int errcode = SQLITE_OK;
+
+   //                                                       0        1       2           3         4           5          6     7
+   std::string_view sql_dup_files = "SELECT versions.file_id, versions.rowid, dir_id, files.name, mod_time, entry_size, hash_type, hash "
+                                       "FROM versions "
+                                          "JOIN scansets ON version_id = versions.rowid "
+                                          "JOIN files ON versions.file_id = files.rowid "
+                                       "WHERE scan_id = ? AND hash IS NOT NULL AND entry_size >= ? "
+                                       "ORDER BY hash, hash_type"sv;
+
+   sqlite_stmt_t stmt_dup_files("duplicate files"sv);
+   sqlite_stmt_t stmt_read_dir("read dir"sv);
+
+   dir_cache_t dir_cache;
+
+   file_tracker_t::prepare_read_dir_stmt(file_scan_db, stmt_read_dir);
+
+   stmt_dup_files.prepare(file_scan_db, sql_dup_files);
+
+   sqlite_param_binder_t dup_files_stmt = stmt_dup_files.get_param_binder();
+
+   dup_files_stmt.bind_param(scan_id);
+   dup_files_stmt.bind_param(static_cast<int64_t>(min_size));
+
+   fputs("hash\tentry_size\tfile_count\twasted_size\tpath\tmod_time\n", stdout);
+
+   group_duplicates([&] (scan_entry_t& scan_entry) {return read_scan_entry(stmt_dup_files, dir_cache, stmt_read_dir, scan_entry);},
+                    [] (const std::vector<scan_entry_t>& dup_group, uint64_t wasted_size)
+                    {
+                       for(const scan_entry_t& scan_entry : dup_group)
+                          fputs(FMTNS::format("{:s}\t{:d}\t{:d}\t{:d}\t{:s}\t{:d}\n", scan_entry.hash.value(), scan_entry.entry_size, dup_group.size(), wasted_size, u8sv(scan_entry.path), scan_entry.mod_time).c_str(), stdout);
+                    });
+
+   dup_files_stmt.release();
+
+   if((errcode = stmt_dup_files.finalize()) != SQLITE_OK)
+      throw std::runtime_error("Cannot finalize a duplicate files statement ("s + sqlite3_errstr(errcode) + ")");
+}
+
 void update_schema_from_v50(sqlite3 *file_scan_db, print_stream_t& print_stream)
 {
    char *errmsg = nullptr;
@@ -1086,7 +2063,9 @@ int main(int argc, char *argv[])
 
       fit::verify_options(options);
 
-      fit::print_title();
+      // scan differences and duplicates are written to stdout without any other output, so they can be processed by other tools
+      if(!options.diff_scan_id.has_value() && !options.dups_scan_id.has_value())
+         fit::print_title();
 
       signal(SIGINT, fit::console_ctrl_c_handler);
       signal(SIGTERM, fit::console_ctrl_c_handler);
@@ -1130,13 +2109,76 @@ int main(int argc, char *argv[])
          throw std::runtime_error(FMTNS::format("Database must be upgraded from v{:s} to v{:s}"sv, fit::schema_version_string(schema_version), fit::schema_version_string(fit::DB_SCHEMA_VERSION)));
       }
 
+      //
+      // Indexes deferred by a first scan that was interrupted, or
+      // that could not build them, are built before the database
+      // is changed. Runs that open the database as read-only cannot
+      // build them and run slower if there are any deferred indexes,
+      // which is reported with index names, so the next scan may be
+      // run to build them.
+      //
+      if(!options.verify_files && !options.diff_scan_id.has_value() && !options.dups_scan_id.has_value())
+         fit::rebuild_deferred_indexes(options, file_scan_db.get(), print_stream);
+      else {
+         std::vector<std::string> deferred_index_names = fit::select_deferred_index_names(file_scan_db.get());
+
+         if(!deferred_index_names.empty()) {
+            std::string index_names;
+
+            for(const std::string& index_name : deferred_index_names)
+               index_names.append(index_names.empty() ? "" : ", ").append(index_name);
+
+            // scan differences and duplicates are written to stdout, so this warning cannot go to the print stream
+            if(options.diff_scan_id.has_value() || options.dups_scan_id.has_value())
+               fputs(FMTNS::format("WARNING: Deferred indexes are not built yet and this may run slower ({:s})\n", index_names).c_str(), stderr);
+            else
+               print_stream.warning("Deferred indexes are not built yet and this may run slower ({:s})", index_names);
+         }
+      }
+
+      if(options.diff_scan_id.has_value()) {
+         fit::diff_scans(options.diff_base_scan_id.value(), options.diff_scan_id.value(), file_scan_db.get());
+         return EXIT_SUCCESS;
+      }
+
+      if(options.dups_scan_id.has_value()) {
+         fit::list_dup_files(options.dups_scan_id.value(), options.dups_min_size, file_scan_db.get());
+         return EXIT_SUCCESS;
+      }
+
+      //
+      // With -M, the scan runs against a copy of the database in
+      // memory, which is saved into the database file periodically
+      // and when the scan is done.
+      //
+      std::optional<fit::memory_db_t> memory_db;
+
+      if(options.memory_db_size.has_value())
+         memory_db.emplace(file_scan_db.get(), options.memory_db_size.value(), print_stream);
+
+      sqlite3 *scan_db = memory_db.has_value() ? memory_db->get_db_handle() : file_scan_db.get();
+
       //
       // Figure out the base scan ID and the current scan ID
       //
       std::optional<int64_t> scan_id;
       std::optional<int64_t> base_scan_id;
 
-      std::tie(base_scan_id, scan_id) = fit::obtain_base_scan_and_new_scan(options, print_stream, file_scan_db.get());
+      std::tie(base_scan_id, scan_id) = fit::obtain_base_scan_and_new_scan(options, print_stream, scan_db);
+
+      // the first scan in the database inserts every file and builds secondary indexes when it is done
+      bool deferred_indexes = false;
+
+      if(!options.verify_files && !options.update_last_scanset && !base_scan_id.has_value()) {
+         int index_count = fit::defer_scan_indexes(scan_id.value(), scan_db);
+
+         if(index_count < 0)
+            print_stream.warning("Cannot defer indexes for scan {:d}", scan_id.value());
+         else if(index_count > 0) {
+            print_stream.info("Deferring {:d} indexes until scan {:d} is done", index_count, scan_id.value());
+            deferred_indexes = true;
+         }
+      }
 
       std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
 
@@ -1151,24 +2193,118 @@ int main(int argc, char *argv[])
       // initialize underlying libraries before any of the components are created and threads started
       fit::file_tree_walker_t::initialize(print_stream);
 
+      //
+      // Scans that write into the database file checkpoint its WAL on
+      // a separate thread. A memory database has no WAL and scans that
+      // only verify files do not write into the database.
+      //
+      std::optional<fit::wal_checkpointer_t> wal_checkpointer;
+
+      if(!memory_db.has_value() && (!options.verify_files || options.scrub_files)) {
+         try {
+            wal_checkpointer.emplace(options.db_path, print_stream);
+         }
+         catch (const std::exception& error) {
+            print_stream.warning("{:s} (WAL will be checkpointed while inserting records)", error.what());
+         }
+      }
+
       try {
          fit::file_tree_walker_t file_tree_walker(options, scan_id, base_scan_id, print_stream);
 
+         // start tuning with scan parameters stored for the same scan paths, if there are any
+         if(options.autotune) {
+            for(const fit::file_tree_walker_t::device_tuning_t& device_tuning : file_tree_walker.get_device_tuning()) {
+               std::optional<fit::file_tree_walker_t::device_tuning_t> stored_tuning = fit::select_scan_tuning(device_tuning.scan_paths, scan_db);
+
+               if(stored_tuning.has_value())
+                  file_tree_walker.set_device_tuning(stored_tuning.value());
+            }
+         }
+
+         // resume after positions saved when the last run of this scan ran out of time
+         if(options.update_last_scanset)
+            file_tree_walker.set_scan_cursors(fit::select_scan_cursors(scan_id.value(), scan_db));
+
+         // the memory database is saved on another thread, which uses both database connections until it is stopped
+         if(memory_db.has_value())
+            memory_db->start_saving(fit::MEMORY_DB_SAVE_INTERVAL);
+
+         if(wal_checkpointer.has_value())
+            wal_checkpointer->start();
+
          if(options.recursive_scan)
             file_tree_walker.walk_tree<std::filesystem::recursive_directory_iterator>();
          else
             file_tree_walker.walk_tree<std::filesystem::directory_iterator>();
 
+         if(wal_checkpointer.has_value())
+            wal_checkpointer->stop();
+
+         if(memory_db.has_value())
+            memory_db->stop_saving();
+
+         // indexes are built even for incomplete scans, so updates of this scan can look up files that were already scanned
+         if(deferred_indexes) {
+            // indexes that cannot be built now remain deferred and are built in the next run
+            try {
+               fit::rebuild_deferred_indexes(options, scan_db, print_stream);
+            }
+            catch (const std::exception& error) {
+               print_stream.warning("{:s} (deferred indexes will be built in the next run)", error.what());
+            }
+         }
+
          if(!options.verify_files) {
+            // tuned parameters are stored even for incomplete scans, so they are not lost if a long scan is interrupted
+            if(options.autotune) {
+               for(const fit::file_tree_walker_t::device_tuning_t& device_tuning : file_tree_walker.get_device_tuning()) {
+                  if(fit::insert_scan_tuning(scan_id.value(), device_tuning, scan_db) != 1)
+                     print_stream.warning("Cannot store tuned scan parameters for scan {:d}", scan_id.value());
+               }
+            }
+
             if(file_tree_walker.was_scan_completed()) {
-               if(fit::complete_scan_record(scan_id.value(), file_scan_db.get()) != 1)
+               if(fit::complete_scan_record(scan_id.value(), scan_db) != 1)
                   print_stream.warning("Cannot update completed time for scan {:d}", scan_id.value());
+
+               // hash checkpoints are only useful while a scan is incomplete (e.g. some may be left behind for files removed after being checkpointed)
+               if(fit::delete_hash_checkpoints(scan_id.value(), scan_db) < 0)
+                  print_stream.warning("Cannot delete hash checkpoints for scan {:d}", scan_id.value());
+
+               if(fit::delete_scan_cursors(scan_id.value(), scan_db) < 0)
+                  print_stream.warning("Cannot delete scan cursors for scan {:d}", scan_id.value());
+
+               // directory tree totals can only be computed when all files in the scan are known
+               if(fit::update_scan_dir_totals(options, scan_id.value(), scan_db) < 0)
+                  print_stream.warning("Cannot update directory totals for scan {:d}", scan_id.value());
+            }
+            else if(file_tree_walker.was_time_limit_reached()) {
+               //
+               // Cursors from an earlier run are left in place if the scan
+               // was aborted, which is safe because files are still looked
+               // up in an update scan and files after old cursors are just
+               // processed again.
+               //
+               std::vector<fit::file_tree_walker_t::scan_cursor_t> scan_cursors = file_tree_walker.get_scan_cursors();
+
+               if(!scan_cursors.empty()) {
+                  if(fit::insert_scan_cursors(scan_id.value(), scan_cursors, scan_db) < 0)
+                     print_stream.warning("Cannot save scan cursors for scan {:d}", scan_id.value());
+                  else
+                     print_stream.info("Scan {:d} stopped at the time limit and may be continued with -u", scan_id.value());
+               }
             }
 
             // at this point cumulative time will not reflect any activities performed while closing the database
-            if(fit::update_scan_duration(options, scan_id.value(), std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now()-start_time).count(), file_scan_db.get()) != 1)
+            if(fit::update_scan_duration(options, scan_id.value(), std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now()-start_time).count(), scan_db) != 1)
                print_stream.warning("Cannot update cumulative duration for scan {:d}", scan_id.value());
 
+            if(memory_db.has_value()) {
+               memory_db->save();
+               memory_db.reset();
+            }
+
             fit::close_sqlite_database(file_scan_db.release());
          }
 
@@ -1192,8 +2328,15 @@ int main(int argc, char *argv[])
                               fit::hr_bytes(static_cast<uint64_t>(file_tree_walker.get_processed_size()/(std::chrono::duration_cast<std::chrono::milliseconds>(end_time-start_time).count()/1000. + .5))));
          }
 
-         if(options.verify_files) {
+         // scans with -R report the same differences as verification scans
+         if(options.verify_files || options.report_removed_files) {
             if(options.report_removed_files) {
+               print_stream.info("Found {:d} modified, {:d} new, {:d} moved, {:d} removed, and {:d} changed files",
+                                 file_tree_walker.get_modified_files(), file_tree_walker.get_new_files(), file_tree_walker.get_moved_files(),
+                                 file_tree_walker.get_removed_files(), file_tree_walker.get_changed_files());
+            }
+            // scrubs report files they selected from the base scan that no longer exist
+            else if(options.scrub_files) {
                print_stream.info("Found {:d} modified, {:d} new, {:d} removed, and {:d} changed files",
                                  file_tree_walker.get_modified_files(), file_tree_walker.get_new_files(),
                                  file_tree_walker.get_removed_files(), file_tree_walker.get_changed_files());
@@ -1204,6 +2347,27 @@ int main(int argc, char *argv[])
                                  file_tree_walker.get_changed_files());
             }
          }
+
+         // files are skipped if they differ in size in verification scans or have unchanged fingerprints in regular scans
+         if(file_tree_walker.get_skipped_files()) {
+            print_stream.info("Skipped reading {:s} in {:d} files based on their size or fingerprint",
+                              fit::hr_bytes(file_tree_walker.get_skipped_size()), file_tree_walker.get_skipped_files());
+         }
+
+         // files with multiple hard links are hashed once per scan
+         if(file_tree_walker.get_linked_files()) {
+            print_stream.info("Reused hashes of {:s} in {:d} hard-linked files",
+                              fit::hr_bytes(file_tree_walker.get_linked_size()), file_tree_walker.get_linked_files());
+         }
+
+         if(file_tree_walker.get_rate_limit_wait_time() != std::chrono::steady_clock::duration::zero())
+            print_stream.info("Waited {:s} in all threads for rate limits", fit::hr_time(file_tree_walker.get_rate_limit_wait_time()));
+
+         // hash jobs wait for file descriptors only when all of them are in use
+         if(file_tree_walker.get_fd_wait_time() != std::chrono::steady_clock::duration::zero()) {
+            print_stream.info("Waited {:s} for file descriptors (limit: {:d} open files)",
+                              fit::hr_time(file_tree_walker.get_fd_wait_time()), file_tree_walker.get_fd_budget());
+         }
       }
       catch (...) {
          fit::file_tree_walker_t::cleanup(print_stream);
@@ -2,6 +2,7 @@
 #define FIT_H
 
 #include <string>
+#include <chrono>
 #include <filesystem>
 #include <optional>
 #include <vector>
@@ -18,6 +19,15 @@ struct file_handle_deleter_t {
    }
 };
 
+//
+// How file tracker threads are pinned to CPUs.
+//
+enum class thread_affinity_t {
+   none,
+   cores,         // each thread runs on one CPU
+   nodes          // each thread runs on any CPU of one NUMA node
+};
+
 //
 // Command line options and their values.
 //
@@ -35,9 +45,17 @@ struct options_t {
    bool update_last_scanset = false;
    bool exiv2_json = false;
    bool report_removed_files = false;
+   bool hash_size_mismatch = false;
    bool upgrade_schema_to_v60 = false;
+   bool autotune = false;
 
    std::optional<int> verify_scan_id;
+
+   std::optional<int64_t> diff_base_scan_id;
+   std::optional<int64_t> diff_scan_id;
+
+   std::optional<int64_t> dups_scan_id;
+   uint64_t dups_min_size = 0;
    std::optional<char8_t> query_path_sep;
 
    std::u8string scan_message;
@@ -46,11 +64,45 @@ struct options_t {
 
 #ifndef NO_SSE_AVX
    size_t mb_hash_max = 8;
+
+   uint64_t hash_checkpoint_interval = 1024*1024*1024;
+
+   bool fingerprint_files = false;
 #endif
 
    size_t thread_count = 4;
+   size_t rotational_thread_count = 2;
    size_t buffer_size = 512*1024;
 
+   // number of queued files hashed largest first (zero: in the order they were found)
+   size_t schedule_window = 0;
+
+   thread_affinity_t thread_affinity = thread_affinity_t::none;
+
+   // stop queuing files after this time and save positions in scan paths (zero: no limit)
+   std::chrono::seconds time_limit = std::chrono::seconds::zero();
+
+   // verify files whose data was verified longest ago, up to this many bytes (zero: no size limit)
+   bool scrub_files = false;
+   uint64_t scrub_size = 0;
+
+   // the database is not changed by anyone while it is verified, such as on read-only media
+   bool immutable_db = false;
+
+   // maximum size of a memory database a scan runs against, instead of the database file
+   std::optional<uint64_t> memory_db_size;
+
+   // a rate limit schedule or a file it is read from, which is checked for changes while scanning
+   std::optional<std::string> rate_limits;
+   std::filesystem::path rate_limits_file;
+
+   // when autotuning, -t, -H and -s values are moved here and are replaced with their tuning maximums
+   size_t autotune_thread_count = 0;
+#ifndef NO_SSE_AVX
+   size_t autotune_mb_hash_max = 0;
+#endif
+   size_t autotune_buffer_size = 0;
+
    int progress_interval = 10;
 
    std::u8string all;
@@ -1,6 +1,9 @@
 #include "format.h"
 
 #include <chrono>
+#include <charconv>
+#include <stdexcept>
+#include <cctype>
 
 using namespace std::literals::string_view_literals;
 using namespace std::literals::string_literals;
@@ -89,4 +92,116 @@ std::string hr_time(std::chrono::steady_clock::duration elapsed)
    return FMTNS::format("{:d}:{:02d}:{:02d} hours"sv, hours, minutes, seconds);
 }
 
+//
+// Parses a byte count with an optional decimal SI unit prefix, such
+// as `20M` or `1.5GB`, which is the reverse of what hr_bytes does.
+// If binary_units is true, unit prefixes are powers of 1024 instead,
+// for sizes that are expected to be aligned on such boundaries.
+//
+uint64_t parse_size(std::string_view size, bool binary_units)
+{
+   static constexpr const std::string_view si_unit_pfx = "KMGTPE"sv;
+
+   uint64_t whole = 0;
+
+   std::from_chars_result result = std::from_chars(size.data(), size.data() + size.size(), whole);
+
+   if(result.ec != std::errc())
+      throw std::runtime_error(FMTNS::format("Invalid size value {:s}"sv, size));
+
+   // up to 3 decimal digits, which is enough for the number of bytes in kilobytes
+   uint64_t decimals = 0;
+   uint64_t decimal_scale = 1;
+
+   if(result.ptr != size.data() + size.size() && *result.ptr == '.') {
+      for(result.ptr++; result.ptr != size.data() + size.size() && *result.ptr >= '0' && *result.ptr <= '9'; result.ptr++) {
+         if(decimal_scale < 1000) {
+            decimals = decimals * 10 + (*result.ptr - '0');
+            decimal_scale *= 10;
+         }
+      }
+   }
+
+   std::string_view unit = size.substr(result.ptr - size.data());
+
+   uint64_t multiplier = 1;
+
+   if(!unit.empty()) {
+      size_t prefix = si_unit_pfx.find(static_cast<char>(toupper(static_cast<unsigned char>(unit.front()))));
+
+      if(prefix != std::string_view::npos) {
+         for(size_t i = 0; i <= prefix; i++)
+            multiplier *= binary_units ? 1024 : 1000;
+
+         unit.remove_prefix(1);
+      }
+
+      if(unit != ""sv && unit != "B"sv && unit != "b"sv)
+         throw std::runtime_error(FMTNS::format("Invalid size unit in {:s}"sv, size));
+   }
+
+   if(decimal_scale > 1 && multiplier < decimal_scale)
+      throw std::runtime_error(FMTNS::format("Fractional byte counts are not allowed ({:s})"sv, size));
+
+   if(whole > UINT64_MAX / multiplier)
+      throw std::runtime_error(FMTNS::format("Size value is too large ({:s})"sv, size));
+
+   // binary multipliers are not divisible by the decimal scale, so the remainder is scaled separately
+   return whole * multiplier + decimals * (multiplier / decimal_scale) + decimals * (multiplier % decimal_scale) / decimal_scale;
+}
+
+//
+// Parses a duration in seconds, such as `90`, or as a sequence of
+// numbers with units `d`, `h`, `m` or `s`, such as `4h` or `1h30m`,
+// which is the reverse of what hr_time does, but without fractions.
+//
+std::chrono::seconds parse_duration(std::string_view duration)
+{
+   std::chrono::seconds seconds(0);
+
+   const char *cp = duration.data();
+   const char *end = duration.data() + duration.size();
+
+   if(cp == end)
+      throw std::runtime_error("A duration cannot be empty");
+
+   while(cp < end) {
+      uint64_t value = 0;
+
+      std::from_chars_result result = std::from_chars(cp, end, value);
+
+      if(result.ec != std::errc() || value > UINT32_MAX)
+         throw std::runtime_error(FMTNS::format("Invalid duration value {:s}"sv, duration));
+
+      // a number without a unit is only allowed on its own
+      if(result.ptr == end) {
+         if(cp != duration.data())
+            throw std::runtime_error(FMTNS::format("Missing duration unit in {:s}"sv, duration));
+
+         return std::chrono::seconds(value);
+      }
+
+      switch(tolower(static_cast<unsigned char>(*result.ptr))) {
+         case 'd':
+            seconds += std::chrono::hours(value * 24);
+            break;
+         case 'h':
+            seconds += std::chrono::hours(value);
+            break;
+         case 'm':
+            seconds += std::chrono::minutes(value);
+            break;
+         case 's':
+            seconds += std::chrono::seconds(value);
+            break;
+         default:
+            throw std::runtime_error(FMTNS::format("Invalid duration unit in {:s}"sv, duration));
+      }
+
+      cp = result.ptr + 1;
+   }
+
+   return seconds;
+}
+
 }
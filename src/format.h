@@ -2,6 +2,7 @@
 #define FIT_FORMAT_H
 
 #include <string>
+#include <string_view>
 #include <cstdint>
 #include <chrono>
 
@@ -65,6 +66,10 @@ std::string hr_bytes(uint64_t num);
 
 std::string hr_time(std::chrono::steady_clock::duration elapsed);
 
+uint64_t parse_size(std::string_view size, bool binary_units = false);
+
+std::chrono::seconds parse_duration(std::string_view duration);
+
 }
 
 #endif // FIT_FORMAT_H
@@ -0,0 +1,94 @@
+#include "hardlink_map.h"
+
+#include <stdexcept>
+#include <functional>
+
+namespace fit {
+
+size_t file_link_id_hash_t::operator () (const file_link_id_t& link_id) const noexcept
+{
+   // inodes are more selective than devices, so just mix devices into the inode hash
+   return std::hash<uint64_t>()(link_id.inode) ^ (std::hash<uint64_t>()(link_id.device) << 1);
+}
+
+//
+// Looks up a file link with `link_count` hard links and returns its
+// state. If the file has been hashed, `link_hash` will contain the
+// hash computed for the first link. If the file is being hashed,
+// `dir_entry` is moved into the map and will be returned when the
+// owner sets the link hash or releases the link.
+//
+hardlink_map_t::link_state_t hardlink_map_t::find_link(const file_link_id_t& link_id, uint64_t link_count, std::filesystem::directory_entry& dir_entry, std::optional<link_hash_t>& link_hash)
+{
+   std::lock_guard<std::mutex> links_lock(links_mtx);
+
+   std::unordered_map<file_link_id_t, link_entry_t, file_link_id_hash_t>::iterator link_it = links.find(link_id);
+
+   if(link_it == links.end()) {
+      links.emplace(link_id, link_entry_t{link_count ? link_count - 1 : 0, std::nullopt, {}});
+      return link_state_t::owner;
+   }
+
+   link_entry_t& link_entry = link_it->second;
+
+   if(!link_entry.link_hash.has_value()) {
+      link_entry.waiting_links.push_back(std::move(dir_entry));
+      return link_state_t::waiting;
+   }
+
+   link_hash = link_entry.link_hash;
+
+   // links created during the scan may exceed the original count
+   if(link_entry.unseen_links)
+      link_entry.unseen_links--;
+
+   if(!link_entry.unseen_links)
+      links.erase(link_it);
+
+   return link_state_t::hashed;
+}
+
+std::vector<std::filesystem::directory_entry> hardlink_map_t::set_link_hash(const file_link_id_t& link_id, link_hash_t&& link_hash)
+{
+   std::lock_guard<std::mutex> links_lock(links_mtx);
+
+   std::unordered_map<file_link_id_t, link_entry_t, file_link_id_hash_t>::iterator link_it = links.find(link_id);
+
+   // this is an assert-type exception - only owners may set link hashes
+   if(link_it == links.end() || link_it->second.link_hash.has_value())
+      throw std::logic_error("Cannot set a hash for a file link that is not being hashed");
+
+   std::vector<std::filesystem::directory_entry> waiting_links = std::move(link_it->second.waiting_links);
+
+   if(!link_it->second.unseen_links)
+      links.erase(link_it);
+   else
+      link_it->second.link_hash = std::move(link_hash);
+
+   return waiting_links;
+}
+
+std::vector<std::filesystem::directory_entry> hardlink_map_t::release_link(const file_link_id_t& link_id)
+{
+   std::lock_guard<std::mutex> links_lock(links_mtx);
+
+   std::unordered_map<file_link_id_t, link_entry_t, file_link_id_hash_t>::iterator link_it = links.find(link_id);
+
+   if(link_it == links.end())
+      return {};
+
+   std::vector<std::filesystem::directory_entry> waiting_links = std::move(link_it->second.waiting_links);
+
+   links.erase(link_it);
+
+   return waiting_links;
+}
+
+size_t hardlink_map_t::size(void)
+{
+   std::lock_guard<std::mutex> links_lock(links_mtx);
+
+   return links.size();
+}
+
+}
@@ -0,0 +1,90 @@
+#ifndef FIT_HARDLINK_MAP_H
+#define FIT_HARDLINK_MAP_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <filesystem>
+
+#include <cstdint>
+
+namespace fit {
+
+//
+// Identifies file data shared by multiple hard links.
+//
+struct file_link_id_t {
+   uint64_t device;
+   uint64_t inode;
+
+   bool operator == (const file_link_id_t& other) const = default;
+};
+
+struct file_link_id_hash_t {
+   size_t operator () (const file_link_id_t& link_id) const noexcept;
+};
+
+//
+// Tracks files with multiple hard links within a single scan, so
+// file data is hashed for the first link found and all other links
+// reuse this hash.
+//
+// The first tracker asking for a link becomes its owner and must
+// either set the link hash or release the link, if it could not
+// be hashed. Other links found while the owner is hashing the file
+// are kept in the map and are returned to the owner when the link
+// hash is set or released, so they can be queued for processing
+// again. If the link was released, one of these links will become
+// the next owner.
+//
+// Link entries are removed when all links counted for a file have
+// been seen, so only hard links pointing outside of the scanned
+// file tree remain in the map.
+//
+// Each device pool uses its own map, so waiting links are queued
+// again in the pool in which they were counted as queued files. A
+// file linked from scan paths in different pools, such as via bind
+// mounts, is hashed once in each pool.
+//
+class hardlink_map_t {
+   public:
+      struct link_hash_t {
+         uint64_t file_size;     // hashed file size
+         std::string hexhash;    // hex file hash
+      };
+
+      enum class link_state_t {
+         owner,                  // the caller must hash the file for all links
+         waiting,                // the file is being hashed and the directory entry was moved into the map
+         hashed                  // the link hash was returned
+      };
+
+   private:
+      struct link_entry_t {
+         uint64_t unseen_links;                                   // number of links not yet returned as hashed
+
+         std::optional<link_hash_t> link_hash;
+
+         std::vector<std::filesystem::directory_entry> waiting_links;
+      };
+
+   private:
+      std::mutex links_mtx;
+
+      std::unordered_map<file_link_id_t, link_entry_t, file_link_id_hash_t> links;
+
+   public:
+      link_state_t find_link(const file_link_id_t& link_id, uint64_t link_count, std::filesystem::directory_entry& dir_entry, std::optional<link_hash_t>& link_hash);
+
+      std::vector<std::filesystem::directory_entry> set_link_hash(const file_link_id_t& link_id, link_hash_t&& link_hash);
+
+      std::vector<std::filesystem::directory_entry> release_link(const file_link_id_t& link_id);
+
+      size_t size(void);
+};
+
+}
+
+#endif // FIT_HARDLINK_MAP_H
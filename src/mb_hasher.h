@@ -8,6 +8,7 @@
 #include <vector>
 #include <tuple>
 #include <queue>
+#include <atomic>
 
 namespace fit {
 
@@ -41,6 +42,13 @@ namespace fit {
 // each hash job will be returned from `get_hash` (e.g. it may carry
 // a data source handle, amount of data read from the data source, etc).
 //
+// Hash jobs for large data sources may be checkpointed by installing
+// a handler via `set_checkpoint_handler`, which will be called with
+// an intermediate hash state every time the specified amount of data
+// has been hashed since the last checkpoint. A hash state obtained
+// this way may be passed into `resume_job` to continue hashing from
+// that point on, without having to hash the preceding data again.
+//
 template <typename mb_hash_traits, typename T, typename ... P>
 class mb_hasher_t {
    public:
@@ -68,6 +76,23 @@ class mb_hasher_t {
       // align memory by this amount based on AVX512 where it is relevant
       static constexpr size_t ALIGN_MEM = 64;
 
+      //
+      // An intermediate hash state, which describes all data hashed
+      // so far. The digest contains the hash of all complete hash
+      // blocks and the partial block contains the remaining bytes
+      // that have not been hashed yet. Digest words are in the same
+      // byte order as maintained by isa-l_crypto.
+      //
+      struct hash_state_t {
+         uint32_t digest[mb_hash_traits::HASH_UINT32_SIZE];
+
+         // total number of bytes hashed so far, including the partial block
+         uint64_t total_length = 0;
+
+         unsigned char partial_block[mb_hash_traits::HASH_BLOCK_SIZE];
+         uint32_t partial_block_length = 0;
+      };
+
    private:
       typedef std::vector<typename mb_hash_traits::HASH_CTX> hash_ctx_vec_t;
 
@@ -94,6 +119,16 @@ class mb_hasher_t {
          // total number of hashed bytes obtained via get_data
          size_t processed_size = 0;
 
+         // total hashed length reported in the last checkpoint or restored from a hash state
+         uint64_t checkpoint_length = 0;
+
+         // size of the first data block read when the job was submitted and whether there is more data
+         std::optional<size_t> preloaded_size;
+         bool preloaded_moredata = false;
+
+         // true if the context was restored from a hash state and has not been started yet
+         bool resumed = false;
+
          ctx_args_t(size_t id, size_t buf_size, param_tuple_t&& params, bool (T::*get_data)(unsigned char*, size_t, size_t&, param_tuple_t&) const noexcept);
       };
 
@@ -140,6 +175,23 @@ class mb_hasher_t {
       // indexes into mb_ctxs for submitted jobs, before their 1st data block is hashed
       std::queue<size_t> pending_ctxs;
 
+      // a caller-provided function to save an intermediate hash state (optional)
+      void (T::*save_state)(const hash_state_t& hash_state, param_tuple_t& args) const noexcept = nullptr;
+
+      // amount of hashed data between hash state checkpoints
+      uint64_t checkpoint_interval = 0;
+
+      // a caller-provided function to acquire data source resources right before the first data block is read (optional)
+      bool (T::*start_data)(param_tuple_t& params, bool wait) const noexcept = nullptr;
+
+   private:
+      template <typename ... O>
+      ctx_args_t *start_job(param_tuple_t (T::*open_job)(O&&...) const, bool (T::*get_data)(unsigned char*, size_t, size_t&, param_tuple_t&) const noexcept, O&&... param);
+
+      void checkpoint_job(typename mb_hash_traits::HASH_CTX *mb_ctx_ptr);
+
+      bool start_pending_job(ctx_args_t *ctx_args, bool wait);
+
    public:
       mb_hasher_t(const T& data_obj, size_t buf_size, size_t max_jobs);
 
@@ -161,8 +213,25 @@ class mb_hasher_t {
       template <typename ... O>
       void submit_job(param_tuple_t (T::*open_job)(O&&...) const, bool (T::*get_data)(unsigned char*, size_t, size_t&, param_tuple_t&) const noexcept, O&&... param);
 
-      // returns the computed hash as computed by isa_l_crypto
-      std::optional<param_tuple_t> get_hash(uint32_t isa_mb_hash[mb_hash_traits::HASH_UINT32_SIZE]);
+      // submits a new hash job and reads its first data block right away
+      template <typename ... O>
+      void submit_preloaded_job(param_tuple_t (T::*open_job)(O&&...) const, bool (T::*get_data)(unsigned char*, size_t, size_t&, param_tuple_t&) const noexcept, O&&... param);
+
+      // submits a hash job that continues hashing from the specified hash state
+      template <typename ... O>
+      void resume_job(const hash_state_t& hash_state, param_tuple_t (T::*open_job)(O&&...) const, bool (T::*get_data)(unsigned char*, size_t, size_t&, param_tuple_t&) const noexcept, O&&... param);
+
+      // sets up a method to be called before the first data block of each job is read
+      void set_start_handler(bool (T::*start_data)(param_tuple_t&, bool) const noexcept);
+
+      // sets up a method to be called with intermediate hash states after each checkpoint_interval bytes
+      void set_checkpoint_handler(void (T::*save_state)(const hash_state_t&, param_tuple_t&) const noexcept, uint64_t checkpoint_interval);
+
+      // flushes all active jobs and saves intermediate hash states of those that haven't been completed
+      void checkpoint_jobs(void);
+
+      // returns the computed hash as computed by isa_l_crypto or nothing if interrupted
+      std::optional<param_tuple_t> get_hash(uint32_t isa_mb_hash[mb_hash_traits::HASH_UINT32_SIZE], const std::atomic<bool> *interrupt = nullptr);
 
       // converts an isa-l_crypto hash into a traditional hexadecimal representation
       static void isa_mb_hash_to_hex(uint32_t isa_mb_hash[mb_hash_traits::HASH_UINT32_SIZE], unsigned char hex_hash[mb_hash_traits::HASH_SIZE*2]);
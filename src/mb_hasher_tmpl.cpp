@@ -85,7 +85,7 @@ size_t mb_hasher_t<mb_hash_traits, T, P...>::active_jobs(void) const
 //
 template <typename mb_hash_traits, typename T, typename ... P>
 template <typename ... O>
-void mb_hasher_t<mb_hash_traits, T, P...>::submit_job(param_tuple_t (T::*open_job)(O&&...) const, bool (T::*get_data)(unsigned char*, size_t, size_t&, param_tuple_t&) const noexcept, O&&... param)
+typename mb_hasher_t<mb_hash_traits, T, P...>::ctx_args_t *mb_hasher_t<mb_hash_traits, T, P...>::start_job(param_tuple_t (T::*open_job)(O&&...) const, bool (T::*get_data)(unsigned char*, size_t, size_t&, param_tuple_t&) const noexcept, O&&... param)
 {
    ctx_args_t *ctx_args = nullptr;
 
@@ -125,11 +125,190 @@ void mb_hasher_t<mb_hash_traits, T, P...>::submit_job(param_tuple_t (T::*open_jo
       mb_ctx_ptr->user_data = ctx_args;
    }
 
+   return ctx_args;
+}
+
+template <typename mb_hash_traits, typename T, typename ... P>
+template <typename ... O>
+void mb_hasher_t<mb_hash_traits, T, P...>::submit_job(param_tuple_t (T::*open_job)(O&&...) const, bool (T::*get_data)(unsigned char*, size_t, size_t&, param_tuple_t&) const noexcept, O&&... param)
+{
+   ctx_args_t *ctx_args = start_job(open_job, get_data, std::forward<O>(param)...);
+
+   pending_ctxs.push(ctx_args->id);
+}
+
+//
+// `submit_preloaded_job` works the same way as `submit_job`, except
+// that `get_data` is called for the first data block right away,
+// instead of when the job is started in `get_hash`. Data sources
+// that fit entirely into the job buffer are read completely when
+// the job is submitted, so `get_data` may release any resources
+// associated with the data source, such as file handles, as soon
+// as it reports that there is no more data. Such jobs are hashed
+// later with `ISAL_HASH_ENTIRE`.
+// 
+// Data sources with more data are continued in `get_hash` like any
+// other job.
+//
+template <typename mb_hash_traits, typename T, typename ... P>
+template <typename ... O>
+void mb_hasher_t<mb_hash_traits, T, P...>::submit_preloaded_job(param_tuple_t (T::*open_job)(O&&...) const, bool (T::*get_data)(unsigned char*, size_t, size_t&, param_tuple_t&) const noexcept, O&&... param)
+{
+   ctx_args_t *ctx_args = start_job(open_job, get_data, std::forward<O>(param)...);
+
+   // if the data source cannot be started without waiting, it will be read when the job is started in get_hash
+   if(!start_data || (data_obj.*start_data)(ctx_args->params.value(), false)) {
+      size_t data_size = 0;
+
+      ctx_args->preloaded_moredata = (data_obj.*ctx_args->get_data)(ctx_args->buffer, buf_size, data_size, ctx_args->params.value());
+      ctx_args->preloaded_size = data_size;
+   }
+
    pending_ctxs.push(ctx_args->id);
 }
 
+//
+// `resume_job` works the same way as `submit_job`, except that the
+// hash job context is initialized from the hash state, which must
+// be obtained from a checkpoint handler for the same hash type, and
+// `open_job` is expected to position the data source at the offset
+// `hash_state.total_length`.
+// 
+// The restored context is queued with other pending jobs, but will
+// be continued with `ISAL_HASH_UPDATE` and will never be submitted
+// with `ISAL_HASH_FIRST`, which would reset the restored digest.
+//
+template <typename mb_hash_traits, typename T, typename ... P>
+template <typename ... O>
+void mb_hasher_t<mb_hash_traits, T, P...>::resume_job(const hash_state_t& hash_state, param_tuple_t (T::*open_job)(O&&...) const, bool (T::*get_data)(unsigned char*, size_t, size_t&, param_tuple_t&) const noexcept, O&&... param)
+{
+   if(hash_state.partial_block_length >= mb_hash_traits::HASH_BLOCK_SIZE || hash_state.partial_block_length > hash_state.total_length)
+      throw std::runtime_error(FMTNS::format("Bad partial block length in a hash state ({:d})", hash_state.partial_block_length));
+
+   ctx_args_t *ctx_args = start_job(open_job, get_data, std::forward<O>(param)...);
+
+   typename mb_hash_traits::HASH_CTX *mb_ctx_ptr = &mb_ctxs[ctx_args->id];
+
+   memcpy(mb_ctx_ptr->job.result_digest, hash_state.digest, sizeof(hash_state.digest));
+
+   mb_ctx_ptr->total_length = hash_state.total_length;
+
+   memcpy(mb_ctx_ptr->partial_block_buffer, hash_state.partial_block, hash_state.partial_block_length);
+   mb_ctx_ptr->partial_block_buffer_length = hash_state.partial_block_length;
+
+   // an idle context will accept more data without resetting the digest
+   mb_ctx_ptr->status = ISAL_HASH_CTX_STS_IDLE;
+   mb_ctx_ptr->error = ISAL_HASH_CTX_ERROR_NONE;
+
+   ctx_args->checkpoint_length = hash_state.total_length;
+   ctx_args->resumed = true;
+
+   pending_ctxs.push(ctx_args->id);
+}
+
+template <typename mb_hash_traits, typename T, typename ... P>
+void mb_hasher_t<mb_hash_traits, T, P...>::set_start_handler(bool (T::*start_data)(param_tuple_t&, bool) const noexcept)
+{
+   this->start_data = start_data;
+}
+
+//
+// Calls the start handler for a pending job, unless the job has no
+// start handler or was already started when it was submitted. If
+// `wait` is `false`, the start handler may return `false` to
+// indicate that the job cannot be started without waiting for
+// some resource. If `wait` is `true`, the start handler should
+// return `false` only if waiting was interrupted.
+//
+template <typename mb_hash_traits, typename T, typename ... P>
+bool mb_hasher_t<mb_hash_traits, T, P...>::start_pending_job(ctx_args_t *ctx_args, bool wait)
+{
+   if(!start_data || ctx_args->preloaded_size.has_value())
+      return true;
+
+   return (data_obj.*start_data)(ctx_args->params.value(), wait);
+}
+
+template <typename mb_hash_traits, typename T, typename ... P>
+void mb_hasher_t<mb_hash_traits, T, P...>::set_checkpoint_handler(void (T::*save_state)(const hash_state_t&, param_tuple_t&) const noexcept, uint64_t checkpoint_interval)
+{
+   this->save_state = checkpoint_interval ? save_state : nullptr;
+   this->checkpoint_interval = checkpoint_interval;
+}
+
+//
+// Only idle contexts, which were returned from the hash manager and
+// have not been submitted with more data yet, may be checkpointed.
+// Contexts that are being processed have their digests maintained
+// within hash manager lanes and their job digests are not current.
+//
+template <typename mb_hash_traits, typename T, typename ... P>
+void mb_hasher_t<mb_hash_traits, T, P...>::checkpoint_job(typename mb_hash_traits::HASH_CTX *mb_ctx_ptr)
+{
+   ctx_args_t *ctx_args = static_cast<ctx_args_t*>(mb_ctx_ptr->user_data);
+
+   if(mb_ctx_ptr->status != ISAL_HASH_CTX_STS_IDLE || mb_ctx_ptr->partial_block_buffer_length >= mb_hash_traits::HASH_BLOCK_SIZE)
+      return;
+
+   hash_state_t hash_state;
+
+   memcpy(hash_state.digest, mb_ctx_ptr->job.result_digest, sizeof(hash_state.digest));
+
+   hash_state.total_length = mb_ctx_ptr->total_length;
+
+   memcpy(hash_state.partial_block, mb_ctx_ptr->partial_block_buffer, mb_ctx_ptr->partial_block_buffer_length);
+   hash_state.partial_block_length = mb_ctx_ptr->partial_block_buffer_length;
+
+   (data_obj.*save_state)(hash_state, ctx_args->params.value());
+
+   ctx_args->checkpoint_length = mb_ctx_ptr->total_length;
+}
+
 template <typename mb_hash_traits, typename T, typename ... P>
-std::optional<typename mb_hasher_t<mb_hash_traits, T, P...>::param_tuple_t> mb_hasher_t<mb_hash_traits, T, P...>::get_hash(uint32_t isa_mb_hash[mb_hash_traits::HASH_UINT32_SIZE])
+void mb_hasher_t<mb_hash_traits, T, P...>::checkpoint_jobs(void)
+{
+   typename mb_hash_traits::HASH_CTX *mb_ctx_ptr = nullptr;
+
+   int isal_error = ISAL_CRYPTO_ERR_NONE;
+
+   if(!save_state)
+      return;
+
+   // retrieve all contexts from the hash manager, so all of them are either idle or complete
+   while((isal_error = mb_hash_traits::ctx_mgr_flush(&mb_ctx_mgr, &mb_ctx_ptr)) == ISAL_CRYPTO_ERR_NONE && mb_ctx_ptr != nullptr) {
+      if(mb_ctx_ptr->error != ISAL_HASH_CTX_ERROR_NONE)
+         throw std::runtime_error("Got a flushed context with an error (" + std::to_string(mb_ctx_ptr->error) + ") for a hash job " + std::to_string(static_cast<ctx_args_t*>(mb_ctx_ptr->user_data)->id));
+
+      // completed contexts will be picked up from this queue in get_hash
+      flushed_ctxs.push(mb_ctx_ptr);
+   }
+
+   if(isal_error != ISAL_CRYPTO_ERR_NONE)
+      throw std::runtime_error(FMTNS::format("Cannot flush a hash job ({:d})", isal_error));
+
+   // rotate the queue once to preserve the order of flushed contexts
+   for(size_t i = flushed_ctxs.size(); i > 0; i--) {
+      mb_ctx_ptr = flushed_ctxs.front();
+      flushed_ctxs.pop();
+
+      ctx_args_t *ctx_args = static_cast<ctx_args_t*>(mb_ctx_ptr->user_data);
+
+      if(mb_ctx_ptr->total_length >= checkpoint_interval && mb_ctx_ptr->total_length > ctx_args->checkpoint_length)
+         checkpoint_job(mb_ctx_ptr);
+
+      flushed_ctxs.push(mb_ctx_ptr);
+   }
+}
+
+//
+// If `interrupt` is provided and is set to `true` while hashes are
+// being computed, `get_hash` will return without a result as soon
+// as it is done with the current data block, so very large inputs
+// do not delay interruptions. All hash jobs remain active and may
+// be either continued via `get_hash` or checkpointed.
+//
+template <typename mb_hash_traits, typename T, typename ... P>
+std::optional<typename mb_hasher_t<mb_hash_traits, T, P...>::param_tuple_t> mb_hasher_t<mb_hash_traits, T, P...>::get_hash(uint32_t isa_mb_hash[mb_hash_traits::HASH_UINT32_SIZE], const std::atomic<bool> *interrupt)
 {
    typename mb_hash_traits::HASH_CTX *mb_ctx_ptr = nullptr;
 
@@ -142,10 +321,22 @@ std::optional<typename mb_hasher_t<mb_hash_traits, T, P...>::param_tuple_t> mb_h
    int isal_error = ISAL_CRYPTO_ERR_NONE;
 
    while (mb_ctx_ptr || !last_block_done) {
+      if(interrupt && *interrupt) {
+         // keep the immediate context in the same state as if it was flushed
+         if(mb_ctx_ptr)
+            flushed_ctxs.push(mb_ctx_ptr);
+
+         return std::nullopt;
+      }
+
       if(mb_ctx_ptr) {
          // always process the immediate context for as long as we have it
          ctx_args_t *ctx_args = static_cast<ctx_args_t*>(mb_ctx_ptr->user_data);
 
+         // save the intermediate hash state if enough data has been hashed since the last checkpoint
+         if(save_state && mb_ctx_ptr->total_length - ctx_args->checkpoint_length >= checkpoint_interval)
+            checkpoint_job(mb_ctx_ptr);
+
          moredata = (data_obj.*ctx_args->get_data)(ctx_args->buffer, buf_size, data_size, ctx_args->params.value());
 
          if((isal_error = mb_hash_traits::ctx_mgr_submit(&mb_ctx_mgr, mb_ctx_ptr, &mb_ctx_ptr, ctx_args->buffer, static_cast<uint32_t>(data_size), moredata ? ISAL_HASH_UPDATE : ISAL_HASH_LAST)) != ISAL_CRYPTO_ERR_NONE)
@@ -161,18 +352,32 @@ std::optional<typename mb_hasher_t<mb_hash_traits, T, P...>::param_tuple_t> mb_h
          mb_ctx_ptr = flushed_ctxs.front();
          flushed_ctxs.pop();
       }
-      else if(!pending_ctxs.empty()) {
-         // add a new pending job into the mix (order doesn't matter here)
+      //
+      // Add a new pending job into the mix (order doesn't matter here).
+      // Pending jobs are allowed to wait for their data sources only
+      // if there are no jobs in the hash manager, which could release
+      // the resources they are waiting for. Otherwise, we flush one
+      // of the jobs in the hash manager to continue hashing.
+      //
+      else if(!pending_ctxs.empty() && start_pending_job(&ctx_args_vec[pending_ctxs.front()], active_jobs() == pending_ctxs.size())) {
          mb_ctx_ptr = &mb_ctxs[pending_ctxs.front()];
 
          pending_ctxs.pop();
 
          ctx_args_t *ctx_args = static_cast<ctx_args_t*>(mb_ctx_ptr->user_data);
 
-         if(mb_ctx_ptr->status != ISAL_HASH_CTX_STS_COMPLETE || !ctx_args->params.has_value() || ctx_args->processed_size)
+         if((mb_ctx_ptr->status != ISAL_HASH_CTX_STS_COMPLETE && !ctx_args->resumed) || !ctx_args->params.has_value() || ctx_args->processed_size)
             throw std::runtime_error("Got a bad pending state for a hash job " + std::to_string(ctx_args->id));
 
-         moredata = (data_obj.*ctx_args->get_data)(ctx_args->buffer, buf_size, data_size, ctx_args->params.value());
+         // use the first data block if it was read when the job was submitted
+         if(ctx_args->preloaded_size.has_value()) {
+            data_size = ctx_args->preloaded_size.value();
+            moredata = ctx_args->preloaded_moredata;
+
+            ctx_args->preloaded_size.reset();
+         }
+         else
+            moredata = (data_obj.*ctx_args->get_data)(ctx_args->buffer, buf_size, data_size, ctx_args->params.value());
 
          //
          // We may get here zero-length data and it's too late to back out
@@ -180,7 +385,12 @@ std::optional<typename mb_hasher_t<mb_hash_traits, T, P...>::param_tuple_t> mb_h
          // to handle these cases gracefully, but caller should discard the
          // resulting hash.
          //
-         if((isal_error = mb_hash_traits::ctx_mgr_submit(&mb_ctx_mgr, mb_ctx_ptr, &mb_ctx_ptr, ctx_args->buffer, static_cast<uint32_t>(data_size), moredata ? ISAL_HASH_FIRST : ISAL_HASH_ENTIRE)) != ISAL_CRYPTO_ERR_NONE)
+         // restored contexts must be continued to preserve their digests
+         ISAL_HASH_CTX_FLAG hash_flags = ctx_args->resumed ? (moredata ? ISAL_HASH_UPDATE : ISAL_HASH_LAST) : (moredata ? ISAL_HASH_FIRST : ISAL_HASH_ENTIRE);
+
+         ctx_args->resumed = false;
+
+         if((isal_error = mb_hash_traits::ctx_mgr_submit(&mb_ctx_mgr, mb_ctx_ptr, &mb_ctx_ptr, ctx_args->buffer, static_cast<uint32_t>(data_size), hash_flags)) != ISAL_CRYPTO_ERR_NONE)
             throw std::runtime_error(FMTNS::format("Cannot submit a hash job {:s} ({:d})", std::to_string(ctx_args->id), isal_error));
 
          ctx_args->processed_size += data_size;
@@ -188,6 +398,10 @@ std::optional<typename mb_hasher_t<mb_hash_traits, T, P...>::param_tuple_t> mb_h
          if(!moredata)
             last_block_done++;
       }
+      else if(!pending_ctxs.empty() && active_jobs() == pending_ctxs.size()) {
+         // a pending job could not be started while waiting for its data source, which happens only if waiting was interrupted
+         return std::nullopt;
+      }
       else {
          // finally, see if we can flush a context to continue
          if(mb_hash_traits::ctx_mgr_flush(&mb_ctx_mgr, &mb_ctx_ptr) || mb_ctx_ptr == nullptr)
@@ -202,6 +416,7 @@ std::optional<typename mb_hasher_t<mb_hash_traits, T, P...>::param_tuple_t> mb_h
 
          if(mb_ctx_ptr->status == ISAL_HASH_CTX_STS_COMPLETE) {
             ctx_args->processed_size = 0;
+            ctx_args->checkpoint_length = 0;
             std::optional<param_tuple_t> params = std::move(ctx_args->params);
             ctx_args->params.reset();
 
@@ -228,6 +443,7 @@ std::optional<typename mb_hasher_t<mb_hash_traits, T, P...>::param_tuple_t> mb_h
          flushed_ctxs.push(mb_ctx_ptr);
       else {
          ctx_args->processed_size = 0;
+         ctx_args->checkpoint_length = 0;
          std::optional<param_tuple_t> params = std::move(ctx_args->params);
          ctx_args->params.reset();
 
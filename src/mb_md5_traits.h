@@ -17,6 +17,8 @@ struct mb_md5_traits {
 
    static constexpr size_t HASH_SIZE = HASH_UINT32_SIZE * sizeof(uint32_t);
 
+   static constexpr size_t HASH_BLOCK_SIZE = ISAL_MD5_BLOCK_SIZE;
+
    static constexpr int (*ctx_mgr_init)(HASH_CTX_MGR *mgr) = &isal_md5_ctx_mgr_init;
    static constexpr int (*ctx_mgr_submit)(HASH_CTX_MGR *mgr, HASH_CTX *ctx, HASH_CTX **ctx_out, const void *buffer, uint32_t len, ISAL_HASH_CTX_FLAG flags) = &isal_md5_ctx_mgr_submit;
    static constexpr int (*ctx_mgr_flush)(HASH_CTX_MGR *mgr, HASH_CTX **ctx_out) = &isal_md5_ctx_mgr_flush;
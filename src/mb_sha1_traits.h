@@ -17,6 +17,8 @@ struct mb_sha1_traits {
 
    static constexpr size_t HASH_SIZE = HASH_UINT32_SIZE * sizeof(uint32_t);
 
+   static constexpr size_t HASH_BLOCK_SIZE = SHA1_BLOCK_SIZE;
+
    static constexpr void (*ctx_mgr_init)(HASH_CTX_MGR *mgr) = &sha1_ctx_mgr_init;
    static constexpr HASH_CTX* (*ctx_mgr_submit)(HASH_CTX_MGR *mgr, HASH_CTX *ctx, const void *buffer, uint32_t len, HASH_CTX_FLAG flags) = &sha1_ctx_mgr_submit;
    static constexpr HASH_CTX* (*ctx_mgr_flush)(HASH_CTX_MGR *mgr) = &sha1_ctx_mgr_flush;
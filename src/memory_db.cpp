@@ -0,0 +1,172 @@
+#include "memory_db.h"
+
+#include "sqlite.h"
+#include "format.h"
+
+#include <memory>
+#include <stdexcept>
+
+namespace fit {
+
+memory_db_t::memory_db_t(sqlite3 *file_scan_db, uint64_t size_limit, print_stream_t& print_stream) :
+      file_scan_db(file_scan_db),
+      print_stream(print_stream)
+{
+   char *errmsg = nullptr;
+   int errcode = SQLITE_OK;
+
+   std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+   // pages copied from a WAL database would make the memory database a WAL database, which cannot be opened
+   if(sqlite3_exec(file_scan_db, "PRAGMA journal_mode=DELETE", nullptr, nullptr, &errmsg) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot switch the database file to a rollback journal ({:s})", std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get()));
+
+   try {
+      // the database handle is allocated even if it cannot be opened
+      errcode = sqlite3_open_v2(MEMORY_DB_URI.data(), &memory_db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI, nullptr);
+
+      if(errcode != SQLITE_OK)
+         throw std::runtime_error(FMTNS::format("Cannot open a memory database ({:s})", sqlite3_errstr(errcode)));
+
+      // the memory database is read while other connections insert file records when it is saved periodically
+      if((errcode = sqlite3_busy_timeout(memory_db, SAVE_BUSY_TIMEOUT)) != SQLITE_OK)
+         throw std::runtime_error(FMTNS::format("Cannot set a memory database busy timeout ({:s})", sqlite3_errstr(errcode)));
+
+      sqlite3_int64 memory_db_size_limit = static_cast<sqlite3_int64>(size_limit);
+
+      if((errcode = sqlite3_file_control(memory_db, "main", SQLITE_FCNTL_SIZE_LIMIT, &memory_db_size_limit)) != SQLITE_OK)
+         throw std::runtime_error(FMTNS::format("Cannot set the memory database size limit ({:s})", sqlite3_errstr(errcode)));
+
+      sqlite3_backup *db_backup = sqlite3_backup_init(memory_db, "main", file_scan_db, "main");
+
+      if(!db_backup)
+         throw std::runtime_error(FMTNS::format("Cannot start copying the database file into memory ({:s})", sqlite3_errmsg(memory_db)));
+
+      errcode = sqlite3_backup_step(db_backup, -1);
+
+      sqlite3_backup_finish(db_backup);
+
+      if(errcode == SQLITE_FULL)
+         throw std::runtime_error(FMTNS::format("The database file is larger than the memory database size limit ({:s})", hr_bytes(size_limit)));
+
+      if(errcode != SQLITE_DONE)
+         throw std::runtime_error(FMTNS::format("Cannot copy the database file into memory ({:s})", sqlite3_errstr(errcode)));
+   }
+   catch (...) {
+      sqlite3_close(memory_db);
+      sqlite3_exec(file_scan_db, "PRAGMA journal_mode=WAL", nullptr, nullptr, nullptr);
+      throw;
+   }
+
+   print_stream.info("Copied the database into memory in {:s}", hr_time(std::chrono::steady_clock::now()-start_time));
+}
+
+memory_db_t::~memory_db_t(void)
+{
+   stop_saving();
+
+   sqlite3_close(memory_db);
+
+   sqlite3_exec(file_scan_db, "PRAGMA journal_mode=WAL", nullptr, nullptr, nullptr);
+}
+
+//
+// A snapshot of the memory database is copied while a read transaction
+// keeps other connections from changing it, and the database file is
+// then replaced with the snapshot in a single backup step, in its own
+// transaction, so an interrupted save leaves the previous copy intact.
+//
+void memory_db_t::save(void)
+{
+   char *errmsg = nullptr;
+   int errcode = SQLITE_OK;
+
+   std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+   sqlite3_int64 db_size = 0;
+
+   if(sqlite3_exec(memory_db, "BEGIN TRANSACTION; SELECT count(*) FROM sqlite_master;", nullptr, nullptr, &errmsg) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot start a memory database snapshot ({:s})", std::unique_ptr<char, sqlite_malloc_deleter_t<char>>(errmsg).get()));
+
+   unsigned char *db_image = sqlite3_serialize(memory_db, "main", &db_size, 0);
+
+   sqlite3_exec(memory_db, "COMMIT TRANSACTION", nullptr, nullptr, nullptr);
+
+   if(!db_image)
+      throw std::runtime_error("Cannot copy a memory database snapshot");
+
+   sqlite3 *db_handle = nullptr;
+
+   // the database handle is allocated even if it cannot be opened
+   errcode = sqlite3_open_v2(":memory:", &db_handle, SQLITE_OPEN_READWRITE, nullptr);
+
+   std::unique_ptr<sqlite3, sqlite_db_deleter_t> snapshot_db(db_handle);
+
+   if(errcode != SQLITE_OK) {
+      sqlite3_free(db_image);
+      throw std::runtime_error(FMTNS::format("Cannot open a memory database snapshot ({:s})", sqlite3_errstr(errcode)));
+   }
+
+   // the snapshot image is released when the snapshot is closed or if it cannot be deserialized
+   if((errcode = sqlite3_deserialize(snapshot_db.get(), "main", db_image, db_size, db_size, SQLITE_DESERIALIZE_FREEONCLOSE | SQLITE_DESERIALIZE_READONLY)) != SQLITE_OK)
+      throw std::runtime_error(FMTNS::format("Cannot load a memory database snapshot ({:s})", sqlite3_errstr(errcode)));
+
+   sqlite3_backup *db_backup = sqlite3_backup_init(file_scan_db, "main", snapshot_db.get(), "main");
+
+   if(!db_backup)
+      throw std::runtime_error(FMTNS::format("Cannot start saving the memory database ({:s})", sqlite3_errmsg(file_scan_db)));
+
+   errcode = sqlite3_backup_step(db_backup, -1);
+
+   sqlite3_backup_finish(db_backup);
+
+   if(errcode != SQLITE_DONE)
+      throw std::runtime_error(FMTNS::format("Cannot save the memory database ({:s})", sqlite3_errstr(errcode)));
+
+   print_stream.info("Saved {:s} of the memory database in {:s}", hr_bytes(static_cast<uint64_t>(db_size)), hr_time(std::chrono::steady_clock::now()-start_time));
+}
+
+void memory_db_t::save_periodically(std::chrono::steady_clock::duration save_interval)
+{
+   std::unique_lock<std::mutex> saver_lock(saver_mtx);
+
+   while(!saver_cv.wait_for(saver_lock, save_interval, [this] {return stop_saver;})) {
+      saver_lock.unlock();
+
+      // a failed save leaves the last saved copy in the database file, which is replaced by the next save
+      try {
+         save();
+      }
+      catch (const std::exception& error) {
+         print_stream.warning("{:s}", error.what());
+      }
+
+      saver_lock.lock();
+   }
+}
+
+void memory_db_t::start_saving(std::chrono::steady_clock::duration save_interval)
+{
+   stop_saving();
+
+   saver_thread = std::thread(&memory_db_t::save_periodically, this, save_interval);
+}
+
+void memory_db_t::stop_saving(void)
+{
+   if(!saver_thread.joinable())
+      return;
+
+   {
+      std::lock_guard<std::mutex> saver_lock(saver_mtx);
+      stop_saver = true;
+   }
+
+   saver_cv.notify_one();
+
+   saver_thread.join();
+
+   stop_saver = false;
+}
+
+}
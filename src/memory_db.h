@@ -0,0 +1,84 @@
+#ifndef FIT_MEMORY_DB_H
+#define FIT_MEMORY_DB_H
+
+#include "print_stream.h"
+
+#include <sqlite3.h>
+
+#include <string_view>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <cstdint>
+
+namespace fit {
+
+//
+// An in-memory copy of the scan database, which is shared by all
+// connections that open `MEMORY_DB_URI`, so file hasher threads do
+// not wait for a slow database disk while they insert file records.
+//
+// The database file is copied into memory when this object is
+// created and the memory database is copied back into the database
+// file when it is saved, in a single backup step, so the database
+// file always contains a consistent copy of the memory database.
+// Saving takes a snapshot of the memory database first, so other
+// connections wait only while the snapshot is being copied, but
+// each save needs as much memory again as the memory database.
+//
+// The memory database cannot grow beyond its size limit and inserts
+// fail with SQLITE_FULL when the limit is reached.
+//
+// The memory database uses the `memdb` VFS, which does not support
+// write-ahead logging, so the database file is switched from WAL to
+// a rollback journal while it is being copied and is switched back
+// to WAL when this object is destroyed.
+//
+// The database file connection and the memory database connection
+// returned from `get_db_handle` cannot be used by the caller while
+// the memory database is being saved periodically.
+//
+class memory_db_t {
+   public:
+      static constexpr const std::string_view MEMORY_DB_URI = "file:/fit-scan.db?vfs=memdb";
+
+      // milliseconds to wait for other connections to finish their transactions before a snapshot is taken
+      static constexpr const int SAVE_BUSY_TIMEOUT = 60000;
+
+   private:
+      sqlite3 *file_scan_db;              // database file connection, owned by the caller
+
+      sqlite3 *memory_db = nullptr;
+
+      print_stream_t& print_stream;
+
+      std::thread saver_thread;
+
+      std::mutex saver_mtx;
+      std::condition_variable saver_cv;
+      bool stop_saver = false;
+
+   private:
+      void save_periodically(std::chrono::steady_clock::duration save_interval);
+
+   public:
+      memory_db_t(sqlite3 *file_scan_db, uint64_t size_limit, print_stream_t& print_stream);
+
+      memory_db_t(const memory_db_t&) = delete;
+
+      ~memory_db_t(void);
+
+      sqlite3 *get_db_handle(void) const {return memory_db;}
+
+      void save(void);
+
+      void start_saving(std::chrono::steady_clock::duration save_interval);
+
+      void stop_saving(void);
+};
+
+}
+
+#endif // FIT_MEMORY_DB_H
@@ -0,0 +1,205 @@
+#include "rate_limiter.h"
+#include "format.h"
+
+#include <thread>
+#include <algorithm>
+#include <charconv>
+#include <stdexcept>
+
+#include <ctime>
+
+using namespace std::literals::string_view_literals;
+
+namespace fit {
+
+void token_bucket_t::set_rate(uint64_t rate, std::chrono::steady_clock::time_point now)
+{
+   std::lock_guard<std::mutex> bucket_lock(bucket_mtx);
+
+   // a bucket that was not limited starts full, so there is no delay until the first second runs out
+   if(!this->rate)
+      tokens = static_cast<double>(rate);
+   else
+      tokens = std::min(tokens, static_cast<double>(rate));
+
+   this->rate = rate;
+   last_time = now;
+}
+
+uint64_t token_bucket_t::get_rate(void)
+{
+   std::lock_guard<std::mutex> bucket_lock(bucket_mtx);
+
+   return rate;
+}
+
+//
+// Takes `count` tokens and returns how long the caller should wait
+// before using more tokens, which is zero if the bucket is not in
+// debt.
+//
+std::chrono::steady_clock::duration token_bucket_t::take(uint64_t count, std::chrono::steady_clock::time_point now)
+{
+   std::lock_guard<std::mutex> bucket_lock(bucket_mtx);
+
+   if(!rate)
+      return std::chrono::steady_clock::duration::zero();
+
+   if(now > last_time) {
+      tokens = std::min(tokens + std::chrono::duration<double>(now - last_time).count() * static_cast<double>(rate), static_cast<double>(rate));
+      last_time = now;
+   }
+
+   tokens -= static_cast<double>(count);
+
+   if(tokens >= 0)
+      return std::chrono::steady_clock::duration::zero();
+
+   return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(-tokens / static_cast<double>(rate)));
+}
+
+void rate_limiter_t::set_limits(const rate_limits_t& rate_limits)
+{
+   std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+   bytes_bucket.set_rate(rate_limits.bytes_per_sec, now);
+   files_bucket.set_rate(rate_limits.files_per_sec, now);
+
+   limited = rate_limits.bytes_per_sec || rate_limits.files_per_sec;
+}
+
+rate_limits_t rate_limiter_t::get_limits(void)
+{
+   return {bytes_bucket.get_rate(), files_bucket.get_rate()};
+}
+
+//
+// Sleeps in short intervals, so limits lowered to a crawl do not
+// hold back an aborted scan.
+//
+void rate_limiter_t::wait(std::chrono::steady_clock::duration wait_duration, const std::atomic<bool>& abort_wait)
+{
+   if(wait_duration == std::chrono::steady_clock::duration::zero())
+      return;
+
+   std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+   std::chrono::steady_clock::time_point end_time = start_time + wait_duration;
+
+   for(std::chrono::steady_clock::time_point now = start_time; !abort_wait && now < end_time; now = std::chrono::steady_clock::now())
+      std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(end_time - now, std::chrono::milliseconds(100)));
+
+   wait_time += (std::chrono::steady_clock::now() - start_time).count();
+}
+
+void rate_limiter_t::take_bytes(uint64_t count, const std::atomic<bool>& abort_wait)
+{
+   if(!limited)
+      return;
+
+   wait(bytes_bucket.take(count, std::chrono::steady_clock::now()), abort_wait);
+}
+
+void rate_limiter_t::take_files(uint64_t count, const std::atomic<bool>& abort_wait)
+{
+   if(!limited)
+      return;
+
+   wait(files_bucket.take(count, std::chrono::steady_clock::now()), abort_wait);
+}
+
+std::chrono::steady_clock::duration rate_limiter_t::get_wait_time(void) const
+{
+   return std::chrono::steady_clock::duration(wait_time.load());
+}
+
+rate_limit_schedule_t rate_limit_schedule_t::parse(std::string_view schedule)
+{
+   rate_limit_schedule_t rate_limit_schedule;
+
+   for(size_t entry_start = 0, entry_end = 0; entry_end != std::string_view::npos; entry_start = entry_end + 1) {
+      entry_end = schedule.find(',', entry_start);
+
+      std::string_view entry = schedule.substr(entry_start, entry_end == std::string_view::npos ? std::string_view::npos : entry_end - entry_start);
+
+      if(entry.empty())
+         throw std::runtime_error("A rate limit schedule cannot have empty entries");
+
+      int start_minute = 0;
+
+      // HH:MM=
+      if(size_t eq = entry.find('='); eq != std::string_view::npos) {
+         std::string_view start_time = entry.substr(0, eq);
+
+         int hours = -1, minutes = -1;
+
+         std::from_chars_result result = std::from_chars(start_time.data(), start_time.data() + start_time.size(), hours);
+
+         if(result.ec != std::errc() || result.ptr == start_time.data() + start_time.size() || *result.ptr != ':' ||
+               std::from_chars(result.ptr + 1, start_time.data() + start_time.size(), minutes).ptr != start_time.data() + start_time.size() ||
+               hours < 0 || hours > 23 || minutes < 0 || minutes > 59)
+            throw std::runtime_error(FMTNS::format("Invalid start time in a rate limit schedule ({:s})"sv, start_time));
+
+         start_minute = hours * 60 + minutes;
+
+         entry.remove_prefix(eq + 1);
+      }
+
+      rate_limits_t rate_limits;
+
+      // bytes[/files]
+      size_t slash = entry.find('/');
+
+      rate_limits.bytes_per_sec = parse_size(entry.substr(0, slash));
+
+      if(slash != std::string_view::npos) {
+         std::string_view files = entry.substr(slash + 1);
+
+         if(std::from_chars(files.data(), files.data() + files.size(), rate_limits.files_per_sec).ptr != files.data() + files.size() || files.empty())
+            throw std::runtime_error(FMTNS::format("Invalid file rate in a rate limit schedule ({:s})"sv, files));
+      }
+
+      if(std::any_of(rate_limit_schedule.entries.begin(), rate_limit_schedule.entries.end(), [start_minute] (const schedule_entry_t& other) {return other.start_minute == start_minute;}))
+         throw std::runtime_error(FMTNS::format("A rate limit schedule has more than one entry at {:02d}:{:02d}"sv, start_minute / 60, start_minute % 60));
+
+      rate_limit_schedule.entries.push_back({start_minute, rate_limits});
+   }
+
+   std::sort(rate_limit_schedule.entries.begin(), rate_limit_schedule.entries.end(), [] (const schedule_entry_t& a, const schedule_entry_t& b) {return a.start_minute < b.start_minute;});
+
+   return rate_limit_schedule;
+}
+
+rate_limits_t rate_limit_schedule_t::get_limits(int minute_of_day) const
+{
+   if(entries.empty())
+      return {};
+
+   // the last entry continues past midnight until the first entry starts
+   rate_limits_t rate_limits = entries.back().rate_limits;
+
+   for(const schedule_entry_t& entry : entries) {
+      if(entry.start_minute > minute_of_day)
+         break;
+
+      rate_limits = entry.rate_limits;
+   }
+
+   return rate_limits;
+}
+
+rate_limits_t rate_limit_schedule_t::get_limits(std::chrono::system_clock::time_point now) const
+{
+   time_t now_time = std::chrono::system_clock::to_time_t(now);
+
+   struct tm now_tm = {};
+
+   #ifdef _WIN32
+   localtime_s(&now_tm, &now_time);
+   #else
+   localtime_r(&now_time, &now_tm);
+   #endif
+
+   return get_limits(now_tm.tm_hour * 60 + now_tm.tm_min);
+}
+
+}
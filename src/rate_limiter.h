@@ -0,0 +1,110 @@
+#ifndef FIT_RATE_LIMITER_H
+#define FIT_RATE_LIMITER_H
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <string_view>
+
+#include <cstdint>
+
+namespace fit {
+
+//
+// I/O rate limits, with zero values meaning no limit.
+//
+struct rate_limits_t {
+   uint64_t bytes_per_sec = 0;
+   uint64_t files_per_sec = 0;
+
+   bool operator == (const rate_limits_t& other) const {return bytes_per_sec == other.bytes_per_sec && files_per_sec == other.files_per_sec;}
+   bool operator != (const rate_limits_t& other) const {return !(*this == other);}
+};
+
+//
+// A token bucket, which accumulates up to one second worth of tokens
+// at the configured rate. Callers take tokens after they are used,
+// such as after a file block was read, and the bucket goes into debt
+// if there are not enough tokens. The returned wait time pays off
+// the debt, so the combined rate of all callers stays within limits,
+// regardless of how many tokens each of them takes at a time.
+//
+// Time is passed in by the caller, so the bucket can be tested with
+// arbitrary time points.
+//
+class token_bucket_t {
+   private:
+      std::mutex bucket_mtx;
+
+      uint64_t rate = 0;
+
+      double tokens = 0;
+
+      std::chrono::steady_clock::time_point last_time;
+
+   public:
+      void set_rate(uint64_t rate, std::chrono::steady_clock::time_point now);
+
+      uint64_t get_rate(void);
+
+      std::chrono::steady_clock::duration take(uint64_t count, std::chrono::steady_clock::time_point now);
+};
+
+//
+// Byte and file rate limits shared by all file trackers.
+//
+class rate_limiter_t {
+   private:
+      token_bucket_t bytes_bucket;
+      token_bucket_t files_bucket;
+
+      std::atomic<bool> limited = false;
+
+      std::atomic<std::chrono::steady_clock::rep> wait_time = 0;
+
+   private:
+      void wait(std::chrono::steady_clock::duration wait_duration, const std::atomic<bool>& abort_wait);
+
+   public:
+      void set_limits(const rate_limits_t& rate_limits);
+
+      rate_limits_t get_limits(void);
+
+      void take_bytes(uint64_t count, const std::atomic<bool>& abort_wait);
+
+      void take_files(uint64_t count, const std::atomic<bool>& abort_wait);
+
+      std::chrono::steady_clock::duration get_wait_time(void) const;
+};
+
+//
+// A daily schedule of rate limits, in the form of a comma-separated
+// list of `[HH:MM=]bytes[/files]` entries, such as `20M/100` or
+// `08:00=20M/100,18:00=0`. Each entry applies from its start time
+// until the start time of the next entry, with the last entry also
+// applying after midnight, until the first entry starts. An entry
+// without a start time applies from midnight.
+//
+class rate_limit_schedule_t {
+   private:
+      struct schedule_entry_t {
+         int start_minute;          // minutes since midnight
+         rate_limits_t rate_limits;
+      };
+
+   private:
+      std::vector<schedule_entry_t> entries;
+
+   public:
+      static rate_limit_schedule_t parse(std::string_view schedule);
+
+      rate_limits_t get_limits(int minute_of_day) const;
+
+      rate_limits_t get_limits(std::chrono::system_clock::time_point now) const;
+};
+
+}
+
+#endif // FIT_RATE_LIMITER_H
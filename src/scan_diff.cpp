@@ -0,0 +1,107 @@
+#include "scan_diff.h"
+
+#include <vector>
+#include <unordered_map>
+#include <string_view>
+
+namespace fit {
+
+//
+// Merges two scansets ordered by file identifiers in a single pass.
+// Files found in both scansets with different versions are reported
+// as changed while scansets are being read. Files found in only one
+// of the scansets are kept until both scansets are read, so added
+// files with the same hash as one of the removed files are reported
+// as moved from that file. Each removed file is matched against one
+// added file. Remaining added files and removed files are reported
+// after moved files.
+//
+// Memory use is proportional to the number of added and removed
+// files and does not depend on the number of unchanged files.
+//
+scan_diff_counts_t diff_scansets(const scan_entry_reader_t& read_base_entry, const scan_entry_reader_t& read_scan_entry, const scan_change_handler_t& report_change)
+{
+   scan_diff_counts_t diff_counts;
+
+   std::vector<scan_entry_t> added_entries;
+   std::vector<scan_entry_t> removed_entries;
+
+   scan_entry_t base_entry;
+   scan_entry_t scan_entry;
+
+   bool has_base_entry = read_base_entry(base_entry);
+   bool has_scan_entry = read_scan_entry(scan_entry);
+
+   while(has_base_entry || has_scan_entry) {
+      if(has_base_entry && (!has_scan_entry || base_entry.file_id < scan_entry.file_id)) {
+         removed_entries.push_back(std::move(base_entry));
+         has_base_entry = read_base_entry(base_entry);
+      }
+      else if(has_scan_entry && (!has_base_entry || scan_entry.file_id < base_entry.file_id)) {
+         added_entries.push_back(std::move(scan_entry));
+         has_scan_entry = read_scan_entry(scan_entry);
+      }
+      else {
+         if(base_entry.version_id != scan_entry.version_id) {
+            report_change(scan_change_t::changed, &base_entry, &scan_entry);
+            diff_counts.changed_files++;
+         }
+
+         has_base_entry = read_base_entry(base_entry);
+         has_scan_entry = read_scan_entry(scan_entry);
+      }
+   }
+
+   // removed files are looked up by their hash values and hash types are compared for matching hashes
+   std::unordered_multimap<std::string_view, size_t> removed_hashes;
+
+   for(size_t i = 0; i < removed_entries.size(); i++) {
+      if(removed_entries[i].hash.has_value())
+         removed_hashes.emplace(removed_entries[i].hash.value(), i);
+   }
+
+   std::vector<bool> moved_entries(removed_entries.size());
+   std::vector<const scan_entry_t*> unmoved_entries;
+
+   for(const scan_entry_t& added_entry : added_entries) {
+      bool moved = false;
+
+      if(added_entry.hash.has_value()) {
+         auto [first, last] = removed_hashes.equal_range(added_entry.hash.value());
+
+         for(auto removed_hash = first; removed_hash != last; ++removed_hash) {
+            const scan_entry_t& removed_entry = removed_entries[removed_hash->second];
+
+            if(removed_entry.hash_type == added_entry.hash_type) {
+               report_change(scan_change_t::moved, &removed_entry, &added_entry);
+               diff_counts.moved_files++;
+
+               moved_entries[removed_hash->second] = true;
+               removed_hashes.erase(removed_hash);
+
+               moved = true;
+               break;
+            }
+         }
+      }
+
+      if(!moved)
+         unmoved_entries.push_back(&added_entry);
+   }
+
+   for(const scan_entry_t *added_entry : unmoved_entries) {
+      report_change(scan_change_t::added, nullptr, added_entry);
+      diff_counts.added_files++;
+   }
+
+   for(size_t i = 0; i < removed_entries.size(); i++) {
+      if(!moved_entries[i]) {
+         report_change(scan_change_t::removed, &removed_entries[i], nullptr);
+         diff_counts.removed_files++;
+      }
+   }
+
+   return diff_counts;
+}
+
+}
@@ -0,0 +1,56 @@
+#ifndef FIT_SCAN_DIFF_H
+#define FIT_SCAN_DIFF_H
+
+#include <string>
+#include <optional>
+#include <functional>
+
+#include <cstdint>
+
+namespace fit {
+
+//
+// A file version in a scanset.
+//
+struct scan_entry_t {
+   int64_t file_id = 0;
+   int64_t version_id = 0;
+   std::u8string path;
+   int64_t mod_time = 0;
+   int64_t entry_size = 0;
+   std::string hash_type;
+   std::optional<std::string> hash;   // empty for files that were not hashed
+};
+
+enum class scan_change_t {
+   added,                              // only the scan entry is reported
+   removed,                            // only the base entry is reported
+   changed,                            // both entries are reported for the same file
+   moved                               // both entries are reported for different files
+};
+
+struct scan_diff_counts_t {
+   uint64_t added_files = 0;
+   uint64_t removed_files = 0;
+   uint64_t changed_files = 0;
+   uint64_t moved_files = 0;
+};
+
+//
+// Reads the next scanset entry into the argument and returns true,
+// or returns false when there are no more entries. Entries must be
+// returned in the ascending order of file identifiers.
+//
+using scan_entry_reader_t = std::function<bool (scan_entry_t&)>;
+
+//
+// Receives a change between scans. The base entry is null for added
+// files and the scan entry is null for removed files.
+//
+using scan_change_handler_t = std::function<void (scan_change_t, const scan_entry_t *, const scan_entry_t *)>;
+
+scan_diff_counts_t diff_scansets(const scan_entry_reader_t& read_base_entry, const scan_entry_reader_t& read_scan_entry, const scan_change_handler_t& report_change);
+
+}
+
+#endif // FIT_SCAN_DIFF_H
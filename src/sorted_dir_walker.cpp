@@ -0,0 +1,105 @@
+#include "sorted_dir_walker.h"
+
+#include <algorithm>
+
+namespace fit {
+
+sorted_dir_walker_t::iterator& sorted_dir_walker_t::iterator::operator ++ (void)
+{
+   dir_walker->next();
+
+   if(!dir_walker->has_current_entry)
+      dir_walker = nullptr;
+
+   return *this;
+}
+
+//
+// `resume_at` is a path relative to `dir_path`, which is visited
+// first, skipping all entries that sort before it. If the resume path
+// no longer exists, the walk resumes with the entry that would follow
+// it.
+//
+sorted_dir_walker_t::sorted_dir_walker_t(const std::filesystem::path& dir_path, bool recursive, std::filesystem::directory_options dir_options, const std::filesystem::path& resume_at) :
+      recursive(recursive),
+      dir_options(dir_options)
+{
+   dir_levels.push_back(read_dir(dir_path));
+
+   for(std::filesystem::path::iterator resume_name = resume_at.begin(); resume_name != resume_at.end(); ) {
+      std::vector<std::filesystem::directory_entry>& dir_level = dir_levels.back();
+
+      // entries sharing the same parent directory sort in the order of their file names
+      while(!dir_level.empty() && dir_level.back().path().filename().native() < resume_name->native())
+         dir_level.pop_back();
+
+      if(dir_level.empty() || dir_level.back().path().filename().native() != resume_name->native())
+         break;
+
+      // the resume path is visited next
+      if(++resume_name == resume_at.end())
+         break;
+
+      // directories of the resume path were visited before
+      std::filesystem::directory_entry dir_entry = std::move(dir_level.back());
+      dir_level.pop_back();
+
+      std::error_code errcode;
+
+      if(!recursive || dir_entry.is_symlink(errcode) || !dir_entry.is_directory(errcode))
+         break;
+
+      dir_levels.push_back(read_dir(dir_entry.path()));
+   }
+
+   next();
+}
+
+std::vector<std::filesystem::directory_entry> sorted_dir_walker_t::read_dir(const std::filesystem::path& dir_path) const
+{
+   std::vector<std::filesystem::directory_entry> dir_entries;
+
+   for(const std::filesystem::directory_entry& dir_entry : std::filesystem::directory_iterator(dir_path, dir_options))
+      dir_entries.push_back(dir_entry);
+
+   // entries are sorted in reverse, so they can be taken from the back
+   std::sort(dir_entries.begin(), dir_entries.end(), [] (const std::filesystem::directory_entry& a, const std::filesystem::directory_entry& b) {return a.path().native() > b.path().native();});
+
+   return dir_entries;
+}
+
+void sorted_dir_walker_t::next(void)
+{
+   while(!dir_levels.empty()) {
+      if(dir_levels.back().empty()) {
+         dir_levels.pop_back();
+         continue;
+      }
+
+      current_entry = std::move(dir_levels.back().back());
+      dir_levels.back().pop_back();
+
+      has_current_entry = true;
+
+      std::error_code errcode;
+
+      if(recursive && !current_entry.is_symlink(errcode) && current_entry.is_directory(errcode))
+         dir_levels.push_back(read_dir(current_entry.path()));
+
+      return;
+   }
+
+   has_current_entry = false;
+}
+
+sorted_dir_walker_t::iterator sorted_dir_walker_t::begin(void)
+{
+   return iterator(has_current_entry ? this : nullptr);
+}
+
+sorted_dir_walker_t::iterator sorted_dir_walker_t::end(void)
+{
+   return iterator(nullptr);
+}
+
+}
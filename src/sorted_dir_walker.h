@@ -0,0 +1,79 @@
+#ifndef FIT_SORTED_DIR_WALKER_H
+#define FIT_SORTED_DIR_WALKER_H
+
+#include <filesystem>
+#include <vector>
+#include <iterator>
+
+namespace fit {
+
+//
+// Walks a directory tree in the order of sorted file names, reading
+// one directory at a time, so a walk may be resumed at a file path
+// saved in an earlier walk without visiting any of the entries that
+// were walked before that path. Entries are visited in the same order
+// as `recursive_directory_iterator` would visit them, if it sorted
+// them, which means that each directory is visited right before its
+// contents, and which is also the order of `std::filesystem::path`
+// comparisons.
+//
+// Directory symlinks are not followed and directories that cannot be
+// opened are either skipped or reported via `filesystem_error`, as
+// `skip_permission_denied` in directory options indicates.
+//
+// Files added after the resume path since an earlier walk will be
+// visited, but files added before that path will not.
+//
+class sorted_dir_walker_t {
+   public:
+      class iterator {
+         private:
+            sorted_dir_walker_t *dir_walker;
+
+         public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type = std::filesystem::directory_entry;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const std::filesystem::directory_entry*;
+            using reference = const std::filesystem::directory_entry&;
+
+         public:
+            iterator(sorted_dir_walker_t *dir_walker) : dir_walker(dir_walker) {}
+
+            reference operator * (void) const {return dir_walker->current_entry;}
+            pointer operator -> (void) const {return &dir_walker->current_entry;}
+
+            iterator& operator ++ (void);
+
+            bool operator == (const iterator& other) const {return dir_walker == other.dir_walker;}
+            bool operator != (const iterator& other) const {return dir_walker != other.dir_walker;}
+      };
+
+   private:
+      bool recursive;
+
+      std::filesystem::directory_options dir_options;
+
+      // sorted entries of each open directory, in reverse order, so the next entry is at the back
+      std::vector<std::vector<std::filesystem::directory_entry>> dir_levels;
+
+      std::filesystem::directory_entry current_entry;
+
+      bool has_current_entry = false;
+
+   private:
+      std::vector<std::filesystem::directory_entry> read_dir(const std::filesystem::path& dir_path) const;
+
+      void next(void);
+
+   public:
+      sorted_dir_walker_t(const std::filesystem::path& dir_path, bool recursive, std::filesystem::directory_options dir_options, const std::filesystem::path& resume_at = {});
+
+      iterator begin(void);
+
+      iterator end(void);
+};
+
+}
+
+#endif // FIT_SORTED_DIR_WALKER_H
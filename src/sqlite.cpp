@@ -1,6 +1,8 @@
 #include "sqlite.h"
+#include "format.h"
 
 #include <stdexcept>
+#include <system_error>
 
 using namespace std::literals::string_view_literals;
 using namespace std::literals::string_literals;
@@ -200,4 +202,80 @@ int sqlite_stmt_t::finalize(void)
    return sqlite3_finalize(stmt);
 }
 
+//
+// Opens a read-only connection to a database file. The database file
+// is memory-mapped, so all connections read pages from the same system
+// file cache, instead of copying them into their own page caches.
+//
+// If `immutable` is true, the caller asserts that the database is not
+// changed by any connection or process while it is open, such as a
+// database on read-only media, and the database is opened as immutable,
+// which skips all file locking and change detection. Writers would not
+// be detected by such connections, so this must not be the default. If
+// the database has a WAL with pages that were not copied into the
+// database file, which immutable connections would ignore, it is opened
+// as a regular read-only database and `immutable` is set to false.
+//
+// The database handle is allocated even if the database cannot be opened.
+//
+int open_sqlite_readonly(const std::filesystem::path& db_path, sqlite3 **db, bool& immutable)
+{
+   std::error_code fs_errcode;
+
+   if(immutable) {
+      std::filesystem::path wal_path = db_path;
+
+      wal_path += "-wal";
+
+      uintmax_t wal_size = std::filesystem::file_size(wal_path, fs_errcode);
+
+      immutable = fs_errcode == std::errc::no_such_file_or_directory || (!fs_errcode && !wal_size);
+   }
+
+   std::filesystem::path abs_db_path = std::filesystem::absolute(db_path, fs_errcode);
+
+   if(fs_errcode)
+      immutable = false;
+
+   int errcode = SQLITE_OK;
+
+   if(!immutable)
+      errcode = sqlite3_open_v2(reinterpret_cast<const char*>(db_path.u8string().c_str()), db, SQLITE_OPEN_READONLY, nullptr);
+   else {
+      //
+      // URI file names are absolute paths with forward slashes, and
+      // Windows paths start with a slash before the drive letter.
+      // URI delimiters in file names are percent-encoded.
+      //
+      std::string db_uri = "file://";
+
+      std::u8string db_path_str = abs_db_path.generic_u8string();
+
+      if(db_path_str.empty() || db_path_str.front() != u8'/')
+         db_uri += '/';
+
+      for(char8_t ch : db_path_str) {
+         if(ch == u8'%' || ch == u8'?' || ch == u8'#')
+            db_uri += FMTNS::format("%{:02X}", static_cast<unsigned int>(ch));
+         else
+            db_uri += static_cast<char>(ch);
+      }
+
+      db_uri += "?immutable=1";
+
+      errcode = sqlite3_open_v2(db_uri.c_str(), db, SQLITE_OPEN_READONLY | SQLITE_OPEN_URI, nullptr);
+   }
+
+   if(errcode != SQLITE_OK)
+      return errcode;
+
+   // memory mapping is just faster and a database that cannot be mapped is read as usual
+   uintmax_t db_size = std::filesystem::file_size(db_path, fs_errcode);
+
+   if(!fs_errcode && db_size)
+      sqlite3_exec(*db, FMTNS::format("PRAGMA mmap_size={:d}", db_size).c_str(), nullptr, nullptr, nullptr);
+
+   return SQLITE_OK;
+}
+
 }
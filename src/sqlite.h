@@ -7,6 +7,7 @@
 #include <string_view>
 #include <tuple>
 #include <utility>
+#include <filesystem>
 
 #include <cstddef>
 
@@ -20,6 +21,13 @@ struct sqlite_malloc_deleter_t {
    }
 };
 
+struct sqlite_db_deleter_t {
+   void operator ()(sqlite3 *db)
+   {
+      sqlite3_close(db);
+   }
+};
+
 //
 // A SQLite statement parameter binder class.
 //
@@ -112,6 +120,8 @@ class sqlite_stmt_t {
       int finalize(void);
 };
 
+int open_sqlite_readonly(const std::filesystem::path& db_path, sqlite3 **db, bool& immutable);
+
 }
 
 #endif // FIT_SQLITE_H
@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+
+#include "../autotuner.h"
+
+#include <chrono>
+
+using namespace std::literals::chrono_literals;
+
+namespace fit {
+namespace test {
+
+TEST(autotuner_suite, is_better_test)
+{
+   ASSERT_TRUE(autotuner_t::is_better({110, 100}, {100, 100}, .05));
+   ASSERT_TRUE(autotuner_t::is_better({100, 110}, {100, 100}, .05));
+
+   // within the threshold
+   ASSERT_FALSE(autotuner_t::is_better({104, 100}, {100, 100}, .05));
+
+   // one measure improves, but the other one drops too much
+   ASSERT_FALSE(autotuner_t::is_better({120, 90}, {100, 100}, .05));
+   ASSERT_TRUE(autotuner_t::is_better({120, 96}, {100, 100}, .05));
+}
+
+TEST(autotuner_suite, climb_and_settle_test)
+{
+   autotuner_t autotuner({{2, 1, 8, true}}, 1s, .05);
+
+   std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+   // throughput for each value, peaking at 4
+   auto throughput = [](size_t value) -> uint64_t
+   {
+      return value == 1 ? 50 : value == 2 ? 100 : value == 4 ? 150 : 120;
+   };
+
+   uint64_t size = 0;
+
+   ASSERT_FALSE(autotuner.update(now, size, 0));
+
+   // baseline with 2, trial with 4
+   size += throughput(autotuner.get_value(0));
+   ASSERT_TRUE(autotuner.update(now += 1s, size, 0));
+   ASSERT_EQ(4, autotuner.get_value(0));
+   ASSERT_EQ(2, autotuner.get_accepted_value(0));
+
+   // 4 is accepted, trial with 8
+   size += throughput(autotuner.get_value(0));
+   ASSERT_TRUE(autotuner.update(now += 1s, size, 0));
+   ASSERT_EQ(8, autotuner.get_value(0));
+   ASSERT_EQ(4, autotuner.get_accepted_value(0));
+
+   // 8 is slower, reverted to 4
+   size += throughput(autotuner.get_value(0));
+   ASSERT_TRUE(autotuner.update(now += 1s, size, 0));
+   ASSERT_EQ(4, autotuner.get_value(0));
+
+   // a new baseline with 4, trial with 2
+   size += throughput(autotuner.get_value(0));
+   ASSERT_TRUE(autotuner.update(now += 1s, size, 0));
+   ASSERT_EQ(2, autotuner.get_value(0));
+
+   // 2 is slower, reverted to 4 and settled after failing in both directions
+   size += throughput(autotuner.get_value(0));
+   ASSERT_TRUE(autotuner.update(now += 1s, size, 0));
+   ASSERT_EQ(4, autotuner.get_value(0));
+   ASSERT_TRUE(autotuner.is_settled());
+
+   size += throughput(autotuner.get_value(0));
+   ASSERT_FALSE(autotuner.update(now += 1s, size, 0));
+   ASSERT_EQ(4, autotuner.get_value(0));
+}
+
+TEST(autotuner_suite, partial_window_test)
+{
+   autotuner_t autotuner({{2, 1, 4, false}}, 2s, .05);
+
+   std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+   ASSERT_FALSE(autotuner.update(now, 0, 0));
+   ASSERT_FALSE(autotuner.update(now + 1s, 100, 10));
+   ASSERT_TRUE(autotuner.update(now + 2s, 200, 20));
+   ASSERT_EQ(3, autotuner.get_value(0));
+}
+
+TEST(autotuner_suite, fixed_range_test)
+{
+   // parameters that cannot move settle immediately
+   autotuner_t autotuner({{2, 2, 2, false}, {4, 4, 4, true}}, 1s, .05);
+
+   std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+   ASSERT_FALSE(autotuner.update(now, 0, 0));
+   ASSERT_FALSE(autotuner.update(now + 1s, 100, 10));
+   ASSERT_TRUE(autotuner.is_settled());
+}
+
+TEST(autotuner_suite, parse_cgroup_test)
+{
+   ASSERT_FALSE(autotuner_t::parse_cgroup_cpu_max("max 100000\n").has_value());
+   ASSERT_DOUBLE_EQ(2., autotuner_t::parse_cgroup_cpu_max("200000 100000\n").value());
+   ASSERT_DOUBLE_EQ(.5, autotuner_t::parse_cgroup_cpu_max("50000 100000").value());
+   ASSERT_FALSE(autotuner_t::parse_cgroup_cpu_max("abc").has_value());
+
+   ASSERT_FALSE(autotuner_t::parse_cgroup_memory_max("max\n").has_value());
+   ASSERT_EQ(1073741824, autotuner_t::parse_cgroup_memory_max("1073741824\n").value());
+   ASSERT_FALSE(autotuner_t::parse_cgroup_memory_max("12x").has_value());
+}
+
+}
+}
@@ -0,0 +1,54 @@
+#include <gtest/gtest.h>
+
+#include "../cpu_topology.h"
+
+namespace fit {
+namespace test {
+
+TEST(cpu_topology_suite, parse_cpu_list_test)
+{
+   ASSERT_EQ(std::vector<unsigned>({0, 1, 2, 3, 8, 10, 11}), cpu_topology_t::parse_cpu_list("0-3,8,10-11\n").value());
+   ASSERT_EQ(std::vector<unsigned>({5}), cpu_topology_t::parse_cpu_list("5").value());
+
+   // nodes without CPUs
+   ASSERT_TRUE(cpu_topology_t::parse_cpu_list("\n").value().empty());
+
+   ASSERT_FALSE(cpu_topology_t::parse_cpu_list("0-3,").has_value());
+   ASSERT_FALSE(cpu_topology_t::parse_cpu_list("3-0").has_value());
+   ASSERT_FALSE(cpu_topology_t::parse_cpu_list("0;1").has_value());
+   ASSERT_FALSE(cpu_topology_t::parse_cpu_list("x").has_value());
+}
+
+TEST(cpu_topology_suite, format_cpu_list_test)
+{
+   ASSERT_EQ("0-3,8,10-11", cpu_topology_t::format_cpu_list({0, 1, 2, 3, 8, 10, 11}));
+   ASSERT_EQ("", cpu_topology_t::format_cpu_list({}));
+}
+
+TEST(cpu_topology_suite, thread_cpus_test)
+{
+   cpu_topology_t cpu_topology({{0, {0, 1, 2}}, {1, {4, 5}}});
+
+   // single CPUs alternate between nodes until the smaller node runs out
+   ASSERT_EQ(std::vector<unsigned>({0}), cpu_topology.get_thread_cpus(0, false));
+   ASSERT_EQ(std::vector<unsigned>({4}), cpu_topology.get_thread_cpus(1, false));
+   ASSERT_EQ(std::vector<unsigned>({1}), cpu_topology.get_thread_cpus(2, false));
+   ASSERT_EQ(std::vector<unsigned>({5}), cpu_topology.get_thread_cpus(3, false));
+   ASSERT_EQ(std::vector<unsigned>({2}), cpu_topology.get_thread_cpus(4, false));
+   ASSERT_EQ(std::vector<unsigned>({0}), cpu_topology.get_thread_cpus(5, false));
+
+   ASSERT_EQ(std::vector<unsigned>({0, 1, 2}), cpu_topology.get_thread_cpus(0, true));
+   ASSERT_EQ(std::vector<unsigned>({4, 5}), cpu_topology.get_thread_cpus(1, true));
+   ASSERT_EQ(std::vector<unsigned>({0, 1, 2}), cpu_topology.get_thread_cpus(2, true));
+}
+
+TEST(cpu_topology_suite, detect_test)
+{
+   cpu_topology_t cpu_topology = cpu_topology_t::detect();
+
+   ASSERT_FALSE(cpu_topology.get_nodes().empty());
+   ASSERT_FALSE(cpu_topology.get_nodes().front().cpus.empty());
+}
+
+}
+}
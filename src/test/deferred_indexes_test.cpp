@@ -0,0 +1,167 @@
+#include <gtest/gtest.h>
+
+#include "../deferred_indexes.h"
+
+#include <sqlite3.h>
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <fstream>
+
+namespace fit {
+namespace test {
+
+class deferred_indexes_suite : public testing::Test {
+   protected:
+      sqlite3 *file_scan_db = nullptr;
+
+      options_t options;
+
+      print_stream_t print_stream;
+
+   protected:
+      deferred_indexes_suite(void) :
+            print_stream(std::ofstream())
+      {
+      }
+
+      void SetUp(void) override
+      {
+         ASSERT_EQ(SQLITE_OK, sqlite3_open(":memory:", &file_scan_db));
+
+         // same tables and indexes as in a new scan database
+         ASSERT_EQ(SQLITE_OK, sqlite3_exec(file_scan_db,
+                                 "CREATE TABLE versions ("
+                                    "id INTEGER NOT NULL PRIMARY KEY,"
+                                    "file_id INTEGER NOT NULL,"
+                                    "version INTEGER NOT NULL,"
+                                    "hash_type VARCHAR(32) NOT NULL,"
+                                    "hash TEXT,"
+                                    "verified_time INTEGER);"
+                                 "CREATE UNIQUE INDEX ix_versions_file ON versions (file_id, version);"
+                                 "CREATE INDEX ix_versions_hash ON versions (hash, hash_type);"
+                                 "CREATE INDEX ix_versions_verified_time ON versions (verified_time) WHERE hash IS NOT NULL AND verified_time IS NOT NULL;"
+                                 "CREATE TABLE scansets ("
+                                    "id INTEGER NOT NULL PRIMARY KEY,"
+                                    "scan_id INTEGER NOT NULL,"
+                                    "version_id INTEGER NOT NULL);"
+                                 "CREATE UNIQUE INDEX ix_scansets_version_scan ON scansets (version_id, scan_id);"
+                                 "CREATE INDEX ix_scansets_scan ON scansets (scan_id);"
+                                 "CREATE TABLE deferred_indexes ("
+                                    "id INTEGER NOT NULL PRIMARY KEY,"
+                                    "scan_id INTEGER NOT NULL,"
+                                    "name TEXT NOT NULL,"
+                                    "sql TEXT NOT NULL);", nullptr, nullptr, nullptr));
+      }
+
+      void TearDown(void) override
+      {
+         sqlite3_close(file_scan_db);
+      }
+
+      std::optional<std::string> select_index_sql(const char *index_name)
+      {
+         std::optional<std::string> index_sql;
+         sqlite3_stmt *stmt = nullptr;
+
+         if(sqlite3_prepare_v2(file_scan_db, "SELECT sql FROM sqlite_master WHERE type = 'index' AND name = ?", -1, &stmt, nullptr) != SQLITE_OK)
+            return index_sql;
+
+         sqlite3_bind_text(stmt, 1, index_name, -1, SQLITE_STATIC);
+
+         if(sqlite3_step(stmt) == SQLITE_ROW)
+            index_sql = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+
+         sqlite3_finalize(stmt);
+
+         return index_sql;
+      }
+
+      // inserts a version of each file and adds it to the scanset, as a scan would
+      int insert_scan_files(int64_t scan_id, int64_t first_file_id, int64_t file_count)
+      {
+         std::string sql;
+
+         for(int64_t file_id = first_file_id; file_id < first_file_id + file_count; file_id++) {
+            sql += "INSERT INTO versions (file_id, version, hash_type, hash, verified_time) VALUES (" + std::to_string(file_id) + ", 1, 'SHA256', '" + std::to_string(file_id % 3) + "', " + std::to_string(file_id) + ");";
+            sql += "INSERT INTO scansets (scan_id, version_id) VALUES (" + std::to_string(scan_id) + ", last_insert_rowid());";
+         }
+
+         return sqlite3_exec(file_scan_db, sql.c_str(), nullptr, nullptr, nullptr);
+      }
+};
+
+TEST_F(deferred_indexes_suite, defer_non_unique_indexes_test)
+{
+   std::optional<std::string> file_index_sql = select_index_sql("ix_versions_file");
+
+   ASSERT_EQ(2, fit::defer_scan_indexes(1, file_scan_db));
+
+   ASSERT_FALSE(select_index_sql("ix_versions_hash").has_value());
+   ASSERT_FALSE(select_index_sql("ix_versions_verified_time").has_value());
+
+   // unique indexes remain in place
+   ASSERT_EQ(file_index_sql, select_index_sql("ix_versions_file"));
+   ASSERT_TRUE(select_index_sql("ix_scansets_version_scan").has_value());
+
+   ASSERT_EQ((std::vector<std::string>{"ix_versions_hash", "ix_versions_verified_time"}), fit::select_deferred_index_names(file_scan_db));
+}
+
+TEST_F(deferred_indexes_suite, reject_duplicates_test)
+{
+   ASSERT_EQ(2, fit::defer_scan_indexes(1, file_scan_db));
+
+   ASSERT_EQ(SQLITE_OK, insert_scan_files(1, 1, 10));
+
+   // same files found twice, such as via overlapping scan paths
+   ASSERT_EQ(SQLITE_CONSTRAINT, sqlite3_exec(file_scan_db, "INSERT INTO versions (file_id, version, hash_type) VALUES (5, 1, 'SHA256')", nullptr, nullptr, nullptr));
+   ASSERT_EQ(SQLITE_CONSTRAINT, sqlite3_exec(file_scan_db, "INSERT INTO scansets (scan_id, version_id) VALUES (1, 5)", nullptr, nullptr, nullptr));
+
+   ASSERT_EQ(2, fit::rebuild_deferred_indexes(options, file_scan_db, print_stream));
+
+   ASSERT_TRUE(fit::select_deferred_index_names(file_scan_db).empty());
+}
+
+TEST_F(deferred_indexes_suite, resume_interrupted_scan_test)
+{
+   std::optional<std::string> hash_index_sql = select_index_sql("ix_versions_hash");
+   std::optional<std::string> verified_time_index_sql = select_index_sql("ix_versions_verified_time");
+
+   // the first scan is interrupted before indexes are rebuilt
+   ASSERT_EQ(2, fit::defer_scan_indexes(1, file_scan_db));
+   ASSERT_EQ(SQLITE_OK, insert_scan_files(1, 1, 100));
+
+   // the next run builds indexes before the scan is resumed
+   ASSERT_EQ(2, fit::rebuild_deferred_indexes(options, file_scan_db, print_stream));
+
+   ASSERT_EQ(hash_index_sql, select_index_sql("ix_versions_hash"));
+   ASSERT_EQ(verified_time_index_sql, select_index_sql("ix_versions_verified_time"));
+   ASSERT_TRUE(fit::select_deferred_index_names(file_scan_db).empty());
+
+   // the resumed scan is still the first one and defers indexes again
+   ASSERT_EQ(2, fit::defer_scan_indexes(1, file_scan_db));
+   ASSERT_EQ(SQLITE_OK, insert_scan_files(1, 101, 100));
+   ASSERT_EQ(2, fit::rebuild_deferred_indexes(options, file_scan_db, print_stream));
+
+   ASSERT_EQ(hash_index_sql, select_index_sql("ix_versions_hash"));
+   ASSERT_EQ(verified_time_index_sql, select_index_sql("ix_versions_verified_time"));
+
+   // there is nothing to build after indexes are in place
+   ASSERT_EQ(0, fit::rebuild_deferred_indexes(options, file_scan_db, print_stream));
+}
+
+TEST_F(deferred_indexes_suite, removed_index_test)
+{
+   // indexes removed by the user are not restored
+   ASSERT_EQ(SQLITE_OK, sqlite3_exec(file_scan_db, "DROP INDEX ix_versions_hash", nullptr, nullptr, nullptr));
+
+   ASSERT_EQ(1, fit::defer_scan_indexes(1, file_scan_db));
+   ASSERT_EQ(1, fit::rebuild_deferred_indexes(options, file_scan_db, print_stream));
+
+   ASSERT_FALSE(select_index_sql("ix_versions_hash").has_value());
+   ASSERT_TRUE(select_index_sql("ix_versions_verified_time").has_value());
+}
+
+}
+}
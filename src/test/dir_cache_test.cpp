@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+
+#include "../dir_cache.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+
+namespace fit {
+namespace test {
+
+class dir_cache_suite : public testing::Test {
+   protected:
+      struct dir_record_t {
+         int64_t parent_id;
+         std::u8string dir_name;
+      };
+
+   protected:
+      // directory records indexed by directory identifiers less one
+      std::vector<dir_record_t> dirs;
+
+      size_t lookup_count = 0;
+
+   protected:
+      std::optional<int64_t> find_dir(int64_t parent_id, const std::u8string& dir_name)
+      {
+         lookup_count++;
+
+         for(size_t i = 0; i < dirs.size(); i++) {
+            if(dirs[i].parent_id == parent_id && dirs[i].dir_name == dir_name)
+               return static_cast<int64_t>(i + 1);
+         }
+
+         return std::nullopt;
+      }
+
+      int64_t insert_dir(int64_t parent_id, const std::u8string& dir_name)
+      {
+         std::optional<int64_t> dir_id = find_dir(parent_id, dir_name);
+
+         if(dir_id.has_value())
+            return dir_id.value();
+
+         dirs.push_back({parent_id, dir_name});
+
+         return static_cast<int64_t>(dirs.size());
+      }
+
+      void read_dir(int64_t dir_id, int64_t& parent_id, std::u8string& dir_name)
+      {
+         lookup_count++;
+
+         parent_id = dirs.at(dir_id - 1).parent_id;
+         dir_name = dirs.at(dir_id - 1).dir_name;
+      }
+
+      int64_t get_dir_id(dir_cache_t& dir_cache, std::u8string_view filepath, char8_t path_sep)
+      {
+         return dir_cache.get_dir_id(filepath, path_sep, [this] (int64_t parent_id, const std::u8string& dir_name) {return insert_dir(parent_id, dir_name);});
+      }
+
+      std::optional<int64_t> find_dir_id(dir_cache_t& dir_cache, std::u8string_view filepath, char8_t path_sep)
+      {
+         return dir_cache.find_dir_id(filepath, path_sep, [this] (int64_t parent_id, const std::u8string& dir_name) {return find_dir(parent_id, dir_name);});
+      }
+
+      std::string get_dir_path(dir_cache_t& dir_cache, int64_t dir_id)
+      {
+         std::u8string dir_path = dir_cache.get_dir_path(dir_id, [this] (int64_t dir_id, int64_t& parent_id, std::u8string& dir_name) {read_dir(dir_id, parent_id, dir_name);});
+
+         return std::string(dir_path.begin(), dir_path.end());
+      }
+};
+
+TEST_F(dir_cache_suite, file_name_offset_test)
+{
+   ASSERT_EQ(5, dir_cache_t::get_file_name_offset(u8"/abc/x.txt", u8'/'));
+   ASSERT_EQ(1, dir_cache_t::get_file_name_offset(u8"/x.txt", u8'/'));
+   ASSERT_EQ(0, dir_cache_t::get_file_name_offset(u8"x.txt", u8'/'));
+   ASSERT_EQ(7, dir_cache_t::get_file_name_offset(u8"C:\\abc\\x.txt", u8'\\'));
+   ASSERT_EQ(0, dir_cache_t::get_file_name_offset(u8"abc\\x.txt", u8'/'));
+}
+
+TEST_F(dir_cache_suite, insert_dirs_test)
+{
+   dir_cache_t dir_cache(100);
+
+   int64_t abc_id = get_dir_id(dir_cache, u8"/abc/x.txt", u8'/');
+
+   // the top directory is inserted before its subdirectory
+   ASSERT_EQ(2, dirs.size());
+   ASSERT_EQ(2, abc_id);
+   ASSERT_TRUE(dirs[0].parent_id == dir_cache_t::NO_DIR_ID && dirs[0].dir_name == u8"/");
+   ASSERT_TRUE(dirs[1].parent_id == 1 && dirs[1].dir_name == u8"abc/");
+
+   // cached directories are not looked up again
+   lookup_count = 0;
+
+   ASSERT_EQ(abc_id, get_dir_id(dir_cache, u8"/abc/y.txt", u8'/'));
+   ASSERT_EQ(0, lookup_count);
+
+   // only the new subdirectory is looked up
+   ASSERT_EQ(3, get_dir_id(dir_cache, u8"/abc/def/z.txt", u8'/'));
+   ASSERT_EQ(1, lookup_count);
+
+   ASSERT_EQ(dir_cache_t::NO_DIR_ID, get_dir_id(dir_cache, u8"x.txt", u8'/'));
+
+   ASSERT_EQ(4, get_dir_id(dir_cache, u8"abc/x.txt", u8'/'));
+   ASSERT_TRUE(dirs[3].parent_id == dir_cache_t::NO_DIR_ID && dirs[3].dir_name == u8"abc/");
+}
+
+TEST_F(dir_cache_suite, find_dirs_test)
+{
+   dir_cache_t dir_cache(100);
+
+   get_dir_id(dir_cache, u8"C:\\abc\\x.txt", u8'\\');
+
+   dir_cache.clear();
+
+   ASSERT_EQ(2, find_dir_id(dir_cache, u8"C:\\abc\\y.txt", u8'\\'));
+
+   // missing directories are not inserted
+   ASSERT_FALSE(find_dir_id(dir_cache, u8"C:\\abc\\def\\z.txt", u8'\\').has_value());
+   ASSERT_FALSE(find_dir_id(dir_cache, u8"D:\\abc\\x.txt", u8'\\').has_value());
+   ASSERT_EQ(2, dirs.size());
+
+   // missing directories are not cached
+   get_dir_id(dir_cache, u8"C:\\abc\\def\\z.txt", u8'\\');
+
+   ASSERT_EQ(3, find_dir_id(dir_cache, u8"C:\\abc\\def\\z.txt", u8'\\'));
+}
+
+TEST_F(dir_cache_suite, dir_paths_test)
+{
+   dir_cache_t dir_cache(2);
+
+   int64_t def_id = get_dir_id(dir_cache, u8"/abc/def/x.txt", u8'/');
+
+   ASSERT_EQ("/abc/def/", get_dir_path(dir_cache, def_id));
+   ASSERT_EQ("/abc/", get_dir_path(dir_cache, 2));
+   ASSERT_EQ("", get_dir_path(dir_cache, dir_cache_t::NO_DIR_ID));
+
+   // a full cache is cleared and directories are looked up again
+   lookup_count = 0;
+
+   ASSERT_EQ("/abc/def/", get_dir_path(dir_cache, def_id));
+   ASSERT_EQ(1, lookup_count);
+
+   // a parent directory must have been inserted before its subdirectories
+   dirs.push_back({5, u8"bad/"});
+
+   ASSERT_THROW(get_dir_path(dir_cache, 4), std::runtime_error);
+}
+
+}
+}
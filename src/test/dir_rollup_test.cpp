@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+
+#include "../dir_rollup.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+
+namespace fit {
+namespace test {
+
+class dir_rollup_suite : public testing::Test {
+   protected:
+      static dir_totals_t make_totals(const std::vector<std::pair<std::u8string, std::string>>& files, int64_t mod_time)
+      {
+         dir_totals_t dir_totals;
+
+         for(const std::pair<std::u8string, std::string>& file : files) {
+            dir_totals.file_count++;
+            dir_totals.total_size += 10;
+            dir_totals.rollup_hash += rollup_hash_t(file.first, file.second);
+         }
+
+         dir_totals.max_mod_time = mod_time;
+
+         return dir_totals;
+      }
+
+      // parent identifiers and names of directory records, mapped by directory identifiers
+      using dir_records_t = std::map<int64_t, std::pair<int64_t, std::u8string>>;
+
+      static std::map<int64_t, dir_totals_t> build(const dir_records_t& dir_records, const std::vector<std::pair<int64_t, dir_totals_t>>& dirs, std::vector<int64_t>&& root_dir_ids)
+      {
+         std::map<int64_t, dir_totals_t> tree_totals;
+
+         dir_rollup_builder_t dir_rollup_builder(std::move(root_dir_ids), [&tree_totals] (int64_t dir_id, const dir_totals_t& dir_totals)
+               {
+                  tree_totals.emplace(dir_id, dir_totals);
+               },
+               [&dir_records] (int64_t dir_id, int64_t& parent_id, std::u8string& dir_name)
+               {
+                  parent_id = dir_records.at(dir_id).first;
+                  dir_name = dir_records.at(dir_id).second;
+               });
+
+         for(const std::pair<int64_t, dir_totals_t>& dir : dirs)
+            dir_rollup_builder.add_dir(dir.first, dir_records.at(dir.first).first, dir_records.at(dir.first).second, dir.second);
+
+         dir_rollup_builder.finish();
+
+         return tree_totals;
+      }
+};
+
+TEST_F(dir_rollup_suite, rollup_hash_test)
+{
+   rollup_hash_t a(u8"a.txt", "AAAA");
+   rollup_hash_t b(u8"b.txt", "BBBB");
+
+   rollup_hash_t ab = a;
+   ab += b;
+
+   rollup_hash_t ba = b;
+   ba += a;
+
+   ASSERT_TRUE(ab == ba);
+
+   // same hashes with different names and same names with different hashes
+   ASSERT_FALSE(rollup_hash_t(u8"a.txt", "BBBB") == a);
+   ASSERT_FALSE(rollup_hash_t(u8"c.txt", "AAAA") == a);
+
+   ASSERT_EQ(rollup_hash_t::HEX_SIZE, ab.to_hex().size());
+   ASSERT_TRUE(rollup_hash_t::from_hex(ab.to_hex()) == ab);
+
+   ASSERT_EQ(std::string(rollup_hash_t::HEX_SIZE, '0'), rollup_hash_t().to_hex());
+
+   ASSERT_THROW(rollup_hash_t::from_hex("0123"), std::runtime_error);
+   ASSERT_THROW(rollup_hash_t::from_hex(std::string(rollup_hash_t::HEX_SIZE, 'x')), std::runtime_error);
+}
+
+TEST_F(dir_rollup_suite, tree_totals_test)
+{
+   // /r is 2, /r/a is 3, /r/a/x is 4, /r/a/y is 5, /r/b is 6 and /r/a-b is 7
+   dir_records_t dir_records = {{1, {0, u8"/"}}, {2, {1, u8"r/"}}, {3, {2, u8"a/"}}, {4, {3, u8"x/"}}, {5, {3, u8"y/"}}, {6, {2, u8"b/"}}, {7, {2, u8"a-b/"}}};
+
+   // directories are added in descending order and /r/a has no files of its own
+   std::map<int64_t, dir_totals_t> tree_totals = build(dir_records, {
+            {7, make_totals({{u8"5.txt", "E"}}, 500)},
+            {6, make_totals({{u8"3.txt", "C"}}, 300)},
+            {5, make_totals({{u8"2.txt", "B"}}, 200)},
+            {4, make_totals({{u8"1.txt", "A"}, {u8"4.txt", "D"}}, 100)},
+            {2, make_totals({{u8"0.txt", "F"}}, 50)}}, {2});
+
+   ASSERT_EQ(6, tree_totals.size());
+
+   ASSERT_EQ(3, tree_totals[3].file_count);
+   ASSERT_EQ(30, tree_totals[3].total_size);
+   ASSERT_EQ(200, tree_totals[3].max_mod_time.value());
+
+   ASSERT_EQ(6, tree_totals[2].file_count);
+   ASSERT_EQ(60, tree_totals[2].total_size);
+   ASSERT_EQ(500, tree_totals[2].max_mod_time.value());
+
+   // directories are not rolled up beyond the root directory
+   ASSERT_EQ(0, tree_totals.count(1));
+}
+
+TEST_F(dir_rollup_suite, relative_tree_totals_test)
+{
+   // files without a directory are in the base directory, which has no parent
+   dir_records_t dir_records = {{0, {0, u8""}}, {1, {0, u8"a/"}}, {2, {1, u8"b/"}}};
+
+   std::map<int64_t, dir_totals_t> tree_totals = build(dir_records, {
+            {2, make_totals({{u8"2.txt", "B"}}, 200)},
+            {0, make_totals({{u8"1.txt", "A"}}, 100)}}, {0});
+
+   ASSERT_EQ(3, tree_totals.size());
+
+   ASSERT_EQ(1, tree_totals[1].file_count);
+   ASSERT_EQ(2, tree_totals[0].file_count);
+   ASSERT_EQ(200, tree_totals[0].max_mod_time.value());
+}
+
+TEST_F(dir_rollup_suite, identical_trees_test)
+{
+   // /r is 2, /r/b is 3, /r/b/x is 4, /r/a is 5, /r/a/x is 6, /q is 7, /q/x is 8 and /q/c is 9
+   dir_records_t dir_records = {{1, {0, u8"/"}}, {2, {1, u8"r/"}}, {3, {2, u8"b/"}}, {4, {3, u8"x/"}}, {5, {2, u8"a/"}}, {6, {5, u8"x/"}},
+            {7, {1, u8"q/"}}, {8, {7, u8"x/"}}, {9, {7, u8"c/"}}};
+
+   std::map<int64_t, dir_totals_t> tree_totals = build(dir_records, {
+            {9, make_totals({{u8"2.txt", "B"}}, 200)},
+            {8, make_totals({{u8"1.txt", "A"}}, 100)},
+            {6, make_totals({{u8"1.txt", "A"}}, 300)},
+            {5, make_totals({{u8"2.txt", "B"}}, 400)},
+            {4, make_totals({{u8"1.txt", "A"}}, 100)},
+            {3, make_totals({{u8"2.txt", "B"}}, 200)}}, {2, 7});
+
+   // same file names and hashes in the same directories have the same rollup hash
+   ASSERT_TRUE(tree_totals[5].rollup_hash == tree_totals[3].rollup_hash);
+
+   // a file moved into another directory changes the rollup hash
+   ASSERT_FALSE(tree_totals[7].rollup_hash == tree_totals[5].rollup_hash);
+}
+
+}
+}
@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+
+#include "../dup_groups.h"
+
+#include <string>
+#include <vector>
+#include <optional>
+
+namespace fit {
+namespace test {
+
+class dup_groups_suite : public testing::Test {
+   protected:
+      static scan_entry_t make_entry(const char8_t *path, int64_t entry_size, const char *hash_type, const char *hash)
+      {
+         return scan_entry_t{0, 0, path, 0, entry_size, hash_type, hash ? std::optional<std::string>(hash) : std::nullopt};
+      }
+
+      std::vector<std::vector<std::string>> group(const std::vector<scan_entry_t>& entries, std::vector<uint64_t>& wasted_sizes, dup_group_counts_t& group_counts)
+      {
+         std::vector<std::vector<std::string>> dup_groups;
+
+         group_counts = group_duplicates(
+               [&entries, i = size_t(0)] (scan_entry_t& entry) mutable
+               {
+                  if(i == entries.size())
+                     return false;
+
+                  entry = entries[i++];
+                  return true;
+               },
+               [&dup_groups, &wasted_sizes] (const std::vector<scan_entry_t>& dup_group, uint64_t wasted_size)
+               {
+                  dup_groups.emplace_back();
+
+                  for(const scan_entry_t& entry : dup_group)
+                     dup_groups.back().emplace_back(entry.path.begin(), entry.path.end());
+
+                  wasted_sizes.push_back(wasted_size);
+               });
+
+         return dup_groups;
+      }
+};
+
+TEST_F(dup_groups_suite, group_duplicates_test)
+{
+   std::vector<uint64_t> wasted_sizes;
+   dup_group_counts_t group_counts;
+
+   std::vector<std::vector<std::string>> dup_groups = group({
+            make_entry(u8"/c", 10, "SHA256", "A"),
+            make_entry(u8"/a", 10, "SHA256", "A"),
+            make_entry(u8"/b", 10, "SHA256", "A"),
+            make_entry(u8"/d", 20, "SHA256", "B"),
+            make_entry(u8"/e", 30, "SHA256", "C"),
+            make_entry(u8"/f", 30, "SHA256", "C")}, wasted_sizes, group_counts);
+
+   ASSERT_EQ(std::vector<std::vector<std::string>>({{"/a", "/b", "/c"}, {"/e", "/f"}}), dup_groups);
+   ASSERT_EQ(std::vector<uint64_t>({20, 30}), wasted_sizes);
+
+   ASSERT_EQ(2, group_counts.dup_groups);
+   ASSERT_EQ(5, group_counts.dup_files);
+   ASSERT_EQ(50, group_counts.wasted_size);
+}
+
+TEST_F(dup_groups_suite, hash_type_and_no_hash_test)
+{
+   std::vector<uint64_t> wasted_sizes;
+   dup_group_counts_t group_counts;
+
+   // same hash values of different types and files without hashes are not duplicates
+   std::vector<std::vector<std::string>> dup_groups = group({
+            make_entry(u8"/a", 10, "SHA256", nullptr),
+            make_entry(u8"/b", 10, "SHA256", nullptr),
+            make_entry(u8"/c", 10, "SHA256", "A"),
+            make_entry(u8"/d", 10, "SHA512", "A")}, wasted_sizes, group_counts);
+
+   ASSERT_TRUE(dup_groups.empty());
+   ASSERT_EQ(0, group_counts.wasted_size);
+}
+
+}
+}
@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+
+#include "../fd_budget.h"
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+
+using namespace std::literals::chrono_literals;
+
+namespace fit {
+namespace test {
+
+TEST(fd_budget_suite, empty_budget_test)
+{
+   ASSERT_THROW(fd_budget_t(0), std::runtime_error);
+}
+
+TEST(fd_budget_suite, try_acquire_release_test)
+{
+   fd_budget_t fd_budget(2);
+
+   ASSERT_EQ(2, fd_budget.max_size());
+   ASSERT_EQ(2, fd_budget.available());
+
+   ASSERT_TRUE(fd_budget.try_acquire());
+   ASSERT_TRUE(fd_budget.try_acquire());
+   ASSERT_EQ(0, fd_budget.available());
+
+   ASSERT_FALSE(fd_budget.try_acquire());
+
+   fd_budget.release();
+   ASSERT_EQ(1, fd_budget.available());
+
+   ASSERT_TRUE(fd_budget.try_acquire());
+   ASSERT_EQ(0, fd_budget.available());
+
+   fd_budget.release();
+   fd_budget.release();
+
+   // extra releases should not grow the budget beyond its size
+   fd_budget.release();
+   ASSERT_EQ(2, fd_budget.available());
+
+   ASSERT_EQ(std::chrono::steady_clock::duration::zero(), fd_budget.get_wait_time());
+}
+
+TEST(fd_budget_suite, acquire_abort_test)
+{
+   fd_budget_t fd_budget(1);
+   std::atomic<bool> abort_wait = false;
+
+   ASSERT_TRUE(fd_budget.acquire(abort_wait));
+
+   abort_wait = true;
+
+   // an aborted wait should not acquire anything
+   ASSERT_FALSE(fd_budget.acquire(abort_wait));
+   ASSERT_EQ(0, fd_budget.available());
+
+   fd_budget.release();
+   ASSERT_EQ(1, fd_budget.available());
+}
+
+TEST(fd_budget_suite, acquire_wait_test)
+{
+   fd_budget_t fd_budget(1);
+   std::atomic<bool> abort_wait = false;
+
+   ASSERT_TRUE(fd_budget.try_acquire());
+
+   std::thread release_thread([&fd_budget] {
+      std::this_thread::sleep_for(50ms);
+      fd_budget.release();
+   });
+
+   ASSERT_TRUE(fd_budget.acquire(abort_wait));
+
+   release_thread.join();
+
+   ASSERT_EQ(0, fd_budget.available());
+   ASSERT_LE(std::chrono::duration_cast<std::chrono::steady_clock::duration>(40ms), fd_budget.get_wait_time());
+}
+
+}
+}
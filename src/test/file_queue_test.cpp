@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+
+#include "../file_queue.h"
+
+#include <filesystem>
+#include <stdexcept>
+
+namespace fit {
+namespace test {
+
+TEST(file_queue_suite, queued_order_test)
+{
+   file_queue_t file_queue;
+
+   ASSERT_TRUE(file_queue.empty());
+   ASSERT_FALSE(file_queue.is_ordered_by_size());
+
+   file_queue.push(std::filesystem::directory_entry(std::filesystem::path("a")), 10);
+   file_queue.push(std::filesystem::directory_entry(std::filesystem::path("b")), 30);
+   file_queue.push(std::filesystem::directory_entry(std::filesystem::path("c")), 20);
+
+   ASSERT_EQ(3, file_queue.size());
+
+   ASSERT_EQ(std::filesystem::path("a"), file_queue.pop().path());
+   ASSERT_EQ(std::filesystem::path("b"), file_queue.pop().path());
+   ASSERT_EQ(std::filesystem::path("c"), file_queue.pop().path());
+
+   ASSERT_TRUE(file_queue.empty());
+   ASSERT_THROW(file_queue.pop(), std::logic_error);
+}
+
+TEST(file_queue_suite, largest_first_test)
+{
+   file_queue_t file_queue(3);
+
+   ASSERT_TRUE(file_queue.is_ordered_by_size());
+
+   file_queue.push(std::filesystem::directory_entry(std::filesystem::path("a")), 10);
+   file_queue.push(std::filesystem::directory_entry(std::filesystem::path("b")), 30);
+   file_queue.push(std::filesystem::directory_entry(std::filesystem::path("c")), 20);
+
+   // the fourth file is larger, but is outside of the first window
+   file_queue.push(std::filesystem::directory_entry(std::filesystem::path("d")), 40);
+
+   ASSERT_EQ(std::filesystem::path("b"), file_queue.pop().path());
+
+   // files queued while a batch is being processed go into the next batch
+   file_queue.push(std::filesystem::directory_entry(std::filesystem::path("e")), 50);
+
+   ASSERT_EQ(4, file_queue.size());
+
+   ASSERT_EQ(std::filesystem::path("c"), file_queue.pop().path());
+   ASSERT_EQ(std::filesystem::path("a"), file_queue.pop().path());
+
+   ASSERT_EQ(std::filesystem::path("e"), file_queue.pop().path());
+   ASSERT_EQ(std::filesystem::path("d"), file_queue.pop().path());
+
+   ASSERT_TRUE(file_queue.empty());
+}
+
+TEST(file_queue_suite, same_size_order_test)
+{
+   file_queue_t file_queue(10);
+
+   file_queue.push(std::filesystem::directory_entry(std::filesystem::path("a")), 0);
+   file_queue.push(std::filesystem::directory_entry(std::filesystem::path("b")), 5);
+   file_queue.push(std::filesystem::directory_entry(std::filesystem::path("c")), 0);
+   file_queue.push(std::filesystem::directory_entry(std::filesystem::path("d")), 5);
+   file_queue.push(std::filesystem::directory_entry(std::filesystem::path("e")), 0);
+
+   ASSERT_EQ(std::filesystem::path("b"), file_queue.pop().path());
+   ASSERT_EQ(std::filesystem::path("d"), file_queue.pop().path());
+   ASSERT_EQ(std::filesystem::path("a"), file_queue.pop().path());
+   ASSERT_EQ(std::filesystem::path("c"), file_queue.pop().path());
+   ASSERT_EQ(std::filesystem::path("e"), file_queue.pop().path());
+}
+
+}
+}
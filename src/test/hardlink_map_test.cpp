@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+
+#include "../hardlink_map.h"
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <filesystem>
+#include <stdexcept>
+
+using namespace std::literals::string_literals;
+
+namespace fit {
+namespace test {
+
+TEST(hardlink_map_suite, owner_hashed_test)
+{
+   hardlink_map_t hardlink_map;
+
+   std::filesystem::directory_entry dir_entry;
+   std::optional<hardlink_map_t::link_hash_t> link_hash;
+
+   file_link_id_t link_id = {1, 100};
+
+   ASSERT_EQ(hardlink_map_t::link_state_t::owner, hardlink_map.find_link(link_id, 3, dir_entry, link_hash));
+   ASSERT_FALSE(link_hash.has_value());
+
+   ASSERT_TRUE(hardlink_map.set_link_hash(link_id, {123, "ABC"s}).empty());
+
+   // a different device with the same inode is a different file
+   ASSERT_EQ(hardlink_map_t::link_state_t::owner, hardlink_map.find_link({2, 100}, 2, dir_entry, link_hash));
+   ASSERT_FALSE(link_hash.has_value());
+
+   ASSERT_EQ(hardlink_map_t::link_state_t::hashed, hardlink_map.find_link(link_id, 3, dir_entry, link_hash));
+   ASSERT_TRUE(link_hash.has_value());
+   ASSERT_EQ(123, link_hash.value().file_size);
+   ASSERT_EQ("ABC"s, link_hash.value().hexhash);
+
+   ASSERT_EQ(2, hardlink_map.size());
+
+   // the last link removes the file from the map
+   link_hash.reset();
+   ASSERT_EQ(hardlink_map_t::link_state_t::hashed, hardlink_map.find_link(link_id, 3, dir_entry, link_hash));
+   ASSERT_TRUE(link_hash.has_value());
+
+   ASSERT_EQ(1, hardlink_map.size());
+
+   // links created after all known links were seen will be hashed again
+   ASSERT_EQ(hardlink_map_t::link_state_t::owner, hardlink_map.find_link(link_id, 4, dir_entry, link_hash));
+}
+
+TEST(hardlink_map_suite, waiting_links_test)
+{
+   hardlink_map_t hardlink_map;
+
+   std::optional<hardlink_map_t::link_hash_t> link_hash;
+
+   file_link_id_t link_id = {1, 100};
+
+   std::filesystem::directory_entry dir_entry_a(std::filesystem::path("a"));
+   std::filesystem::directory_entry dir_entry_b(std::filesystem::path("b"));
+   std::filesystem::directory_entry dir_entry_c(std::filesystem::path("c"));
+
+   ASSERT_EQ(hardlink_map_t::link_state_t::owner, hardlink_map.find_link(link_id, 3, dir_entry_a, link_hash));
+
+   ASSERT_EQ(hardlink_map_t::link_state_t::waiting, hardlink_map.find_link(link_id, 3, dir_entry_b, link_hash));
+   ASSERT_EQ(hardlink_map_t::link_state_t::waiting, hardlink_map.find_link(link_id, 3, dir_entry_c, link_hash));
+   ASSERT_FALSE(link_hash.has_value());
+
+   std::vector<std::filesystem::directory_entry> waiting_links = hardlink_map.set_link_hash(link_id, {123, "ABC"s});
+
+   ASSERT_EQ(2, waiting_links.size());
+   ASSERT_EQ(std::filesystem::path("b"), waiting_links[0].path());
+   ASSERT_EQ(std::filesystem::path("c"), waiting_links[1].path());
+
+   ASSERT_EQ(hardlink_map_t::link_state_t::hashed, hardlink_map.find_link(link_id, 3, waiting_links[0], link_hash));
+   ASSERT_EQ(hardlink_map_t::link_state_t::hashed, hardlink_map.find_link(link_id, 3, waiting_links[1], link_hash));
+
+   ASSERT_EQ(0, hardlink_map.size());
+}
+
+TEST(hardlink_map_suite, release_link_test)
+{
+   hardlink_map_t hardlink_map;
+
+   std::optional<hardlink_map_t::link_hash_t> link_hash;
+
+   file_link_id_t link_id = {1, 100};
+
+   std::filesystem::directory_entry dir_entry_a(std::filesystem::path("a"));
+   std::filesystem::directory_entry dir_entry_b(std::filesystem::path("b"));
+
+   ASSERT_EQ(hardlink_map_t::link_state_t::owner, hardlink_map.find_link(link_id, 2, dir_entry_a, link_hash));
+   ASSERT_EQ(hardlink_map_t::link_state_t::waiting, hardlink_map.find_link(link_id, 2, dir_entry_b, link_hash));
+
+   std::vector<std::filesystem::directory_entry> waiting_links = hardlink_map.release_link(link_id);
+
+   ASSERT_EQ(1, waiting_links.size());
+   ASSERT_EQ(0, hardlink_map.size());
+
+   // a released link is owned by the next link found
+   ASSERT_EQ(hardlink_map_t::link_state_t::owner, hardlink_map.find_link(link_id, 2, waiting_links[0], link_hash));
+
+   // only the owner may set a link hash
+   ASSERT_TRUE(hardlink_map.set_link_hash(link_id, {123, "ABC"s}).empty());
+   ASSERT_THROW(hardlink_map.set_link_hash(link_id, {123, "ABC"s}), std::logic_error);
+}
+
+}
+}
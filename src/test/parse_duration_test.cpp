@@ -0,0 +1,38 @@
+#include <gtest/gtest.h>
+
+#include "../format.h"
+
+#include <chrono>
+#include <stdexcept>
+
+using namespace std::literals::chrono_literals;
+
+namespace fit {
+namespace test {
+
+TEST(parse_duration_suite, plain_seconds_test)
+{
+   ASSERT_EQ(0s, fit::parse_duration("0"));
+   ASSERT_EQ(90s, fit::parse_duration("90"));
+}
+
+TEST(parse_duration_suite, units_test)
+{
+   ASSERT_EQ(45s, fit::parse_duration("45s"));
+   ASSERT_EQ(30min, fit::parse_duration("30m"));
+   ASSERT_EQ(4h, fit::parse_duration("4H"));
+   ASSERT_EQ(48h, fit::parse_duration("2d"));
+   ASSERT_EQ(1h + 30min + 15s, fit::parse_duration("1h30m15s"));
+}
+
+TEST(parse_duration_suite, bad_duration_test)
+{
+   ASSERT_THROW(fit::parse_duration(""), std::runtime_error);
+   ASSERT_THROW(fit::parse_duration("h"), std::runtime_error);
+   ASSERT_THROW(fit::parse_duration("4x"), std::runtime_error);
+   ASSERT_THROW(fit::parse_duration("1h30"), std::runtime_error);
+   ASSERT_THROW(fit::parse_duration("-5m"), std::runtime_error);
+}
+
+}
+}
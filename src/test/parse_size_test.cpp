@@ -0,0 +1,56 @@
+#include <gtest/gtest.h>
+
+#include "../format.h"
+
+#include <stdexcept>
+
+namespace fit {
+namespace test {
+
+TEST(parse_size_suite, plain_bytes_test)
+{
+   ASSERT_EQ(0, fit::parse_size("0"));
+   ASSERT_EQ(12345, fit::parse_size("12345"));
+   ASSERT_EQ(12345, fit::parse_size("12345B"));
+}
+
+TEST(parse_size_suite, unit_prefix_test)
+{
+   ASSERT_EQ(UINT64_C(20'000), fit::parse_size("20K"));
+   ASSERT_EQ(UINT64_C(20'000'000), fit::parse_size("20m"));
+   ASSERT_EQ(UINT64_C(20'000'000), fit::parse_size("20MB"));
+   ASSERT_EQ(UINT64_C(3'000'000'000'000), fit::parse_size("3T"));
+}
+
+TEST(parse_size_suite, decimals_test)
+{
+   ASSERT_EQ(UINT64_C(1'500'000'000), fit::parse_size("1.5G"));
+   ASSERT_EQ(UINT64_C(1'234), fit::parse_size("1.234K"));
+
+   // digits past the third decimal are ignored
+   ASSERT_EQ(UINT64_C(1'234'000), fit::parse_size("1.2345M"));
+}
+
+TEST(parse_size_suite, binary_units_test)
+{
+   ASSERT_EQ(UINT64_C(12345), fit::parse_size("12345", true));
+   ASSERT_EQ(UINT64_C(16'777'216), fit::parse_size("16M", true));
+   ASSERT_EQ(UINT64_C(1'073'741'824), fit::parse_size("1GB", true));
+   ASSERT_EQ(UINT64_C(1'610'612'736), fit::parse_size("1.5G", true));
+   ASSERT_EQ(UINT64_C(1'536), fit::parse_size("1.5K", true));
+
+   ASSERT_THROW(fit::parse_size("abc", true), std::runtime_error);
+}
+
+TEST(parse_size_suite, bad_size_test)
+{
+   ASSERT_THROW(fit::parse_size(""), std::runtime_error);
+   ASSERT_THROW(fit::parse_size("M"), std::runtime_error);
+   ASSERT_THROW(fit::parse_size("10X"), std::runtime_error);
+   ASSERT_THROW(fit::parse_size("10MBs"), std::runtime_error);
+   ASSERT_THROW(fit::parse_size("1.5"), std::runtime_error);
+   ASSERT_THROW(fit::parse_size("20E"), std::runtime_error);
+}
+
+}
+}
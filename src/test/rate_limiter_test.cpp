@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+
+#include "../rate_limiter.h"
+
+#include <chrono>
+#include <stdexcept>
+
+using namespace std::literals::chrono_literals;
+
+namespace fit {
+namespace test {
+
+TEST(rate_limiter_suite, unlimited_bucket_test)
+{
+   token_bucket_t token_bucket;
+
+   std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+   ASSERT_EQ(std::chrono::steady_clock::duration::zero(), token_bucket.take(1'000'000, now));
+}
+
+TEST(rate_limiter_suite, token_debt_test)
+{
+   token_bucket_t token_bucket;
+
+   std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+   // a new bucket starts with one second worth of tokens
+   token_bucket.set_rate(1000, now);
+
+   ASSERT_EQ(std::chrono::steady_clock::duration::zero(), token_bucket.take(600, now));
+   ASSERT_EQ(std::chrono::steady_clock::duration::zero(), token_bucket.take(400, now));
+
+   // debts are paid off at the bucket rate
+   ASSERT_EQ(500ms, std::chrono::duration_cast<std::chrono::milliseconds>(token_bucket.take(500, now)));
+   ASSERT_EQ(1500ms, std::chrono::duration_cast<std::chrono::milliseconds>(token_bucket.take(1000, now)));
+
+   // 1.5 seconds later the debt is paid off
+   ASSERT_EQ(std::chrono::steady_clock::duration::zero(), token_bucket.take(0, now + 1500ms));
+
+   // unused tokens accumulate for no more than one second
+   ASSERT_EQ(std::chrono::steady_clock::duration::zero(), token_bucket.take(1000, now + 10s));
+   ASSERT_EQ(100ms, std::chrono::duration_cast<std::chrono::milliseconds>(token_bucket.take(100, now + 10s)));
+}
+
+TEST(rate_limiter_suite, change_rate_test)
+{
+   token_bucket_t token_bucket;
+
+   std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+   token_bucket.set_rate(1000, now);
+
+   // lowering the rate drops tokens above the new rate
+   token_bucket.set_rate(100, now);
+
+   ASSERT_EQ(100, token_bucket.get_rate());
+   ASSERT_EQ(1s, std::chrono::duration_cast<std::chrono::milliseconds>(token_bucket.take(200, now)));
+
+   token_bucket.set_rate(0, now);
+
+   ASSERT_EQ(std::chrono::steady_clock::duration::zero(), token_bucket.take(1'000'000, now));
+}
+
+TEST(rate_limiter_suite, parse_schedule_test)
+{
+   rate_limit_schedule_t rate_limit_schedule = rate_limit_schedule_t::parse("18:00=0,08:30=20M/100");
+
+   ASSERT_EQ((rate_limits_t{20'000'000, 100}), rate_limit_schedule.get_limits(8 * 60 + 30));
+   ASSERT_EQ((rate_limits_t{20'000'000, 100}), rate_limit_schedule.get_limits(12 * 60));
+   ASSERT_EQ((rate_limits_t{0, 0}), rate_limit_schedule.get_limits(18 * 60));
+
+   // the last entry continues after midnight
+   ASSERT_EQ((rate_limits_t{0, 0}), rate_limit_schedule.get_limits(0));
+   ASSERT_EQ((rate_limits_t{0, 0}), rate_limit_schedule.get_limits(8 * 60 + 29));
+
+   ASSERT_EQ((rate_limits_t{500'000, 0}), rate_limit_schedule_t::parse("500K").get_limits(12 * 60));
+   ASSERT_EQ((rate_limits_t{0, 50}), rate_limit_schedule_t::parse("0/50").get_limits(12 * 60));
+}
+
+TEST(rate_limiter_suite, bad_schedule_test)
+{
+   ASSERT_THROW(rate_limit_schedule_t::parse(""), std::runtime_error);
+   ASSERT_THROW(rate_limit_schedule_t::parse("24:00=1M"), std::runtime_error);
+   ASSERT_THROW(rate_limit_schedule_t::parse("8=1M"), std::runtime_error);
+   ASSERT_THROW(rate_limit_schedule_t::parse("1M/x"), std::runtime_error);
+   ASSERT_THROW(rate_limit_schedule_t::parse("1M/"), std::runtime_error);
+   ASSERT_THROW(rate_limit_schedule_t::parse("08:00=1M,08:00=2M"), std::runtime_error);
+   ASSERT_THROW(rate_limit_schedule_t::parse("1M,"), std::runtime_error);
+}
+
+}
+}
@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+
+#include "../scan_diff.h"
+
+#include <string>
+#include <vector>
+#include <optional>
+
+namespace fit {
+namespace test {
+
+class scan_diff_suite : public testing::Test {
+   protected:
+      struct change_t {
+         scan_change_t change;
+         int64_t base_file_id;
+         int64_t scan_file_id;
+
+         bool operator == (const change_t& other) const = default;
+      };
+
+   protected:
+      static scan_entry_t make_entry(int64_t file_id, int64_t version_id, const char *hash)
+      {
+         return scan_entry_t{file_id, version_id, u8"/file-" + std::u8string(1, static_cast<char8_t>(u8'0' + file_id)), 0, 0, "SHA256", hash ? std::optional<std::string>(hash) : std::nullopt};
+      }
+
+      static scan_entry_reader_t make_reader(const std::vector<scan_entry_t>& entries)
+      {
+         return [&entries, i = size_t(0)] (scan_entry_t& entry) mutable
+         {
+            if(i == entries.size())
+               return false;
+
+            entry = entries[i++];
+            return true;
+         };
+      }
+
+      std::vector<change_t> diff(const std::vector<scan_entry_t>& base_entries, const std::vector<scan_entry_t>& scan_entries, scan_diff_counts_t& diff_counts)
+      {
+         std::vector<change_t> changes;
+
+         diff_counts = diff_scansets(make_reader(base_entries), make_reader(scan_entries),
+               [&changes] (scan_change_t change, const scan_entry_t *base_entry, const scan_entry_t *scan_entry)
+               {
+                  changes.push_back({change, base_entry ? base_entry->file_id : 0, scan_entry ? scan_entry->file_id : 0});
+               });
+
+         return changes;
+      }
+};
+
+TEST_F(scan_diff_suite, added_removed_changed_test)
+{
+   scan_diff_counts_t diff_counts;
+
+   std::vector<change_t> changes = diff(
+            {make_entry(1, 1, "A"), make_entry(2, 2, "B"), make_entry(4, 4, "D")},
+            {make_entry(2, 5, "E"), make_entry(3, 3, "C"), make_entry(4, 4, "D"), make_entry(6, 6, "F")},
+            diff_counts);
+
+   ASSERT_EQ(std::vector<change_t>({
+            {scan_change_t::changed, 2, 2},
+            {scan_change_t::added, 0, 3},
+            {scan_change_t::added, 0, 6},
+            {scan_change_t::removed, 1, 0}}), changes);
+
+   ASSERT_EQ(2, diff_counts.added_files);
+   ASSERT_EQ(1, diff_counts.removed_files);
+   ASSERT_EQ(1, diff_counts.changed_files);
+   ASSERT_EQ(0, diff_counts.moved_files);
+}
+
+TEST_F(scan_diff_suite, moved_test)
+{
+   scan_diff_counts_t diff_counts;
+
+   // each removed file is matched against one added file with the same hash
+   std::vector<change_t> changes = diff(
+            {make_entry(1, 1, "A"), make_entry(2, 2, "B"), make_entry(3, 3, nullptr)},
+            {make_entry(4, 4, "A"), make_entry(5, 5, "A"), make_entry(6, 6, nullptr)},
+            diff_counts);
+
+   ASSERT_EQ(std::vector<change_t>({
+            {scan_change_t::moved, 1, 4},
+            {scan_change_t::added, 0, 5},
+            {scan_change_t::added, 0, 6},
+            {scan_change_t::removed, 2, 0},
+            {scan_change_t::removed, 3, 0}}), changes);
+
+   ASSERT_EQ(2, diff_counts.added_files);
+   ASSERT_EQ(2, diff_counts.removed_files);
+   ASSERT_EQ(0, diff_counts.changed_files);
+   ASSERT_EQ(1, diff_counts.moved_files);
+}
+
+TEST_F(scan_diff_suite, empty_scanset_test)
+{
+   scan_diff_counts_t diff_counts;
+
+   ASSERT_EQ(std::vector<change_t>({{scan_change_t::removed, 1, 0}}), diff({make_entry(1, 1, "A")}, {}, diff_counts));
+
+   ASSERT_EQ(std::vector<change_t>({{scan_change_t::added, 0, 1}}), diff({}, {make_entry(1, 1, "A")}, diff_counts));
+
+   ASSERT_TRUE(diff({}, {}, diff_counts).empty());
+}
+
+}
+}
@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+
+#include "../sorted_dir_walker.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include <chrono>
+
+namespace fit {
+namespace test {
+
+class sorted_dir_walker_suite : public testing::Test {
+   protected:
+      std::filesystem::path test_dir;
+
+   protected:
+      void SetUp(void) override
+      {
+         test_dir = std::filesystem::temp_directory_path() / ("fit-sorted-dir-walker-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+
+         std::filesystem::create_directories(test_dir / "b" / "y");
+         std::filesystem::create_directories(test_dir / "d");
+
+         for(const char *file_path : {"a.txt", "b/x.txt", "b/y/1.txt", "b/y/2.txt", "b/z.txt", "c.txt", "d/e.txt"})
+            std::ofstream(test_dir / file_path).put('A');
+      }
+
+      void TearDown(void) override
+      {
+         std::filesystem::remove_all(test_dir);
+      }
+
+      std::vector<std::string> walk(bool recursive, const std::filesystem::path& resume_at = {})
+      {
+         std::vector<std::string> file_paths;
+
+         for(const std::filesystem::directory_entry& dir_entry : sorted_dir_walker_t(test_dir, recursive, std::filesystem::directory_options::none, resume_at))
+            file_paths.push_back(dir_entry.path().lexically_relative(test_dir).generic_string());
+
+         return file_paths;
+      }
+};
+
+TEST_F(sorted_dir_walker_suite, recursive_walk_test)
+{
+   ASSERT_EQ(std::vector<std::string>({"a.txt", "b", "b/x.txt", "b/y", "b/y/1.txt", "b/y/2.txt", "b/z.txt", "c.txt", "d", "d/e.txt"}), walk(true));
+}
+
+TEST_F(sorted_dir_walker_suite, flat_walk_test)
+{
+   ASSERT_EQ(std::vector<std::string>({"a.txt", "b", "c.txt", "d"}), walk(false));
+}
+
+TEST_F(sorted_dir_walker_suite, resume_walk_test)
+{
+   ASSERT_EQ(std::vector<std::string>({"b/y/2.txt", "b/z.txt", "c.txt", "d", "d/e.txt"}), walk(true, std::filesystem::path("b") / "y" / "2.txt"));
+
+   ASSERT_EQ(std::vector<std::string>({"c.txt", "d", "d/e.txt"}), walk(true, "c.txt"));
+
+   ASSERT_EQ(std::vector<std::string>({"d/e.txt"}), walk(true, std::filesystem::path("d") / "e.txt"));
+}
+
+TEST_F(sorted_dir_walker_suite, resume_missing_path_test)
+{
+   // a removed file resumes with the file that would follow it
+   ASSERT_EQ(std::vector<std::string>({"b/z.txt", "c.txt", "d", "d/e.txt"}), walk(true, std::filesystem::path("b") / "y1.txt"));
+
+   // a removed directory resumes with the entry that would follow it
+   ASSERT_EQ(std::vector<std::string>({"c.txt", "d", "d/e.txt"}), walk(true, std::filesystem::path("bb") / "x.txt"));
+
+   ASSERT_TRUE(walk(true, "e.txt").empty());
+}
+
+}
+}
@@ -0,0 +1,187 @@
+#include "wal_checkpointer.h"
+
+#include "sqlite.h"
+#include "format.h"
+
+#include <stdexcept>
+#include <algorithm>
+
+#include <cstring>
+
+using namespace std::literals::string_view_literals;
+
+namespace fit {
+
+std::atomic<wal_checkpointer_t*> wal_checkpointer_t::active_checkpointer = nullptr;
+
+wal_checkpointer_t::wal_checkpointer_t(const std::filesystem::path& db_path, print_stream_t& print_stream) :
+      wal_path(db_path),
+      print_stream(print_stream)
+{
+   int errcode = SQLITE_OK;
+
+   wal_path += "-wal";
+
+   if((errcode = sqlite3_open_v2(reinterpret_cast<const char*>(db_path.u8string().c_str()), &checkpoint_db, SQLITE_OPEN_READWRITE, nullptr)) != SQLITE_OK) {
+      // the database handle is allocated even if it cannot be opened
+      sqlite3_close(checkpoint_db);
+      throw std::runtime_error(FMTNS::format("Cannot open a WAL checkpoint connection ({:s})", sqlite3_errstr(errcode)));
+   }
+
+   sqlite3_wal_autocheckpoint(checkpoint_db, 0);
+
+   // passive checkpoints never wait for other connections, but WAL resets wait this long before giving up
+   sqlite3_busy_timeout(checkpoint_db, RESET_BUSY_TIMEOUT);
+
+   //
+   // Scan connections switch the database to WAL, which persists in
+   // the database file, and the same is done here because checkpoints
+   // do nothing until the connection finds that the database uses WAL.
+   //
+   sqlite_stmt_t journal_mode_stmt("PRAGMA journal_mode=WAL"sv);
+
+   if((errcode = journal_mode_stmt.prepare(checkpoint_db, "PRAGMA journal_mode=WAL"sv)) != SQLITE_OK || (errcode = sqlite3_step(journal_mode_stmt)) != SQLITE_ROW) {
+      journal_mode_stmt.finalize();
+      sqlite3_close(checkpoint_db);
+      throw std::runtime_error(FMTNS::format("Cannot set SQLite journal mode to WAL ({:s})", sqlite3_errstr(errcode)));
+   }
+
+   bool have_wal = !strcmp(reinterpret_cast<const char*>(sqlite3_column_text(journal_mode_stmt, 0)), "wal");
+
+   journal_mode_stmt.finalize();
+
+   if(!have_wal) {
+      sqlite3_close(checkpoint_db);
+      throw std::runtime_error("The database does not use WAL");
+   }
+}
+
+wal_checkpointer_t::~wal_checkpointer_t(void)
+{
+   stop();
+
+   sqlite3_close(checkpoint_db);
+}
+
+uint64_t wal_checkpointer_t::get_wal_size(void) const
+{
+   std::error_code errcode;
+
+   uintmax_t wal_size = std::filesystem::file_size(wal_path, errcode);
+
+   return errcode ? 0 : static_cast<uint64_t>(wal_size);
+}
+
+//
+// A passive checkpoint copies as many pages as it can without waiting
+// for other connections. If all pages were copied, the WAL is reset,
+// so it does not keep growing while other connections keep reading
+// from it. A WAL that keeps growing because pages are written faster
+// than they are copied is reset while writers wait.
+//
+void wal_checkpointer_t::checkpoint(void)
+{
+   int log_page_count = 0;
+   int copied_page_count = 0;
+
+   std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+   int errcode = sqlite3_wal_checkpoint_v2(checkpoint_db, "main", SQLITE_CHECKPOINT_PASSIVE, &log_page_count, &copied_page_count);
+
+   uint64_t wal_size = get_wal_size();
+
+   max_wal_size = std::max(max_wal_size, wal_size);
+
+   if(errcode == SQLITE_OK) {
+      checkpointed_page_count = copied_page_count;
+
+      if(log_page_count >= MAX_WAL_PAGE_COUNT || (copied_page_count == log_page_count && log_page_count >= CHECKPOINT_PAGE_COUNT)) {
+         if(sqlite3_wal_checkpoint_v2(checkpoint_db, "main", SQLITE_CHECKPOINT_RESTART, nullptr, nullptr) == SQLITE_OK) {
+            checkpointed_page_count = 0;
+            wal_reset_count++;
+         }
+      }
+   }
+   else if(errcode != SQLITE_BUSY)
+      print_stream.warning("Cannot checkpoint the database WAL ({:s})", sqlite3_errstr(errcode));
+
+   last_checkpoint_time = std::chrono::steady_clock::now();
+
+   checkpoint_count++;
+   checkpoint_time += last_checkpoint_time - start_time;
+   max_checkpoint_time = std::max(max_checkpoint_time, last_checkpoint_time - start_time);
+}
+
+void wal_checkpointer_t::run_checkpoints(void)
+{
+   std::unique_lock<std::mutex> checkpointer_lock(checkpointer_mtx);
+
+   while(!checkpointer_cv.wait_for(checkpointer_lock, POLL_INTERVAL, [this] {return stop_checkpointer;})) {
+      checkpointer_lock.unlock();
+
+      int page_count = wal_page_count.load();
+
+      // the WAL was reset by a writer if it has fewer pages than were copied by the last checkpoint
+      int new_page_count = page_count >= checkpointed_page_count ? page_count - checkpointed_page_count : page_count;
+
+      if(new_page_count >= CHECKPOINT_PAGE_COUNT || (new_page_count > 0 && std::chrono::steady_clock::now() - last_checkpoint_time >= CHECKPOINT_INTERVAL))
+         checkpoint();
+
+      checkpointer_lock.lock();
+   }
+}
+
+void wal_checkpointer_t::start(void)
+{
+   stop();
+
+   last_checkpoint_time = std::chrono::steady_clock::now();
+
+   active_checkpointer.store(this);
+
+   checkpointer_thread = std::thread(&wal_checkpointer_t::run_checkpoints, this);
+}
+
+void wal_checkpointer_t::stop(void)
+{
+   if(!checkpointer_thread.joinable())
+      return;
+
+   {
+      std::lock_guard<std::mutex> checkpointer_lock(checkpointer_mtx);
+      stop_checkpointer = true;
+   }
+
+   checkpointer_cv.notify_one();
+
+   checkpointer_thread.join();
+
+   stop_checkpointer = false;
+
+   active_checkpointer.store(nullptr);
+
+   // the WAL file is not truncated while scanning because it would have to grow again
+   if(get_wal_size() >= WAL_TRUNCATE_SIZE)
+      sqlite3_wal_checkpoint_v2(checkpoint_db, "main", SQLITE_CHECKPOINT_TRUNCATE, nullptr, nullptr);
+
+   if(checkpoint_count)
+      print_stream.info("Ran {:d} WAL checkpoints in {:s} (longest: {:s}, WAL resets: {:d}, largest WAL: {:s})", checkpoint_count, hr_time(checkpoint_time), hr_time(max_checkpoint_time), wal_reset_count, hr_bytes(max_wal_size));
+}
+
+//
+// Replaces SQLite's automatic checkpoints on connections that write
+// scan records and is called after each commit with the number of
+// pages in the WAL, including pages already copied into the database
+// file, unless the WAL was reset.
+//
+int wal_checkpointer_t::wal_hook_cb(void*, sqlite3 *db, const char *db_name, int page_count)
+{
+   if(wal_checkpointer_t *checkpointer = active_checkpointer.load(); checkpointer)
+      checkpointer->wal_page_count.store(page_count);
+   else if(page_count >= AUTOCHECKPOINT_PAGE_COUNT)
+      sqlite3_wal_checkpoint_v2(db, db_name, SQLITE_CHECKPOINT_PASSIVE, nullptr, nullptr);
+
+   return SQLITE_OK;
+}
+
+}
@@ -0,0 +1,116 @@
+#ifndef FIT_WAL_CHECKPOINTER_H
+#define FIT_WAL_CHECKPOINTER_H
+
+#include "print_stream.h"
+
+#include <sqlite3.h>
+
+#include <filesystem>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include <cstdint>
+
+namespace fit {
+
+//
+// Copies pages from the write-ahead log (WAL) of the scan database
+// into the database file on its own thread and connection, so file
+// hasher threads do not stall on checkpoints while they insert file
+// records.
+//
+// Connections that write scan records should install `wal_hook_cb`,
+// which replaces SQLite's automatic checkpoints and reports the
+// number of pages in the WAL after each commit. A passive checkpoint
+// runs when enough pages were written since the last checkpoint, or
+// when the checkpoint interval expires, and does not wait for other
+// connections. If all pages were copied, or if the WAL grew too large,
+// the checkpoint is escalated to reset the WAL, so the next writer
+// starts at the beginning of the WAL instead of growing it. A reset
+// waits briefly for other connections to finish reading from the WAL
+// and is attempted again after the next passive checkpoint if they
+// did not. A large WAL file is truncated when the checkpointer is
+// stopped.
+//
+// If no checkpointer is running, `wal_hook_cb` runs passive
+// checkpoints on the committing connection, the same way SQLite
+// does by default.
+//
+class wal_checkpointer_t {
+   public:
+      // WAL pages written since the last checkpoint that start a new checkpoint
+      static constexpr const int CHECKPOINT_PAGE_COUNT = 1000;
+
+      // WAL pages that start a checkpoint on the committing connection while no checkpointer is running (SQLite's default)
+      static constexpr const int AUTOCHECKPOINT_PAGE_COUNT = 1000;
+
+      // WAL pages that reset the WAL, even if writers have to wait for pages to be copied
+      static constexpr const int MAX_WAL_PAGE_COUNT = 16384;
+
+      // WAL files larger than this are truncated when the checkpointer is stopped
+      static constexpr const uint64_t WAL_TRUNCATE_SIZE = 64 * 1024 * 1024;
+
+      // milliseconds to wait for other connections before a WAL reset is attempted again later
+      static constexpr const int RESET_BUSY_TIMEOUT = 100;
+
+      static constexpr const std::chrono::seconds CHECKPOINT_INTERVAL = std::chrono::seconds(30);
+
+      static constexpr const std::chrono::milliseconds POLL_INTERVAL = std::chrono::milliseconds(50);
+
+   private:
+      // a checkpointer cannot be destroyed while connections with the WAL hook are writing
+      static std::atomic<wal_checkpointer_t*> active_checkpointer;
+
+      sqlite3 *checkpoint_db = nullptr;
+
+      std::filesystem::path wal_path;
+
+      print_stream_t& print_stream;
+
+      std::atomic<int> wal_page_count = 0;      // WAL pages after the last commit on any connection
+
+      int checkpointed_page_count = 0;          // WAL pages copied into the database file by the last checkpoint
+
+      std::chrono::steady_clock::time_point last_checkpoint_time;
+
+      size_t checkpoint_count = 0;
+      size_t wal_reset_count = 0;
+
+      std::chrono::steady_clock::duration checkpoint_time = std::chrono::steady_clock::duration::zero();
+      std::chrono::steady_clock::duration max_checkpoint_time = std::chrono::steady_clock::duration::zero();
+
+      uint64_t max_wal_size = 0;
+
+      std::thread checkpointer_thread;
+
+      std::mutex checkpointer_mtx;
+      std::condition_variable checkpointer_cv;
+      bool stop_checkpointer = false;
+
+   private:
+      void run_checkpoints(void);
+
+      void checkpoint(void);
+
+      uint64_t get_wal_size(void) const;
+
+   public:
+      wal_checkpointer_t(const std::filesystem::path& db_path, print_stream_t& print_stream);
+
+      wal_checkpointer_t(const wal_checkpointer_t&) = delete;
+
+      ~wal_checkpointer_t(void);
+
+      void start(void);
+
+      void stop(void);
+
+      static int wal_hook_cb(void*, sqlite3 *db, const char *db_name, int page_count);
+};
+
+}
+
+#endif // FIT_WAL_CHECKPOINTER_H